@@ -2,6 +2,7 @@ project "App"
    kind "ConsoleApp"
    language "C++"
    cppdialect "C++20"
+   vectorextensions "AVX2"
    targetdir "Binaries/%{cfg.buildcfg}"
    staticruntime "off"
 
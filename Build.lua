@@ -31,5 +31,6 @@ group "Core"
 group ""
 
 include "App/Build-App.lua"
+include "Tests/Build-Tests.lua"
 
 
@@ -0,0 +1,75 @@
+#include "AabbKernels.h"
+
+#include <immintrin.h>
+
+void spheresToAabbs(const glm::vec4* spheres, uint32_t count, VkAabbPositionsKHR* aabbs)
+{
+    static_assert(sizeof(glm::vec4) == 16 && sizeof(VkAabbPositionsKHR) == 24);
+    if (count == 0)
+    {
+        return;
+    }
+
+    const float* src = &spheres[0].x;
+    float* dst = &aabbs[0].minX;
+
+    // Two spheres make two AABBs, 48 bytes, three stores
+    uint32_t i = 0;
+    for (; i + 2 <= count; i += 2)
+    {
+        const __m128 a = _mm_loadu_ps(src + 4 * i);
+        const __m128 b = _mm_loadu_ps(src + 4 * i + 4);
+        const __m128 radiusA = _mm_shuffle_ps(a, a, _MM_SHUFFLE(3, 3, 3, 3));
+        const __m128 radiusB = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 3, 3, 3));
+        const __m128 minA = _mm_sub_ps(a, radiusA);
+        const __m128 maxA = _mm_add_ps(a, radiusA);
+        const __m128 minB = _mm_sub_ps(b, radiusB);
+        const __m128 maxB = _mm_add_ps(b, radiusB);
+
+        // minA.xyz maxA.x | maxA.yz minB.xy | minB.z maxB.xyz
+        const __m128 zxA = _mm_shuffle_ps(minA, maxA, _MM_SHUFFLE(0, 0, 2, 2));
+        const __m128 out0 = _mm_shuffle_ps(minA, zxA, _MM_SHUFFLE(2, 0, 1, 0));
+        const __m128 out1 = _mm_shuffle_ps(maxA, minB, _MM_SHUFFLE(1, 0, 2, 1));
+        const __m128 zxB = _mm_shuffle_ps(minB, maxB, _MM_SHUFFLE(0, 0, 2, 2));
+        const __m128 out2 = _mm_shuffle_ps(zxB, maxB, _MM_SHUFFLE(2, 1, 2, 0));
+
+        _mm_storeu_ps(dst + 6 * i, out0);
+        _mm_storeu_ps(dst + 6 * i + 4, out1);
+        _mm_storeu_ps(dst + 6 * i + 8, out2);
+    }
+
+    for (; i < count; ++i)
+    {
+        const glm::vec4& sphere = spheres[i];
+        aabbs[i] = { sphere.x - sphere.w, sphere.y - sphere.w, sphere.z - sphere.w,
+                     sphere.x + sphere.w, sphere.y + sphere.w, sphere.z + sphere.w };
+    }
+}
+
+void expandAabbBounds(const VkAabbPositionsKHR* aabbs, uint32_t count, glm::vec3& min, glm::vec3& max)
+{
+    if (count == 0)
+    {
+        return;
+    }
+
+    // minX minY minZ maxX from the start of an AABB, minZ maxX maxY maxZ from two floats in, so
+    // neither load reads past the last one
+    const float* p = &aabbs[0].minX;
+    __m128 boundsMin = _mm_setr_ps(min.x, min.y, min.z, 0.0f);
+    __m128 boundsMax = _mm_setr_ps(0.0f, max.x, max.y, max.z);
+    boundsMin = _mm_min_ps(boundsMin, _mm_loadu_ps(p));
+    boundsMax = _mm_max_ps(boundsMax, _mm_loadu_ps(p + 2));
+    for (uint32_t i = 1; i < count; ++i)
+    {
+        boundsMin = _mm_min_ps(boundsMin, _mm_loadu_ps(p + 6 * i));
+        boundsMax = _mm_max_ps(boundsMax, _mm_loadu_ps(p + 6 * i + 2));
+    }
+
+    alignas(16) float lower[4];
+    alignas(16) float upper[4];
+    _mm_store_ps(lower, boundsMin);
+    _mm_store_ps(upper, boundsMax);
+    min = glm::vec3(lower[0], lower[1], lower[2]);
+    max = glm::vec3(upper[1], upper[2], upper[3]);
+}
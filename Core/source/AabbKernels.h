@@ -0,0 +1,14 @@
+#pragma once
+
+#include "vulkan/vulkan.h"
+#include "glm/glm.hpp"
+
+#include <cstdint>
+
+// Bulk AABB conversions for BLAS inputs, SSE over a few primitives at a time
+
+// Bounds of spheres stored as xyz = center, w = radius
+void spheresToAabbs(const glm::vec4* spheres, uint32_t count, VkAabbPositionsKHR* aabbs);
+
+// Grows min/max to enclose the AABBs, start from +/-FLT_MAX for a fresh bound
+void expandAabbBounds(const VkAabbPositionsKHR* aabbs, uint32_t count, glm::vec3& min, glm::vec3& max);
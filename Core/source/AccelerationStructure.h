@@ -8,12 +8,22 @@
 #include "Buffer.h"
 #include "VulkanContext.h"
 #include "PerformanceTimer.h"
+#include "ChunkCulling.h"
+#include "InstanceTable.h"
+#include "BVH.h"
+#include "BlasCache.h"
+#include "ScratchArena.h"
+#include "BlasCompaction.h"
+#include "TlasQuality.h"
+#include "AabbKernels.h"
 
 #include <vector>
 #include <algorithm>
 #include <stdexcept>
 #include <memory>
 #include <iostream>
+#include <functional>
+#include <cfloat>
 
 
 class BLAS
@@ -38,24 +48,59 @@ public:
             m_buildInfo = other.m_buildInfo;
             m_buildScratchSize = other.m_buildScratchSize;
             m_updateScratchSize = other.m_updateScratchSize;
+            m_boundsMin = other.m_boundsMin;
+            m_boundsMax = other.m_boundsMax;
+            m_compacted = other.m_compacted;
 
             // Invalidate the source object
             other.m_blasHandle = VK_NULL_HANDLE;
             other.m_deviceAddress = 0;
             other.m_primitiveCount = 0;
+            other.m_scratchBuffer = {};
         }
         return *this;
     }
 
 	void init(const VkAabbPositionsKHR* initialAABBData, uint32_t aabbDataSize)
 	{
+        create(initialAABBData, aabbDataSize);
+        build(initialAABBData, aabbDataSize);
+	}
+
+    // Creates the acceleration structure and its AABB buffer without building it. The AABBs are
+    // only read for the bounds, uploading them and the build are up to the caller, see
+    // AccelerationStructureManager::addBlases. allowCompaction builds it for a later compacting
+    // copy, see createCompacted().
+	void create(const VkAabbPositionsKHR* initialAABBData, uint32_t aabbDataSize, bool allowCompaction = false)
+	{
         if (initialAABBData == nullptr || aabbDataSize == 0) {
             throw std::runtime_error("Initial AABB data cannot be null or empty for BLAS init.");
         }
         if (aabbDataSize % sizeof(VkAabbPositionsKHR) != 0) {
              throw std::runtime_error("AABB data size is not a multiple of VkAabbPositionsKHR size.");
         }
-		m_primitiveCount = aabbDataSize / sizeof(VkAabbPositionsKHR);
+        const uint32_t primitiveCount = aabbDataSize / sizeof(VkAabbPositionsKHR);
+
+        glm::vec3 boundsMin(FLT_MAX);
+        glm::vec3 boundsMax(-FLT_MAX);
+        expandAabbBounds(initialAABBData, primitiveCount, boundsMin, boundsMax);
+        create(primitiveCount, boundsMin, boundsMax, allowCompaction);
+	}
+
+    // create() for AABBs that aren't all in host memory at once, with their bounds
+    void create(uint32_t primitiveCount, const glm::vec3& boundsMin, const glm::vec3& boundsMax, bool allowCompaction = false)
+    {
+        if (primitiveCount == 0) {
+            throw std::runtime_error("BLAS primitive count cannot be 0.");
+        }
+        if (primitiveCount > UINT32_MAX / sizeof(VkAabbPositionsKHR)) {
+            throw std::runtime_error("BLAS AABB data exceeds 4 GB.");
+        }
+		m_primitiveCount = primitiveCount;
+        const uint32_t aabbDataSize = primitiveCount * sizeof(VkAabbPositionsKHR);
+
+        m_boundsMin = boundsMin;
+        m_boundsMax = boundsMax;
 
 		const VkBufferUsageFlags aabbBufferUsageFlags =
 			VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_BUILD_INPUT_READ_ONLY_BIT_KHR |
@@ -85,6 +130,10 @@ public:
 		m_buildInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_BUILD_GEOMETRY_INFO_KHR;
 		m_buildInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR;
 		m_buildInfo.flags = VK_BUILD_ACCELERATION_STRUCTURE_PREFER_FAST_TRACE_BIT_KHR;
+        if (allowCompaction)
+        {
+            m_buildInfo.flags |= VK_BUILD_ACCELERATION_STRUCTURE_ALLOW_COMPACTION_BIT_KHR;
+        }
 		m_buildInfo.geometryCount = 1;
 		m_buildInfo.pGeometries = &m_geometry;
 
@@ -104,46 +153,45 @@ public:
         m_buildScratchSize = buildSizesInfo.buildScratchSize;
         m_updateScratchSize = buildSizesInfo.updateScratchSize;
 
+        createAccelerationStructure(buildSizesInfo.accelerationStructureSize);
+	}
 
-		m_buffer.create(
-			VulkanContext::vmaAllocator,
-			VulkanContext::device,
-			buildSizesInfo.accelerationStructureSize,
-			VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_STORAGE_BIT_KHR |
-			VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
-			VulkanContext::vkGetBufferDeviceAddressKHR
-		);
-
-		VkAccelerationStructureCreateInfoKHR createInfo{};
-		createInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_CREATE_INFO_KHR;
-		createInfo.buffer = m_buffer.handle;
-		createInfo.size = buildSizesInfo.accelerationStructureSize;
-		createInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR;
-
-		VkResult result = VulkanContext::vkCreateAccelerationStructureKHR(
-			VulkanContext::device,
-			&createInfo,
-			nullptr,
-			&m_blasHandle);
-        if (result != VK_SUCCESS) {
-             throw std::runtime_error("Failed to create acceleration structure handle.");
-        }
+    // Takes over the AABB buffer and the build description of source, which was built with
+    // allowCompaction, with a new acceleration structure of its compacted size. The caller records
+    // the VK_COPY_ACCELERATION_STRUCTURE_MODE_COMPACT_KHR copy from source into it.
+    //
+    // A compacted BLAS can't be rebuilt in place, its storage only fits the built tree.
+    void createCompacted(BLAS& source, VkDeviceSize compactedSize)
+    {
+        // First, so a failure leaves source with its AABB buffer
+        createAccelerationStructure(compactedSize);
 
-        VkDeviceSize scratchSize = std::max(m_buildScratchSize, m_updateScratchSize);
-		m_scratchBuffer.createScratchBuffer(
-            VulkanContext::vmaAllocator,
-            VulkanContext::device,
-            scratchSize,
-            VulkanContext::vkGetBufferDeviceAddressKHR
-        );
+        m_primitiveCount = source.m_primitiveCount;
+        m_aabbBuffer = std::move(source.m_aabbBuffer);
+        m_geometry = source.m_geometry;
+        m_buildInfo = source.m_buildInfo;
+        m_buildInfo.pGeometries = &m_geometry;
+        m_buildScratchSize = source.m_buildScratchSize;
+        m_updateScratchSize = source.m_updateScratchSize;
+        m_boundsMin = source.m_boundsMin;
+        m_boundsMax = source.m_boundsMax;
+        m_compacted = true;
+    }
 
-		VkAccelerationStructureDeviceAddressInfoKHR addressInfo{};
-		addressInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_DEVICE_ADDRESS_INFO_KHR;
-		addressInfo.accelerationStructure = m_blasHandle;
-		m_deviceAddress = VulkanContext::vkGetAccelerationStructureDeviceAddressKHR(VulkanContext::device, &addressInfo);
+    // Build of the whole AABB buffer with the given scratch memory, for recording several BLASes
+    // in one vkCmdBuildAccelerationStructuresKHR
+    void getBuildInfo(VkDeviceAddress scratchAddress, VkAccelerationStructureBuildGeometryInfoKHR& buildInfo, VkAccelerationStructureBuildRangeInfoKHR& buildRangeInfo) const
+    {
+		buildInfo = m_buildInfo;
+		buildInfo.mode = VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR;
+		buildInfo.dstAccelerationStructure = m_blasHandle;
+        buildInfo.scratchData.deviceAddress = scratchAddress;
+        buildInfo.srcAccelerationStructure = VK_NULL_HANDLE;
+        buildInfo.pGeometries = &m_geometry;
 
-        build(initialAABBData, aabbDataSize);
-	}
+        buildRangeInfo = {};
+		buildRangeInfo.primitiveCount = m_primitiveCount;
+    }
 
 	void build(const VkAabbPositionsKHR* aabbData, uint32_t aabbDataSize)
 	{
@@ -156,22 +204,26 @@ public:
         if (aabbDataSize != m_aabbBuffer.size) {
             throw std::runtime_error("AABB data size in build() does not match size during init().");
         }
+        if (m_compacted) {
+            throw std::runtime_error("A compacted BLAS can't be rebuilt.");
+        }
 
         m_aabbBuffer.uploadData(VulkanContext::vmaAllocator, VulkanContext::device, VulkanContext::graphicsQueue, aabbData, aabbDataSize);
 
-		VkAccelerationStructureBuildGeometryInfoKHR buildInfo = m_buildInfo;
-		buildInfo.mode = VK_BUILD_ACCELERATION_STRUCTURE_MODE_BUILD_KHR;
-		buildInfo.dstAccelerationStructure = m_blasHandle;
-        buildInfo.scratchData.deviceAddress = m_scratchBuffer.deviceAddress;
-        buildInfo.srcAccelerationStructure = VK_NULL_HANDLE;
-        buildInfo.pGeometries = &m_geometry;
-
+        // BLASes built in a batch used shared scratch memory, they get their own on the first rebuild
+        if (m_scratchBuffer.handle == VK_NULL_HANDLE)
+        {
+		    m_scratchBuffer.createScratchBuffer(
+                VulkanContext::vmaAllocator,
+                VulkanContext::device,
+                std::max(m_buildScratchSize, m_updateScratchSize),
+                VulkanContext::vkGetBufferDeviceAddressKHR
+            );
+        }
 
-		VkAccelerationStructureBuildRangeInfoKHR buildRangeInfo{};
-		buildRangeInfo.primitiveCount = m_primitiveCount;
-		buildRangeInfo.primitiveOffset = 0;
-		buildRangeInfo.firstVertex = 0;
-		buildRangeInfo.transformOffset = 0;
+		VkAccelerationStructureBuildGeometryInfoKHR buildInfo;
+		VkAccelerationStructureBuildRangeInfoKHR buildRangeInfo;
+        getBuildInfo(m_scratchBuffer.deviceAddress, buildInfo, buildRangeInfo);
 
 		const VkAccelerationStructureBuildRangeInfoKHR* pBuildRangeInfo = &buildRangeInfo;
 
@@ -224,13 +276,63 @@ public:
         m_buildInfo = {};
         m_buildScratchSize = 0;
         m_updateScratchSize = 0;
+        m_boundsMin = glm::vec3(0.0f);
+        m_boundsMax = glm::vec3(0.0f);
+        m_compacted = false;
 	}
 
 	VkAccelerationStructureKHR getHandle() const { return m_blasHandle; }
 	uint64_t getDeviceAddress() const { return m_deviceAddress; }
     uint64_t getPrimitiveCount() const { return m_primitiveCount; }
 
+    // Device memory held: the acceleration structure, its AABB input and its scratch buffer if it has one
+    VkDeviceSize getMemorySize() const
+    {
+        const VkDeviceSize scratchSize = m_scratchBuffer.handle != VK_NULL_HANDLE ? std::max(m_buildScratchSize, m_updateScratchSize) : 0;
+        return m_buffer.size + m_aabbBuffer.size + scratchSize;
+    }
+    VkDeviceSize getAccelerationStructureSize() const { return m_buffer.size; }
+    VkDeviceSize getBuildScratchSize() const { return m_buildScratchSize; }
+    VkBuffer getAabbBuffer() const { return m_aabbBuffer.handle; }
+    bool isCompacted() const { return m_compacted; }
+
+    // Object-space bounds of all primitives, taken from the AABBs passed to create()
+    const glm::vec3& getBoundsMin() const { return m_boundsMin; }
+    const glm::vec3& getBoundsMax() const { return m_boundsMax; }
+
 private:
+    void createAccelerationStructure(VkDeviceSize size)
+    {
+		m_buffer.create(
+			VulkanContext::vmaAllocator,
+			VulkanContext::device,
+			size,
+			VK_BUFFER_USAGE_ACCELERATION_STRUCTURE_STORAGE_BIT_KHR |
+			VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT,
+			VulkanContext::vkGetBufferDeviceAddressKHR
+		);
+
+		VkAccelerationStructureCreateInfoKHR createInfo{};
+		createInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_CREATE_INFO_KHR;
+		createInfo.buffer = m_buffer.handle;
+		createInfo.size = size;
+		createInfo.type = VK_ACCELERATION_STRUCTURE_TYPE_BOTTOM_LEVEL_KHR;
+
+		VkResult result = VulkanContext::vkCreateAccelerationStructureKHR(
+			VulkanContext::device,
+			&createInfo,
+			nullptr,
+			&m_blasHandle);
+        if (result != VK_SUCCESS) {
+             throw std::runtime_error("Failed to create acceleration structure handle.");
+        }
+
+		VkAccelerationStructureDeviceAddressInfoKHR addressInfo{};
+		addressInfo.sType = VK_STRUCTURE_TYPE_ACCELERATION_STRUCTURE_DEVICE_ADDRESS_INFO_KHR;
+		addressInfo.accelerationStructure = m_blasHandle;
+		m_deviceAddress = VulkanContext::vkGetAccelerationStructureDeviceAddressKHR(VulkanContext::device, &addressInfo);
+	}
+
 	VkAccelerationStructureKHR m_blasHandle = VK_NULL_HANDLE;
 	uint64_t m_deviceAddress = 0;
 	Buffer<BufferType::DeviceLocal> m_buffer;
@@ -244,6 +346,11 @@ private:
 
     VkDeviceSize m_buildScratchSize = 0;
     VkDeviceSize m_updateScratchSize = 0;
+
+    glm::vec3 m_boundsMin{ 0.0f };
+    glm::vec3 m_boundsMax{ 0.0f };
+
+    bool m_compacted = false;
 };
 
 
@@ -390,16 +497,40 @@ public:
             throw std::runtime_error("Instance count exceeds maximum instance count during build.");
         }
 
-        bool performUpdate = update;
-        if (performUpdate && m_buildInfo.srcAccelerationStructure == VK_NULL_HANDLE) 
+        updateInstances(instanceData, 0, instanceCount);
+        build(cmd, instanceCount, update);
+    }
+
+    // Writes instances [first, first + count) of the instance buffer
+    void updateInstances(const VkAccelerationStructureInstanceKHR* instanceData, uint32_t first, uint32_t count)
+    {
+        if (first + count > m_maxInstances)
         {
-            performUpdate = false; 
+            throw std::runtime_error("Instance range exceeds maximum instance count.");
+        }
+        if (count > 0)
+        {
+            m_instanceBuffer.updateData(VulkanContext::vmaAllocator, instanceData,
+                sizeof(VkAccelerationStructureInstanceKHR) * count, sizeof(VkAccelerationStructureInstanceKHR) * first);
         }
+    }
 
-        VkDeviceSize dataSize = sizeof(VkAccelerationStructureInstanceKHR) * instanceCount;
-        if (dataSize > 0) 
+    // Builds from the first instanceCount instances already in the instance buffer
+    void build(VkCommandBuffer cmd, uint32_t instanceCount, bool update = false)
+    {
+        if (m_tlasHandle == VK_NULL_HANDLE) 
+        {
+            throw std::runtime_error("TLAS must be initialized before building.");
+        }
+        if (instanceCount > m_maxInstances) 
         {
-            m_instanceBuffer.updateData(VulkanContext::vmaAllocator, instanceData, dataSize);
+            throw std::runtime_error("Instance count exceeds maximum instance count during build.");
+        }
+
+        bool performUpdate = update;
+        if (performUpdate && m_buildInfo.srcAccelerationStructure == VK_NULL_HANDLE) 
+        {
+            performUpdate = false; 
         }
 
         m_instanceCount = instanceCount;
@@ -486,9 +617,25 @@ public:
     VkDeviceSize m_updateScratchSize = 0;
 };
 
-using InstanceIndex = uint32_t;
 using BlasIndex = uint32_t;
 
+struct BlasBuildInput
+{
+    const VkAabbPositionsKHR* aabbs = nullptr;
+    uint32_t aabbDataSize = 0;  // In bytes, like addBlas
+};
+
+// Writes the AABBs of primitives [first, first + count) to aabbs, called in order with count at
+// most AccelerationStructureManager::AABB_STREAM_BLOCK_SIZE
+using AabbBlockProducer = std::function<void(uint32_t first, uint32_t count, VkAabbPositionsKHR* aabbs)>;
+
+struct BlasBatchStats
+{
+    uint32_t blasCount = 0;     // Built by the last addBlases, cache hits not included
+    uint32_t batchCount = 0;    // vkCmdBuildAccelerationStructuresKHR calls it recorded, all in one submit
+    VkDeviceSize scratchArenaSize = 0;
+};
+
 class AccelerationStructureManager
 {
 public:
@@ -500,32 +647,191 @@ public:
     AccelerationStructureManager(AccelerationStructureManager&&) = delete;
     AccelerationStructureManager& operator=(AccelerationStructureManager&&) = delete;
 
+    // Returns the BLAS already built from identical AABBs if there is one, each call holds a
+    // reference until releaseBlas
     BlasIndex addBlas(const VkAabbPositionsKHR* initialAABBData, uint32_t aabbDataSize)
     {
-        m_blases.emplace_back();
-        try 
+        BlasIndex index;
+        const BlasBuildInput input = { initialAABBData, aabbDataSize };
+        addBlases(&input, 1, &index);
+        return index;
+    }
+
+    // addBlas for many AABB arrays, their indices go to outIndices. Contents already cached are
+    // resolved first. The rest is uploaded through one staging buffer and built in one submit,
+    // with one vkCmdBuildAccelerationStructuresKHR per batch of BLASes whose scratch memory fits
+    // in the shared arena together.
+    void addBlases(const BlasBuildInput* inputs, uint32_t count, BlasIndex* outIndices)
+    {
+        PERF_SCOPE("Add BLASes");
+
+        for (uint32_t i = 0; i < count; ++i)
         {
-            m_blases.back().init(initialAABBData, aabbDataSize);
-        } 
-        catch (...) 
+            if (inputs[i].aabbs == nullptr || inputs[i].aabbDataSize == 0 || inputs[i].aabbDataSize % sizeof(VkAabbPositionsKHR) != 0)
+            {
+                throw std::runtime_error("addBlases: AABB data is null, empty or not a multiple of VkAabbPositionsKHR.");
+            }
+        }
+
+        // Every miss is cached as soon as it is created, so repeats within the call hit as well
+        std::vector<uint32_t> builtInputs;
+        std::vector<BlasIndex> builtIndices;
+
+        // On failure the call leaves no references and no unbuilt BLASes behind
+        auto rollback = [&](uint32_t resolvedCount)
         {
-            m_blases.pop_back();
+            for (BlasIndex created : builtIndices)
+            {
+                m_blasCache.remove(created);
+                m_blasCompaction.cancel(created);
+                m_blases[created].destroy();
+                m_freeBlasIndices.push_back(created);
+            }
+            for (uint32_t i = 0; i < resolvedCount; ++i)
+            {
+                m_blasCache.releaseOwner(outIndices[i]);
+            }
+        };
+
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            const uint32_t primitiveCount = inputs[i].aabbDataSize / sizeof(VkAabbPositionsKHR);
+            const uint64_t hash = BlasCache::hashAabbs(inputs[i].aabbs, primitiveCount);
+            const uint32_t cached = m_blasCache.acquire(hash, primitiveCount);
+            if (cached != BlasCache::NOT_FOUND)
+            {
+                outIndices[i] = cached;
+                continue;
+            }
+
+            const BlasIndex index = allocateBlasIndex();
+            try 
+            {
+                m_blases[index].create(inputs[i].aabbs, inputs[i].aabbDataSize, m_compactionEnabled);
+            } 
+            catch (...) 
+            {
+                m_blases[index].destroy();
+                m_freeBlasIndices.push_back(index);
+                rollback(i);
+                throw;
+            }
+
+            m_blasCache.insert(index, hash, primitiveCount, m_blases[index].getMemorySize());
+            outIndices[i] = index;
+            builtInputs.push_back(i);
+            builtIndices.push_back(index);
+        }
+
+        m_lastBatchStats = {};
+        if (!builtIndices.empty())
+        {
+            try
+            {
+                uploadAndBuildBlases(inputs, builtInputs, builtIndices);
+            }
+            catch (...)
+            {
+                rollback(count);
+                throw;
+            }
+        }
+    }
+    static constexpr uint32_t AABB_STREAM_BLOCK_SIZE = 4096; // 96 KB of AABBs, stays in L2 between producing and uploading
+
+    // addBlas for AABBs produced block by block. Every block is hashed and bounded while it is
+    // in cache and then written to the upload memory, so the whole array never exists on the
+    // host. A cache hit is only known at the end, its blocks are produced for nothing.
+    BlasIndex addBlasStreamed(uint32_t primitiveCount, const AabbBlockProducer& produce)
+    {
+        PERF_SCOPE("Add Streamed BLAS");
+
+        if (primitiveCount == 0 || primitiveCount > UINT32_MAX / sizeof(VkAabbPositionsKHR) || !produce)
+        {
+            throw std::runtime_error("addBlasStreamed: No producer, no primitives or more than 4 GB of AABBs.");
+        }
+
+        Buffer<BufferType::HostVisible> stagingBuffer;
+        createStagingBuffer(stagingBuffer, static_cast<VkDeviceSize>(primitiveCount) * sizeof(VkAabbPositionsKHR));
+
+        AabbHasher hasher;
+        glm::vec3 boundsMin(FLT_MAX);
+        glm::vec3 boundsMax(-FLT_MAX);
+        m_streamBlock.resize(std::min(primitiveCount, AABB_STREAM_BLOCK_SIZE));
+        try
+        {
+            for (uint32_t first = 0; first < primitiveCount; first += AABB_STREAM_BLOCK_SIZE)
+            {
+                const uint32_t count = std::min(primitiveCount - first, AABB_STREAM_BLOCK_SIZE);
+                produce(first, count, m_streamBlock.data());
+
+                hasher.update(m_streamBlock.data(), count);
+                expandAabbBounds(m_streamBlock.data(), count, boundsMin, boundsMax);
+                stagingBuffer.updateData(VulkanContext::vmaAllocator, m_streamBlock.data(), count * sizeof(VkAabbPositionsKHR), first * sizeof(VkAabbPositionsKHR));
+            }
+        }
+        catch (...)
+        {
+            stagingBuffer.destroy(VulkanContext::vmaAllocator);
             throw;
         }
-        
-        return static_cast<BlasIndex>(m_blases.size() - 1);
+
+        m_lastBatchStats = {};
+        const uint64_t hash = hasher.digest();
+        const uint32_t cached = m_blasCache.acquire(hash, primitiveCount);
+        if (cached != BlasCache::NOT_FOUND)
+        {
+            stagingBuffer.destroy(VulkanContext::vmaAllocator);
+            return cached;
+        }
+
+        const BlasIndex index = allocateBlasIndex();
+        try
+        {
+            m_blases[index].create(primitiveCount, boundsMin, boundsMax, m_compactionEnabled);
+            m_blasCache.insert(index, hash, primitiveCount, m_blases[index].getMemorySize());
+            buildBlases(stagingBuffer, { index });
+        }
+        catch (...)
+        {
+            m_blasCache.remove(index);
+            m_blasCompaction.cancel(index);
+            m_blases[index].destroy();
+            m_freeBlasIndices.push_back(index);
+            stagingBuffer.destroy(VulkanContext::vmaAllocator);
+            throw;
+        }
+
+        stagingBuffer.destroy(VulkanContext::vmaAllocator);
+        return index;
+    }
+
+    // Drops the reference of one addBlas, the BLAS is destroyed once its instances are gone too
+    // and no frame in flight can trace it anymore
+    void releaseBlas(BlasIndex index)
+    {
+        if (m_blasCache.getOwnerCount(index) == 0)
+        {
+            LOG_ERROR("releaseBlas: BLAS " << index << " has no references left.");
+            return;
+        }
+        m_blasCache.releaseOwner(index);
     }
 
-    InstanceIndex instantiateBlas(BlasIndex index, VkTransformMatrixKHR transform)
+    InstanceHandle instantiateBlas(BlasIndex index, VkTransformMatrixKHR transform)
     {
-        if (index >= m_blases.size()) 
+        if (index >= m_blases.size() || !m_blasCache.contains(index)) 
         {
             LOG_ERROR("instantiateBLAS: BLAS index out of range.");
-            return 0;
+            return {};
+        }
+        if (m_tlas.m_tlasHandle != VK_NULL_HANDLE && m_instanceTable.getHoleCount() == 0 && m_instanceTable.getSlotCount() >= m_tlas.m_maxInstances)
+        {
+            LOG_ERROR("instantiateBLAS: TLAS is full (" << m_tlas.m_maxInstances << " instances).");
+            return {};
         }
 
-        m_instances.emplace_back();
-        auto& instance = m_instances.back();
+        VkAccelerationStructureInstanceKHR instance{};
         instance.transform = transform;
         instance.instanceCustomIndex = static_cast<uint32_t>(primitiveUniqueIndexCounter);
         instance.mask = 0xFF;
@@ -534,59 +840,173 @@ public:
         instance.accelerationStructureReference = m_blases[index].getDeviceAddress();
         primitiveUniqueIndexCounter += m_blases[index].getPrimitiveCount();
 
-		return static_cast<InstanceIndex>(m_instances.size() - 1);
+        m_blasCache.addInstance(index);
+        return m_instanceTable.add(instance, index);
     }
 
-    void initTLAS()
+    void removeInstance(InstanceHandle handle)
     {
-        if (m_instances.size() == 0)
+        const uint32_t slot = m_instanceTable.getSlot(handle);
+        if (slot == InstanceTable::INVALID_SLOT)
+        {
+            LOG_ERROR("removeInstance: Stale or invalid instance handle.");
+            return;
+        }
+
+        m_blasCache.releaseInstance(m_instanceTable.getBlas(slot));
+        m_instanceTable.remove(handle);
+    }
+
+    // Closes the holes removals left, so the TLAS is built over fewer instances. Moves instances
+    // between slots, the next update is a full rebuild.
+    void compactInstances()
+    {
+        m_instanceTable.compact();
+    }
+
+    // maxInstances is the capacity of the TLAS for the rest of its life, by default twice the
+    // current instances and at least MIN_TLAS_CAPACITY
+    void initTLAS(uint32_t maxInstances = 0)
+    {
+        const uint32_t slotCount = m_instanceTable.getSlotCount();
+        if (slotCount == 0)
         {
             LOG_ERROR("Can't initialize tlas with no blas instances!");
         }
         else
         {
-			m_tlas.init(m_instances.data(), static_cast<uint32_t>(m_instances.size()), static_cast<uint32_t>(m_instances.size()));
+            const uint32_t capacity = std::max(maxInstances != 0 ? maxInstances : std::max(2 * slotCount, MIN_TLAS_CAPACITY), slotCount);
+			m_tlas.init(m_instanceTable.getInstances(), slotCount, capacity);
+
+            m_builtInstanceIndices.resize(slotCount);
+            m_builtPositions.resize(slotCount);
+            for (uint32_t i = 0; i < m_builtInstanceIndices.size(); ++i)
+            {
+                m_builtInstanceIndices[i] = i;
+                m_builtPositions[i] = i;
+            }
+            m_uploadedInstances.assign(m_instanceTable.getInstances(), m_instanceTable.getInstances() + slotCount);
+            m_builtLayoutVersion = m_instanceTable.getLayoutVersion();
+            m_instanceTable.takeDirtyRanges(m_dirtyRanges);
+            rebuildQualityTree();
         }
     }
 
-    void moveBlasInstance(uint32_t index, VkTransformMatrixKHR vkTransform)
+    // Culls the instances by their world-space bounds, the next updateTLAS() only builds the
+    // survivors. Without a call in a frame every instance goes into the TLAS.
+    void cullInstances(ChunkCuller& culler, const glm::mat4& viewProjection, const glm::vec3& cameraPosition)
     {
-        if (index >= m_blases.size()) 
+        PERF_SCOPE("Cull Instances");
+
+        culler.begin(viewProjection, cameraPosition);
+        for (uint32_t slot = 0; slot < m_instanceTable.getSlotCount(); ++slot)
         {
-            LOG_ERROR("MoveBLAS: BLAS index out of range.");
-            return;
+            if (!m_instanceTable.isLive(slot))
+            {
+                continue;
+            }
+
+            const BLAS& blas = m_blases[m_instanceTable.getBlas(slot)];
+
+            glm::vec3 min;
+            glm::vec3 max;
+            transformBounds(m_instanceTable.getInstance(slot).transform, blas.getBoundsMin(), blas.getBoundsMax(), min, max);
+            culler.add(min, max, slot);
         }
 
-		if (index >= m_tlas.m_maxInstances) 
+        culler.cull(m_visibleInstanceIndices);
+        m_instancesCulled = true;
+    }
+
+    void moveBlasInstance(InstanceHandle handle, VkTransformMatrixKHR vkTransform)
+    {
+        if (!m_instanceTable.setTransform(handle, vkTransform))
         {
-            LOG_ERROR("moveBLAS: Instance index exceeds TLAS capacity.");
-            return;
+            LOG_ERROR("moveBLAS: Stale or invalid instance handle.");
         }
-
-	    m_instances[index].transform = vkTransform;
 	}
 
+    // Builds the TLAS over the visible instances. While the instance list is the one of the last
+    // build only the instances that changed are written to the instance buffer and the TLAS is
+    // refitted, otherwise the whole list is written and rebuilt.
+    //
+    // A refit degrades the tree the further instances move, TlasQuality decides when the TLAS is
+    // rebuilt instead.
     void updateTLAS(VkCommandBuffer cmd)
     {
         PERF_SCOPE("Update TLAS");
 
-        if (m_instances.empty()) 
-		{
-			if (!m_instances.empty()) {
-				 LOG_ERROR("UpdateTLAS: Instance and transform matrix count mismatch.");
-			}
-			return;
-		}
+        // One TLAS build per frame, so this is where BLASes released framesInFlight frames ago go
+        destroyReleasedBlases();
+        compactBlases(cmd);
 
-        if (m_instances.empty())
+        if (m_instanceTable.getSlotCount() == 0)
         {
             LOG_ERROR("UpdateTLAS: No instances to update.");
             return;
         }
 
-		m_tlas.build(cmd, m_instances.data(), static_cast<uint32_t>(m_instances.size()), true);
+        // Without culling every slot goes in, holes are inactive instances
+        if (!m_instancesCulled)
+        {
+            m_visibleInstanceIndices.resize(m_instanceTable.getSlotCount());
+            for (uint32_t i = 0; i < m_visibleInstanceIndices.size(); ++i)
+            {
+                m_visibleInstanceIndices[i] = i;
+            }
+        }
+        m_instancesCulled = false;
+
+        m_instanceTable.takeDirtyRanges(m_dirtyRanges, DIRTY_RANGE_MERGE_GAP);
+        const uint32_t instanceCount = static_cast<uint32_t>(m_visibleInstanceIndices.size());
+
+        // An update has to keep the exact instance list of the last build, otherwise rebuild
+        // Swapped in compacted BLASes are only picked up by a rebuild, an update may keep the old ones
+        const bool sameInstanceList = m_visibleInstanceIndices == m_builtInstanceIndices && m_builtLayoutVersion == m_instanceTable.getLayoutVersion() && !m_blasReferencesChanged;
+        const bool update = m_tlasQuality.decide(sameInstanceList, m_dirtyRanges, m_instanceBounds) == TLASBuildDecision::Refit;
+
+        if (update)
+        {
+            uploadDirtyInstances();
+        }
+        else
+        {
+            m_uploadedInstances.resize(instanceCount);
+            m_builtPositions.assign(m_instanceTable.getSlotCount(), InstanceTable::INVALID_SLOT);
+            for (uint32_t i = 0; i < instanceCount; ++i)
+            {
+                m_uploadedInstances[i] = m_instanceTable.getInstance(m_visibleInstanceIndices[i]);
+                m_builtPositions[m_visibleInstanceIndices[i]] = i;
+            }
+            m_tlas.updateInstances(m_uploadedInstances.data(), 0, instanceCount);
+            m_uploadedInstanceCount = instanceCount;
+
+            m_builtInstanceIndices = m_visibleInstanceIndices;
+            m_builtLayoutVersion = m_instanceTable.getLayoutVersion();
+            m_blasReferencesChanged = false;
+            rebuildQualityTree();
+        }
+
+		m_tlas.build(cmd, instanceCount, update);
+
+        PERF_COUNTER("TLAS Cost Ratio", m_tlasQuality.getCostRatio());
+        PERF_COUNTER("TLAS Refits Since Rebuild", m_tlasQuality.getRefitsSinceRebuild());
+        PERF_COUNTER("TLAS Quality Rebuilds", m_tlasQuality.getQualityRebuildCount());
+    }
+
+    // Switching the quality tracking on measures from the current TLAS
+    void setUpdateSettings(const TLASUpdateSettings& settings)
+    {
+        const bool trackingChanged = (settings.rebuildCostRatio > 0.0f) != m_tlasQuality.isTracking();
+        m_tlasQuality.setSettings(settings);
+        if (trackingChanged)
+        {
+            rebuildQualityTree();
+        }
     }
 
+    const TLASUpdateSettings& getUpdateSettings() const { return m_tlasQuality.getSettings(); }
+
     void destroy()
     {
         for (auto& blas : m_blases) 
@@ -594,17 +1014,500 @@ public:
             blas.destroy();
         }
 
+        for (auto& blas : m_compactionOriginals)
+        {
+            blas.destroy();
+        }
+
         m_blases.clear();
+        m_freeBlasIndices.clear();
+        m_blasCache.clear();
+        m_releasedBlases.clear();
+        m_compactionOriginals.clear();
+        m_blasCompaction.clear();
+        m_retiredOriginals.clear();
+        m_blasReferencesChanged = false;
+        destroyCompactionQueryPool();
+        releaseScratchArena();
+        m_instanceTable.clear();
+        primitiveUniqueIndexCounter = 0;
+        m_visibleInstanceIndices.clear();
+        m_builtInstanceIndices.clear();
+        m_builtPositions.clear();
+        m_uploadedInstances.clear();
+        m_dirtyRanges.clear();
+        m_tlasQuality.clear();
         m_tlas.destroy();
     }
 
     VkAccelerationStructureKHR getTLASHandle() const { return m_tlas.m_tlasHandle; }
+    uint32_t getInstanceCount() const { return m_instanceTable.getLiveCount(); }
+    uint32_t getBuiltInstanceCount() const { return static_cast<uint32_t>(m_builtInstanceIndices.size()); }
+    uint32_t getTLASCapacity() const { return m_tlas.m_maxInstances; }
+    uint32_t getUploadedInstanceCount() const { return m_uploadedInstanceCount; } // Written by the last updateTLAS
+    const InstanceTable& getInstanceTable() const { return m_instanceTable; }
+
+    // Frames that may still trace a TLAS after it was replaced, BLASes are destroyed that much later
+    void setFramesInFlight(uint32_t framesInFlight)
+    {
+        m_blasCache.setFramesInFlight(framesInFlight);
+        m_blasCompaction.setFramesInFlight(framesInFlight);
+    }
+    const BlasCacheStats& getBlasCacheStats() const { return m_blasCache.getStats(); }
+    const BlasBatchStats& getLastBatchStats() const { return m_lastBatchStats; }
+
+    // BLASes added from now on are built for compaction and replaced by a tightly sized copy a few
+    // frames later, for BLASes that are never rebuilt
+    void setCompactionEnabled(bool enabled) { m_compactionEnabled = enabled; }
+    bool isCompactionEnabled() const { return m_compactionEnabled; }
+    const BlasCompactionStats& getBlasCompactionStats() const { return m_blasCompaction.getStats(); }
+
+    // Quality of the current TLAS, SAH cost of the CPU instance tree relative to the last rebuild
+    float getCostRatio() const { return m_tlasQuality.getCostRatio(); }
+    uint32_t getRefitsSinceRebuild() const { return m_tlasQuality.getRefitsSinceRebuild(); }
+    uint32_t getQualityRebuildCount() const { return m_tlasQuality.getQualityRebuildCount(); }
+    TLASBuildDecision getLastBuildDecision() const { return m_tlasQuality.getLastDecision(); }
 
 private:
+    static constexpr uint32_t MIN_TLAS_CAPACITY = 1024;
+    static constexpr VkDeviceSize MAX_SCRATCH_ARENA_SIZE = 64ull << 20; // Batches are split to fit, the arena is kept between calls
+    static constexpr VkDeviceSize MAX_COMPACTION_BYTES_PER_FRAME = 64ull << 20; // Of uncompacted BLASes copied in one frame
+    static constexpr uint32_t DIRTY_RANGE_MERGE_GAP = 4; // Unchanged instances copied to save a separate copy
+
+    // Copies the changed instances to their positions in the built list, consecutive positions in one go
+    void uploadDirtyInstances()
+    {
+        m_uploadedInstanceCount = 0;
+        for (const InstanceRange& range : m_dirtyRanges)
+        {
+            uint32_t runFirst = InstanceTable::INVALID_SLOT;
+            uint32_t runEnd = 0;
+            for (uint32_t slot = range.first; slot < range.first + range.count; ++slot)
+            {
+                const uint32_t position = m_builtPositions[slot];
+                if (position == InstanceTable::INVALID_SLOT)
+                {
+                    continue;
+                }
+
+                m_uploadedInstances[position] = m_instanceTable.getInstance(slot);
+                if (position != runEnd || runFirst == InstanceTable::INVALID_SLOT)
+                {
+                    if (runFirst != InstanceTable::INVALID_SLOT)
+                    {
+                        m_tlas.updateInstances(m_uploadedInstances.data() + runFirst, runFirst, runEnd - runFirst);
+                        m_uploadedInstanceCount += runEnd - runFirst;
+                    }
+                    runFirst = position;
+                }
+                runEnd = position + 1;
+            }
+
+            if (runFirst != InstanceTable::INVALID_SLOT)
+            {
+                m_tlas.updateInstances(m_uploadedInstances.data() + runFirst, runFirst, runEnd - runFirst);
+                m_uploadedInstanceCount += runEnd - runFirst;
+            }
+        }
+    }
+
+    BlasIndex allocateBlasIndex()
+    {
+        if (!m_freeBlasIndices.empty())
+        {
+            const BlasIndex index = m_freeBlasIndices.back();
+            m_freeBlasIndices.pop_back();
+            return index;
+        }
+
+        m_blases.emplace_back();
+        return static_cast<BlasIndex>(m_blases.size() - 1);
+    }
+
+    // Uploads and builds freshly created BLASes with one submit, inputs[builtInputs[i]] goes to m_blases[builtIndices[i]]
+    void uploadAndBuildBlases(const BlasBuildInput* inputs, const std::vector<uint32_t>& builtInputs, const std::vector<BlasIndex>& builtIndices)
+    {
+        VkDeviceSize stagingSize = 0;
+        for (uint32_t input : builtInputs)
+        {
+            stagingSize += inputs[input].aabbDataSize;
+        }
+
+        Buffer<BufferType::HostVisible> stagingBuffer;
+        createStagingBuffer(stagingBuffer, stagingSize);
+
+        VkDeviceSize stagingOffset = 0;
+        for (uint32_t input : builtInputs)
+        {
+            stagingBuffer.updateData(VulkanContext::vmaAllocator, inputs[input].aabbs, inputs[input].aabbDataSize, stagingOffset);
+            stagingOffset += inputs[input].aabbDataSize;
+        }
+
+        try
+        {
+            buildBlases(stagingBuffer, builtIndices);
+        }
+        catch (...)
+        {
+            stagingBuffer.destroy(VulkanContext::vmaAllocator);
+            throw;
+        }
+        stagingBuffer.destroy(VulkanContext::vmaAllocator);
+    }
+
+    static void createStagingBuffer(Buffer<BufferType::HostVisible>& stagingBuffer, VkDeviceSize size)
+    {
+        stagingBuffer.create(
+            VulkanContext::vmaAllocator,
+            VulkanContext::device,
+            size,
+            VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+            VulkanContext::vkGetBufferDeviceAddressKHR,
+            (size > 100000000) // Greater than 100 MB, get it's own allocation
+        );
+    }
+
+    // Builds freshly created BLASes with one submit, their AABBs lie back to back in stagingBuffer
+    void buildBlases(const Buffer<BufferType::HostVisible>& stagingBuffer, const std::vector<BlasIndex>& builtIndices)
+    {
+        const uint32_t count = static_cast<uint32_t>(builtIndices.size());
+
+        // Created with allowCompaction, their compacted sizes are queried right after the builds
+        const bool compact = m_compactionEnabled;
+        if (compact)
+        {
+            reserveCompactionQueries(count);
+        }
+
+        VkCommandBuffer cmd = VulkanContext::CreateCommandBuffer(VK_COMMAND_BUFFER_LEVEL_PRIMARY, true);
+        if (compact)
+        {
+            vkCmdResetQueryPool(cmd, m_compactionQueryPool, 0, count);
+        }
+
+        VkDeviceSize stagingOffset = 0;
+        for (BlasIndex index : builtIndices)
+        {
+            const VkDeviceSize aabbDataSize = m_blases[index].getPrimitiveCount() * sizeof(VkAabbPositionsKHR);
+
+            VkBufferCopy copyRegion{};
+            copyRegion.srcOffset = stagingOffset;
+            copyRegion.dstOffset = 0;
+            copyRegion.size = aabbDataSize;
+            vkCmdCopyBuffer(cmd, stagingBuffer.handle, m_blases[index].getAabbBuffer(), 1, &copyRegion);
+            stagingOffset += aabbDataSize;
+        }
+
+        VkMemoryBarrier memoryBarrier = { VK_STRUCTURE_TYPE_MEMORY_BARRIER };
+        memoryBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        memoryBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+        vkCmdPipelineBarrier(
+            cmd,
+            VK_PIPELINE_STAGE_TRANSFER_BIT,
+            VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
+            0,
+            1, &memoryBarrier,
+            0, nullptr,
+            0, nullptr
+        );
+
+        std::vector<VkDeviceSize> scratchSizes(count);
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            scratchSizes[i] = m_blases[builtIndices[i]].getBuildScratchSize();
+        }
+
+        const VkDeviceSize alignment = std::max<VkDeviceSize>(VulkanContext::accelerationStructureProperties.minAccelerationStructureScratchOffsetAlignment, 1);
+        std::vector<BlasBuildBatch> batches;
+        std::vector<VkDeviceSize> scratchOffsets;
+        ScratchArena::planBatches(scratchSizes.data(), count, alignment, MAX_SCRATCH_ARENA_SIZE, batches, scratchOffsets);
+
+        VkDeviceSize arenaSize = 0;
+        for (const BlasBuildBatch& batch : batches)
+        {
+            arenaSize = std::max(arenaSize, batch.scratchSize);
+        }
+        const VkDeviceAddress arenaAddress = reserveScratchArena(arenaSize, alignment);
+
+        std::vector<VkAccelerationStructureBuildGeometryInfoKHR> buildInfos(count);
+        std::vector<VkAccelerationStructureBuildRangeInfoKHR> buildRangeInfos(count);
+        std::vector<const VkAccelerationStructureBuildRangeInfoKHR*> pBuildRangeInfos(count);
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            m_blases[builtIndices[i]].getBuildInfo(arenaAddress + scratchOffsets[i], buildInfos[i], buildRangeInfos[i]);
+            pBuildRangeInfos[i] = &buildRangeInfos[i];
+        }
+
+        // Batches share the arena, each waits for the builds of the previous one
+        for (const BlasBuildBatch& batch : batches)
+        {
+            VulkanContext::vkCmdBuildAccelerationStructuresKHR(cmd, batch.count, &buildInfos[batch.first], &pBuildRangeInfos[batch.first]);
+
+            memoryBarrier.srcAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR;
+            memoryBarrier.dstAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR | VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR;
+            vkCmdPipelineBarrier(
+                cmd,
+                VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
+                VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR | VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR,
+                0,
+                1, &memoryBarrier,
+                0, nullptr,
+                0, nullptr
+            );
+        }
+
+        if (compact)
+        {
+            std::vector<VkAccelerationStructureKHR> handles(count);
+            for (uint32_t i = 0; i < count; ++i)
+            {
+                handles[i] = m_blases[builtIndices[i]].getHandle();
+                m_blasCompaction.request(builtIndices[i], m_blases[builtIndices[i]].getAccelerationStructureSize());
+            }
+            VulkanContext::vkCmdWriteAccelerationStructuresPropertiesKHR(cmd, count, handles.data(), VK_QUERY_TYPE_ACCELERATION_STRUCTURE_COMPACTED_SIZE_KHR, m_compactionQueryPool, 0);
+        }
+
+        VulkanContext::SubmitCommandBuffer(cmd, VulkanContext::graphicsQueue, true);
+
+        // The submit waited for the builds, a failed query leaves the size at 0 and skips the BLAS
+        if (compact)
+        {
+            std::vector<VkDeviceSize> compactedSizes(count, 0);
+            VK_ERROR_CHECK(vkGetQueryPoolResults(VulkanContext::device, m_compactionQueryPool, 0, count, count * sizeof(VkDeviceSize),
+                compactedSizes.data(), sizeof(VkDeviceSize), VK_QUERY_RESULT_64_BIT | VK_QUERY_RESULT_WAIT_BIT));
+            for (uint32_t i = 0; i < count; ++i)
+            {
+                m_blasCompaction.setCompactedSize(builtIndices[i], compactedSizes[i]);
+            }
+        }
+
+        m_lastBatchStats.blasCount = count;
+        m_lastBatchStats.batchCount = static_cast<uint32_t>(batches.size());
+        m_lastBatchStats.scratchArenaSize = m_scratchArenaSize;
+
+        // An arena grown for a single huge build isn't worth keeping around
+        if (m_scratchArenaSize > MAX_SCRATCH_ARENA_SIZE)
+        {
+            releaseScratchArena();
+        }
+    }
+
+    // Device address of at least size bytes of scratch memory, aligned, the arena only grows
+    VkDeviceAddress reserveScratchArena(VkDeviceSize size, VkDeviceSize alignment)
+    {
+        // The allocation isn't necessarily aligned as strictly as scratch memory has to be
+        const VkDeviceSize requiredSize = size + alignment - 1;
+        if (m_scratchArena.handle == VK_NULL_HANDLE || m_scratchArenaSize < requiredSize)
+        {
+            releaseScratchArena();
+            m_scratchArena.createScratchBuffer(
+                VulkanContext::vmaAllocator,
+                VulkanContext::device,
+                requiredSize,
+                VulkanContext::vkGetBufferDeviceAddressKHR
+            );
+            m_scratchArenaSize = requiredSize;
+        }
+        return (m_scratchArena.deviceAddress + alignment - 1) & ~(alignment - 1);
+    }
+
+    void releaseScratchArena()
+    {
+        m_scratchArena.destroyScratchBuffer(VulkanContext::vmaAllocator);
+        m_scratchArenaSize = 0;
+    }
+
+    void destroyReleasedBlases()
+    {
+        // Originals are kept apart from m_blases, so a compacted BLAS can go before its original.
+        // Its index isn't compacted again until the original went as well.
+        m_blasCache.collect(m_releasedBlases);
+        m_blasCompaction.collect(m_retiredOriginals);
+        for (BlasIndex index : m_retiredOriginals)
+        {
+            m_compactionOriginals[index].destroy();
+        }
+
+        for (BlasIndex index : m_releasedBlases)
+        {
+            m_blasCompaction.cancel(index);
+            m_blases[index].destroy();
+            m_freeBlasIndices.push_back(index);
+        }
+    }
+
+    // Records the compacting copies that are due into the frame's command buffer and swaps them
+    // in for their originals, the TLAS built after them in the same command buffer uses them.
+    // The originals are kept until no frame in flight traces them.
+    void compactBlases(VkCommandBuffer cmd)
+    {
+        if (!m_blasCompaction.hasReadyCopies())
+        {
+            return;
+        }
+
+        m_blasCompaction.takeCopies(m_compactionCopies, MAX_COMPACTION_BYTES_PER_FRAME);
+        m_compactionOriginals.resize(std::max(m_compactionOriginals.size(), m_blases.size()));
+        for (const BlasCompactionCopy& copy : m_compactionCopies)
+        {
+            BLAS compacted;
+            compacted.createCompacted(m_blases[copy.blas], copy.compactedSize);
+
+            VkCopyAccelerationStructureInfoKHR copyInfo{};
+            copyInfo.sType = VK_STRUCTURE_TYPE_COPY_ACCELERATION_STRUCTURE_INFO_KHR;
+            copyInfo.src = m_blases[copy.blas].getHandle();
+            copyInfo.dst = compacted.getHandle();
+            copyInfo.mode = VK_COPY_ACCELERATION_STRUCTURE_MODE_COMPACT_KHR;
+            VulkanContext::vkCmdCopyAccelerationStructureKHR(cmd, &copyInfo);
+
+            m_compactionOriginals[copy.blas] = std::move(m_blases[copy.blas]);
+            m_blases[copy.blas] = std::move(compacted);
+            m_blasCache.setMemorySize(copy.blas, m_blases[copy.blas].getMemorySize());
+        }
+
+        VkMemoryBarrier memoryBarrier = { VK_STRUCTURE_TYPE_MEMORY_BARRIER };
+        memoryBarrier.srcAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_WRITE_BIT_KHR;
+        memoryBarrier.dstAccessMask = VK_ACCESS_ACCELERATION_STRUCTURE_READ_BIT_KHR;
+        vkCmdPipelineBarrier(
+            cmd,
+            VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR,
+            VK_PIPELINE_STAGE_ACCELERATION_STRUCTURE_BUILD_BIT_KHR | VK_PIPELINE_STAGE_RAY_TRACING_SHADER_BIT_KHR,
+            0,
+            1, &memoryBarrier,
+            0, nullptr,
+            0, nullptr
+        );
+
+        for (uint32_t slot = 0; slot < m_instanceTable.getSlotCount(); ++slot)
+        {
+            if (!m_instanceTable.isLive(slot))
+            {
+                continue;
+            }
+
+            const uint64_t reference = m_blases[m_instanceTable.getBlas(slot)].getDeviceAddress();
+            if (m_instanceTable.getInstance(slot).accelerationStructureReference != reference)
+            {
+                m_instanceTable.setReference(slot, reference);
+            }
+        }
+        m_blasReferencesChanged = true;
+    }
+
+    void reserveCompactionQueries(uint32_t count)
+    {
+        if (m_compactionQueryPool != VK_NULL_HANDLE && m_compactionQueryCapacity >= count)
+        {
+            return;
+        }
+
+        destroyCompactionQueryPool();
+
+        VkQueryPoolCreateInfo createInfo{};
+        createInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+        createInfo.queryType = VK_QUERY_TYPE_ACCELERATION_STRUCTURE_COMPACTED_SIZE_KHR;
+        createInfo.queryCount = count;
+        if (vkCreateQueryPool(VulkanContext::device, &createInfo, nullptr, &m_compactionQueryPool) != VK_SUCCESS)
+        {
+            m_compactionQueryPool = VK_NULL_HANDLE;
+            throw std::runtime_error("Failed to create the BLAS compaction query pool.");
+        }
+        m_compactionQueryCapacity = count;
+    }
+
+    void destroyCompactionQueryPool()
+    {
+        if (m_compactionQueryPool != VK_NULL_HANDLE)
+        {
+            vkDestroyQueryPool(VulkanContext::device, m_compactionQueryPool, nullptr);
+            m_compactionQueryPool = VK_NULL_HANDLE;
+        }
+        m_compactionQueryCapacity = 0;
+    }
+
+    VkAabbPositionsKHR getWorldBounds(uint32_t slot) const
+    {
+        const BLAS& blas = m_blases[m_instanceTable.getBlas(slot)];
+
+        glm::vec3 min;
+        glm::vec3 max;
+        transformBounds(m_instanceTable.getInstance(slot).transform, blas.getBoundsMin(), blas.getBoundsMax(), min, max);
+        return { min.x, min.y, min.z, max.x, max.y, max.z };
+    }
+
+    // The TLAS just built is the new reference for its quality
+    void rebuildQualityTree()
+    {
+        m_tlasQuality.reset(m_builtInstanceIndices, m_instanceTable.getSlotCount(), m_instanceBounds);
+    }
+
+    // Axis-aligned bounds of the transformed box (Arvo)
+    static void transformBounds(const VkTransformMatrixKHR& transform, const glm::vec3& min, const glm::vec3& max, glm::vec3& outMin, glm::vec3& outMax)
+    {
+        const glm::vec3 center = (min + max) * 0.5f;
+        const glm::vec3 extent = (max - min) * 0.5f;
+        for (int32_t row = 0; row < 3; ++row)
+        {
+            const float* m = transform.matrix[row];
+            const float c = m[0] * center.x + m[1] * center.y + m[2] * center.z + m[3];
+            const float e = std::abs(m[0]) * extent.x + std::abs(m[1]) * extent.y + std::abs(m[2]) * extent.z;
+            outMin[row] = c - e;
+            outMax[row] = c + e;
+        }
+    }
+
+    // Destroyed BLASes keep their index until a new one takes it
     std::vector<BLAS> m_blases;
-    std::vector<VkAccelerationStructureInstanceKHR> m_instances;
+    std::vector<BlasIndex> m_freeBlasIndices;
+    BlasCache m_blasCache;
+    std::vector<BlasIndex> m_releasedBlases;
+
+    // Compaction: the originals of swapped BLASes until they retire, by BLAS index, and the
+    // compacted size queries of addBlases
+    bool m_compactionEnabled = false;
+    BlasCompaction m_blasCompaction;
+    std::vector<BLAS> m_compactionOriginals;
+    std::vector<BlasIndex> m_retiredOriginals;
+    std::vector<BlasCompactionCopy> m_compactionCopies;
+    VkQueryPool m_compactionQueryPool = VK_NULL_HANDLE;
+    uint32_t m_compactionQueryCapacity = 0;
+    bool m_blasReferencesChanged = false;
+
+    // Block of addBlasStreamed between the producer and the upload memory
+    std::vector<VkAabbPositionsKHR> m_streamBlock;
+
+    // Scratch memory shared by the builds of addBlases
+    ScratchBuffer m_scratchArena;
+    VkDeviceSize m_scratchArenaSize = 0;
+    BlasBatchStats m_lastBatchStats;
+    InstanceTable m_instanceTable;
     TLAS m_tlas;
 
+    // Slots that go into the next build, in slot order, and the ones in the current TLAS
+    std::vector<uint32_t> m_visibleInstanceIndices;
+    std::vector<uint32_t> m_builtInstanceIndices;
+    bool m_instancesCulled = false;
+
+    // What the instance buffer holds: the built instances in order, the position of every slot in
+    // it (INVALID_SLOT if culled) and the layout version of the table it was built from
+    std::vector<VkAccelerationStructureInstanceKHR> m_uploadedInstances;
+    std::vector<uint32_t> m_builtPositions;
+    uint64_t m_builtLayoutVersion = 0;
+    std::vector<InstanceRange> m_dirtyRanges;
+    uint32_t m_uploadedInstanceCount = 0;
+
+    // Refit or rebuild, from the world bounds of the live instances
+    TlasQuality m_tlasQuality;
+    const InstanceBoundsFunction m_instanceBounds = [this](uint32_t slot, VkAabbPositionsKHR& bounds)
+    {
+        if (!m_instanceTable.isLive(slot))
+        {
+            return false;
+        }
+        bounds = getWorldBounds(slot);
+        return true;
+    };
+
     uint64_t primitiveUniqueIndexCounter = 0;
 };
 
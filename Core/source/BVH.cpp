@@ -0,0 +1,811 @@
+#include "BVH.h"
+#include "Timer.h"
+#include "DebugUtils.h"
+
+#include <array>
+#include <deque>
+#include <bit>
+
+struct BVH::PrimitiveRef
+{
+    glm::vec3 boundsMin;
+    uint32_t index;
+    glm::vec3 boundsMax;
+    uint32_t padding;
+
+    // Twice the centroid, binning only needs the relative position
+    glm::vec3 centroid2() const { return boundsMin + boundsMax; }
+};
+
+namespace
+{
+    constexpr uint32_t BINNING_BLOCK_SIZE = 1u << 16;
+
+    struct Bounds
+    {
+        glm::vec3 min{ std::numeric_limits<float>::max() };
+        glm::vec3 max{ -std::numeric_limits<float>::max() };
+
+        void grow(const glm::vec3& point)
+        {
+            min = glm::min(min, point);
+            max = glm::max(max, point);
+        }
+
+        void grow(const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+        {
+            min = glm::min(min, boundsMin);
+            max = glm::max(max, boundsMax);
+        }
+
+        void grow(const Bounds& other)
+        {
+            grow(other.min, other.max);
+        }
+
+        float surfaceArea() const
+        {
+            const glm::vec3 extent = glm::max(max - min, glm::vec3(0.0f));
+            return 2.0f * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+        }
+    };
+
+    struct Bin
+    {
+        Bounds bounds;
+        uint32_t count = 0;
+    };
+
+    using AxisBins = std::array<std::array<Bin, BVH::MAX_BINS>, 3>;
+
+    float surfaceArea(const BVHNode& node)
+    {
+        Bounds bounds;
+        bounds.grow(node.boundsMin, node.boundsMax);
+        return bounds.surfaceArea();
+    }
+
+    void setLeaf(BVHNode& node, const Bounds& bounds, uint32_t first, uint32_t count)
+    {
+        node.boundsMin = bounds.min;
+        node.boundsMax = bounds.max;
+        node.leftFirst = first;
+        node.primitiveCount = count;
+    }
+
+    // Runs func(begin, end, block) over fixed-size blocks of [0, count), on the pool if there is one
+    template<typename Func>
+    void forEachBlock(ThreadPool* threadPool, uint32_t count, Func&& func)
+    {
+        const uint32_t blockCount = (count + BINNING_BLOCK_SIZE - 1) / BINNING_BLOCK_SIZE;
+        auto runBlock = [&](uint32_t block)
+        {
+            const uint32_t begin = block * BINNING_BLOCK_SIZE;
+            func(begin, std::min(count, begin + BINNING_BLOCK_SIZE), block);
+        };
+
+        if (threadPool != nullptr && blockCount > 1)
+        {
+            threadPool->parallelFor(blockCount, runBlock);
+        }
+        else
+        {
+            for (uint32_t block = 0; block < blockCount; ++block)
+            {
+                runBlock(block);
+            }
+        }
+    }
+}
+
+void BVH::build(const VkAabbPositionsKHR* aabbs, uint32_t count, const BVHBuildSettings& settings, ThreadPool& threadPool)
+{
+    clear();
+    if (aabbs == nullptr || count == 0)
+    {
+        return;
+    }
+
+    Timer timer;
+    timer.start();
+
+    BuildContext context;
+    context.settings = settings;
+    context.settings.binCount = std::clamp(settings.binCount, 2u, MAX_BINS);
+    context.settings.maxLeafSize = std::max(settings.maxLeafSize, 1u);
+    context.threadPool = &threadPool;
+
+    std::vector<PrimitiveRef> refs(count);
+    context.refs = refs.data();
+
+    const uint32_t blockCount = (count + BINNING_BLOCK_SIZE - 1) / BINNING_BLOCK_SIZE;
+    std::vector<Bounds> blockBounds(blockCount);
+    forEachBlock(&threadPool, count, [&](uint32_t begin, uint32_t end, uint32_t block)
+    {
+        for (uint32_t i = begin; i < end; ++i)
+        {
+            const VkAabbPositionsKHR& aabb = aabbs[i];
+            refs[i] = { glm::vec3(aabb.minX, aabb.minY, aabb.minZ), i, glm::vec3(aabb.maxX, aabb.maxY, aabb.maxZ), 0 };
+            blockBounds[block].grow(refs[i].boundsMin, refs[i].boundsMax);
+        }
+    });
+
+    Bounds rootBounds;
+    for (const Bounds& bounds : blockBounds)
+    {
+        rootBounds.grow(bounds);
+    }
+
+    m_nodes.resize(2 * static_cast<size_t>(count) - 1);
+    setLeaf(m_nodes[0], rootBounds, 0, count);
+    context.nodeCount = 1;
+
+    // Upper levels on this thread, splitting with parallel binning until the nodes are small
+    // enough to be built as independent subtrees
+    struct Subtree
+    {
+        uint32_t node;
+        uint32_t depth;
+    };
+
+    std::vector<Subtree> subtrees;
+    std::deque<Subtree> queue{ { 0, 0 } };
+    while (!queue.empty())
+    {
+        const Subtree task = queue.front();
+        queue.pop_front();
+
+        BVHNode& node = m_nodes[task.node];
+        if (node.primitiveCount < context.settings.parallelThreshold)
+        {
+            subtrees.push_back(task);
+        }
+        else if (splitNode(context, node, task.depth, true))
+        {
+            queue.push_back({ node.leftFirst, task.depth + 1 });
+            queue.push_back({ node.leftFirst + 1, task.depth + 1 });
+        }
+    }
+
+    // Largest subtrees first, so the pool doesn't end up waiting on one big straggler
+    std::sort(subtrees.begin(), subtrees.end(), [this](const Subtree& a, const Subtree& b)
+    {
+        return m_nodes[a.node].primitiveCount > m_nodes[b.node].primitiveCount;
+    });
+
+    threadPool.parallelFor(static_cast<uint32_t>(subtrees.size()), [&](uint32_t i)
+    {
+        buildSubtree(context, subtrees[i].node, subtrees[i].depth);
+    });
+
+    m_nodes.resize(context.nodeCount.load());
+
+    m_primitiveIndices.resize(count);
+    forEachBlock(&threadPool, count, [&](uint32_t begin, uint32_t end, uint32_t)
+    {
+        for (uint32_t i = begin; i < end; ++i)
+        {
+            m_primitiveIndices[i] = refs[i].index;
+        }
+    });
+
+    timer.stop();
+    computeStats(context.settings);
+    m_stats.buildMilliseconds = timer.elapsedTime<std::chrono::microseconds>() / 1000.0;
+}
+
+void BVH::clear()
+{
+    m_nodes.clear();
+    m_nodes.shrink_to_fit();
+    m_primitiveIndices.clear();
+    m_primitiveIndices.shrink_to_fit();
+    m_parents.clear();
+    m_parents.shrink_to_fit();
+    m_refitArrivals.clear();
+    m_refitArrivals.shrink_to_fit();
+    m_stats = {};
+}
+
+namespace
+{
+    constexpr uint32_t RADIX_BITS = 8;
+    constexpr uint32_t REFIT_PREFETCH_DISTANCE = 16;
+    constexpr uint32_t RADIX_SIZE = 1u << RADIX_BITS;
+
+    // Spreads the low 10 bits so there are two zero bits between each
+    uint32_t expandBits(uint32_t value)
+    {
+        value &= 0x3FFu;
+        value = (value | (value << 16)) & 0x030000FFu;
+        value = (value | (value << 8)) & 0x0300F00Fu;
+        value = (value | (value << 4)) & 0x030C30C3u;
+        value = (value | (value << 2)) & 0x09249249u;
+        return value;
+    }
+
+    // Same for the low 21 bits
+    uint64_t expandBits(uint64_t value)
+    {
+        value &= 0x1FFFFFull;
+        value = (value | (value << 32)) & 0x001F00000000FFFFull;
+        value = (value | (value << 16)) & 0x001F0000FF0000FFull;
+        value = (value | (value << 8)) & 0x100F00F00F00F00Full;
+        value = (value | (value << 4)) & 0x10C30C30C30C30C3ull;
+        value = (value | (value << 2)) & 0x1249249249249249ull;
+        return value;
+    }
+
+    // Stable LSD radix sort of keys with their values, 8 bits per pass. Every block counts its digits,
+    // the counts are turned into per-block offsets, then every block scatters its keys in order.
+    template<typename Key>
+    void radixSort(std::vector<Key>& keys, std::vector<uint32_t>& values, uint32_t keyBits, ThreadPool& threadPool)
+    {
+        const uint32_t count = static_cast<uint32_t>(keys.size());
+        const uint32_t blockCount = (count + BINNING_BLOCK_SIZE - 1) / BINNING_BLOCK_SIZE;
+        std::vector<Key> keysOut(count);
+        std::vector<uint32_t> valuesOut(count);
+        std::vector<uint32_t> offsets(static_cast<size_t>(blockCount) * RADIX_SIZE);
+
+        for (uint32_t shift = 0; shift < keyBits; shift += RADIX_BITS)
+        {
+            forEachBlock(&threadPool, count, [&](uint32_t begin, uint32_t end, uint32_t block)
+            {
+                uint32_t* histogram = offsets.data() + static_cast<size_t>(block) * RADIX_SIZE;
+                std::fill(histogram, histogram + RADIX_SIZE, 0u);
+                for (uint32_t i = begin; i < end; ++i)
+                {
+                    histogram[(keys[i] >> shift) & (RADIX_SIZE - 1)]++;
+                }
+            });
+
+            // A digit every key shares doesn't reorder anything
+            bool sameDigit = false;
+            uint32_t running = 0;
+            for (uint32_t digit = 0; digit < RADIX_SIZE && !sameDigit; ++digit)
+            {
+                const uint32_t digitStart = running;
+                for (uint32_t block = 0; block < blockCount; ++block)
+                {
+                    uint32_t& offset = offsets[static_cast<size_t>(block) * RADIX_SIZE + digit];
+                    const uint32_t digitCount = offset;
+                    offset = running;
+                    running += digitCount;
+                }
+                sameDigit = running - digitStart == count;
+            }
+            if (sameDigit)
+            {
+                continue;
+            }
+
+            forEachBlock(&threadPool, count, [&](uint32_t begin, uint32_t end, uint32_t block)
+            {
+                uint32_t* blockOffsets = offsets.data() + static_cast<size_t>(block) * RADIX_SIZE;
+                for (uint32_t i = begin; i < end; ++i)
+                {
+                    const uint32_t target = blockOffsets[(keys[i] >> shift) & (RADIX_SIZE - 1)]++;
+                    keysOut[target] = keys[i];
+                    valuesOut[target] = values[i];
+                }
+            });
+            keys.swap(keysOut);
+            values.swap(valuesOut);
+        }
+    }
+
+    // Karras 2012: internal node i covers a range of sorted codes starting or ending at i, found from
+    // the common prefix lengths of its neighbours, and splits it where the prefix gets longer.
+    // Internal nodes and leaves are numbered by position, an internal node splitting at gamma has
+    // gamma and gamma + 1 as children. Both children of the node splitting at gamma are stored at
+    // 2 * gamma + 1 and 2 * gamma + 2, so an internal node ending its range at i is at 2 * i + 1 and
+    // one starting at i at 2 * i, and every node knows its own slot without any allocation.
+    template<typename Code>
+    void emitHierarchy(const std::vector<Code>& codes, BVHNode* nodes, uint32_t* parents, ThreadPool& threadPool)
+    {
+        const int64_t count = static_cast<int64_t>(codes.size());
+        auto prefixLength = [&](int64_t i, int64_t j) -> int
+        {
+            if (j < 0 || j >= count)
+            {
+                return -1;
+            }
+            const Code difference = codes[i] ^ codes[j];
+            if (difference != 0)
+            {
+                return std::countl_zero(difference);
+            }
+            // Duplicate codes are told apart by their position
+            return static_cast<int>(sizeof(Code) * 8) + std::countl_zero(static_cast<uint32_t>(i ^ j));
+        };
+
+        forEachBlock(&threadPool, static_cast<uint32_t>(count - 1), [&](uint32_t begin, uint32_t end, uint32_t)
+        {
+            for (int64_t i = begin; i < end; ++i)
+            {
+                const int64_t direction = prefixLength(i, i + 1) >= prefixLength(i, i - 1) ? 1 : -1;
+                const int minimumPrefix = prefixLength(i, i - direction);
+
+                int64_t lengthBound = 2;
+                while (prefixLength(i, i + lengthBound * direction) > minimumPrefix)
+                {
+                    lengthBound *= 2;
+                }
+                int64_t length = 0;
+                for (int64_t step = lengthBound / 2; step >= 1; step /= 2)
+                {
+                    if (prefixLength(i, i + (length + step) * direction) > minimumPrefix)
+                    {
+                        length += step;
+                    }
+                }
+                const int64_t other = i + length * direction;
+
+                const int nodePrefix = prefixLength(i, other);
+                int64_t split = 0;
+                int64_t step = length;
+                do
+                {
+                    step = (step + 1) / 2;
+                    if (prefixLength(i, i + (split + step) * direction) > nodePrefix)
+                    {
+                        split += step;
+                    }
+                } while (step > 1);
+                const int64_t gamma = i + split * direction + std::min<int64_t>(direction, 0);
+
+                const uint32_t slot = static_cast<uint32_t>(direction > 0 ? 2 * i : 2 * i + 1);
+                const uint32_t left = static_cast<uint32_t>(2 * gamma + 1);
+                nodes[slot].leftFirst = left;
+                nodes[slot].primitiveCount = 0;
+                parents[left] = slot;
+                parents[left + 1] = slot;
+
+                if (std::min(i, other) == gamma)
+                {
+                    nodes[left].leftFirst = static_cast<uint32_t>(gamma);
+                    nodes[left].primitiveCount = 1;
+                }
+                if (std::max(i, other) == gamma + 1)
+                {
+                    nodes[left + 1].leftFirst = static_cast<uint32_t>(gamma + 1);
+                    nodes[left + 1].primitiveCount = 1;
+                }
+            }
+        });
+    }
+
+    template<typename Code>
+    void computeMortonCodes(const VkAabbPositionsKHR* aabbs, uint32_t count, uint32_t bitsPerAxis, std::vector<Code>& codes, ThreadPool& threadPool)
+    {
+        const uint32_t blockCount = (count + BINNING_BLOCK_SIZE - 1) / BINNING_BLOCK_SIZE;
+        std::vector<Bounds> blockBounds(blockCount);
+        forEachBlock(&threadPool, count, [&](uint32_t begin, uint32_t end, uint32_t block)
+        {
+            for (uint32_t i = begin; i < end; ++i)
+            {
+                const VkAabbPositionsKHR& aabb = aabbs[i];
+                blockBounds[block].grow(glm::vec3(aabb.minX + aabb.maxX, aabb.minY + aabb.maxY, aabb.minZ + aabb.maxZ));
+            }
+        });
+
+        Bounds centroidBounds;
+        for (const Bounds& bounds : blockBounds)
+        {
+            centroidBounds.grow(bounds);
+        }
+
+        const float cells = static_cast<float>((1u << bitsPerAxis) - 1);
+        const glm::vec3 extent = centroidBounds.max - centroidBounds.min;
+        const glm::vec3 scale = glm::vec3(
+            extent.x > 0.0f ? cells / extent.x : 0.0f,
+            extent.y > 0.0f ? cells / extent.y : 0.0f,
+            extent.z > 0.0f ? cells / extent.z : 0.0f);
+
+        codes.resize(count);
+        forEachBlock(&threadPool, count, [&](uint32_t begin, uint32_t end, uint32_t)
+        {
+            for (uint32_t i = begin; i < end; ++i)
+            {
+                const VkAabbPositionsKHR& aabb = aabbs[i];
+                const glm::vec3 centroid2(aabb.minX + aabb.maxX, aabb.minY + aabb.maxY, aabb.minZ + aabb.maxZ);
+                const glm::vec3 cell = glm::clamp((centroid2 - centroidBounds.min) * scale, glm::vec3(0.0f), glm::vec3(cells));
+                codes[i] = (expandBits(static_cast<Code>(cell.x)) << 2) | (expandBits(static_cast<Code>(cell.y)) << 1) | expandBits(static_cast<Code>(cell.z));
+            }
+        });
+    }
+
+    template<typename Code>
+    void buildLinearHierarchy(const VkAabbPositionsKHR* aabbs, uint32_t count, uint32_t bitsPerAxis,
+        std::vector<BVHNode>& nodes, std::vector<uint32_t>& primitiveIndices, std::vector<uint32_t>& parents, ThreadPool& threadPool)
+    {
+        std::vector<Code> codes;
+        computeMortonCodes(aabbs, count, bitsPerAxis, codes, threadPool);
+
+        primitiveIndices.resize(count);
+        forEachBlock(&threadPool, count, [&](uint32_t begin, uint32_t end, uint32_t)
+        {
+            for (uint32_t i = begin; i < end; ++i)
+            {
+                primitiveIndices[i] = i;
+            }
+        });
+        radixSort(codes, primitiveIndices, bitsPerAxis * 3, threadPool);
+
+        nodes.resize(2 * static_cast<size_t>(count) - 1);
+        parents.resize(nodes.size());
+        parents[0] = BVH::NO_PARENT;
+        if (count == 1)
+        {
+            nodes[0].leftFirst = 0;
+            nodes[0].primitiveCount = 1;
+            return;
+        }
+        emitHierarchy(codes, nodes.data(), parents.data(), threadPool);
+    }
+}
+
+void BVH::buildLinear(const VkAabbPositionsKHR* aabbs, uint32_t count, const LBVHBuildSettings& settings, ThreadPool& threadPool)
+{
+    if (aabbs == nullptr || count == 0)
+    {
+        clear();
+        return;
+    }
+
+    // Every node is written by the build, so the storage of the previous one is kept and
+    // per-frame rebuilds don't have to fault in fresh pages
+    m_stats = {};
+
+    Timer timer;
+    timer.start();
+
+    if (settings.mortonBits > 30)
+    {
+        buildLinearHierarchy<uint64_t>(aabbs, count, 21, m_nodes, m_primitiveIndices, m_parents, threadPool);
+    }
+    else
+    {
+        buildLinearHierarchy<uint32_t>(aabbs, count, 10, m_nodes, m_primitiveIndices, m_parents, threadPool);
+    }
+    refit(aabbs, count, threadPool);
+
+    timer.stop();
+    computeStats(BVHBuildSettings{});
+    m_stats.buildMilliseconds = timer.elapsedTime<std::chrono::microseconds>() / 1000.0;
+
+    // Only pathological clustering gets here, the traversal stack can't hold the tree
+    if (m_stats.maxDepth > MAX_DEPTH)
+    {
+        LOG_ERROR("BVH: linear build is " << m_stats.maxDepth << " levels deep, falling back to the SAH build");
+        build(aabbs, count, BVHBuildSettings{}, threadPool);
+    }
+}
+
+void BVH::refit(const VkAabbPositionsKHR* aabbs, uint32_t count, ThreadPool& threadPool)
+{
+    if (m_nodes.empty() || aabbs == nullptr || count != m_primitiveIndices.size())
+    {
+        LOG_ERROR("BVH: refit with " << count << " primitives for a tree over " << m_primitiveIndices.size());
+        return;
+    }
+
+    Timer timer;
+    timer.start();
+
+    if (m_parents.size() != m_nodes.size())
+    {
+        computeParents();
+    }
+
+    // Every leaf walks up its path, the second child to arrive at a node computes its bounds and
+    // continues, so each node is written once, after both children
+    m_refitArrivals.assign(m_nodes.size(), 0);
+    forEachBlock(&threadPool, static_cast<uint32_t>(m_nodes.size()), [&](uint32_t begin, uint32_t end, uint32_t)
+    {
+        for (uint32_t index = begin; index < end; ++index)
+        {
+            // The AABBs are read in tree order, which is random order in memory
+            if (index + REFIT_PREFETCH_DISTANCE < end && m_nodes[index + REFIT_PREFETCH_DISTANCE].isLeaf())
+            {
+                const uint32_t primitive = m_primitiveIndices[m_nodes[index + REFIT_PREFETCH_DISTANCE].leftFirst];
+                _mm_prefetch(reinterpret_cast<const char*>(aabbs + primitive), _MM_HINT_T0);
+            }
+
+            BVHNode& leaf = m_nodes[index];
+            if (!leaf.isLeaf())
+            {
+                continue;
+            }
+
+            Bounds bounds;
+            for (uint32_t i = leaf.leftFirst; i < leaf.leftFirst + leaf.primitiveCount; ++i)
+            {
+                const VkAabbPositionsKHR& aabb = aabbs[m_primitiveIndices[i]];
+                bounds.grow(glm::vec3(aabb.minX, aabb.minY, aabb.minZ), glm::vec3(aabb.maxX, aabb.maxY, aabb.maxZ));
+            }
+            leaf.boundsMin = bounds.min;
+            leaf.boundsMax = bounds.max;
+
+            uint32_t parent = m_parents[index];
+            while (parent != NO_PARENT && std::atomic_ref<uint32_t>(m_refitArrivals[parent]).fetch_add(1, std::memory_order_acq_rel) == 1)
+            {
+                BVHNode& node = m_nodes[parent];
+                const BVHNode& left = m_nodes[node.leftFirst];
+                const BVHNode& right = m_nodes[node.leftFirst + 1];
+                node.boundsMin = glm::min(left.boundsMin, right.boundsMin);
+                node.boundsMax = glm::max(left.boundsMax, right.boundsMax);
+                parent = m_parents[parent];
+            }
+        }
+    });
+
+    timer.stop();
+    m_stats.refitMilliseconds = timer.elapsedTime<std::chrono::microseconds>() / 1000.0;
+}
+
+void BVH::computeParents()
+{
+    m_parents.assign(m_nodes.size(), NO_PARENT);
+    for (uint32_t index = 0; index < m_nodes.size(); ++index)
+    {
+        const BVHNode& node = m_nodes[index];
+        if (!node.isLeaf())
+        {
+            m_parents[node.leftFirst] = index;
+            m_parents[node.leftFirst + 1] = index;
+        }
+    }
+}
+
+bool BVH::splitNode(BuildContext& context, BVHNode& node, uint32_t depth, bool parallelBinning)
+{
+    const BVHBuildSettings& settings = context.settings;
+    const uint32_t first = node.leftFirst;
+    const uint32_t count = node.primitiveCount;
+    if (count <= 1 || depth + 1 >= MAX_DEPTH)
+    {
+        return false;
+    }
+
+    PrimitiveRef* refs = context.refs + first;
+    ThreadPool* threadPool = parallelBinning ? context.threadPool : nullptr;
+    const uint32_t blockCount = (count + BINNING_BLOCK_SIZE - 1) / BINNING_BLOCK_SIZE;
+    const bool parallel = threadPool != nullptr && blockCount > 1;
+
+    // Centroid bounds decide the bin layout
+    auto growCentroids = [refs](uint32_t begin, uint32_t end, Bounds& bounds)
+    {
+        for (uint32_t i = begin; i < end; ++i)
+        {
+            bounds.grow(refs[i].centroid2());
+        }
+    };
+
+    Bounds centroidBounds;
+    if (parallel)
+    {
+        std::vector<Bounds> blockCentroids(blockCount);
+        forEachBlock(threadPool, count, [&](uint32_t begin, uint32_t end, uint32_t block)
+        {
+            growCentroids(begin, end, blockCentroids[block]);
+        });
+        for (const Bounds& bounds : blockCentroids)
+        {
+            centroidBounds.grow(bounds);
+        }
+    }
+    else
+    {
+        growCentroids(0, count, centroidBounds);
+    }
+
+    // Small nodes don't need more bins than primitives, most nodes are small
+    const uint32_t binCount = std::min(settings.binCount, std::max(count, 4u));
+    const glm::vec3 extent = centroidBounds.max - centroidBounds.min;
+    const glm::vec3 scale = glm::vec3(
+        extent.x > 0.0f ? binCount / extent.x : 0.0f,
+        extent.y > 0.0f ? binCount / extent.y : 0.0f,
+        extent.z > 0.0f ? binCount / extent.z : 0.0f);
+
+    auto binOf = [&](const glm::vec3& centroid2)
+    {
+        const glm::uvec3 bin = glm::uvec3((centroid2 - centroidBounds.min) * scale);
+        return glm::min(bin, glm::uvec3(binCount - 1));
+    };
+
+    auto binRange = [&](uint32_t begin, uint32_t end, AxisBins& bins)
+    {
+        for (uint32_t i = begin; i < end; ++i)
+        {
+            const PrimitiveRef& ref = refs[i];
+            const glm::uvec3 bin = binOf(ref.centroid2());
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                Bin& target = bins[axis][bin[axis]];
+                target.bounds.grow(ref.boundsMin, ref.boundsMax);
+                target.count++;
+            }
+        }
+    };
+
+    AxisBins bins;
+    if (parallel)
+    {
+        std::vector<AxisBins> blockBins(blockCount);
+        forEachBlock(threadPool, count, [&](uint32_t begin, uint32_t end, uint32_t block)
+        {
+            binRange(begin, end, blockBins[block]);
+        });
+
+        for (const AxisBins& block : blockBins)
+        {
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                for (uint32_t b = 0; b < binCount; ++b)
+                {
+                    bins[axis][b].bounds.grow(block[axis][b].bounds);
+                    bins[axis][b].count += block[axis][b].count;
+                }
+            }
+        }
+    }
+    else
+    {
+        binRange(0, count, bins);
+    }
+
+    // Sweep the bin boundaries of every axis, split i puts bins [0, i) on the left
+    const float inverseArea = 1.0f / std::max(surfaceArea(node), std::numeric_limits<float>::min());
+    float bestCost = std::numeric_limits<float>::max();
+    int bestAxis = -1;
+    uint32_t bestSplit = 0;
+    Bounds bestLeft;
+    Bounds bestRight;
+    for (int axis = 0; axis < 3; ++axis)
+    {
+        if (scale[axis] == 0.0f)
+        {
+            continue;
+        }
+
+        std::array<Bounds, MAX_BINS> rightBounds;
+        std::array<uint32_t, MAX_BINS> rightCounts;
+        Bounds accumulated;
+        uint32_t accumulatedCount = 0;
+        for (uint32_t b = binCount - 1; b > 0; --b)
+        {
+            accumulated.grow(bins[axis][b].bounds);
+            accumulatedCount += bins[axis][b].count;
+            rightBounds[b] = accumulated;
+            rightCounts[b] = accumulatedCount;
+        }
+
+        Bounds left;
+        uint32_t leftCount = 0;
+        for (uint32_t split = 1; split < binCount; ++split)
+        {
+            left.grow(bins[axis][split - 1].bounds);
+            leftCount += bins[axis][split - 1].count;
+            if (leftCount == 0 || rightCounts[split] == 0)
+            {
+                continue;
+            }
+
+            const float cost = settings.traversalCost + settings.intersectionCost * inverseArea *
+                (left.surfaceArea() * leftCount + rightBounds[split].surfaceArea() * rightCounts[split]);
+            if (cost < bestCost)
+            {
+                bestCost = cost;
+                bestAxis = axis;
+                bestSplit = split;
+                bestLeft = left;
+                bestRight = rightBounds[split];
+            }
+        }
+    }
+
+    const float leafCost = settings.intersectionCost * count;
+    if (count <= settings.maxLeafSize && (bestAxis < 0 || bestCost >= leafCost))
+    {
+        return false;
+    }
+
+    uint32_t leftCount = 0;
+    if (bestAxis >= 0)
+    {
+        PrimitiveRef* middle = std::partition(refs, refs + count, [&](const PrimitiveRef& ref)
+        {
+            return binOf(ref.centroid2())[bestAxis] < bestSplit;
+        });
+        leftCount = static_cast<uint32_t>(middle - refs);
+    }
+    else
+    {
+        // Every centroid is the same point, halve the range
+        leftCount = count / 2;
+        bestLeft = Bounds();
+        bestRight = Bounds();
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            (i < leftCount ? bestLeft : bestRight).grow(refs[i].boundsMin, refs[i].boundsMax);
+        }
+    }
+
+    const uint32_t left = context.nodeCount.fetch_add(2, std::memory_order_relaxed);
+    setLeaf(m_nodes[left], bestLeft, first, leftCount);
+    setLeaf(m_nodes[left + 1], bestRight, first + leftCount, count - leftCount);
+    node.leftFirst = left;
+    node.primitiveCount = 0;
+    return true;
+}
+
+void BVH::buildSubtree(BuildContext& context, uint32_t root, uint32_t depth)
+{
+    struct Pending
+    {
+        uint32_t node;
+        uint32_t depth;
+    };
+
+    // Depth first, so children are allocated close to their parent
+    std::vector<Pending> stack{ { root, depth } };
+    while (!stack.empty())
+    {
+        const Pending pending = stack.back();
+        stack.pop_back();
+
+        BVHNode& node = m_nodes[pending.node];
+        if (splitNode(context, node, pending.depth, false))
+        {
+            stack.push_back({ node.leftFirst + 1, pending.depth + 1 });
+            stack.push_back({ node.leftFirst, pending.depth + 1 });
+        }
+    }
+}
+
+float BVH::computeSahCost(const BVHBuildSettings& settings) const
+{
+    if (m_nodes.empty())
+    {
+        return 0.0f;
+    }
+
+    const float inverseRootArea = 1.0f / std::max(surfaceArea(m_nodes[0]), std::numeric_limits<float>::min());
+    double cost = 0.0;
+    for (const BVHNode& node : m_nodes)
+    {
+        const double area = surfaceArea(node) * inverseRootArea;
+        cost += area * (node.isLeaf() ? settings.intersectionCost * node.primitiveCount : settings.traversalCost);
+    }
+    return static_cast<float>(cost);
+}
+
+void BVH::computeStats(const BVHBuildSettings& settings)
+{
+    m_stats = {};
+    m_stats.primitiveCount = static_cast<uint32_t>(m_primitiveIndices.size());
+    m_stats.nodeCount = static_cast<uint32_t>(m_nodes.size());
+    m_stats.sahCost = computeSahCost(settings);
+
+    std::vector<std::pair<uint32_t, uint32_t>> stack{ { 0, 1 } };
+    while (!stack.empty())
+    {
+        const auto [index, depth] = stack.back();
+        stack.pop_back();
+
+        const BVHNode& node = m_nodes[index];
+        m_stats.maxDepth = std::max(m_stats.maxDepth, depth);
+        if (node.isLeaf())
+        {
+            m_stats.leafCount++;
+            m_stats.maxLeafSize = std::max(m_stats.maxLeafSize, node.primitiveCount);
+            continue;
+        }
+
+        stack.push_back({ node.leftFirst, depth + 1 });
+        stack.push_back({ node.leftFirst + 1, depth + 1 });
+    }
+
+    m_stats.averageLeafSize = m_stats.leafCount > 0 ? static_cast<float>(m_stats.primitiveCount) / m_stats.leafCount : 0.0f;
+}
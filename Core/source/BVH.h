@@ -0,0 +1,330 @@
+#pragma once
+
+#include "vulkan/vulkan.h"
+#include "glm/glm.hpp"
+
+#include "Multithreading.h"
+
+#include <immintrin.h>
+
+#include <cstdint>
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include <atomic>
+#include <cmath>
+#include <bit>
+
+struct BVHNode
+{
+    glm::vec3 boundsMin{ 0.0f };
+    uint32_t leftFirst = 0;         // Left child for interior nodes (the right one follows it), first primitive for leaves
+    glm::vec3 boundsMax{ 0.0f };
+    uint32_t primitiveCount = 0;    // 0 for interior nodes
+
+    bool isLeaf() const { return primitiveCount != 0; }
+};
+static_assert(sizeof(BVHNode) == 32, "BVHNode is meant to fill half a cache line");
+
+// Eight rays traced together in SoA layout. Lanes without a ray get tMax below zero and never hit.
+struct BVHRayPacket
+{
+    static constexpr uint32_t SIZE = 8;
+
+    alignas(32) float originX[SIZE];
+    alignas(32) float originY[SIZE];
+    alignas(32) float originZ[SIZE];
+    alignas(32) float directionX[SIZE];
+    alignas(32) float directionY[SIZE];
+    alignas(32) float directionZ[SIZE];
+    alignas(32) float inverseX[SIZE];
+    alignas(32) float inverseY[SIZE];
+    alignas(32) float inverseZ[SIZE];
+    alignas(32) float tMax[SIZE];
+    uint32_t primitive[SIZE];
+};
+
+struct BVHBuildSettings
+{
+    uint32_t binCount = 16;                 // Per axis, at most MAX_BINS
+    uint32_t maxLeafSize = 4;               // Larger leaves are always split
+    float traversalCost = 1.0f;             // SAH cost of visiting a node, relative to intersectionCost
+    float intersectionCost = 1.0f;
+    uint32_t parallelThreshold = 1u << 14;  // Subtrees at least this large are handed to other threads
+};
+
+struct LBVHBuildSettings
+{
+    uint32_t mortonBits = 30;               // 30 (10 per axis, 32-bit codes) or 63 (21 per axis, 64-bit codes)
+};
+
+struct BVHStats
+{
+    uint32_t primitiveCount = 0;
+    uint32_t nodeCount = 0;
+    uint32_t leafCount = 0;
+    uint32_t maxDepth = 0;
+    uint32_t maxLeafSize = 0;
+    float averageLeafSize = 0.0f;
+    float sahCost = 0.0f;           // Expected cost of a random ray hitting the root, in BVHBuildSettings units
+    double buildMilliseconds = 0.0;
+    double refitMilliseconds = 0.0;
+};
+
+// CPU bounding volume hierarchy over the same AABB arrays handed to BLAS::init.
+//
+// Built top-down with binned SAH: the centroids of a node are binned along all three axes and the
+// cheapest bin boundary is taken, or a leaf if splitting doesn't pay. The upper levels are split on
+// the calling thread with parallel binning, the subtrees below them are built concurrently on the
+// thread pool. Nodes live in one flat array with siblings next to each other, node 0 is the root.
+// The array is sized for the worst case of 2N - 1 nodes up front, so a build over N primitives
+// holds 64 bytes per primitive for the nodes and another 32 for sorting while it runs.
+//
+// buildLinear is the fast alternative for geometry that moves every frame: an LBVH that sorts the
+// primitive centroids along a Morton curve with a parallel radix sort and emits the hierarchy from
+// the sorted codes (Karras 2012), every internal node independently. Leaves hold one primitive
+// and the tree is worse than the SAH one, but the build is a few linear passes. refit keeps the
+// topology of either tree and recomputes its bounds bottom-up from moved AABBs.
+//
+// Use it for CPU ray queries against the scene the GPU traces and to measure tree quality
+// (getStats) without a device.
+class BVH
+{
+public:
+    static constexpr uint32_t MAX_BINS = 32;
+    static constexpr uint32_t MAX_DEPTH = 64; // Traversal stack size, nodes this deep become leaves
+    static constexpr uint32_t NO_PARENT = std::numeric_limits<uint32_t>::max();
+
+    void build(const VkAabbPositionsKHR* aabbs, uint32_t count, const BVHBuildSettings& settings = {}, ThreadPool& threadPool = ThreadPool::getInstance());
+    void buildLinear(const VkAabbPositionsKHR* aabbs, uint32_t count, const LBVHBuildSettings& settings = {}, ThreadPool& threadPool = ThreadPool::getInstance());
+    void clear();
+
+    // New bounds for the same primitives, count has to match the build
+    void refit(const VkAabbPositionsKHR* aabbs, uint32_t count, ThreadPool& threadPool = ThreadPool::getInstance());
+
+    // Closest hit along origin + t * direction for t in (0, tMax]. intersect(primitive, tMax) tests one
+    // primitive and returns true after lowering tMax to its hit distance. Returns the hit primitive or
+    // UINT32_MAX, tMax holds the hit distance.
+    template<typename IntersectFunc>
+    uint32_t intersect(const glm::vec3& origin, const glm::vec3& direction, float& tMax, IntersectFunc&& intersect) const;
+
+    // Same for a packet, the rays visit every node any of them enters. intersect(primitive) tests all
+    // lanes of the packet and lowers tMax and sets primitive for those that hit.
+    template<typename IntersectFunc>
+    void intersect(BVHRayPacket& packet, IntersectFunc&& intersect) const;
+
+    // Sum of the SAH cost of every node, recomputed from the tree
+    float computeSahCost(const BVHBuildSettings& settings = {}) const;
+
+    const std::vector<BVHNode>& getNodes() const { return m_nodes; }
+    const std::vector<uint32_t>& getPrimitiveIndices() const { return m_primitiveIndices; }
+    const BVHStats& getStats() const { return m_stats; }
+    bool isEmpty() const { return m_nodes.empty(); }
+
+    // Entry and exit distance of a ray against a box, a miss if entry > exit
+    static glm::vec2 intersectBounds(const glm::vec3& origin, const glm::vec3& inverseDirection, const glm::vec3& boundsMin, const glm::vec3& boundsMax, float tMax)
+    {
+        const glm::vec3 t0 = (boundsMin - origin) * inverseDirection;
+        const glm::vec3 t1 = (boundsMax - origin) * inverseDirection;
+        const glm::vec3 tNear = glm::min(t0, t1);
+        const glm::vec3 tFar = glm::max(t0, t1);
+        const float entry = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.0f));
+        const float exit = std::min(std::min(tFar.x, tFar.y), std::min(tFar.z, tMax));
+        return glm::vec2(entry, exit);
+    }
+
+    // Lanes of the packet whose ray enters the box before its current tMax, entry distances in entryDistances
+    static uint32_t intersectBounds(const BVHRayPacket& packet, const glm::vec3& boundsMin, const glm::vec3& boundsMax, float* entryDistances)
+    {
+#if defined(__AVX2__)
+        const __m256 originX = _mm256_load_ps(packet.originX);
+        const __m256 originY = _mm256_load_ps(packet.originY);
+        const __m256 originZ = _mm256_load_ps(packet.originZ);
+        const __m256 inverseX = _mm256_load_ps(packet.inverseX);
+        const __m256 inverseY = _mm256_load_ps(packet.inverseY);
+        const __m256 inverseZ = _mm256_load_ps(packet.inverseZ);
+
+        const __m256 t0x = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(boundsMin.x), originX), inverseX);
+        const __m256 t1x = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(boundsMax.x), originX), inverseX);
+        const __m256 t0y = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(boundsMin.y), originY), inverseY);
+        const __m256 t1y = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(boundsMax.y), originY), inverseY);
+        const __m256 t0z = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(boundsMin.z), originZ), inverseZ);
+        const __m256 t1z = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(boundsMax.z), originZ), inverseZ);
+
+        const __m256 entry = _mm256_max_ps(
+            _mm256_max_ps(_mm256_min_ps(t0x, t1x), _mm256_min_ps(t0y, t1y)),
+            _mm256_max_ps(_mm256_min_ps(t0z, t1z), _mm256_setzero_ps()));
+        const __m256 exit = _mm256_min_ps(
+            _mm256_min_ps(_mm256_max_ps(t0x, t1x), _mm256_max_ps(t0y, t1y)),
+            _mm256_min_ps(_mm256_max_ps(t0z, t1z), _mm256_load_ps(packet.tMax)));
+        _mm256_store_ps(entryDistances, entry);
+        return static_cast<uint32_t>(_mm256_movemask_ps(_mm256_cmp_ps(entry, exit, _CMP_LE_OQ)));
+#else
+        uint32_t mask = 0;
+        for (uint32_t lane = 0; lane < BVHRayPacket::SIZE; ++lane)
+        {
+            const glm::vec3 origin(packet.originX[lane], packet.originY[lane], packet.originZ[lane]);
+            const glm::vec3 inverse(packet.inverseX[lane], packet.inverseY[lane], packet.inverseZ[lane]);
+            const glm::vec2 hit = intersectBounds(origin, inverse, boundsMin, boundsMax, packet.tMax[lane]);
+            entryDistances[lane] = hit.x;
+            mask |= (hit.x <= hit.y ? 1u : 0u) << lane;
+        }
+        return mask;
+#endif
+    }
+
+    static glm::vec3 safeInverse(const glm::vec3& direction)
+    {
+        constexpr float EPSILON = 1e-20f;
+        return glm::vec3(
+            1.0f / (std::abs(direction.x) > EPSILON ? direction.x : std::copysign(EPSILON, direction.x)),
+            1.0f / (std::abs(direction.y) > EPSILON ? direction.y : std::copysign(EPSILON, direction.y)),
+            1.0f / (std::abs(direction.z) > EPSILON ? direction.z : std::copysign(EPSILON, direction.z)));
+    }
+
+private:
+    struct PrimitiveRef;
+
+    struct BuildContext
+    {
+        PrimitiveRef* refs = nullptr;   // Sorted along with the splits, so binning reads them in order
+        BVHBuildSettings settings;
+        ThreadPool* threadPool = nullptr;
+        std::atomic<uint32_t> nodeCount{ 0 };
+    };
+
+    // Splits a leaf node, partitioning its primitive range. False if it should stay a leaf.
+    bool splitNode(BuildContext& context, BVHNode& node, uint32_t depth, bool parallelBinning);
+    void buildSubtree(BuildContext& context, uint32_t root, uint32_t depth);
+    void computeStats(const BVHBuildSettings& settings);
+    void computeParents();
+
+    std::vector<BVHNode> m_nodes;
+    std::vector<uint32_t> m_primitiveIndices;
+    std::vector<uint32_t> m_parents;        // Parent of every node for refits, NO_PARENT for the root
+    std::vector<uint32_t> m_refitArrivals;  // Children of every node refitted so far, kept between refits
+    BVHStats m_stats;
+};
+
+template<typename IntersectFunc>
+uint32_t BVH::intersect(const glm::vec3& origin, const glm::vec3& direction, float& tMax, IntersectFunc&& intersect) const
+{
+    uint32_t hit = std::numeric_limits<uint32_t>::max();
+    if (m_nodes.empty())
+    {
+        return hit;
+    }
+
+    const glm::vec3 inverseDirection = safeInverse(direction);
+    const glm::vec2 rootHit = intersectBounds(origin, inverseDirection, m_nodes[0].boundsMin, m_nodes[0].boundsMax, tMax);
+    if (rootHit.x > rootHit.y)
+    {
+        return hit;
+    }
+
+    uint32_t stack[MAX_DEPTH];
+    float stackEntry[MAX_DEPTH];
+    uint32_t stackSize = 0;
+    uint32_t nodeIndex = 0;
+    while (true)
+    {
+        const BVHNode& node = m_nodes[nodeIndex];
+        if (node.isLeaf())
+        {
+            for (uint32_t i = node.leftFirst; i < node.leftFirst + node.primitiveCount; ++i)
+            {
+                if (intersect(m_primitiveIndices[i], tMax))
+                {
+                    hit = m_primitiveIndices[i];
+                }
+            }
+        }
+        else
+        {
+            // Nearer child first, the other one is revisited only if it is still in front of the hit
+            const BVHNode& left = m_nodes[node.leftFirst];
+            const BVHNode& right = m_nodes[node.leftFirst + 1];
+            const glm::vec2 leftHit = intersectBounds(origin, inverseDirection, left.boundsMin, left.boundsMax, tMax);
+            const glm::vec2 rightHit = intersectBounds(origin, inverseDirection, right.boundsMin, right.boundsMax, tMax);
+            const bool visitLeft = leftHit.x <= leftHit.y;
+            const bool visitRight = rightHit.x <= rightHit.y;
+
+            if (visitLeft && visitRight)
+            {
+                const bool leftFirst = leftHit.x <= rightHit.x;
+                stack[stackSize] = node.leftFirst + (leftFirst ? 1 : 0);
+                stackEntry[stackSize++] = leftFirst ? rightHit.x : leftHit.x;
+                nodeIndex = node.leftFirst + (leftFirst ? 0 : 1);
+                continue;
+            }
+            if (visitLeft || visitRight)
+            {
+                nodeIndex = node.leftFirst + (visitLeft ? 0 : 1);
+                continue;
+            }
+        }
+
+        do
+        {
+            if (stackSize == 0)
+            {
+                return hit;
+            }
+            nodeIndex = stack[--stackSize];
+        } while (stackEntry[stackSize] > tMax);
+    }
+}
+
+template<typename IntersectFunc>
+void BVH::intersect(BVHRayPacket& packet, IntersectFunc&& intersect) const
+{
+    if (m_nodes.empty())
+    {
+        return;
+    }
+
+    alignas(32) float entry[BVHRayPacket::SIZE];
+    if (intersectBounds(packet, m_nodes[0].boundsMin, m_nodes[0].boundsMax, entry) == 0)
+    {
+        return;
+    }
+
+    // Children are tested together at their parent, only those some ray enters are visited
+    uint32_t stack[MAX_DEPTH + 1];
+    uint32_t stackSize = 0;
+    stack[stackSize++] = 0;
+    while (stackSize > 0)
+    {
+        const BVHNode& node = m_nodes[stack[--stackSize]];
+        if (node.isLeaf())
+        {
+            for (uint32_t i = node.leftFirst; i < node.leftFirst + node.primitiveCount; ++i)
+            {
+                intersect(m_primitiveIndices[i]);
+            }
+            continue;
+        }
+
+        const BVHNode& left = m_nodes[node.leftFirst];
+        const BVHNode& right = m_nodes[node.leftFirst + 1];
+        alignas(32) float leftEntry[BVHRayPacket::SIZE];
+        alignas(32) float rightEntry[BVHRayPacket::SIZE];
+        const uint32_t leftMask = intersectBounds(packet, left.boundsMin, left.boundsMax, leftEntry);
+        const uint32_t rightMask = intersectBounds(packet, right.boundsMin, right.boundsMax, rightEntry);
+        if (leftMask == 0 || rightMask == 0)
+        {
+            if (leftMask != 0 || rightMask != 0)
+            {
+                stack[stackSize++] = node.leftFirst + (leftMask != 0 ? 0 : 1);
+            }
+            continue;
+        }
+
+        // Nearer child first for the first ray that enters both
+        const uint32_t both = leftMask & rightMask;
+        const uint32_t lane = std::countr_zero(both != 0 ? both : leftMask);
+        const bool rightFirst = rightEntry[lane] < leftEntry[lane];
+        stack[stackSize++] = node.leftFirst + (rightFirst ? 0 : 1);
+        stack[stackSize++] = node.leftFirst + (rightFirst ? 1 : 0);
+    }
+}
@@ -0,0 +1,336 @@
+#include "BlasCache.h"
+
+#include <bit>
+#include <cstring>
+
+namespace
+{
+    // XXH64 (Yann Collet), the reference algorithm
+    constexpr uint64_t PRIME1 = 11400714785074694791ull;
+    constexpr uint64_t PRIME2 = 14029467366897019727ull;
+    constexpr uint64_t PRIME3 = 1609587929392839161ull;
+    constexpr uint64_t PRIME4 = 9650029242287828579ull;
+    constexpr uint64_t PRIME5 = 2870177450012600261ull;
+
+    uint64_t read64(const uint8_t* p)
+    {
+        uint64_t value;
+        std::memcpy(&value, p, sizeof(value));
+        return value;
+    }
+
+    uint32_t read32(const uint8_t* p)
+    {
+        uint32_t value;
+        std::memcpy(&value, p, sizeof(value));
+        return value;
+    }
+
+    uint64_t round(uint64_t accumulator, uint64_t input)
+    {
+        accumulator += input * PRIME2;
+        accumulator = std::rotl(accumulator, 31);
+        return accumulator * PRIME1;
+    }
+
+    uint64_t mergeRound(uint64_t accumulator, uint64_t value)
+    {
+        accumulator ^= round(0, value);
+        return accumulator * PRIME1 + PRIME4;
+    }
+
+    uint64_t finalize(uint64_t hash, const uint8_t* p, const uint8_t* end)
+    {
+        for (; p + 8 <= end; p += 8)
+        {
+            hash ^= round(0, read64(p));
+            hash = std::rotl(hash, 27) * PRIME1 + PRIME4;
+        }
+        if (p + 4 <= end)
+        {
+            hash ^= static_cast<uint64_t>(read32(p)) * PRIME1;
+            hash = std::rotl(hash, 23) * PRIME2 + PRIME3;
+            p += 4;
+        }
+        for (; p < end; ++p)
+        {
+            hash ^= *p * PRIME5;
+            hash = std::rotl(hash, 11) * PRIME1;
+        }
+
+        hash ^= hash >> 33;
+        hash *= PRIME2;
+        hash ^= hash >> 29;
+        hash *= PRIME3;
+        hash ^= hash >> 32;
+        return hash;
+    }
+}
+
+// XXH64 with seed 0, four independent lanes over 32-byte stripes
+AabbHasher::AabbHasher()
+{
+    m_lanes[0] = PRIME1 + PRIME2;
+    m_lanes[1] = PRIME2;
+    m_lanes[2] = 0;
+    m_lanes[3] = 0 - PRIME1;
+}
+
+void AabbHasher::update(const VkAabbPositionsKHR* aabbs, uint32_t count)
+{
+    update(reinterpret_cast<const uint8_t*>(aabbs), sizeof(VkAabbPositionsKHR) * static_cast<size_t>(count));
+}
+
+void AabbHasher::update(const uint8_t* data, size_t size)
+{
+    if (size == 0)
+    {
+        return;
+    }
+    m_totalSize += size;
+
+    if (m_bufferSize + size < 32)
+    {
+        std::memcpy(m_buffer + m_bufferSize, data, size);
+        m_bufferSize += static_cast<uint32_t>(size);
+        return;
+    }
+
+    auto consumeStripe = [this](const uint8_t* p)
+    {
+        m_lanes[0] = round(m_lanes[0], read64(p));
+        m_lanes[1] = round(m_lanes[1], read64(p + 8));
+        m_lanes[2] = round(m_lanes[2], read64(p + 16));
+        m_lanes[3] = round(m_lanes[3], read64(p + 24));
+    };
+
+    if (m_bufferSize > 0)
+    {
+        const size_t fill = 32 - m_bufferSize;
+        std::memcpy(m_buffer + m_bufferSize, data, fill);
+        consumeStripe(m_buffer);
+        data += fill;
+        size -= fill;
+        m_bufferSize = 0;
+    }
+    for (; size >= 32; data += 32, size -= 32)
+    {
+        consumeStripe(data);
+    }
+
+    std::memcpy(m_buffer, data, size);
+    m_bufferSize = static_cast<uint32_t>(size);
+}
+
+uint64_t AabbHasher::digest() const
+{
+    uint64_t hash;
+    if (m_totalSize >= 32)
+    {
+        hash = std::rotl(m_lanes[0], 1) + std::rotl(m_lanes[1], 7) + std::rotl(m_lanes[2], 12) + std::rotl(m_lanes[3], 18);
+        hash = mergeRound(hash, m_lanes[0]);
+        hash = mergeRound(hash, m_lanes[1]);
+        hash = mergeRound(hash, m_lanes[2]);
+        hash = mergeRound(hash, m_lanes[3]);
+    }
+    else
+    {
+        hash = PRIME5;
+    }
+
+    hash += m_totalSize;
+    return finalize(hash, m_buffer, m_buffer + m_bufferSize);
+}
+
+uint64_t BlasCache::hashAabbs(const VkAabbPositionsKHR* aabbs, uint32_t count)
+{
+    AabbHasher hasher;
+    hasher.update(aabbs, count);
+    return hasher.digest();
+}
+
+uint32_t BlasCache::acquire(uint64_t hash, uint32_t primitiveCount)
+{
+    m_stats.lookups++;
+
+    auto it = m_indices.find(hash);
+    if (it == m_indices.end() || m_entries[it->second].primitiveCount != primitiveCount)
+    {
+        return NOT_FOUND;
+    }
+
+    Entry& entry = m_entries[it->second];
+    if (entry.owners > 0)
+    {
+        m_stats.bytesSaved += entry.memorySize;
+    }
+    revive(entry);
+    entry.owners++;
+    m_stats.hits++;
+    return it->second;
+}
+
+void BlasCache::insert(uint32_t index, uint64_t hash, uint32_t primitiveCount, uint64_t memorySize)
+{
+    if (index >= m_entries.size())
+    {
+        m_entries.resize(index + 1);
+    }
+
+    Entry& entry = m_entries[index];
+    entry = {};
+    entry.hash = hash;
+    entry.memorySize = memorySize;
+    entry.primitiveCount = primitiveCount;
+    entry.owners = 1;
+    entry.cached = true;
+    m_indices.try_emplace(hash, index);
+    m_stats.entryCount++;
+}
+
+void BlasCache::remove(uint32_t index)
+{
+    if (!contains(index))
+    {
+        return;
+    }
+
+    Entry& entry = m_entries[index];
+    auto it = m_indices.find(entry.hash);
+    if (it != m_indices.end() && it->second == index)
+    {
+        m_indices.erase(it);
+    }
+    if (entry.owners > 1)
+    {
+        m_stats.bytesSaved -= (entry.owners - 1) * entry.memorySize;
+    }
+    if (entry.pending)
+    {
+        std::erase(m_pending, index);
+        if (entry.owners + entry.instances == 0)
+        {
+            m_stats.pendingDestructions--;
+        }
+    }
+    entry = {};
+    m_stats.entryCount--;
+}
+
+void BlasCache::setMemorySize(uint32_t index, uint64_t memorySize)
+{
+    if (!contains(index))
+    {
+        return;
+    }
+
+    Entry& entry = m_entries[index];
+    if (entry.owners > 1)
+    {
+        m_stats.bytesSaved -= (entry.owners - 1) * entry.memorySize;
+        m_stats.bytesSaved += (entry.owners - 1) * memorySize;
+    }
+    entry.memorySize = memorySize;
+}
+
+void BlasCache::releaseOwner(uint32_t index)
+{
+    if (!contains(index) || m_entries[index].owners == 0)
+    {
+        return;
+    }
+
+    Entry& entry = m_entries[index];
+    if (entry.owners > 1)
+    {
+        m_stats.bytesSaved -= entry.memorySize;
+    }
+    entry.owners--;
+    releaseReference(entry, index);
+}
+
+void BlasCache::addInstance(uint32_t index)
+{
+    if (contains(index))
+    {
+        revive(m_entries[index]);
+        m_entries[index].instances++;
+    }
+}
+
+void BlasCache::releaseInstance(uint32_t index)
+{
+    if (!contains(index) || m_entries[index].instances == 0)
+    {
+        return;
+    }
+
+    Entry& entry = m_entries[index];
+    entry.instances--;
+    releaseReference(entry, index);
+}
+
+void BlasCache::releaseReference(Entry& entry, uint32_t index)
+{
+    if (entry.owners + entry.instances > 0)
+    {
+        return;
+    }
+
+    entry.releaseFrame = m_frame;
+    m_stats.pendingDestructions++;
+    if (!entry.pending)
+    {
+        entry.pending = true;
+        m_pending.push_back(index);
+    }
+}
+
+void BlasCache::revive(Entry& entry)
+{
+    if (entry.pending && entry.owners + entry.instances == 0)
+    {
+        m_stats.pendingDestructions--;
+    }
+}
+
+void BlasCache::collect(std::vector<uint32_t>& released)
+{
+    released.clear();
+    m_frame++;
+
+    // Revived entries just leave the list, the others stay until no frame in flight can use them
+    std::erase_if(m_pending, [&](uint32_t index)
+    {
+        Entry& entry = m_entries[index];
+        if (entry.owners + entry.instances > 0)
+        {
+            entry.pending = false;
+            return true;
+        }
+        if (m_frame < entry.releaseFrame + m_framesInFlight)
+        {
+            return false;
+        }
+
+        auto it = m_indices.find(entry.hash);
+        if (it != m_indices.end() && it->second == index)
+        {
+            m_indices.erase(it);
+        }
+        entry = {};
+        m_stats.pendingDestructions--;
+        m_stats.entryCount--;
+        released.push_back(index);
+        return true;
+    });
+}
+
+void BlasCache::clear()
+{
+    m_entries.clear();
+    m_indices.clear();
+    m_pending.clear();
+    m_frame = 0;
+    m_stats = {};
+}
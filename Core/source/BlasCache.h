@@ -0,0 +1,116 @@
+#pragma once
+
+#include "vulkan/vulkan.h"
+
+#include <cstdint>
+#include <cstddef>
+#include <vector>
+#include <unordered_map>
+#include <limits>
+
+struct BlasCacheStats
+{
+    uint64_t lookups = 0;
+    uint64_t hits = 0;
+    uint32_t entryCount = 0;            // BLASes in the cache, including those waiting for destruction
+    uint32_t pendingDestructions = 0;
+    uint64_t bytesSaved = 0;            // Memory the duplicates of the cached BLASes would take
+
+    float getHitRate() const { return lookups > 0 ? static_cast<float>(hits) / lookups : 0.0f; }
+};
+
+// BlasCache::hashAabbs of AABBs that arrive block by block, digest() gives the same hash as
+// hashing everything added in one go
+class AabbHasher
+{
+public:
+    AabbHasher();
+
+    void update(const VkAabbPositionsKHR* aabbs, uint32_t count);
+    uint64_t digest() const;
+
+private:
+    void update(const uint8_t* data, size_t size);
+
+    uint64_t m_lanes[4];
+    uint8_t m_buffer[32];       // Bytes short of a full stripe
+    uint32_t m_bufferSize = 0;
+    uint64_t m_totalSize = 0;
+};
+
+// Content-addressed bookkeeping for BLASes, indexed like AccelerationStructureManager::m_blases.
+//
+// Every BLAS is keyed by a 64-bit hash of its AABB array (XXH64) and its primitive count, a lookup
+// with the same key returns the existing index instead of building a copy. Colliding arrays of
+// the same size are not told apart, at 64 bits that takes around 2^32 distinct arrays.
+//
+// A BLAS is referenced by its owners (every addBlas that returned it) and by its instances. The
+// last released reference doesn't free it right away: frames still in flight may trace a TLAS
+// that points at it, so it is handed back by collect() framesInFlight frames later. Until then a
+// lookup of the same content revives it.
+//
+// Holds no BLASes, only their indices and references. The caller builds on a miss and destroys
+// what collect() hands back.
+class BlasCache
+{
+public:
+    static constexpr uint32_t NOT_FOUND = std::numeric_limits<uint32_t>::max();
+
+    static uint64_t hashAabbs(const VkAabbPositionsKHR* aabbs, uint32_t count);
+
+    explicit BlasCache(uint32_t framesInFlight = 2) : m_framesInFlight(framesInFlight) {}
+
+    // Index of a cached BLAS with this content and one more owner, NOT_FOUND on a miss
+    uint32_t acquire(uint64_t hash, uint32_t primitiveCount);
+
+    // Registers a BLAS built after a miss, with one owner
+    void insert(uint32_t index, uint64_t hash, uint32_t primitiveCount, uint64_t memorySize);
+
+    // Drops a BLAS right away, for one that was inserted but never built
+    void remove(uint32_t index);
+
+    // The BLAS was replaced by a copy of another size, e.g. compacted
+    void setMemorySize(uint32_t index, uint64_t memorySize);
+
+    void releaseOwner(uint32_t index);
+    void addInstance(uint32_t index);
+    void releaseInstance(uint32_t index);
+
+    // Starts the next frame and returns the BLASes without references since framesInFlight
+    // frames, they leave the cache and can be destroyed
+    void collect(std::vector<uint32_t>& released);
+    void clear();
+
+    bool contains(uint32_t index) const { return index < m_entries.size() && m_entries[index].cached; }
+    bool isReferenced(uint32_t index) const { return contains(index) && m_entries[index].owners + m_entries[index].instances > 0; }
+    uint32_t getOwnerCount(uint32_t index) const { return contains(index) ? m_entries[index].owners : 0; }
+    uint32_t getInstanceCount(uint32_t index) const { return contains(index) ? m_entries[index].instances : 0; }
+
+    void setFramesInFlight(uint32_t framesInFlight) { m_framesInFlight = framesInFlight; }
+    uint64_t getFrame() const { return m_frame; }
+    const BlasCacheStats& getStats() const { return m_stats; }
+
+private:
+    struct Entry
+    {
+        uint64_t hash = 0;
+        uint64_t memorySize = 0;
+        uint32_t primitiveCount = 0;
+        uint32_t owners = 0;
+        uint32_t instances = 0;
+        uint64_t releaseFrame = 0;      // Frame the last reference went away
+        bool cached = false;
+        bool pending = false;           // In m_pending, possibly revived since
+    };
+
+    void releaseReference(Entry& entry, uint32_t index);
+    void revive(Entry& entry);
+
+    std::vector<Entry> m_entries;
+    std::unordered_map<uint64_t, uint32_t> m_indices; // Content hash to index, first come for colliding sizes
+    std::vector<uint32_t> m_pending;
+
+    uint32_t m_framesInFlight;
+    uint64_t m_frame = 0;
+    BlasCacheStats m_stats;
+};
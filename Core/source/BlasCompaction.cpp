@@ -0,0 +1,116 @@
+#include "BlasCompaction.h"
+
+#include <algorithm>
+
+bool BlasCompaction::request(uint32_t blas, VkDeviceSize originalSize)
+{
+    if (blas >= m_entries.size())
+    {
+        m_entries.resize(blas + 1);
+    }
+
+    Entry& entry = m_entries[blas];
+    if (entry.state != BlasCompactionState::None)
+    {
+        return false;
+    }
+
+    entry = {};
+    entry.originalSize = originalSize;
+    entry.state = BlasCompactionState::SizeQueried;
+    m_stats.pending++;
+    return true;
+}
+
+void BlasCompaction::setCompactedSize(uint32_t blas, VkDeviceSize compactedSize)
+{
+    if (getState(blas) != BlasCompactionState::SizeQueried)
+    {
+        return;
+    }
+
+    Entry& entry = m_entries[blas];
+    const bool worthCopying = compactedSize > 0 && compactedSize < entry.originalSize &&
+        1.0 - static_cast<double>(compactedSize) / static_cast<double>(entry.originalSize) >= m_minSavedFraction;
+    if (!worthCopying)
+    {
+        entry.state = BlasCompactionState::None;
+        m_stats.pending--;
+        m_stats.skipped++;
+        return;
+    }
+
+    entry.compactedSize = compactedSize;
+    entry.state = BlasCompactionState::ReadyToCopy;
+    m_ready.push_back(blas);
+}
+
+void BlasCompaction::takeCopies(std::vector<BlasCompactionCopy>& copies, VkDeviceSize maxBytes)
+{
+    copies.clear();
+
+    VkDeviceSize takenBytes = 0;
+    size_t taken = 0;
+    for (; taken < m_ready.size() && (copies.empty() || takenBytes < maxBytes); ++taken)
+    {
+        Entry& entry = m_entries[m_ready[taken]];
+        copies.push_back({ m_ready[taken], entry.compactedSize });
+        takenBytes += entry.originalSize;
+
+        entry.state = BlasCompactionState::Copied;
+        entry.copyFrame = m_frame;
+        m_copied.push_back(m_ready[taken]);
+
+        m_stats.pending--;
+        m_stats.retiring++;
+        m_stats.compacted++;
+        m_stats.originalBytes += entry.originalSize;
+        m_stats.compactedBytes += entry.compactedSize;
+    }
+    m_ready.erase(m_ready.begin(), m_ready.begin() + taken);
+}
+
+void BlasCompaction::collect(std::vector<uint32_t>& retired)
+{
+    retired.clear();
+    m_frame++;
+
+    std::erase_if(m_copied, [&](uint32_t blas)
+    {
+        Entry& entry = m_entries[blas];
+        if (m_frame < entry.copyFrame + m_framesInFlight)
+        {
+            return false;
+        }
+
+        entry = {};
+        m_stats.retiring--;
+        retired.push_back(blas);
+        return true;
+    });
+}
+
+void BlasCompaction::cancel(uint32_t blas)
+{
+    const BlasCompactionState state = getState(blas);
+    if (state != BlasCompactionState::SizeQueried && state != BlasCompactionState::ReadyToCopy)
+    {
+        return;
+    }
+
+    if (state == BlasCompactionState::ReadyToCopy)
+    {
+        std::erase(m_ready, blas);
+    }
+    m_entries[blas] = {};
+    m_stats.pending--;
+}
+
+void BlasCompaction::clear()
+{
+    m_entries.clear();
+    m_ready.clear();
+    m_copied.clear();
+    m_frame = 0;
+    m_stats = {};
+}
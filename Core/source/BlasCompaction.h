@@ -0,0 +1,91 @@
+#pragma once
+
+#include "vulkan/vulkan.h"
+
+#include <cstdint>
+#include <vector>
+
+enum class BlasCompactionState : uint8_t
+{
+    None,
+    SizeQueried,    // Built with ALLOW_COMPACTION, waiting for the compacted size query
+    ReadyToCopy,
+    Copied          // Swapped for the compacted copy, the original waits for the frames in flight
+};
+
+struct BlasCompactionCopy
+{
+    uint32_t blas = 0;
+    VkDeviceSize compactedSize = 0;
+};
+
+struct BlasCompactionStats
+{
+    uint32_t pending = 0;           // Waiting for their size or their copy
+    uint32_t retiring = 0;          // Originals not freed yet
+    uint32_t compacted = 0;
+    uint32_t skipped = 0;           // Saved too little to be worth a copy
+    uint64_t originalBytes = 0;     // Of the compacted BLASes, before and after
+    uint64_t compactedBytes = 0;
+};
+
+// Pending compactions of BLASes, indexed like AccelerationStructureManager::m_blases.
+//
+// A BLAS built with ALLOW_COMPACTION is requested along with its compacted size query. Once the
+// size is in, it waits for takeCopies() to hand it out for a copy into a tight buffer, at most
+// a budget of bytes per frame as the copies go into the frame's command buffer. From then on the
+// compacted copy is the BLAS and the original is only kept for the frames still in flight,
+// collect() hands it back framesInFlight frames later, like BlasCache does for released BLASes.
+//
+// Tracks indices and sizes only. The caller records the size queries and copies and destroys
+// the retired originals.
+class BlasCompaction
+{
+public:
+    explicit BlasCompaction(uint32_t framesInFlight = 2) : m_framesInFlight(framesInFlight) {}
+
+    // Returns false if the BLAS has a compaction in progress already
+    bool request(uint32_t blas, VkDeviceSize originalSize);
+
+    // Result of the size query. A BLAS that shrinks by less than the minimum saved fraction is
+    // dropped, it stays as it is.
+    void setCompactedSize(uint32_t blas, VkDeviceSize compactedSize);
+
+    // Starts the copies of ready BLASes in the order their sizes came in, until maxBytes of
+    // original size are taken but at least one. They count as copied in the current frame.
+    void takeCopies(std::vector<BlasCompactionCopy>& copies, VkDeviceSize maxBytes);
+
+    // Starts the next frame and returns the BLASes whose originals no frame in flight can use
+    // anymore, they can be destroyed
+    void collect(std::vector<uint32_t>& retired);
+
+    // For a BLAS destroyed before its copy, a copied one keeps its original until collected
+    void cancel(uint32_t blas);
+    void clear();
+
+    BlasCompactionState getState(uint32_t blas) const { return blas < m_entries.size() ? m_entries[blas].state : BlasCompactionState::None; }
+    bool hasReadyCopies() const { return !m_ready.empty(); }
+
+    void setFramesInFlight(uint32_t framesInFlight) { m_framesInFlight = framesInFlight; }
+    void setMinSavedFraction(float fraction) { m_minSavedFraction = fraction; }
+    float getMinSavedFraction() const { return m_minSavedFraction; }
+    const BlasCompactionStats& getStats() const { return m_stats; }
+
+private:
+    struct Entry
+    {
+        VkDeviceSize originalSize = 0;
+        VkDeviceSize compactedSize = 0;
+        uint64_t copyFrame = 0;
+        BlasCompactionState state = BlasCompactionState::None;
+    };
+
+    std::vector<Entry> m_entries;
+    std::vector<uint32_t> m_ready;      // In the order their sizes came in
+    std::vector<uint32_t> m_copied;
+
+    uint32_t m_framesInFlight;
+    uint64_t m_frame = 0;
+    float m_minSavedFraction = 0.1f;
+    BlasCompactionStats m_stats;
+};
@@ -0,0 +1,443 @@
+#include "CellularSimulation.h"
+#include "World.h"
+#include "LightEngine.h"
+#include "VoxelEdit.h"
+#include "PerformanceTimer.h"
+
+#include <bit>
+
+namespace
+{
+    constexpr uint32_t SELF = 13; // Centre of the 3x3x3 neighbourhood
+    constexpr int32_t SIZE = static_cast<int32_t>(CHUNK_SIZE_X);
+
+    constexpr uint32_t neighborSlot(int32_t dx, int32_t dy, int32_t dz)
+    {
+        return static_cast<uint32_t>((dx + 1) + (dy + 1) * 3 + (dz + 1) * 9);
+    }
+
+    glm::ivec3 neighborOffset(uint32_t slot)
+    {
+        return glm::ivec3(static_cast<int32_t>(slot % 3) - 1, static_cast<int32_t>((slot / 3) % 3) - 1, static_cast<int32_t>(slot / 9) - 1);
+    }
+
+    struct CellRef
+    {
+        uint32_t slot;
+        uint32_t index;
+    };
+
+    // Local position that may lie up to one chunk outside [0, 32)
+    CellRef resolve(const glm::ivec3& local)
+    {
+        const glm::ivec3 offset = local >> static_cast<int32_t>(CHUNK_SIZE_SHIFT);
+        const glm::ivec3 inner = local & (SIZE - 1);
+        return { neighborSlot(offset.x, offset.y, offset.z), Chunk::index(inner.x, inner.y, inner.z) };
+    }
+
+    uint32_t hashCell(const glm::ivec3& p, uint64_t tick)
+    {
+        uint32_t h = static_cast<uint32_t>(p.x) * 73856093u ^ static_cast<uint32_t>(p.y) * 19349663u ^ static_cast<uint32_t>(p.z) * 83492791u ^ static_cast<uint32_t>(tick) * 2654435761u;
+        h ^= h >> 15;
+        h *= 0x2C1B3C6Du;
+        h ^= h >> 12;
+        return h;
+    }
+
+    const glm::ivec3 DIAGONALS[4] = { { 1, -1, 0 }, { -1, -1, 0 }, { 0, -1, 1 }, { 0, -1, -1 } };
+    const glm::ivec3 SIDES[4] = { { 1, 0, 0 }, { -1, 0, 0 }, { 0, 0, 1 }, { 0, 0, -1 } };
+}
+
+CellularSimulation::SimChunk& CellularSimulation::getOrCreate(const glm::ivec3& chunkCoord)
+{
+    const ChunkKey key = packChunkKey(chunkCoord);
+    std::unique_ptr<SimChunk>* existing = m_chunks.find(key);
+    if (existing != nullptr)
+    {
+        return **existing;
+    }
+
+    auto sim = std::make_unique<SimChunk>();
+    sim->position = chunkCoord;
+    return *m_chunks.insert(key, std::move(sim));
+}
+
+void CellularSimulation::activate(const glm::ivec3& voxel)
+{
+    activateRegion(voxel, voxel);
+}
+
+void CellularSimulation::activateRegion(const glm::ivec3& min, const glm::ivec3& max)
+{
+    // Neighbours too, they may have lost their support or gained room to move
+    const glm::ivec3 lo = glm::min(min, max) - 1;
+    const glm::ivec3 hi = glm::max(min, max) + 1;
+
+    const glm::ivec3 minChunk = worldToChunkCoord(lo);
+    const glm::ivec3 maxChunk = worldToChunkCoord(hi);
+    for (int32_t cz = minChunk.z; cz <= maxChunk.z; ++cz)
+    {
+        for (int32_t cy = minChunk.y; cy <= maxChunk.y; ++cy)
+        {
+            for (int32_t cx = minChunk.x; cx <= maxChunk.x; ++cx)
+            {
+                SimChunk& sim = getOrCreate(glm::ivec3(cx, cy, cz));
+                const glm::ivec3 origin = glm::ivec3(cx, cy, cz) * SIZE;
+                const glm::ivec3 from = glm::max(lo - origin, glm::ivec3(0));
+                const glm::ivec3 to = glm::min(hi - origin, glm::ivec3(SIZE - 1));
+
+                const uint32_t rowMask = (~0u << from.x) & (~0u >> (SIZE - 1 - to.x));
+                Bitmap& active = sim.active[sim.current];
+                for (int32_t z = from.z; z <= to.z; ++z)
+                {
+                    for (int32_t y = from.y; y <= to.y; ++y)
+                    {
+                        uint32_t& row = active[ChunkOccupancy::rowIndex(y, z)];
+                        const uint32_t added = std::popcount(rowMask & ~row);
+                        sim.activeCells += added;
+                        m_stats.activeCells += added;
+                        row |= rowMask;
+                    }
+                }
+            }
+        }
+    }
+
+    m_stats.activeChunks = m_chunks.size();
+}
+
+void CellularSimulation::tick(World& world, ThreadPool& threadPool)
+{
+    PERF_SCOPE("Simulation Tick");
+
+    for (std::vector<SimChunk*>& pass : m_passes)
+    {
+        pass.clear();
+    }
+
+    // Bucket the active chunks by coordinate parity, state for chunks that are gone is dropped
+    std::vector<ChunkKey> evicted;
+    m_chunks.forEach([&](ChunkKey key, std::unique_ptr<SimChunk>& sim)
+    {
+        Chunk* chunk = world.getChunk(sim->position);
+        if (chunk == nullptr)
+        {
+            evicted.push_back(key);
+            return;
+        }
+        if (sim->activeCells == 0)
+        {
+            return;
+        }
+
+        for (uint32_t slot = 0; slot < 27; ++slot)
+        {
+            sim->neighbors[slot] = slot == SELF ? chunk : world.getChunk(sim->position + neighborOffset(slot));
+        }
+
+        const glm::ivec3 parity = sim->position & 1;
+        m_passes[parity.x | parity.y << 1 | parity.z << 2].push_back(sim.get());
+    });
+
+    for (ChunkKey key : evicted)
+    {
+        m_chunks.erase(key);
+    }
+
+    for (std::vector<SimChunk*>& pass : m_passes)
+    {
+        threadPool.parallelFor(static_cast<uint32_t>(pass.size()), [&pass, this](uint32_t i)
+        {
+            stepChunk(*pass[i]);
+        });
+
+        for (SimChunk* sim : pass)
+        {
+            applyOutgoing(*sim);
+        }
+    }
+
+    finishTick(world, threadPool);
+}
+
+void CellularSimulation::stepChunk(SimChunk& sim)
+{
+    Chunk& chunk = *sim.neighbors[SELF];
+    const Bitmap& current = sim.active[sim.current];
+    Bitmap& next = sim.active[sim.current ^ 1];
+    const glm::ivec3 origin = chunk.getWorldOrigin();
+    const uint64_t tick = m_stats.tick;
+
+    // Cells outside the resident neighbourhood read as solid, so nothing moves into them
+    auto read = [&](const glm::ivec3& p) -> VoxelID
+    {
+        const CellRef ref = resolve(p);
+        const Chunk* target = sim.neighbors[ref.slot];
+        return target != nullptr ? target->voxels[ref.index] : STONE_VOXEL;
+    };
+
+    auto write = [&](const glm::ivec3& p, VoxelID id, VoxelID oldId)
+    {
+        const CellRef ref = resolve(p);
+        sim.neighbors[ref.slot]->voxels[ref.index] = id;
+
+        const uint32_t change = VoxelEdit::packChange(ref.index, oldId, id);
+        if (ref.slot == SELF)
+        {
+            sim.changes.push_back(change);
+        }
+        else
+        {
+            sim.outgoing.push_back({ static_cast<uint8_t>(ref.slot), Outgoing::Changed, static_cast<uint16_t>(ref.index), change });
+        }
+    };
+
+    auto markMoved = [&](const glm::ivec3& p)
+    {
+        const CellRef ref = resolve(p);
+        if (ref.slot == SELF)
+        {
+            sim.moved[ref.index >> CHUNK_SIZE_SHIFT] |= 1u << (ref.index & (SIZE - 1));
+        }
+        else
+        {
+            sim.outgoing.push_back({ static_cast<uint8_t>(ref.slot), Outgoing::Moved, static_cast<uint16_t>(ref.index), 0 });
+        }
+    };
+
+    auto wakeRow = [&](const CellRef& ref, uint32_t mask)
+    {
+        if (ref.slot == SELF)
+        {
+            next[ref.index >> CHUNK_SIZE_SHIFT] |= mask;
+        }
+        else if (sim.neighbors[ref.slot] != nullptr)
+        {
+            sim.outgoing.push_back({ static_cast<uint8_t>(ref.slot), Outgoing::Wake, static_cast<uint16_t>(ref.index), mask });
+        }
+    };
+
+    // Row by row, the three cells of a row share a chunk unless p is on an X face
+    auto wake = [&](const glm::ivec3& p)
+    {
+        const bool xInterior = p.x > 0 && p.x < SIZE - 1;
+        for (int32_t dz = -1; dz <= 1; ++dz)
+        {
+            for (int32_t dy = -1; dy <= 1; ++dy)
+            {
+                if (xInterior)
+                {
+                    wakeRow(resolve(p + glm::ivec3(0, dy, dz)), 7u << (p.x - 1));
+                    continue;
+                }
+
+                for (int32_t dx = -1; dx <= 1; ++dx)
+                {
+                    const CellRef ref = resolve(p + glm::ivec3(dx, dy, dz));
+                    wakeRow(ref, 1u << (ref.index & (SIZE - 1)));
+                }
+            }
+        }
+    };
+
+    // Swaps the cells, whatever was displaced (air or water) ends up at from
+    auto move = [&](const glm::ivec3& from, const glm::ivec3& to, VoxelID id, VoxelID displaced)
+    {
+        write(to, id, displaced);
+        write(from, displaced, id);
+        markMoved(to);
+        if (displaced != AIR_VOXEL)
+        {
+            markMoved(from);
+        }
+        wake(from);
+        wake(to);
+        sim.moves++;
+    };
+
+    // Bottom-up, so a cell that fell into an already visited row isn't stepped twice
+    for (int32_t z = 0; z < SIZE; ++z)
+    {
+        for (int32_t y = 0; y < SIZE; ++y)
+        {
+            const uint32_t row = ChunkOccupancy::rowIndex(y, z);
+            for (uint32_t bits = current[row]; bits != 0; bits &= bits - 1)
+            {
+                const int32_t x = std::countr_zero(bits);
+                if ((sim.moved[row] >> x) & 1u)
+                {
+                    continue;
+                }
+
+                const VoxelID id = chunk.voxels[Chunk::index(x, y, z)];
+                if (id != SAND_VOXEL && id != WATER_VOXEL)
+                {
+                    continue;
+                }
+
+                const glm::ivec3 p(x, y, z);
+                auto passable = [id](VoxelID other)
+                {
+                    return other == AIR_VOXEL || (id == SAND_VOXEL && other == WATER_VOXEL);
+                };
+
+                const glm::ivec3 below = p + glm::ivec3(0, -1, 0);
+                const VoxelID belowId = read(below);
+                if (passable(belowId))
+                {
+                    move(p, below, id, belowId);
+                    continue;
+                }
+
+                const uint32_t start = hashCell(origin + p, tick);
+                bool moved = false;
+                for (uint32_t k = 0; k < 4 && !moved; ++k)
+                {
+                    const glm::ivec3 target = p + DIAGONALS[(start + k) & 3];
+                    const VoxelID targetId = read(target);
+                    if (passable(targetId))
+                    {
+                        move(p, target, id, targetId);
+                        moved = true;
+                    }
+                }
+
+                // Water spreads sideways only when pushed by water above it
+                if (moved || id != WATER_VOXEL || read(p + glm::ivec3(0, 1, 0)) != WATER_VOXEL)
+                {
+                    continue;
+                }
+
+                for (uint32_t k = 0; k < 4; ++k)
+                {
+                    const glm::ivec3 target = p + SIDES[((start >> 2) + k) & 3];
+                    if (read(target) == AIR_VOXEL)
+                    {
+                        move(p, target, id, AIR_VOXEL);
+                        break;
+                    }
+                }
+            }
+        }
+    }
+}
+
+void CellularSimulation::applyOutgoing(SimChunk& sim)
+{
+    std::array<SimChunk*, 27> targets{};
+    for (const Outgoing& outgoing : sim.outgoing)
+    {
+        SimChunk*& cached = targets[outgoing.neighbor];
+        if (cached == nullptr)
+        {
+            cached = &getOrCreate(sim.position + neighborOffset(outgoing.neighbor));
+        }
+
+        SimChunk& target = *cached;
+        const uint32_t row = outgoing.index >> CHUNK_SIZE_SHIFT;
+        const uint32_t bit = 1u << (outgoing.index & (SIZE - 1));
+
+        switch (outgoing.type)
+        {
+        case Outgoing::Wake:
+            target.active[target.current ^ 1][row] |= outgoing.change;
+            break;
+        case Outgoing::Moved:
+            target.moved[row] |= bit;
+            break;
+        case Outgoing::Changed:
+            target.changes.push_back(outgoing.change);
+            break;
+        }
+    }
+    sim.outgoing.clear();
+}
+
+void CellularSimulation::finishTick(World& world, ThreadPool& threadPool)
+{
+    std::vector<SimChunk*> changed;
+    std::vector<ChunkKey> idle;
+    m_stats.movedCells = 0;
+    m_stats.activeCells = 0;
+
+    m_chunks.forEach([&](ChunkKey, std::unique_ptr<SimChunk>& sim)
+    {
+        if (!sim->changes.empty())
+        {
+            sim->neighbors[SELF] = world.getChunk(sim->position);
+            changed.push_back(sim.get());
+        }
+        m_stats.movedCells += sim->moves;
+        sim->moves = 0;
+    });
+
+    // Derived data once per changed chunk, the raw voxel writes above left it stale
+    threadPool.parallelFor(static_cast<uint32_t>(changed.size()), [&changed](uint32_t i)
+    {
+        SimChunk& sim = *changed[i];
+        Chunk& chunk = *sim.neighbors[SELF];
+        VoxelEdit::collapseChanges(sim.changes);
+        if (sim.changes.empty())
+        {
+            return;
+        }
+
+        uint64_t dirtyBricks = 0;
+        for (uint32_t change : sim.changes)
+        {
+            const uint32_t index = VoxelEdit::getChangeIndex(change);
+            const uint32_t x = index & (CHUNK_SIZE_X - 1);
+            const uint32_t y = (index >> CHUNK_SIZE_SHIFT) & (CHUNK_SIZE_Y - 1);
+            const uint32_t z = index >> (CHUNK_SIZE_SHIFT * 2);
+            dirtyBricks |= 1ull << ChunkOccupancy::brickIndex(x >> ChunkOccupancy::BRICK_SHIFT, y >> ChunkOccupancy::BRICK_SHIFT, z >> ChunkOccupancy::BRICK_SHIFT);
+        }
+
+        chunk.occupancy.build(chunk.voxels.data());
+        chunk.mips.build(chunk.voxels.data());
+        chunk.dirtyBricks |= dirtyBricks;
+        chunk.bumpVersion();
+    });
+
+    LightEngine* lightEngine = world.getLightEngine();
+    for (SimChunk* sim : changed)
+    {
+        if (lightEngine != nullptr && !sim->changes.empty())
+        {
+            lightEngine->onChunkEdited(*sim->neighbors[SELF], std::move(sim->changes));
+        }
+        sim->changes.clear();
+    }
+    if (lightEngine != nullptr)
+    {
+        lightEngine->applyEdits();
+    }
+
+    // Swap the active sets
+    m_chunks.forEach([&](ChunkKey key, std::unique_ptr<SimChunk>& sim)
+    {
+        sim->active[sim->current].fill(0);
+        sim->moved.fill(0);
+        sim->current ^= 1;
+
+        uint64_t activeCells = 0;
+        for (uint32_t row : sim->active[sim->current])
+        {
+            activeCells += std::popcount(row);
+        }
+        sim->activeCells = activeCells;
+        m_stats.activeCells += activeCells;
+
+        if (activeCells == 0)
+        {
+            idle.push_back(key);
+        }
+    });
+
+    for (ChunkKey key : idle)
+    {
+        m_chunks.erase(key);
+    }
+
+    m_stats.activeChunks = m_chunks.size();
+    m_stats.tick++;
+}
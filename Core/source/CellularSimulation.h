@@ -0,0 +1,89 @@
+#pragma once
+
+#include "Chunk.h"
+#include "ChunkHashMap.h"
+#include "Multithreading.h"
+
+#include "glm/glm.hpp"
+
+#include <cstdint>
+#include <array>
+#include <vector>
+#include <memory>
+
+class World;
+
+struct SimulationStats
+{
+    uint64_t activeCells = 0;    // Cells that will be looked at next tick
+    uint64_t movedCells = 0;     // Moves made in the last tick
+    uint32_t activeChunks = 0;
+    uint64_t tick = 0;
+};
+
+// Cellular automaton for falling sand and flowing water.
+//
+// Only active cells are visited. Each chunk with activity keeps two 32^3 active-set bitmaps
+// (rows along X, like ChunkOccupancy): cells in the current set are stepped, and every cell that
+// changes wakes its 3x3x3 neighbourhood in the next set. Cells that can't move drop out, so
+// settled water and sand cost nothing.
+//
+// A tick runs the active chunks in 8 checkerboard passes by chunk coordinate parity. Chunks in
+// one pass never touch each other, and as cells move at most one voxel per tick, two jobs can't
+// reach the same voxel either. A job writes neighbour voxels directly but queues
+// wake-ups and other bitmap updates for them, which are applied between passes.
+//
+// Rules: sand falls through air and water, otherwise slides diagonally down. Water falls, flows
+// diagonally down, and spreads sideways only under pressure (water on top), so puddles settle.
+class CellularSimulation
+{
+public:
+    // Wakes the voxel and its neighbours, call after placing or removing sand, water or their supports.
+    // World does this for its own edits once given the simulation with World::setSimulation.
+    void activate(const glm::ivec3& voxel);
+    void activateRegion(const glm::ivec3& min, const glm::ivec3& max);
+
+    // One step of every active cell. Changed chunks get their derived data rebuilt and a version
+    // bump, and are relit in one batch when the world has a light engine.
+    void tick(World& world, ThreadPool& threadPool = ThreadPool::getInstance());
+
+    void clear() { m_chunks.clear(); }
+
+    const SimulationStats& getStats() const { return m_stats; }
+
+private:
+    using Bitmap = std::array<uint32_t, CHUNK_SIZE_Y * CHUNK_SIZE_Z>;
+
+    // Bitmap update or voxel change a job made in a neighbouring chunk, applied after the pass
+    struct Outgoing
+    {
+        enum Type : uint8_t { Wake, Moved, Changed };
+
+        uint8_t neighbor;  // Index into the 3x3x3 neighbourhood, 13 is the chunk itself
+        Type type;
+        uint16_t index;    // Chunk::index in the neighbour
+        uint32_t change;   // VoxelEdit::packChange for Changed, row bits for Wake
+    };
+
+    struct SimChunk
+    {
+        glm::ivec3 position{ 0 };
+        std::array<Bitmap, 2> active{};
+        Bitmap moved{};                 // Cells that already moved this tick
+        uint32_t current = 0;           // Index of the active set being stepped
+        uint64_t activeCells = 0;       // Cells in the current set
+        std::vector<uint32_t> changes;  // This tick, packed with VoxelEdit::packChange
+        std::vector<Outgoing> outgoing;
+        uint32_t moves = 0;
+        std::array<Chunk*, 27> neighbors{};
+    };
+
+    SimChunk& getOrCreate(const glm::ivec3& chunkCoord);
+    void stepChunk(SimChunk& sim);
+    void applyOutgoing(SimChunk& sim);
+    void finishTick(World& world, ThreadPool& threadPool);
+
+    ChunkHashMap<std::unique_ptr<SimChunk>> m_chunks;
+    SimulationStats m_stats;
+    std::vector<SimChunk*> m_passes[8];
+};
@@ -1,34 +1,190 @@
-//#pragma once
+#pragma once
+
+#include "ChunkOccupancy.h"
+#include "ChunkMips.h"
+
+#include "glm/glm.hpp"
+
+#include <cstdint>
+#include <array>
+#include <algorithm>
+#include <atomic>
+#include <vector>
+
+using VoxelID = uint8_t;
+constexpr VoxelID AIR_VOXEL = 0;
+constexpr VoxelID STONE_VOXEL = 1;
+constexpr VoxelID DIRT_VOXEL = 2;
+constexpr VoxelID GRASS_VOXEL = 3;
+constexpr VoxelID SAND_VOXEL = 4;
+constexpr VoxelID WATER_VOXEL = 5;
+constexpr VoxelID TORCH_VOXEL = 6;
+
+constexpr uint32_t CHUNK_SIZE_X = 32;
+constexpr uint32_t CHUNK_SIZE_Y = 32;
+constexpr uint32_t CHUNK_SIZE_Z = 32;
+constexpr uint32_t CHUNK_VOLUME = CHUNK_SIZE_X * CHUNK_SIZE_Y * CHUNK_SIZE_Z;
+constexpr uint32_t CHUNK_SIZE_BYTES = CHUNK_VOLUME * sizeof(VoxelID);
+constexpr uint32_t CHUNK_SIZE_SHIFT = 5;
+
+static_assert(CHUNK_SIZE_X == CHUNK_SIZE_Y && CHUNK_SIZE_Y == CHUNK_SIZE_Z, "Chunks are assumed to be cubic");
+static_assert((1u << CHUNK_SIZE_SHIFT) == CHUNK_SIZE_X, "CHUNK_SIZE_SHIFT does not match CHUNK_SIZE_X");
+static_assert(ChunkOccupancy::SIZE == CHUNK_SIZE_X, "ChunkOccupancy must cover exactly one chunk");
+static_assert(ChunkMipChain::SIZE == CHUNK_SIZE_X, "ChunkMipChain must cover exactly one chunk");
+
+constexpr uint32_t CHUNK_MIP_LEVEL_COUNT = ChunkMipChain::LEVEL_COUNT;
+
+// Chunk coordinates packed 21:21:21 bits (x low, z high), each axis biased so negative coordinates fit
+using ChunkKey = uint64_t;
+constexpr int32_t CHUNK_KEY_AXIS_BITS = 21;
+constexpr int32_t CHUNK_KEY_AXIS_BIAS = 1 << (CHUNK_KEY_AXIS_BITS - 1);
+constexpr uint64_t CHUNK_KEY_AXIS_MASK = (1ull << CHUNK_KEY_AXIS_BITS) - 1;
+constexpr ChunkKey INVALID_CHUNK_KEY = ~0ull;
+
+inline ChunkKey packChunkKey(const glm::ivec3& chunkCoord)
+{
+    return (static_cast<uint64_t>(chunkCoord.x + CHUNK_KEY_AXIS_BIAS) & CHUNK_KEY_AXIS_MASK) |
+          ((static_cast<uint64_t>(chunkCoord.y + CHUNK_KEY_AXIS_BIAS) & CHUNK_KEY_AXIS_MASK) << CHUNK_KEY_AXIS_BITS) |
+          ((static_cast<uint64_t>(chunkCoord.z + CHUNK_KEY_AXIS_BIAS) & CHUNK_KEY_AXIS_MASK) << (CHUNK_KEY_AXIS_BITS * 2));
+}
+
+inline glm::ivec3 unpackChunkKey(ChunkKey key)
+{
+    return glm::ivec3(
+        static_cast<int32_t>(key & CHUNK_KEY_AXIS_MASK) - CHUNK_KEY_AXIS_BIAS,
+        static_cast<int32_t>((key >> CHUNK_KEY_AXIS_BITS) & CHUNK_KEY_AXIS_MASK) - CHUNK_KEY_AXIS_BIAS,
+        static_cast<int32_t>((key >> (CHUNK_KEY_AXIS_BITS * 2)) & CHUNK_KEY_AXIS_MASK) - CHUNK_KEY_AXIS_BIAS);
+}
+
+// Floor division so that voxel -1 lands in chunk -1 rather than chunk 0
+inline glm::ivec3 worldToChunkCoord(const glm::ivec3& voxelCoord)
+{
+    return glm::ivec3(
+        voxelCoord.x >> CHUNK_SIZE_SHIFT,
+        voxelCoord.y >> CHUNK_SIZE_SHIFT,
+        voxelCoord.z >> CHUNK_SIZE_SHIFT);
+}
+
+inline glm::ivec3 worldToLocalCoord(const glm::ivec3& voxelCoord)
+{
+    return glm::ivec3(
+        voxelCoord.x & static_cast<int32_t>(CHUNK_SIZE_X - 1),
+        voxelCoord.y & static_cast<int32_t>(CHUNK_SIZE_Y - 1),
+        voxelCoord.z & static_cast<int32_t>(CHUNK_SIZE_Z - 1));
+}
+
+// World-wide counter behind Chunk::version. A chunk that is evicted and loaded again gets a
+// value it never had before, so (position, version) identifies voxel contents across reloads
+// and caches keyed on it can't be fooled by a recycled Chunk allocation.
+inline uint64_t nextChunkGeneration()
+{
+    static std::atomic<uint64_t> generation{ 0 };
+    return generation.fetch_add(1, std::memory_order_relaxed) + 1;
+}
+
+struct Chunk
+{
+    glm::ivec3 position{ 0 }; // In chunk coordinates, multiply by CHUNK_SIZE for world space
+    uint64_t version = 0;     // Fresh world-wide generation on every load and modification, see nextChunkGeneration
+    uint64_t savedVersion = 0; // Version that was last read from or written to disk
+    uint64_t dirtyBricks = ~0ull; // 8^3 bricks changed since the last ChunkSnapshot, see ChunkSnapshot::create
+
+    std::array<VoxelID, CHUNK_VOLUME> voxels{};
+    ChunkOccupancy occupancy;  // Non-air voxels, kept in sync by set/fill
+    ChunkMipChain mips;        // Downsampled levels 1..5, kept in sync by set/fill
+
+
+    static constexpr uint32_t index(uint32_t x, uint32_t y, uint32_t z)
+    {
+        return x + CHUNK_SIZE_X * (y + CHUNK_SIZE_Y * z);
+    }
+
+    VoxelID get(uint32_t x, uint32_t y, uint32_t z) const
+    {
+        return voxels[index(x, y, z)];
+    }
+
+    void set(uint32_t x, uint32_t y, uint32_t z, VoxelID id)
+    {
+        voxels[index(x, y, z)] = id;
+        occupancy.set(x, y, z, id != AIR_VOXEL);
+        mips.update(voxels.data(), x, y, z);
+        dirtyBricks |= 1ull << ChunkOccupancy::brickIndex(x >> ChunkOccupancy::BRICK_SHIFT, y >> ChunkOccupancy::BRICK_SHIFT, z >> ChunkOccupancy::BRICK_SHIFT);
+        bumpVersion();
+    }
+
+    void fill(VoxelID id)
+    {
+        std::fill(voxels.begin(), voxels.end(), id);
+        occupancy.fill(id != AIR_VOXEL);
+        mips.fill(id);
+        dirtyBricks = ~0ull;
+        bumpVersion();
+    }
+
+    // Rebuilds occupancy and mips, call after writing to voxels directly (generators, decoders)
+    void rebuildDerivedData()
+    {
+        static_assert(sizeof(VoxelID) == 1, "ChunkOccupancy and ChunkMipChain expect byte-sized voxels");
+        occupancy.build(voxels.data());
+        mips.build(voxels.data());
+        dirtyBricks = ~0ull;
+        bumpVersion();
+    }
+
+    void bumpVersion() { version = nextChunkGeneration(); }
+
+    bool isModified() const { return version != savedVersion; }
+
+    glm::ivec3 getWorldOrigin() const
+    {
+        return position * glm::ivec3(CHUNK_SIZE_X, CHUNK_SIZE_Y, CHUNK_SIZE_Z);
+    }
+};
+
+// Read-only stand-in for a distant chunk, only one mip level of its voxels is kept
+struct ChunkLod
+{
+    glm::ivec3 position{ 0 }; // In chunk coordinates
+    uint32_t level = 1;       // Mip level, each voxel covers 2^level chunk voxels per axis
+    std::vector<VoxelID> voxels;
+
+    uint32_t size() const { return ChunkMipChain::levelSize(level); }
+
+    VoxelID get(uint32_t x, uint32_t y, uint32_t z) const
+    {
+        return voxels[ChunkMipChain::cellIndex(size(), x, y, z)];
+    }
+
+    void assign(const Chunk& chunk, uint32_t mipLevel)
+    {
+        position = chunk.position;
+        level = mipLevel;
+        const VoxelID* src = chunk.mips.getLevel(mipLevel);
+        voxels.assign(src, src + ChunkMipChain::levelVolume(mipLevel));
+    }
+
+    // Downsamples in place to a coarser level
+    void coarsen(uint32_t mipLevel)
+    {
+        while (level < mipLevel)
+        {
+            std::vector<VoxelID> coarser(ChunkMipChain::levelVolume(level + 1));
+            ChunkMipChain::downsample(voxels.data(), size(), coarser.data());
+            voxels.swap(coarser);
+            level++;
+        }
+    }
+
+    static constexpr size_t getMemorySize(uint32_t mipLevel)
+    {
+        return sizeof(ChunkLod) + ChunkMipChain::levelVolume(mipLevel);
+    }
+};
+
+
+// Legacy GPU-side chunk pool, kept for reference until chunks are streamed to the device
 //
-//#include "PerformanceTimer.hpp"
-//#include "DebugUtils.hpp"
-//#include "VulkanContext.hpp"
-//#include "AccelerationStructure.h"
-//#include "Buffer.hpp"
-//
-//#include <cstdint>
-//#include <vector>
-//#include <stack>
-//#include <unordered_map>
-//#include <stdexcept>
-//
-//#include "glm/gtc/matrix_transform.hpp"
-//
-//using VoxelID = uint8_t;
-//
-//constexpr uint32_t CHUNK_SIZE_X = 32;
-//constexpr uint32_t CHUNK_SIZE_Y = 32;
-//constexpr uint32_t CHUNK_SIZE_Z = 32;
-//constexpr uint32_t CHUNK_VOLUME = CHUNK_SIZE_X * CHUNK_SIZE_Y * CHUNK_SIZE_Z;
-//constexpr uint32_t CHUNK_SIZE_BYTES = CHUNK_VOLUME * sizeof(VoxelID);
-//
-//
-//struct MaterialEntry
-//{
-//    glm::vec4 albedo;
-//    glm::vec4 roughness;
-//    glm::vec4 metallic;
-//};
 //
 //constexpr uint32_t INVALID_POOL_INDEX = 0xFFFFFFFF;
 //
@@ -119,17 +275,3 @@
 //
 //    std::stack<TlasInstanceIndex> m_freeSlots;
 //};
-//
-//
-//
-//struct Chunk
-//{
-//    TlasInstanceIndex tlasInstanceIndex = INVALID_TLAS_INSTANCE_INDEX;
-//    uint32_t voxelPoolIndex = INVALID_POOL_INDEX;
-//
-//	VkTransformMatrixKHR transform;
-//    glm::ivec3 position;
-//
-//    void init(glm::ivec3 position);
-//    void destroy();
-//};
@@ -0,0 +1,122 @@
+#pragma once
+
+#include "Chunk.h"
+
+#include <cstdint>
+#include <cstring>
+#include <array>
+
+constexpr uint32_t CHUNK_APRON_SIZE = CHUNK_SIZE_X + 2;
+constexpr uint32_t CHUNK_APRON_VOLUME = CHUNK_APRON_SIZE * CHUNK_APRON_SIZE * CHUNK_APRON_SIZE;
+constexpr uint32_t CHUNK_APRON_NEIGHBOR_COUNT = 27; // Including the chunk itself
+
+// Padded 34^3 copy of a chunk plus the one-voxel layer of its 26 neighbours, so kernels that
+// look at neighbouring voxels (face culling, AO, lighting) can index x-1..x+1 without any
+// chunk lookups or bounds checks. Coordinates are chunk-local and range over [-1, 32].
+//
+// Each of the 27 source regions remembers the Chunk::version it was copied from, so a refresh
+// only recopies the regions whose source changed. Versions are world-wide generations, an
+// evicted and reloaded neighbour never matches an old stamp even if it reuses the same memory.
+// Non-resident neighbours read as air.
+struct ChunkApron
+{
+    struct SourceStamp
+    {
+        uint64_t version = 0; // 0 for a non-resident neighbour
+        bool valid = false;
+    };
+
+    std::array<VoxelID, CHUNK_APRON_VOLUME> voxels{};
+    std::array<SourceStamp, CHUNK_APRON_NEIGHBOR_COUNT> stamps{};
+
+    static constexpr int32_t index(int32_t x, int32_t y, int32_t z)
+    {
+        return (x + 1) + static_cast<int32_t>(CHUNK_APRON_SIZE) * ((y + 1) + static_cast<int32_t>(CHUNK_APRON_SIZE) * (z + 1));
+    }
+
+    // Offsets between neighbouring voxels in the flat array
+    static constexpr int32_t STRIDE_X = 1;
+    static constexpr int32_t STRIDE_Y = CHUNK_APRON_SIZE;
+    static constexpr int32_t STRIDE_Z = CHUNK_APRON_SIZE * CHUNK_APRON_SIZE;
+
+    static constexpr uint32_t neighborIndex(const glm::ivec3& offset)
+    {
+        return static_cast<uint32_t>((offset.x + 1) + 3 * ((offset.y + 1) + 3 * (offset.z + 1)));
+    }
+
+    VoxelID get(int32_t x, int32_t y, int32_t z) const { return voxels[index(x, y, z)]; }
+
+    // Bit per face (-X, +X, -Y, +Y, -Z, +Z) that borders air, 0 for air voxels
+    uint32_t getExposedFaces(int32_t x, int32_t y, int32_t z) const
+    {
+        const int32_t i = index(x, y, z);
+        const uint32_t solid = voxels[i] != AIR_VOXEL;
+        return solid * (
+            (static_cast<uint32_t>(voxels[i - STRIDE_X] == AIR_VOXEL) << 0) |
+            (static_cast<uint32_t>(voxels[i + STRIDE_X] == AIR_VOXEL) << 1) |
+            (static_cast<uint32_t>(voxels[i - STRIDE_Y] == AIR_VOXEL) << 2) |
+            (static_cast<uint32_t>(voxels[i + STRIDE_Y] == AIR_VOXEL) << 3) |
+            (static_cast<uint32_t>(voxels[i - STRIDE_Z] == AIR_VOXEL) << 4) |
+            (static_cast<uint32_t>(voxels[i + STRIDE_Z] == AIR_VOXEL) << 5));
+    }
+
+    // Recopies the region fed by the neighbour at offset (each component -1, 0 or 1) if its
+    // source changed. neighbor may be nullptr for non-resident chunks. Returns true if copied.
+    bool refreshRegion(const glm::ivec3& offset, const Chunk* neighbor)
+    {
+        SourceStamp& stamp = stamps[neighborIndex(offset)];
+        const uint64_t version = neighbor != nullptr ? neighbor->version : 0;
+        if (stamp.valid && stamp.version == version)
+        {
+            return false;
+        }
+
+        stamp.version = version;
+        stamp.valid = true;
+
+        // Per axis: apron range and the matching chunk-local source start
+        int32_t begin[3];
+        int32_t count[3];
+        int32_t source[3];
+        for (int32_t axis = 0; axis < 3; ++axis)
+        {
+            const int32_t size = static_cast<int32_t>(CHUNK_SIZE_X);
+            if (offset[axis] < 0)
+            {
+                begin[axis] = -1;
+                count[axis] = 1;
+                source[axis] = size - 1;
+            }
+            else if (offset[axis] > 0)
+            {
+                begin[axis] = size;
+                count[axis] = 1;
+                source[axis] = 0;
+            }
+            else
+            {
+                begin[axis] = 0;
+                count[axis] = size;
+                source[axis] = 0;
+            }
+        }
+
+        for (int32_t z = 0; z < count[2]; ++z)
+        {
+            for (int32_t y = 0; y < count[1]; ++y)
+            {
+                VoxelID* dst = voxels.data() + index(begin[0], begin[1] + y, begin[2] + z);
+                if (neighbor == nullptr)
+                {
+                    std::memset(dst, AIR_VOXEL, count[0]);
+                }
+                else
+                {
+                    const VoxelID* src = neighbor->voxels.data() + Chunk::index(source[0], source[1] + y, source[2] + z);
+                    std::memcpy(dst, src, count[0]);
+                }
+            }
+        }
+        return true;
+    }
+};
@@ -0,0 +1,437 @@
+#include "ChunkCulling.h"
+
+#include <immintrin.h>
+
+#include <cmath>
+#include <limits>
+#include <algorithm>
+#include <bit>
+
+namespace
+{
+    // Points closer than this (in clip w) are treated as crossing the camera
+    constexpr float MIN_PROJECTED_W = 1e-3f;
+
+    glm::vec4 getRow(const glm::mat4& m, int32_t row)
+    {
+        return glm::vec4(m[0][row], m[1][row], m[2][row], m[3][row]);
+    }
+
+    // Bricks [x0, x1] x [y0, y1] x [z0, z1] of a 4^3 brick grid, ChunkOccupancy::brickIndex layout
+    uint64_t getBrickBlockMask(uint32_t x0, uint32_t x1, uint32_t y0, uint32_t y1, uint32_t z0, uint32_t z1)
+    {
+        uint64_t mask = 0;
+        for (uint32_t z = z0; z <= z1; ++z)
+        {
+            for (uint32_t y = y0; y <= y1; ++y)
+            {
+                for (uint32_t x = x0; x <= x1; ++x)
+                {
+                    mask |= 1ull << ChunkOccupancy::brickIndex(x, y, z);
+                }
+            }
+        }
+        return mask;
+    }
+}
+
+Frustum Frustum::fromViewProjection(const glm::mat4& viewProjection)
+{
+    const glm::vec4 row0 = getRow(viewProjection, 0);
+    const glm::vec4 row1 = getRow(viewProjection, 1);
+    const glm::vec4 row2 = getRow(viewProjection, 2);
+    const glm::vec4 row3 = getRow(viewProjection, 3);
+
+    // The near plane assumes -1..1 depth, with 0..1 depth it ends up slightly behind the real one
+    Frustum frustum;
+    frustum.planes[0] = row3 + row0;
+    frustum.planes[1] = row3 - row0;
+    frustum.planes[2] = row3 + row1;
+    frustum.planes[3] = row3 - row1;
+    frustum.planes[4] = row3 + row2;
+    return frustum;
+}
+
+bool Frustum::intersects(const glm::vec3& min, const glm::vec3& max) const
+{
+    for (const glm::vec4& plane : planes)
+    {
+        // Corner furthest along the plane normal
+        const glm::vec3 corner(
+            plane.x >= 0.0f ? max.x : min.x,
+            plane.y >= 0.0f ? max.y : min.y,
+            plane.z >= 0.0f ? max.z : min.z);
+
+        if (glm::dot(glm::vec3(plane), corner) + plane.w < 0.0f)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+void CullingDepthBuffer::begin(const glm::mat4& viewProjection, const glm::vec3& cameraPosition)
+{
+    m_viewProjection = viewProjection;
+    m_cameraPosition = cameraPosition;
+    m_depth.fill(std::numeric_limits<float>::infinity());
+}
+
+bool CullingDepthBuffer::project(const glm::vec3& point, glm::vec3& screen) const
+{
+    const glm::vec4 clip = m_viewProjection * glm::vec4(point, 1.0f);
+    if (clip.w < MIN_PROJECTED_W)
+    {
+        return false;
+    }
+
+    const float invW = 1.0f / clip.w;
+    screen.x = (clip.x * invW * 0.5f + 0.5f) * static_cast<float>(WIDTH);
+    screen.y = (clip.y * invW * 0.5f + 0.5f) * static_cast<float>(HEIGHT);
+    screen.z = clip.w;
+    return true;
+}
+
+void CullingDepthBuffer::rasterizeBox(const glm::vec3& min, const glm::vec3& max)
+{
+    for (int32_t axis = 0; axis < 3; ++axis)
+    {
+        float plane;
+        if (m_cameraPosition[axis] < min[axis])
+        {
+            plane = min[axis];
+        }
+        else if (m_cameraPosition[axis] > max[axis])
+        {
+            plane = max[axis];
+        }
+        else
+        {
+            continue;
+        }
+
+        const int32_t u = (axis + 1) % 3;
+        const int32_t v = (axis + 2) % 3;
+
+        glm::vec3 corners[4];
+        for (int32_t i = 0; i < 4; ++i)
+        {
+            corners[i][axis] = plane;
+            corners[i][u] = (i == 1 || i == 2) ? max[u] : min[u];
+            corners[i][v] = (i >= 2) ? max[v] : min[v];
+        }
+
+        glm::vec3 screen[4];
+        if (project(corners[0], screen[0]) && project(corners[1], screen[1]) &&
+            project(corners[2], screen[2]) && project(corners[3], screen[3]))
+        {
+            rasterizeQuad(screen[0], screen[1], screen[2], screen[3]);
+        }
+    }
+}
+
+void CullingDepthBuffer::rasterizeQuad(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c, const glm::vec3& d)
+{
+    const glm::vec3 vertices[4] = { a, b, c, d };
+
+    float area = 0.0f;
+    for (int32_t i = 0; i < 4; ++i)
+    {
+        const glm::vec3& p = vertices[i];
+        const glm::vec3& q = vertices[(i + 1) % 4];
+        area += p.x * q.y - q.x * p.y;
+    }
+    if (std::abs(area) < 1e-6f)
+    {
+        return;
+    }
+
+    // Edge functions oriented so the inside is positive. The projection of a planar convex quad in
+    // front of the camera stays convex, so inside all four edges means inside the quad.
+    const float orientation = area > 0.0f ? 1.0f : -1.0f;
+    float edgeA[4];
+    float edgeB[4];
+    float edgeC[4];
+    float edgeSlack[4];
+    for (int32_t i = 0; i < 4; ++i)
+    {
+        const glm::vec3& p = vertices[i];
+        const glm::vec3& q = vertices[(i + 1) % 4];
+        edgeA[i] = -(q.y - p.y) * orientation;
+        edgeB[i] = (q.x - p.x) * orientation;
+        edgeC[i] = -(edgeA[i] * p.x + edgeB[i] * p.y);
+
+        // Evaluated at the pixel centre, the edge function is this much higher than at the pixel's worst corner
+        edgeSlack[i] = 0.5f * (std::abs(edgeA[i]) + std::abs(edgeB[i]));
+    }
+
+    float minX = a.x, maxX = a.x, minY = a.y, maxY = a.y, depth = a.z;
+    for (const glm::vec3& vertex : vertices)
+    {
+        minX = std::min(minX, vertex.x);
+        maxX = std::max(maxX, vertex.x);
+        minY = std::min(minY, vertex.y);
+        maxY = std::max(maxY, vertex.y);
+        depth = std::max(depth, vertex.z);
+    }
+
+    // Only pixels lying completely inside the quad
+    const int32_t x0 = std::max(static_cast<int32_t>(std::ceil(minX)), 0);
+    const int32_t x1 = std::min(static_cast<int32_t>(std::floor(maxX)) - 1, static_cast<int32_t>(WIDTH) - 1);
+    const int32_t y0 = std::max(static_cast<int32_t>(std::ceil(minY)), 0);
+    const int32_t y1 = std::min(static_cast<int32_t>(std::floor(maxY)) - 1, static_cast<int32_t>(HEIGHT) - 1);
+
+    for (int32_t y = y0; y <= y1; ++y)
+    {
+        const float py = static_cast<float>(y) + 0.5f;
+        for (int32_t x = x0; x <= x1; ++x)
+        {
+            const float px = static_cast<float>(x) + 0.5f;
+
+            bool covered = true;
+            for (int32_t i = 0; i < 4; ++i)
+            {
+                if (edgeA[i] * px + edgeB[i] * py + edgeC[i] < edgeSlack[i])
+                {
+                    covered = false;
+                    break;
+                }
+            }
+
+            if (covered)
+            {
+                float& stored = m_depth[x + y * WIDTH];
+                stored = std::min(stored, depth);
+            }
+        }
+    }
+}
+
+bool CullingDepthBuffer::isBoxVisible(const glm::vec3& min, const glm::vec3& max) const
+{
+    if (glm::all(glm::greaterThanEqual(m_cameraPosition, min)) && glm::all(glm::lessThanEqual(m_cameraPosition, max)))
+    {
+        return true;
+    }
+
+    float minX = std::numeric_limits<float>::max();
+    float maxX = std::numeric_limits<float>::lowest();
+    float minY = std::numeric_limits<float>::max();
+    float maxY = std::numeric_limits<float>::lowest();
+    float nearest = std::numeric_limits<float>::max();
+    for (int32_t i = 0; i < 8; ++i)
+    {
+        const glm::vec3 corner((i & 1) ? max.x : min.x, (i & 2) ? max.y : min.y, (i & 4) ? max.z : min.z);
+
+        glm::vec3 screen;
+        if (!project(corner, screen))
+        {
+            return true;
+        }
+
+        minX = std::min(minX, screen.x);
+        maxX = std::max(maxX, screen.x);
+        minY = std::min(minY, screen.y);
+        maxY = std::max(maxY, screen.y);
+        nearest = std::min(nearest, screen.z);
+    }
+
+    // Every pixel the rectangle touches
+    const int32_t x0 = std::max(static_cast<int32_t>(std::floor(minX)), 0);
+    const int32_t x1 = std::min(static_cast<int32_t>(std::ceil(maxX)) - 1, static_cast<int32_t>(WIDTH) - 1);
+    const int32_t y0 = std::max(static_cast<int32_t>(std::floor(minY)), 0);
+    const int32_t y1 = std::min(static_cast<int32_t>(std::ceil(maxY)) - 1, static_cast<int32_t>(HEIGHT) - 1);
+    if (x0 > x1 || y0 > y1)
+    {
+        return true;
+    }
+
+    for (int32_t y = y0; y <= y1; ++y)
+    {
+        const float* row = m_depth.data() + y * WIDTH;
+        for (int32_t x = x0; x <= x1; ++x)
+        {
+            if (row[x] >= nearest)
+            {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void ChunkCuller::begin(const glm::mat4& viewProjection, const glm::vec3& cameraPosition)
+{
+    m_frustum = Frustum::fromViewProjection(viewProjection);
+    m_depthBuffer.begin(viewProjection, cameraPosition);
+    m_stats = {};
+
+    m_minX.clear();
+    m_minY.clear();
+    m_minZ.clear();
+    m_maxX.clear();
+    m_maxY.clear();
+    m_maxZ.clear();
+    m_ids.clear();
+}
+
+void ChunkCuller::addOccluder(const glm::vec3& min, const glm::vec3& max)
+{
+    if (!m_occlusionEnabled || !m_frustum.intersects(min, max))
+    {
+        return;
+    }
+
+    m_depthBuffer.rasterizeBox(min, max);
+    m_stats.occluders++;
+}
+
+void ChunkCuller::addChunkOccluders(const Chunk& chunk)
+{
+    if (!m_occlusionEnabled)
+    {
+        return;
+    }
+
+    constexpr float BRICK_SIZE = static_cast<float>(ChunkOccupancy::BRICK_SIZE);
+
+    std::array<BrickBox, 64> boxes;
+    const uint32_t boxCount = mergeBricks(chunk.occupancy.computeFullBrickBits(), boxes.data());
+    const glm::vec3 origin(chunk.getWorldOrigin());
+    for (uint32_t i = 0; i < boxCount; ++i)
+    {
+        addOccluder(origin + glm::vec3(boxes[i].min) * BRICK_SIZE, origin + glm::vec3(boxes[i].max + 1u) * BRICK_SIZE);
+    }
+}
+
+uint32_t ChunkCuller::mergeBricks(uint64_t bricks, BrickBox* boxes)
+{
+    constexpr uint32_t BRICKS = ChunkOccupancy::BRICKS_PER_AXIS;
+
+    uint32_t boxCount = 0;
+    uint64_t remaining = bricks;
+    while (remaining != 0)
+    {
+        const uint32_t brick = std::countr_zero(remaining);
+        const uint32_t x0 = brick % BRICKS;
+        const uint32_t y0 = (brick / BRICKS) % BRICKS;
+        const uint32_t z0 = brick / (BRICKS * BRICKS);
+
+        uint32_t x1 = x0;
+        while (x1 + 1 < BRICKS && (remaining & getBrickBlockMask(x1 + 1, x1 + 1, y0, y0, z0, z0)) != 0)
+        {
+            x1++;
+        }
+
+        uint32_t y1 = y0;
+        while (y1 + 1 < BRICKS)
+        {
+            const uint64_t next = getBrickBlockMask(x0, x1, y1 + 1, y1 + 1, z0, z0);
+            if ((remaining & next) != next)
+            {
+                break;
+            }
+            y1++;
+        }
+
+        uint32_t z1 = z0;
+        while (z1 + 1 < BRICKS)
+        {
+            const uint64_t next = getBrickBlockMask(x0, x1, y0, y1, z1 + 1, z1 + 1);
+            if ((remaining & next) != next)
+            {
+                break;
+            }
+            z1++;
+        }
+
+        remaining &= ~getBrickBlockMask(x0, x1, y0, y1, z0, z1);
+        boxes[boxCount++] = { glm::uvec3(x0, y0, z0), glm::uvec3(x1, y1, z1) };
+    }
+    return boxCount;
+}
+
+void ChunkCuller::add(const glm::vec3& min, const glm::vec3& max, uint32_t id)
+{
+    m_minX.push_back(min.x);
+    m_minY.push_back(min.y);
+    m_minZ.push_back(min.z);
+    m_maxX.push_back(max.x);
+    m_maxY.push_back(max.y);
+    m_maxZ.push_back(max.z);
+    m_ids.push_back(id);
+}
+
+void ChunkCuller::cull(std::vector<uint32_t>& visible)
+{
+    visible.clear();
+
+    const uint32_t count = static_cast<uint32_t>(m_ids.size());
+    m_stats.tested = count;
+
+    auto accept = [&](uint32_t i)
+    {
+        if (m_occlusionEnabled && m_stats.occluders > 0)
+        {
+            const glm::vec3 min(m_minX[i], m_minY[i], m_minZ[i]);
+            const glm::vec3 max(m_maxX[i], m_maxY[i], m_maxZ[i]);
+            if (!m_depthBuffer.isBoxVisible(min, max))
+            {
+                m_stats.occlusionCulled++;
+                return;
+            }
+        }
+        visible.push_back(m_ids[i]);
+    };
+
+    uint32_t i = 0;
+
+#if defined(__AVX2__)
+    const __m256 zero = _mm256_setzero_ps();
+    for (; i + 8 <= count; i += 8)
+    {
+        const __m256 minX = _mm256_loadu_ps(m_minX.data() + i);
+        const __m256 minY = _mm256_loadu_ps(m_minY.data() + i);
+        const __m256 minZ = _mm256_loadu_ps(m_minZ.data() + i);
+        const __m256 maxX = _mm256_loadu_ps(m_maxX.data() + i);
+        const __m256 maxY = _mm256_loadu_ps(m_maxY.data() + i);
+        const __m256 maxZ = _mm256_loadu_ps(m_maxZ.data() + i);
+
+        __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+        for (const glm::vec4& plane : m_frustum.planes)
+        {
+            // The sign of each normal component is the same for all 8 boxes, so the corner
+            // furthest along the normal is picked per plane instead of per lane
+            const __m256 x = plane.x >= 0.0f ? maxX : minX;
+            const __m256 y = plane.y >= 0.0f ? maxY : minY;
+            const __m256 z = plane.z >= 0.0f ? maxZ : minZ;
+
+            __m256 distance = _mm256_add_ps(_mm256_mul_ps(x, _mm256_set1_ps(plane.x)), _mm256_set1_ps(plane.w));
+            distance = _mm256_add_ps(distance, _mm256_mul_ps(y, _mm256_set1_ps(plane.y)));
+            distance = _mm256_add_ps(distance, _mm256_mul_ps(z, _mm256_set1_ps(plane.z)));
+            inside = _mm256_and_ps(inside, _mm256_cmp_ps(distance, zero, _CMP_GE_OQ));
+        }
+
+        const uint32_t mask = static_cast<uint32_t>(_mm256_movemask_ps(inside));
+        m_stats.frustumCulled += 8 - std::popcount(mask);
+        for (uint32_t bits = mask; bits != 0; bits &= bits - 1)
+        {
+            accept(i + std::countr_zero(bits));
+        }
+    }
+#endif
+
+    for (; i < count; ++i)
+    {
+        const glm::vec3 min(m_minX[i], m_minY[i], m_minZ[i]);
+        const glm::vec3 max(m_maxX[i], m_maxY[i], m_maxZ[i]);
+        if (!m_frustum.intersects(min, max))
+        {
+            m_stats.frustumCulled++;
+            continue;
+        }
+        accept(i);
+    }
+
+    m_stats.visible = static_cast<uint32_t>(visible.size());
+}
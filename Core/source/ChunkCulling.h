@@ -0,0 +1,116 @@
+#pragma once
+
+#include "Chunk.h"
+
+#include "glm/glm.hpp"
+
+#include <cstdint>
+#include <array>
+#include <vector>
+
+// Side planes of a view-projection matrix, normals pointing inwards. There is no far plane:
+// rays are traced well past the camera's far clip, so geometry beyond it is still visible.
+struct Frustum
+{
+    static constexpr uint32_t PLANE_COUNT = 5; // left, right, bottom, top, near
+
+    std::array<glm::vec4, PLANE_COUNT> planes{};
+
+    static Frustum fromViewProjection(const glm::mat4& viewProjection);
+
+    bool intersects(const glm::vec3& min, const glm::vec3& max) const;
+};
+
+// Coarse CPU depth buffer holding the nearest occluder distance (clip w) per pixel.
+//
+// Occluders only mark pixels they cover completely, with the farthest depth of the face that
+// covers them, and tests take the nearest depth of the whole screen rectangle of a box. Both err
+// towards visible, so a box is only rejected when it really is hidden.
+class CullingDepthBuffer
+{
+public:
+    static constexpr uint32_t WIDTH = 128;
+    static constexpr uint32_t HEIGHT = 64;
+
+    void begin(const glm::mat4& viewProjection, const glm::vec3& cameraPosition);
+
+    // Rasterizes the faces of a solid box that face the camera, faces crossing the near plane are skipped
+    void rasterizeBox(const glm::vec3& min, const glm::vec3& max);
+
+    // False only if every pixel the box could touch has an occluder in front of it
+    bool isBoxVisible(const glm::vec3& min, const glm::vec3& max) const;
+
+    float getDepth(uint32_t x, uint32_t y) const { return m_depth[x + y * WIDTH]; }
+
+private:
+    // Screen position in pixels and clip w, false if the point is too close to or behind the camera
+    bool project(const glm::vec3& point, glm::vec3& screen) const;
+
+    void rasterizeQuad(const glm::vec3& a, const glm::vec3& b, const glm::vec3& c, const glm::vec3& d);
+
+    glm::mat4 m_viewProjection{ 1.0f };
+    glm::vec3 m_cameraPosition{ 0.0f };
+    std::array<float, WIDTH * HEIGHT> m_depth{};
+};
+
+// Inclusive box of bricks in the 4^3 brick grid of a chunk, see ChunkOccupancy::brickIndex
+struct BrickBox
+{
+    glm::uvec3 min{ 0 };
+    glm::uvec3 max{ 0 };
+};
+
+struct CullingStats
+{
+    uint32_t tested = 0;
+    uint32_t frustumCulled = 0;
+    uint32_t occlusionCulled = 0;
+    uint32_t visible = 0;
+    uint32_t occluders = 0;
+};
+
+// Frustum and occlusion culling of world-space boxes, each tagged with a caller-defined id.
+//
+// Per frame: begin() with the camera, addOccluder()/addChunkOccluders() for nearby solid
+// geometry, add() every candidate, then cull() writes the ids of the visible ones, in the order
+// they were added. The frustum test runs on 8 boxes at a time with AVX, survivors are then
+// checked against the depth buffer.
+class ChunkCuller
+{
+public:
+    void begin(const glm::mat4& viewProjection, const glm::vec3& cameraPosition);
+
+    void addOccluder(const glm::vec3& min, const glm::vec3& max);
+
+    // Fully solid bricks of the chunk, merged into as few boxes as possible
+    void addChunkOccluders(const Chunk& chunk);
+
+    void add(const glm::vec3& min, const glm::vec3& max, uint32_t id);
+
+    // Splits the set bits of a brick mask into disjoint boxes, growing each along x, then y, then
+    // z while every brick it would add is set. Writes at most 64 boxes and returns their count.
+    static uint32_t mergeBricks(uint64_t bricks, BrickBox* boxes);
+
+    void cull(std::vector<uint32_t>& visible);
+
+    void setOcclusionEnabled(bool enabled) { m_occlusionEnabled = enabled; }
+    bool isOcclusionEnabled() const { return m_occlusionEnabled; }
+
+    const CullingStats& getStats() const { return m_stats; }
+    const CullingDepthBuffer& getDepthBuffer() const { return m_depthBuffer; }
+
+private:
+    Frustum m_frustum;
+    CullingDepthBuffer m_depthBuffer;
+    bool m_occlusionEnabled = true;
+    CullingStats m_stats;
+
+    // Candidates as SoA so the frustum test can load 8 of each bound at once
+    std::vector<float> m_minX;
+    std::vector<float> m_minY;
+    std::vector<float> m_minZ;
+    std::vector<float> m_maxX;
+    std::vector<float> m_maxY;
+    std::vector<float> m_maxZ;
+    std::vector<uint32_t> m_ids;
+};
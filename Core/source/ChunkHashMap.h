@@ -0,0 +1,269 @@
+#pragma once
+
+#include "Chunk.h"
+
+#include <emmintrin.h>
+
+#include <cstdint>
+#include <vector>
+#include <bit>
+#include <utility>
+
+// Open-addressing hash map keyed on packed chunk coordinates.
+// Slots are grouped 16 at a time, each group has 16 control bytes holding 7 bits of the
+// hash (or EMPTY/DELETED). A probe compares the whole control group against the key's tag
+// with one SSE2 compare and only touches keys whose tag matched.
+template<typename T>
+class ChunkHashMap
+{
+public:
+    // Remembers the last hit slot, validated against the map's generation so it can't go stale.
+    // Give each thread its own cache when looking up concurrently.
+    struct LookupCache
+    {
+        ChunkKey key = INVALID_CHUNK_KEY;
+        uint32_t slot = 0;
+        uint64_t generation = ~0ull;
+    };
+
+    explicit ChunkHashMap(uint32_t initialCapacity = 256)
+    {
+        allocate(capacityForCount(initialCapacity));
+    }
+
+    T* find(ChunkKey key)
+    {
+        uint32_t slot = findSlot(key);
+        return slot != INVALID_SLOT ? &m_values[slot] : nullptr;
+    }
+
+    const T* find(ChunkKey key) const
+    {
+        uint32_t slot = findSlot(key);
+        return slot != INVALID_SLOT ? &m_values[slot] : nullptr;
+    }
+
+    T* find(ChunkKey key, LookupCache& cache)
+    {
+        if (cache.key == key && cache.generation == m_generation)
+        {
+            return &m_values[cache.slot];
+        }
+
+        uint32_t slot = findSlot(key);
+        if (slot == INVALID_SLOT)
+        {
+            return nullptr;
+        }
+
+        cache.key = key;
+        cache.slot = slot;
+        cache.generation = m_generation;
+        return &m_values[slot];
+    }
+
+    const T* find(ChunkKey key, LookupCache& cache) const
+    {
+        return const_cast<ChunkHashMap*>(this)->find(key, cache);
+    }
+
+    bool contains(ChunkKey key) const { return findSlot(key) != INVALID_SLOT; }
+
+    // Inserts or overwrites, returns a reference to the stored value
+    T& insert(ChunkKey key, T value)
+    {
+        uint32_t slot = findSlot(key);
+        if (slot != INVALID_SLOT)
+        {
+            m_values[slot] = std::move(value);
+            return m_values[slot];
+        }
+
+        if ((m_size + m_tombstones + 1) * 8 > capacity() * 7)
+        {
+            rehash(m_size + 1 > capacity() / 2 ? capacity() * 2 : capacity());
+        }
+
+        slot = findInsertSlot(hashKey(key));
+        if (m_ctrl[slot] == CTRL_DELETED)
+        {
+            m_tombstones--;
+        }
+
+        m_ctrl[slot] = tagOf(hashKey(key));
+        m_keys[slot] = key;
+        m_values[slot] = std::move(value);
+        m_size++;
+        return m_values[slot];
+    }
+
+    bool erase(ChunkKey key)
+    {
+        uint32_t slot = findSlot(key);
+        if (slot == INVALID_SLOT)
+        {
+            return false;
+        }
+
+        m_ctrl[slot] = CTRL_DELETED;
+        m_keys[slot] = INVALID_CHUNK_KEY;
+        m_values[slot] = T{};
+        m_size--;
+        m_tombstones++;
+        m_generation++;
+        return true;
+    }
+
+    void clear()
+    {
+        allocate(capacity());
+    }
+
+    template<typename Func>
+    void forEach(Func&& func)
+    {
+        for (uint32_t slot = 0; slot < capacity(); ++slot)
+        {
+            if (m_ctrl[slot] >= 0)
+            {
+                func(m_keys[slot], m_values[slot]);
+            }
+        }
+    }
+
+    uint32_t size() const { return m_size; }
+    bool empty() const { return m_size == 0; }
+    uint32_t capacity() const { return static_cast<uint32_t>(m_keys.size()); }
+
+private:
+    static constexpr uint32_t GROUP_SIZE = 16;
+    static constexpr uint32_t INVALID_SLOT = 0xFFFFFFFF;
+    static constexpr int8_t CTRL_EMPTY = static_cast<int8_t>(0x80);
+    static constexpr int8_t CTRL_DELETED = static_cast<int8_t>(0xFE);
+
+    // splitmix64 finalizer, packed keys are highly structured so they need a proper mix
+    static uint64_t hashKey(ChunkKey key)
+    {
+        key ^= key >> 30;
+        key *= 0xbf58476d1ce4e5b9ull;
+        key ^= key >> 27;
+        key *= 0x94d049bb133111ebull;
+        key ^= key >> 31;
+        return key;
+    }
+
+    static int8_t tagOf(uint64_t hash) { return static_cast<int8_t>(hash & 0x7F); }
+
+    static uint32_t capacityForCount(uint32_t count)
+    {
+        uint32_t capacity = GROUP_SIZE;
+        while (capacity * 7 < count * 8)
+        {
+            capacity *= 2;
+        }
+        return capacity;
+    }
+
+    uint32_t groupMask() const { return capacity() / GROUP_SIZE - 1; }
+
+    uint32_t matchMask(uint32_t group, int8_t tag) const
+    {
+        __m128i ctrl = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&m_ctrl[group * GROUP_SIZE]));
+        return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8(tag))));
+    }
+
+    uint32_t emptyMask(uint32_t group) const
+    {
+        return matchMask(group, CTRL_EMPTY);
+    }
+
+    uint32_t findSlot(ChunkKey key) const
+    {
+        const uint64_t hash = hashKey(key);
+        const int8_t tag = tagOf(hash);
+        const uint32_t mask = groupMask();
+
+        uint32_t group = static_cast<uint32_t>(hash >> 7) & mask;
+        for (uint32_t probe = 1; probe <= mask + 1; ++probe)
+        {
+            uint32_t matches = matchMask(group, tag);
+            while (matches != 0)
+            {
+                uint32_t slot = group * GROUP_SIZE + std::countr_zero(matches);
+                if (m_keys[slot] == key)
+                {
+                    return slot;
+                }
+                matches &= matches - 1;
+            }
+
+            if (emptyMask(group) != 0)
+            {
+                return INVALID_SLOT;
+            }
+
+            group = (group + probe) & mask;
+        }
+        return INVALID_SLOT;
+    }
+
+    // First EMPTY or DELETED slot along the probe sequence
+    uint32_t findInsertSlot(uint64_t hash) const
+    {
+        const uint32_t mask = groupMask();
+
+        uint32_t group = static_cast<uint32_t>(hash >> 7) & mask;
+        for (uint32_t probe = 1; ; ++probe)
+        {
+            __m128i ctrl = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&m_ctrl[group * GROUP_SIZE]));
+            // EMPTY and DELETED are the only control values with the sign bit set
+            uint32_t available = static_cast<uint32_t>(_mm_movemask_epi8(ctrl));
+            if (available != 0)
+            {
+                return group * GROUP_SIZE + std::countr_zero(available);
+            }
+            group = (group + probe) & mask;
+        }
+    }
+
+    void allocate(uint32_t newCapacity)
+    {
+        m_ctrl.assign(newCapacity, CTRL_EMPTY);
+        m_keys.assign(newCapacity, INVALID_CHUNK_KEY);
+        m_values.clear();
+        m_values.resize(newCapacity);
+        m_size = 0;
+        m_tombstones = 0;
+        m_generation++;
+    }
+
+    void rehash(uint32_t newCapacity)
+    {
+        std::vector<int8_t> oldCtrl = std::move(m_ctrl);
+        std::vector<ChunkKey> oldKeys = std::move(m_keys);
+        std::vector<T> oldValues = std::move(m_values);
+
+        allocate(newCapacity);
+
+        for (size_t slot = 0; slot < oldKeys.size(); ++slot)
+        {
+            if (oldCtrl[slot] >= 0)
+            {
+                const uint64_t hash = hashKey(oldKeys[slot]);
+                uint32_t newSlot = findInsertSlot(hash);
+                m_ctrl[newSlot] = tagOf(hash);
+                m_keys[newSlot] = oldKeys[slot];
+                m_values[newSlot] = std::move(oldValues[slot]);
+                m_size++;
+            }
+        }
+    }
+
+    std::vector<int8_t> m_ctrl;
+    std::vector<ChunkKey> m_keys;
+    std::vector<T> m_values;
+
+    uint32_t m_size = 0;
+    uint32_t m_tombstones = 0;
+    uint64_t m_generation = 0;
+};
@@ -0,0 +1,136 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <array>
+
+// Mip chain of a 32^3 chunk: 16^3, 8^3, 4^3, 2^3 and 1 voxel, each cell holding the majority
+// vote of its 2x2x2 children. Ties go to the first non-air child so thin surfaces survive the
+// downsampling. Level 0 is the chunk itself and isn't stored here.
+class ChunkMipChain
+{
+public:
+    static constexpr uint32_t SIZE = 32;
+    static constexpr uint32_t LEVEL_COUNT = 6; // Including level 0
+
+    static constexpr uint32_t levelSize(uint32_t level) { return SIZE >> level; }
+    static constexpr uint32_t levelVolume(uint32_t level) { return levelSize(level) * levelSize(level) * levelSize(level); }
+    static constexpr uint32_t levelOffset(uint32_t level)
+    {
+        uint32_t offset = 0;
+        for (uint32_t l = 1; l < level; ++l)
+        {
+            offset += levelVolume(l);
+        }
+        return offset;
+    }
+    static constexpr uint32_t STORAGE_SIZE = (SIZE * SIZE * SIZE - 1) / 7; // 8^4 + 8^3 + ... + 1
+
+    static constexpr uint32_t cellIndex(uint32_t size, uint32_t x, uint32_t y, uint32_t z)
+    {
+        return x + size * (y + size * z);
+    }
+
+    static uint8_t majorityVote(const uint8_t (&children)[8])
+    {
+        uint64_t packed;
+        std::memcpy(&packed, children, sizeof(packed));
+        if (packed == children[0] * 0x0101010101010101ull)
+        {
+            return children[0];
+        }
+
+        uint8_t best = children[0];
+        uint32_t bestCount = 0;
+        for (uint32_t i = 0; i < 8; ++i)
+        {
+            uint32_t count = 0;
+            for (uint32_t j = 0; j < 8; ++j)
+            {
+                count += children[j] == children[i];
+            }
+
+            if (count > bestCount || (count == bestCount && best == 0 && children[i] != 0))
+            {
+                best = children[i];
+                bestCount = count;
+            }
+        }
+        return best;
+    }
+
+    // Majority vote of the 2x2x2 block of src (srcSize^3) that maps to cell (x, y, z) of the next level
+    static uint8_t downsampleCell(const uint8_t* src, uint32_t srcSize, uint32_t x, uint32_t y, uint32_t z)
+    {
+        uint8_t children[8];
+        for (uint32_t i = 0; i < 8; ++i)
+        {
+            children[i] = src[cellIndex(srcSize, 2 * x + (i & 1), 2 * y + ((i >> 1) & 1), 2 * z + (i >> 2))];
+        }
+        return majorityVote(children);
+    }
+
+    // dst must hold (srcSize / 2)^3 cells
+    static void downsample(const uint8_t* src, uint32_t srcSize, uint8_t* dst)
+    {
+        const uint32_t dstSize = srcSize / 2;
+        for (uint32_t z = 0; z < dstSize; ++z)
+        {
+            for (uint32_t y = 0; y < dstSize; ++y)
+            {
+                for (uint32_t x = 0; x < dstSize; ++x)
+                {
+                    dst[cellIndex(dstSize, x, y, z)] = downsampleCell(src, srcSize, x, y, z);
+                }
+            }
+        }
+    }
+
+    void build(const uint8_t* voxels)
+    {
+        const uint8_t* src = voxels;
+        for (uint32_t level = 1; level < LEVEL_COUNT; ++level)
+        {
+            uint8_t* dst = m_levels.data() + levelOffset(level);
+            downsample(src, levelSize(level - 1), dst);
+            src = dst;
+        }
+    }
+
+    // Re-votes only the cells above voxel (x, y, z), one per level
+    void update(const uint8_t* voxels, uint32_t x, uint32_t y, uint32_t z)
+    {
+        const uint8_t* src = voxels;
+        for (uint32_t level = 1; level < LEVEL_COUNT; ++level)
+        {
+            x >>= 1;
+            y >>= 1;
+            z >>= 1;
+
+            uint8_t* dst = m_levels.data() + levelOffset(level);
+            const uint32_t index = cellIndex(levelSize(level), x, y, z);
+            const uint8_t value = downsampleCell(src, levelSize(level - 1), x, y, z);
+            if (dst[index] == value)
+            {
+                return; // Nothing above can change either
+            }
+
+            dst[index] = value;
+            src = dst;
+        }
+    }
+
+    void fill(uint8_t id) { m_levels.fill(id); }
+
+    // level must be in [1, LEVEL_COUNT)
+    const uint8_t* getLevel(uint32_t level) const { return m_levels.data() + levelOffset(level); }
+    uint8_t get(uint32_t level, uint32_t x, uint32_t y, uint32_t z) const
+    {
+        return getLevel(level)[cellIndex(levelSize(level), x, y, z)];
+    }
+
+private:
+    std::array<uint8_t, STORAGE_SIZE> m_levels{};
+};
+
+static_assert(ChunkMipChain::STORAGE_SIZE == ChunkMipChain::levelOffset(ChunkMipChain::LEVEL_COUNT), "ChunkMipChain storage does not match its levels");
@@ -0,0 +1,372 @@
+#pragma once
+
+#include <immintrin.h>
+
+#include <cstdint>
+#include <cstring>
+#include <array>
+#include <bit>
+
+// One bit per voxel of a 32^3 chunk (4 KB) plus summary bits, so empty space can be skipped
+// without touching the voxel bytes.
+//
+// Bits are stored as rows along X: row (y, z) is a uint32_t with bit x set when voxel (x, y, z)
+// is solid. On top of that:
+//   - column bits: bit y of m_columnBits[z] is set when row (y, z) has any solid voxel
+//   - slice bits:  bit z of m_sliceBits is set when the XY slice at z has any solid voxel
+//   - brick bits:  one bit per 8^3 brick, 4x4x4 bricks, x fastest
+// Setting a voxel solid is O(1), clearing one recomputes at most one brick (64 rows).
+class ChunkOccupancy
+{
+public:
+    static constexpr uint32_t SIZE = 32;
+    static constexpr uint32_t ROW_COUNT = SIZE * SIZE;
+    static constexpr uint32_t BRICK_SIZE = 8;
+    static constexpr uint32_t BRICK_SHIFT = 3;
+    static constexpr uint32_t BRICKS_PER_AXIS = SIZE / BRICK_SIZE;
+
+    static constexpr uint32_t rowIndex(uint32_t y, uint32_t z) { return y + SIZE * z; }
+    static constexpr uint32_t brickIndex(uint32_t bx, uint32_t by, uint32_t bz)
+    {
+        return bx + BRICKS_PER_AXIS * (by + BRICKS_PER_AXIS * bz);
+    }
+
+    void clear()
+    {
+        m_rows.fill(0);
+        m_columnBits.fill(0);
+        m_sliceBits = 0;
+        m_brickBits = 0;
+    }
+
+    void fill(bool solid)
+    {
+        if (!solid)
+        {
+            clear();
+            return;
+        }
+
+        m_rows.fill(~0u);
+        m_columnBits.fill(~0u);
+        m_sliceBits = ~0u;
+        m_brickBits = ~0ull;
+    }
+
+    // Rebuilds everything from 32^3 voxel bytes laid out x fastest, any non-zero byte is solid
+    void build(const uint8_t* voxels)
+    {
+        for (uint32_t row = 0; row < ROW_COUNT; ++row)
+        {
+#if defined(__AVX2__)
+            const __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(voxels + row * SIZE));
+            const __m256i isAir = _mm256_cmpeq_epi8(bytes, _mm256_setzero_si256());
+            m_rows[row] = ~static_cast<uint32_t>(_mm256_movemask_epi8(isAir));
+#else
+            uint32_t bits = 0;
+            for (uint32_t x = 0; x < SIZE; ++x)
+            {
+                bits |= static_cast<uint32_t>(voxels[row * SIZE + x] != 0) << x;
+            }
+            m_rows[row] = bits;
+#endif
+        }
+
+        rebuildSummaries();
+    }
+
+    bool isSolid(uint32_t x, uint32_t y, uint32_t z) const
+    {
+        return (m_rows[rowIndex(y, z)] >> x) & 1u;
+    }
+
+    void set(uint32_t x, uint32_t y, uint32_t z, bool solid)
+    {
+        uint32_t& row = m_rows[rowIndex(y, z)];
+
+        if (solid)
+        {
+            row |= 1u << x;
+            m_columnBits[z] |= 1u << y;
+            m_sliceBits |= 1u << z;
+            m_brickBits |= 1ull << brickIndex(x >> BRICK_SHIFT, y >> BRICK_SHIFT, z >> BRICK_SHIFT);
+            return;
+        }
+
+        row &= ~(1u << x);
+
+        const uint32_t bx = x >> BRICK_SHIFT;
+        if ((row >> (bx * BRICK_SIZE)) & 0xFFu)
+        {
+            return;
+        }
+
+        if (row == 0)
+        {
+            m_columnBits[z] &= ~(1u << y);
+            if (m_columnBits[z] == 0)
+            {
+                m_sliceBits &= ~(1u << z);
+            }
+        }
+
+        const uint32_t by = y >> BRICK_SHIFT;
+        const uint32_t bz = z >> BRICK_SHIFT;
+        if (!computeBrickSolid(bx, by, bz))
+        {
+            m_brickBits &= ~(1ull << brickIndex(bx, by, bz));
+        }
+    }
+
+    uint32_t getRow(uint32_t y, uint32_t z) const { return m_rows[rowIndex(y, z)]; }
+    uint32_t getColumnBits(uint32_t z) const { return m_columnBits[z]; }
+    uint32_t getSliceBits() const { return m_sliceBits; }
+    uint64_t getBrickBits() const { return m_brickBits; }
+
+    // One bit per brick (same layout as getBrickBits) that is completely solid. Not cached,
+    // walks the rows of every non-empty brick.
+    uint64_t computeFullBrickBits() const
+    {
+        uint64_t full = 0;
+        for (uint64_t bits = m_brickBits; bits != 0; bits &= bits - 1)
+        {
+            const uint32_t brick = std::countr_zero(bits);
+            const uint32_t bx = brick % BRICKS_PER_AXIS;
+            const uint32_t by = (brick / BRICKS_PER_AXIS) % BRICKS_PER_AXIS;
+            const uint32_t bz = brick / (BRICKS_PER_AXIS * BRICKS_PER_AXIS);
+
+            bool solid = true;
+            for (uint32_t z = bz * BRICK_SIZE; z < (bz + 1) * BRICK_SIZE && solid; ++z)
+            {
+                for (uint32_t y = by * BRICK_SIZE; y < (by + 1) * BRICK_SIZE; ++y)
+                {
+                    if (((m_rows[rowIndex(y, z)] >> (bx * BRICK_SIZE)) & 0xFFu) != 0xFFu)
+                    {
+                        solid = false;
+                        break;
+                    }
+                }
+            }
+
+            if (solid)
+            {
+                full |= 1ull << brick;
+            }
+        }
+        return full;
+    }
+
+    bool isEmpty() const { return m_sliceBits == 0; }
+    bool isFull() const { return countSolid() == SIZE * SIZE * SIZE; }
+    bool isRowEmpty(uint32_t y, uint32_t z) const { return ((m_columnBits[z] >> y) & 1u) == 0; }
+    bool isSliceEmpty(uint32_t z) const { return ((m_sliceBits >> z) & 1u) == 0; }
+
+    // Brick coordinates are in 8^3 units (0..3 per axis)
+    bool isBrickEmpty(uint32_t bx, uint32_t by, uint32_t bz) const
+    {
+        return ((m_brickBits >> brickIndex(bx, by, bz)) & 1ull) == 0;
+    }
+
+    // First solid voxel at or after x along +X in row (y, z), -1 if there is none
+    int32_t firstSolidPositiveX(uint32_t x, uint32_t y, uint32_t z) const
+    {
+        const uint32_t bits = m_rows[rowIndex(y, z)] & (~0u << x);
+        return bits != 0 ? std::countr_zero(bits) : -1;
+    }
+
+    // First solid voxel at or before x along -X in row (y, z), -1 if there is none
+    int32_t firstSolidNegativeX(uint32_t x, uint32_t y, uint32_t z) const
+    {
+        const uint32_t bits = m_rows[rowIndex(y, z)] & (~0u >> (SIZE - 1 - x));
+        return bits != 0 ? static_cast<int32_t>(SIZE - 1) - std::countl_zero(bits) : -1;
+    }
+
+    // Along Y and Z only rows flagged in the summaries are visited
+    int32_t firstSolidPositiveY(uint32_t x, uint32_t y, uint32_t z) const
+    {
+        uint32_t candidates = m_columnBits[z] & (~0u << y);
+        while (candidates != 0)
+        {
+            const uint32_t cy = std::countr_zero(candidates);
+            if (isSolid(x, cy, z))
+            {
+                return static_cast<int32_t>(cy);
+            }
+            candidates &= candidates - 1;
+        }
+        return -1;
+    }
+
+    int32_t firstSolidNegativeY(uint32_t x, uint32_t y, uint32_t z) const
+    {
+        uint32_t candidates = m_columnBits[z] & (~0u >> (SIZE - 1 - y));
+        while (candidates != 0)
+        {
+            const uint32_t cy = SIZE - 1 - std::countl_zero(candidates);
+            if (isSolid(x, cy, z))
+            {
+                return static_cast<int32_t>(cy);
+            }
+            candidates &= ~(1u << cy);
+        }
+        return -1;
+    }
+
+    int32_t firstSolidPositiveZ(uint32_t x, uint32_t y, uint32_t z) const
+    {
+        uint32_t candidates = m_sliceBits & (~0u << z);
+        while (candidates != 0)
+        {
+            const uint32_t cz = std::countr_zero(candidates);
+            if (isSolid(x, y, cz))
+            {
+                return static_cast<int32_t>(cz);
+            }
+            candidates &= candidates - 1;
+        }
+        return -1;
+    }
+
+    int32_t firstSolidNegativeZ(uint32_t x, uint32_t y, uint32_t z) const
+    {
+        uint32_t candidates = m_sliceBits & (~0u >> (SIZE - 1 - z));
+        while (candidates != 0)
+        {
+            const uint32_t cz = SIZE - 1 - std::countl_zero(candidates);
+            if (isSolid(x, y, cz))
+            {
+                return static_cast<int32_t>(cz);
+            }
+            candidates &= ~(1u << cz);
+        }
+        return -1;
+    }
+
+    // True if no voxel in the inclusive box [min, max] is solid
+    bool isBoxEmpty(uint32_t minX, uint32_t minY, uint32_t minZ, uint32_t maxX, uint32_t maxY, uint32_t maxZ) const
+    {
+        const uint32_t xMask = (~0u << minX) & (~0u >> (SIZE - 1 - maxX));
+        const uint32_t yMask = (~0u << minY) & (~0u >> (SIZE - 1 - maxY));
+        const uint32_t zMask = (~0u << minZ) & (~0u >> (SIZE - 1 - maxZ));
+
+        if ((m_sliceBits & zMask) == 0)
+        {
+            return true;
+        }
+
+        for (uint32_t z = minZ; z <= maxZ; ++z)
+        {
+            if ((m_columnBits[z] & yMask) == 0)
+            {
+                continue;
+            }
+
+            const uint32_t* rows = m_rows.data() + rowIndex(0, z);
+            uint32_t y = minY;
+#if defined(__AVX2__)
+            const __m256i xMask8 = _mm256_set1_epi32(static_cast<int32_t>(xMask));
+            for (; y + 8 <= maxY + 1; y += 8)
+            {
+                const __m256i row8 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rows + y));
+                if (!_mm256_testz_si256(row8, xMask8))
+                {
+                    return false;
+                }
+            }
+#endif
+            for (; y <= maxY; ++y)
+            {
+                if (rows[y] & xMask)
+                {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    uint32_t countSolid() const
+    {
+        uint32_t count = 0;
+        for (uint32_t z = 0; z < SIZE; ++z)
+        {
+            if (isSliceEmpty(z))
+            {
+                continue;
+            }
+
+            const uint32_t* rows = m_rows.data() + rowIndex(0, z);
+            for (uint32_t y = 0; y < SIZE; y += 2)
+            {
+                uint64_t pair;
+                std::memcpy(&pair, rows + y, sizeof(pair));
+                count += std::popcount(pair);
+            }
+        }
+        return count;
+    }
+
+private:
+    bool computeBrickSolid(uint32_t bx, uint32_t by, uint32_t bz) const
+    {
+        const uint32_t xMask = 0xFFu << (bx * BRICK_SIZE);
+        for (uint32_t z = bz * BRICK_SIZE; z < (bz + 1) * BRICK_SIZE; ++z)
+        {
+            const uint32_t* rows = m_rows.data() + rowIndex(by * BRICK_SIZE, z);
+#if defined(__AVX2__)
+            const __m256i row8 = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(rows));
+            if (!_mm256_testz_si256(row8, _mm256_set1_epi32(static_cast<int32_t>(xMask))))
+            {
+                return true;
+            }
+#else
+            for (uint32_t y = 0; y < BRICK_SIZE; ++y)
+            {
+                if (rows[y] & xMask)
+                {
+                    return true;
+                }
+            }
+#endif
+        }
+        return false;
+    }
+
+    void rebuildSummaries()
+    {
+        m_sliceBits = 0;
+        m_brickBits = 0;
+
+        for (uint32_t z = 0; z < SIZE; ++z)
+        {
+            uint32_t columnBits = 0;
+            uint32_t brickRows[BRICKS_PER_AXIS] = {}; // OR of the rows in each y brick of this slice
+
+            for (uint32_t y = 0; y < SIZE; ++y)
+            {
+                const uint32_t row = m_rows[rowIndex(y, z)];
+                columnBits |= static_cast<uint32_t>(row != 0) << y;
+                brickRows[y >> BRICK_SHIFT] |= row;
+            }
+
+            m_columnBits[z] = columnBits;
+            m_sliceBits |= static_cast<uint32_t>(columnBits != 0) << z;
+
+            for (uint32_t by = 0; by < BRICKS_PER_AXIS; ++by)
+            {
+                for (uint32_t bx = 0; bx < BRICKS_PER_AXIS; ++bx)
+                {
+                    if ((brickRows[by] >> (bx * BRICK_SIZE)) & 0xFFu)
+                    {
+                        m_brickBits |= 1ull << brickIndex(bx, by, z >> BRICK_SHIFT);
+                    }
+                }
+            }
+        }
+    }
+
+    std::array<uint32_t, ROW_COUNT> m_rows{};
+    std::array<uint32_t, SIZE> m_columnBits{};
+    uint32_t m_sliceBits = 0;
+    uint64_t m_brickBits = 0;
+};
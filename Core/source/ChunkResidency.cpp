@@ -0,0 +1,374 @@
+#include "ChunkResidency.h"
+#include "PerformanceTimer.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+void ChunkResidencyManager::init(const ChunkResidencyConfig& config, ChunkLoadFunction loader, ThreadPool& threadPool)
+{
+    if (!loader)
+    {
+        throw std::runtime_error("ChunkResidencyManager requires a chunk load function.");
+    }
+    if (config.loadRadius < 0 || config.maxJobsInFlight == 0 || config.lodLevels >= CHUNK_MIP_LEVEL_COUNT)
+    {
+        throw std::runtime_error("Invalid chunk residency config.");
+    }
+    if (config.memoryBudgetBytes < getChunkMemorySize())
+    {
+        throw std::runtime_error("Chunk residency memory budget cannot hold a single chunk.");
+    }
+
+    m_config = config;
+    m_loader = std::move(loader);
+    m_threadPool = &threadPool;
+    m_scan = 0;
+    m_hasScanned = false;
+}
+
+void ChunkResidencyManager::update(const FirstPersonCamera& camera)
+{
+    update(camera.getPosition(), camera.getForwardDirection());
+}
+
+void ChunkResidencyManager::update(const glm::vec3& cameraPosition, const glm::vec3& cameraForward)
+{
+    PERF_SCOPE("Chunk Residency Update");
+
+    if (m_threadPool == nullptr)
+    {
+        LOG_ERROR("ChunkResidencyManager::update called before init.");
+        return;
+    }
+
+    integrateCompletedLoads();
+
+    const glm::ivec3 cameraChunk = glm::ivec3(glm::floor(cameraPosition / static_cast<float>(CHUNK_SIZE_X)));
+    const float forwardLength = glm::length(cameraForward);
+    const glm::vec3 forward = forwardLength > 0.0f ? cameraForward / forwardLength : glm::vec3(0.0f);
+
+    if (!m_hasScanned || cameraChunk != m_scanCameraChunk || glm::dot(forward, m_scanForward) < 0.9f)
+    {
+        gatherDesiredChunks(cameraPosition, forward);
+    }
+
+    submitLoads();
+}
+
+void ChunkResidencyManager::flush()
+{
+    {
+        std::unique_lock<std::mutex> lock(m_completedMutex);
+        m_loadCompleted.wait(lock, [this]() { return m_completed.size() == m_pending.size(); });
+    }
+    integrateCompletedLoads();
+}
+
+void ChunkResidencyManager::destroy()
+{
+    if (m_threadPool == nullptr)
+    {
+        return;
+    }
+
+    flush();
+
+    while (!m_resident.empty())
+    {
+        evict(m_resident.begin());
+    }
+
+    m_lru.clear();
+    m_candidates.clear();
+    m_nextCandidate = 0;
+    m_residentBytes = 0;
+    m_pendingBytes = 0;
+    m_residentLodCount = 0;
+    m_threadPool = nullptr;
+}
+
+Chunk* ChunkResidencyManager::findChunk(const glm::ivec3& chunkCoord) const
+{
+    auto it = m_resident.find(packChunkKey(chunkCoord));
+    return it != m_resident.end() ? it->second.chunk.get() : nullptr;
+}
+
+const ChunkLod* ChunkResidencyManager::findChunkLod(const glm::ivec3& chunkCoord) const
+{
+    auto it = m_resident.find(packChunkKey(chunkCoord));
+    return it != m_resident.end() ? it->second.lod.get() : nullptr;
+}
+
+uint32_t ChunkResidencyManager::getDesiredLevel(int32_t distanceSq) const
+{
+    for (uint32_t level = 0; level <= m_config.lodLevels; ++level)
+    {
+        const int32_t radius = m_config.loadRadius << level;
+        if (distanceSq <= radius * radius)
+        {
+            return level;
+        }
+    }
+    return INVALID_LEVEL;
+}
+
+void ChunkResidencyManager::integrateCompletedLoads()
+{
+    std::vector<ChunkKey> completed;
+    {
+        std::lock_guard<std::mutex> lock(m_completedMutex);
+        completed.swap(m_completed);
+    }
+
+    for (ChunkKey key : completed)
+    {
+        auto pendingIt = m_pending.find(key);
+        if (pendingIt == m_pending.end())
+        {
+            LOG_ERROR("ChunkResidencyManager: completed load has no pending entry.");
+            continue;
+        }
+
+        PendingChunk pending = std::move(pendingIt->second);
+        m_pendingBytes -= pending.bytes;
+        m_pending.erase(pendingIt);
+
+        // The camera may have moved on while this was loading. A chunk the last scan doesn't want
+        // goes to the back of the LRU, evictLeastRecentlyUsed only looks there.
+        const glm::ivec3 offset = unpackChunkKey(key) - m_scanCameraChunk;
+        const uint32_t desiredLevel = getDesiredLevel(offset.x * offset.x + offset.y * offset.y + offset.z * offset.z);
+        const auto lruPosition = desiredLevel != INVALID_LEVEL ? m_lru.begin() : m_lru.end();
+
+        auto residentIt = m_resident.find(key);
+        if (residentIt == m_resident.end())
+        {
+            ResidentChunk resident;
+            resident.lruPosition = m_lru.insert(lruPosition, key);
+            residentIt = m_resident.emplace(key, std::move(resident)).first;
+        }
+        else
+        {
+            // Finer replacement for a resident LOD
+            m_lru.splice(lruPosition, m_lru, residentIt->second.lruPosition);
+        }
+
+        ResidentChunk& resident = residentIt->second;
+        setResidentData(resident, std::move(pending.chunk), std::move(pending.lod), pending.level, pending.bytes);
+        resident.lastUsedScan = desiredLevel != INVALID_LEVEL ? m_scan : 0;
+
+        if (resident.chunk && m_onChunkLoaded)
+        {
+            m_onChunkLoaded(*resident.chunk);
+        }
+
+        if (desiredLevel != INVALID_LEVEL && desiredLevel > resident.level)
+        {
+            coarsen(resident, desiredLevel);
+        }
+    }
+}
+
+void ChunkResidencyManager::gatherDesiredChunks(const glm::vec3& cameraPosition, const glm::vec3& forward)
+{
+    m_scan++;
+    m_hasScanned = true;
+    m_candidates.clear();
+    m_nextCandidate = 0;
+
+    const float chunkSize = static_cast<float>(CHUNK_SIZE_X);
+    const glm::ivec3 cameraChunk = glm::ivec3(glm::floor(cameraPosition / chunkSize));
+    const glm::vec3 cameraInChunks = cameraPosition / chunkSize;
+
+    m_scanCameraChunk = cameraChunk;
+    m_scanForward = forward;
+
+    const int32_t radius = m_config.loadRadius << m_config.lodLevels;
+    const int32_t radiusSq = radius * radius;
+
+    for (int32_t dz = -radius; dz <= radius; ++dz)
+    {
+        for (int32_t dy = -radius; dy <= radius; ++dy)
+        {
+            for (int32_t dx = -radius; dx <= radius; ++dx)
+            {
+                const int32_t distanceSq = dx * dx + dy * dy + dz * dz;
+                if (distanceSq > radiusSq)
+                {
+                    continue;
+                }
+
+                const uint32_t level = getDesiredLevel(distanceSq);
+                const glm::ivec3 chunkCoord = cameraChunk + glm::ivec3(dx, dy, dz);
+                const ChunkKey key = packChunkKey(chunkCoord);
+
+                auto residentIt = m_resident.find(key);
+                if (residentIt != m_resident.end())
+                {
+                    ResidentChunk& resident = residentIt->second;
+                    resident.lastUsedScan = m_scan;
+                    m_lru.splice(m_lru.begin(), m_lru, resident.lruPosition);
+
+                    if (resident.level < level)
+                    {
+                        coarsen(resident, level);
+                    }
+                    if (resident.level <= level)
+                    {
+                        continue;
+                    }
+                    // Too coarse, keep it until the finer load lands
+                }
+
+                if (m_pending.find(key) != m_pending.end())
+                {
+                    continue;
+                }
+
+                const glm::vec3 toChunk = glm::vec3(chunkCoord) + glm::vec3(0.5f) - cameraInChunks;
+                const float distance = glm::length(toChunk);
+                const float cosAngle = distance > 0.0f ? glm::dot(toChunk / distance, forward) : 1.0f;
+
+                LoadCandidate candidate;
+                candidate.key = key;
+                candidate.chunkCoord = chunkCoord;
+                candidate.level = level;
+                candidate.priority = distance * (1.0f + m_config.viewDirectionWeight * 0.5f * (1.0f - cosAngle));
+                m_candidates.push_back(candidate);
+            }
+        }
+    }
+
+    std::sort(m_candidates.begin(), m_candidates.end(),
+        [](const LoadCandidate& a, const LoadCandidate& b) { return a.priority < b.priority; });
+}
+
+void ChunkResidencyManager::submitLoads()
+{
+    while (m_pending.size() < m_config.maxJobsInFlight && m_nextCandidate < m_candidates.size())
+    {
+        const LoadCandidate& candidate = m_candidates[m_nextCandidate];
+        const size_t bytes = getChunkMemorySize(candidate.level);
+
+        while (getCommittedBytes() + bytes > m_config.memoryBudgetBytes)
+        {
+            if (!evictLeastRecentlyUsed())
+            {
+                // Everything resident is still wanted, the budget is saturated
+                return;
+            }
+        }
+
+        m_nextCandidate++;
+
+        PendingChunk pending;
+        pending.level = candidate.level;
+        pending.bytes = bytes;
+        if (candidate.level == 0)
+        {
+            pending.chunk = std::make_unique<Chunk>();
+            pending.chunk->position = candidate.chunkCoord;
+        }
+        else
+        {
+            pending.lod = std::make_unique<ChunkLod>();
+            pending.lod->position = candidate.chunkCoord;
+            pending.lod->level = candidate.level;
+        }
+
+        Chunk* chunk = pending.chunk.get();
+        ChunkLod* lod = pending.lod.get();
+        const ChunkKey key = candidate.key;
+
+        m_pendingBytes += bytes;
+        m_pending.emplace(key, std::move(pending));
+
+        m_threadPool->submit([this, chunk, lod, key]()
+        {
+            if (chunk != nullptr)
+            {
+                m_loader(*chunk);
+            }
+            else
+            {
+                // Distant chunks are loaded at full resolution into scratch memory and only the mip is kept
+                thread_local std::unique_ptr<Chunk> scratch = std::make_unique<Chunk>();
+                scratch->position = lod->position;
+                m_loader(*scratch);
+                lod->assign(*scratch, lod->level);
+            }
+
+            // Notified under the lock: once flush() sees this load it may return and the manager
+            // be destroyed, so the job must not touch it after releasing the mutex
+            std::lock_guard<std::mutex> lock(m_completedMutex);
+            m_completed.push_back(key);
+            m_loadCompleted.notify_all();
+        });
+    }
+}
+
+void ChunkResidencyManager::coarsen(ResidentChunk& resident, uint32_t level)
+{
+    std::unique_ptr<ChunkLod> lod;
+    if (resident.chunk)
+    {
+        if (m_onChunkEvicted)
+        {
+            m_onChunkEvicted(*resident.chunk);
+        }
+
+        lod = std::make_unique<ChunkLod>();
+        lod->assign(*resident.chunk, level);
+    }
+    else
+    {
+        lod = std::make_unique<ChunkLod>(std::move(*resident.lod));
+        lod->coarsen(level);
+    }
+
+    setResidentData(resident, nullptr, std::move(lod), level, getChunkMemorySize(level));
+}
+
+void ChunkResidencyManager::setResidentData(ResidentChunk& resident, std::unique_ptr<Chunk> chunk, std::unique_ptr<ChunkLod> lod, uint32_t level, size_t bytes)
+{
+    m_residentBytes -= resident.bytes;
+    m_residentLodCount -= resident.lod ? 1 : 0;
+
+    resident.chunk = std::move(chunk);
+    resident.lod = std::move(lod);
+    resident.level = level;
+    resident.bytes = bytes;
+
+    m_residentBytes += resident.bytes;
+    m_residentLodCount += resident.lod ? 1 : 0;
+}
+
+bool ChunkResidencyManager::evictLeastRecentlyUsed()
+{
+    if (m_lru.empty())
+    {
+        return false;
+    }
+
+    auto it = m_resident.find(m_lru.back());
+    if (it == m_resident.end() || it->second.lastUsedScan == m_scan)
+    {
+        return false;
+    }
+
+    evict(it);
+    return true;
+}
+
+void ChunkResidencyManager::evict(std::unordered_map<ChunkKey, ResidentChunk>::iterator it)
+{
+    ResidentChunk& resident = it->second;
+
+    if (resident.chunk && m_onChunkEvicted)
+    {
+        m_onChunkEvicted(*resident.chunk);
+    }
+
+    setResidentData(resident, nullptr, nullptr, 0, 0);
+    m_lru.erase(resident.lruPosition);
+    m_resident.erase(it);
+}
@@ -0,0 +1,155 @@
+#pragma once
+
+#include "Chunk.h"
+#include "Multithreading.h"
+#include "FirstPersonCamera.h"
+
+#include "glm/glm.hpp"
+
+#include <cstdint>
+#include <vector>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <unordered_map>
+
+struct ChunkResidencyConfig
+{
+    int32_t loadRadius = 8;                                 // In chunks, measured from the camera's chunk
+    size_t memoryBudgetBytes = 256ull * 1024ull * 1024ull;  // Resident + in-flight chunks never exceed this
+    uint32_t maxJobsInFlight = 32;
+    float viewDirectionWeight = 1.0f;                       // 0 = pure distance ordering, higher favours chunks in front of the camera
+
+    // Rings of read-only ChunkLods beyond loadRadius, ring L keeps mip level L out to loadRadius * 2^L.
+    // Each ring costs about as much memory as the full-resolution sphere, so 3 rings give 8x the view
+    // distance for roughly 3.6x the memory of the inner sphere alone. 0 disables LODs.
+    uint32_t lodLevels = 0;
+};
+
+// Runs on a worker thread and must fill the chunk's voxels (generate or read from disk).
+// Loaders writing voxels directly must finish with chunk.rebuildDerivedData().
+using ChunkLoadFunction = std::function<void(Chunk&)>;
+// Runs on the thread calling update()/flush()/destroy()
+using ChunkEventFunction = std::function<void(Chunk&)>;
+
+// Decides which chunks should be in memory around the camera, streams missing ones in
+// on worker threads ordered by distance and view direction, and evicts least recently
+// used chunks to stay under the memory budget. Has no GPU dependencies so it can be
+// driven headless with a scripted camera path.
+//
+// Chunks leaving the full-resolution sphere are turned into ChunkLods from their mips
+// without reloading; a ChunkLod stays resident until its finer replacement is loaded.
+// The desired set is only rescanned when the camera changes chunk or turns noticeably.
+class ChunkResidencyManager
+{
+public:
+    ChunkResidencyManager() = default;
+    ~ChunkResidencyManager() { destroy(); }
+
+    ChunkResidencyManager(const ChunkResidencyManager&) = delete;
+    ChunkResidencyManager& operator=(const ChunkResidencyManager&) = delete;
+    ChunkResidencyManager(ChunkResidencyManager&&) = delete;
+    ChunkResidencyManager& operator=(ChunkResidencyManager&&) = delete;
+
+    void init(const ChunkResidencyConfig& config, ChunkLoadFunction loader, ThreadPool& threadPool = ThreadPool::getInstance());
+
+    void update(const FirstPersonCamera& camera);
+    void update(const glm::vec3& cameraPosition, const glm::vec3& cameraForward);
+
+    // Waits for all in-flight loads and makes them resident
+    void flush();
+
+    void destroy();
+
+    void setOnChunkLoaded(ChunkEventFunction callback) { m_onChunkLoaded = std::move(callback); }
+    void setOnChunkEvicted(ChunkEventFunction callback) { m_onChunkEvicted = std::move(callback); }
+
+    // Only full-resolution chunks, see findChunkLod for the distant ones
+    Chunk* findChunk(const glm::ivec3& chunkCoord) const;
+    const ChunkLod* findChunkLod(const glm::ivec3& chunkCoord) const;
+    bool isResident(const glm::ivec3& chunkCoord) const { return findChunk(chunkCoord) != nullptr; }
+
+    size_t getResidentBytes() const { return m_residentBytes; }
+    size_t getPendingBytes() const { return m_pendingBytes; }
+    size_t getCommittedBytes() const { return m_residentBytes + m_pendingBytes; }
+    size_t getMemoryBudget() const { return m_config.memoryBudgetBytes; }
+    uint32_t getResidentCount() const { return static_cast<uint32_t>(m_resident.size()); }
+    uint32_t getResidentLodCount() const { return m_residentLodCount; }
+    uint32_t getPendingCount() const { return static_cast<uint32_t>(m_pending.size()); }
+    const ChunkResidencyConfig& getConfig() const { return m_config; }
+
+    // Loads at mip levels > 0 also use a per-worker scratch Chunk that isn't counted against the budget
+    static constexpr size_t getChunkMemorySize(uint32_t level = 0)
+    {
+        return level == 0 ? sizeof(Chunk) : ChunkLod::getMemorySize(level);
+    }
+
+private:
+    static constexpr uint32_t INVALID_LEVEL = ~0u;
+
+    // Exactly one of chunk (level 0) and lod (level > 0) is set
+    struct ResidentChunk
+    {
+        std::unique_ptr<Chunk> chunk;
+        std::unique_ptr<ChunkLod> lod;
+        uint32_t level = 0;
+        std::list<ChunkKey>::iterator lruPosition;
+        uint64_t lastUsedScan = 0;
+        size_t bytes = 0;
+    };
+
+    struct PendingChunk
+    {
+        std::unique_ptr<Chunk> chunk;
+        std::unique_ptr<ChunkLod> lod;
+        uint32_t level = 0;
+        size_t bytes = 0;
+    };
+
+    struct LoadCandidate
+    {
+        ChunkKey key;
+        glm::ivec3 chunkCoord;
+        uint32_t level;
+        float priority;
+    };
+
+    void integrateCompletedLoads();
+    void gatherDesiredChunks(const glm::vec3& cameraPosition, const glm::vec3& forward);
+    void submitLoads();
+    void coarsen(ResidentChunk& resident, uint32_t level);
+    void setResidentData(ResidentChunk& resident, std::unique_ptr<Chunk> chunk, std::unique_ptr<ChunkLod> lod, uint32_t level, size_t bytes);
+    uint32_t getDesiredLevel(int32_t distanceSq) const;
+    bool evictLeastRecentlyUsed();
+    void evict(std::unordered_map<ChunkKey, ResidentChunk>::iterator it);
+
+    ChunkResidencyConfig m_config;
+    ChunkLoadFunction m_loader;
+    ThreadPool* m_threadPool = nullptr;
+
+    ChunkEventFunction m_onChunkLoaded;
+    ChunkEventFunction m_onChunkEvicted;
+
+    std::unordered_map<ChunkKey, ResidentChunk> m_resident;
+    std::unordered_map<ChunkKey, PendingChunk> m_pending;
+    std::list<ChunkKey> m_lru; // Front = most recently used
+
+    std::vector<LoadCandidate> m_candidates;
+    size_t m_nextCandidate = 0;
+
+    // Residents stamped with the current scan are wanted and never evicted
+    uint64_t m_scan = 0;
+    bool m_hasScanned = false;
+    glm::ivec3 m_scanCameraChunk{ 0 };
+    glm::vec3 m_scanForward{ 0.0f };
+
+    size_t m_residentBytes = 0;
+    size_t m_pendingBytes = 0;
+    uint32_t m_residentLodCount = 0;
+
+    std::mutex m_completedMutex;
+    std::condition_variable m_loadCompleted;
+    std::vector<ChunkKey> m_completed;
+};
@@ -0,0 +1,163 @@
+#pragma once
+
+#include "Chunk.h"
+
+#include <cstdint>
+#include <cstring>
+#include <array>
+#include <memory>
+#include <mutex>
+
+constexpr uint32_t CHUNK_BRICK_SIZE = ChunkOccupancy::BRICK_SIZE;
+constexpr uint32_t CHUNK_BRICK_SHIFT = ChunkOccupancy::BRICK_SHIFT;
+constexpr uint32_t CHUNK_BRICKS_PER_AXIS = ChunkOccupancy::BRICKS_PER_AXIS;
+constexpr uint32_t CHUNK_BRICK_COUNT = CHUNK_BRICKS_PER_AXIS * CHUNK_BRICKS_PER_AXIS * CHUNK_BRICKS_PER_AXIS;
+constexpr uint32_t CHUNK_BRICK_VOLUME = CHUNK_BRICK_SIZE * CHUNK_BRICK_SIZE * CHUNK_BRICK_SIZE;
+
+static_assert(CHUNK_BRICK_COUNT == 64, "Chunk::dirtyBricks holds one bit per brick");
+
+// 8^3 voxels, x fastest. Never modified once it is shared by a snapshot.
+struct ChunkBrick
+{
+    std::array<VoxelID, CHUNK_BRICK_VOLUME> voxels{};
+
+    static constexpr uint32_t index(uint32_t x, uint32_t y, uint32_t z)
+    {
+        return x + CHUNK_BRICK_SIZE * (y + CHUNK_BRICK_SIZE * z);
+    }
+};
+
+// Immutable copy of a chunk's voxels, safe to read from any thread for as long as it is held.
+//
+// The voxels live in 64 reference-counted bricks. A new version shares every brick that wasn't
+// touched since the previous one and only clones the dirty ones, so publishing after a few edits
+// costs a few 512 byte copies instead of 32 KB. All-air bricks share one global brick.
+class ChunkSnapshot
+{
+public:
+    using BrickPtr = std::shared_ptr<const ChunkBrick>;
+
+    // Snapshot of chunk's current voxels. With a previous snapshot of the same chunk, only the
+    // bricks flagged in chunk.dirtyBricks are copied and the rest are shared.
+    static std::shared_ptr<const ChunkSnapshot> create(const Chunk& chunk, const ChunkSnapshot* previous)
+    {
+        auto snapshot = std::make_shared<ChunkSnapshot>();
+        snapshot->m_position = chunk.position;
+        snapshot->m_version = chunk.version;
+
+        const uint64_t dirty = previous != nullptr ? chunk.dirtyBricks : ~0ull;
+        for (uint32_t brick = 0; brick < CHUNK_BRICK_COUNT; ++brick)
+        {
+            if (((dirty >> brick) & 1ull) == 0)
+            {
+                snapshot->m_bricks[brick] = previous->m_bricks[brick];
+                continue;
+            }
+
+            const uint32_t bx = brick % CHUNK_BRICKS_PER_AXIS;
+            const uint32_t by = (brick / CHUNK_BRICKS_PER_AXIS) % CHUNK_BRICKS_PER_AXIS;
+            const uint32_t bz = brick / (CHUNK_BRICKS_PER_AXIS * CHUNK_BRICKS_PER_AXIS);
+            if (chunk.occupancy.isBrickEmpty(bx, by, bz))
+            {
+                snapshot->m_bricks[brick] = getAirBrick();
+                continue;
+            }
+
+            snapshot->m_bricks[brick] = cloneBrick(chunk, bx, by, bz);
+            snapshot->m_clonedBrickCount++;
+        }
+        return snapshot;
+    }
+
+    const glm::ivec3& getPosition() const { return m_position; }
+    uint64_t getVersion() const { return m_version; } // Chunk::version it was taken at
+
+    VoxelID get(uint32_t x, uint32_t y, uint32_t z) const
+    {
+        const uint32_t brick = ChunkOccupancy::brickIndex(x >> CHUNK_BRICK_SHIFT, y >> CHUNK_BRICK_SHIFT, z >> CHUNK_BRICK_SHIFT);
+        const uint32_t mask = CHUNK_BRICK_SIZE - 1;
+        return m_bricks[brick]->voxels[ChunkBrick::index(x & mask, y & mask, z & mask)];
+    }
+
+    const ChunkBrick& getBrick(uint32_t brick) const { return *m_bricks[brick]; }
+    bool sharesBrick(const ChunkSnapshot& other, uint32_t brick) const { return m_bricks[brick] == other.m_bricks[brick]; }
+
+    // Bricks that had to be copied when this snapshot was created
+    uint32_t getClonedBrickCount() const { return m_clonedBrickCount; }
+
+    // Writes the voxels back out in Chunk::index order (CHUNK_VOLUME bytes)
+    void copyTo(VoxelID* dst) const
+    {
+        for (uint32_t brick = 0; brick < CHUNK_BRICK_COUNT; ++brick)
+        {
+            const uint32_t bx = brick % CHUNK_BRICKS_PER_AXIS;
+            const uint32_t by = (brick / CHUNK_BRICKS_PER_AXIS) % CHUNK_BRICKS_PER_AXIS;
+            const uint32_t bz = brick / (CHUNK_BRICKS_PER_AXIS * CHUNK_BRICKS_PER_AXIS);
+            const VoxelID* src = m_bricks[brick]->voxels.data();
+
+            for (uint32_t z = 0; z < CHUNK_BRICK_SIZE; ++z)
+            {
+                for (uint32_t y = 0; y < CHUNK_BRICK_SIZE; ++y)
+                {
+                    VoxelID* row = dst + Chunk::index(bx * CHUNK_BRICK_SIZE, by * CHUNK_BRICK_SIZE + y, bz * CHUNK_BRICK_SIZE + z);
+                    std::memcpy(row, src + ChunkBrick::index(0, y, z), CHUNK_BRICK_SIZE);
+                }
+            }
+        }
+    }
+
+private:
+    static BrickPtr cloneBrick(const Chunk& chunk, uint32_t bx, uint32_t by, uint32_t bz)
+    {
+        auto brick = std::make_shared<ChunkBrick>();
+        for (uint32_t z = 0; z < CHUNK_BRICK_SIZE; ++z)
+        {
+            for (uint32_t y = 0; y < CHUNK_BRICK_SIZE; ++y)
+            {
+                const VoxelID* row = chunk.voxels.data() + Chunk::index(bx * CHUNK_BRICK_SIZE, by * CHUNK_BRICK_SIZE + y, bz * CHUNK_BRICK_SIZE + z);
+                std::memcpy(brick->voxels.data() + ChunkBrick::index(0, y, z), row, CHUNK_BRICK_SIZE);
+            }
+        }
+        return brick;
+    }
+
+    static const BrickPtr& getAirBrick()
+    {
+        static const BrickPtr airBrick = std::make_shared<const ChunkBrick>();
+        return airBrick;
+    }
+
+    glm::ivec3 m_position{ 0 };
+    uint64_t m_version = 0;
+    uint32_t m_clonedBrickCount = 0;
+    std::array<BrickPtr, CHUNK_BRICK_COUNT> m_bricks;
+};
+
+using ChunkSnapshotPtr = std::shared_ptr<const ChunkSnapshot>;
+
+// Latest published snapshot of one chunk. The main thread publishes, any thread may load;
+// a reader keeps the version it loaded alive no matter how often newer ones are published.
+//
+// The lock only covers the pointer copy. std::atomic<std::shared_ptr> would do the same, but
+// libstdc++ 12 releases its internal lock in load() with relaxed ordering, which races with
+// the next publish.
+class ChunkSnapshotSlot
+{
+public:
+    ChunkSnapshotPtr load() const
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        return m_snapshot;
+    }
+
+    void publish(ChunkSnapshotPtr snapshot)
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_snapshot.swap(snapshot);
+        // The old snapshot is freed with the parameter, after the lock is released
+    }
+
+private:
+    mutable std::mutex m_mutex;
+    ChunkSnapshotPtr m_snapshot;
+};
@@ -0,0 +1,309 @@
+#include "CpuRayTracer.h"
+#include "Timer.h"
+
+#include <immintrin.h>
+
+#include <atomic>
+#include <bit>
+#include <stdexcept>
+
+namespace
+{
+    const glm::vec3 MISS_COLOR = glm::vec3(0.0f, 0.5f, 1.0f); // shader.rmiss
+
+    constexpr uint32_t PACKET_WIDTH = 4;
+    constexpr uint32_t PACKET_HEIGHT = 2;
+    static_assert(PACKET_WIDTH * PACKET_HEIGHT == BVHRayPacket::SIZE, "A packet covers 4x2 pixels");
+    constexpr uint32_t NO_HIT = std::numeric_limits<uint32_t>::max();
+
+    // shader.rint: the nearer root if it is in range, otherwise the farther one
+    bool intersectSphere(const glm::vec3& origin, const glm::vec3& direction, const glm::vec4& sphere, float& tMax)
+    {
+        const glm::vec3 oc = origin - glm::vec3(sphere);
+        const float a = glm::dot(direction, direction);
+        const float b = 2.0f * glm::dot(oc, direction);
+        const float c = glm::dot(oc, oc) - sphere.w * sphere.w;
+        const float disc = b * b - 4.0f * a * c;
+        if (disc < 0.0f)
+        {
+            return false;
+        }
+
+        const float sqrtDisc = std::sqrt(disc);
+        const float t1 = (-b - sqrtDisc) / (2.0f * a);
+        const float t2 = (-b + sqrtDisc) / (2.0f * a);
+        const float t = std::min(t1, t2);
+        if (t >= CpuRayTracer::T_MIN && t <= tMax)
+        {
+            tMax = t;
+            return true;
+        }
+        if (t2 >= CpuRayTracer::T_MIN && t2 <= tMax)
+        {
+            tMax = t2;
+            return true;
+        }
+        return false;
+    }
+
+    void intersectSpherePacket(BVHRayPacket& packet, const glm::vec4& sphere, uint32_t primitive)
+    {
+#if defined(__AVX2__)
+        const __m256 directionX = _mm256_load_ps(packet.directionX);
+        const __m256 directionY = _mm256_load_ps(packet.directionY);
+        const __m256 directionZ = _mm256_load_ps(packet.directionZ);
+        const __m256 ocX = _mm256_sub_ps(_mm256_load_ps(packet.originX), _mm256_set1_ps(sphere.x));
+        const __m256 ocY = _mm256_sub_ps(_mm256_load_ps(packet.originY), _mm256_set1_ps(sphere.y));
+        const __m256 ocZ = _mm256_sub_ps(_mm256_load_ps(packet.originZ), _mm256_set1_ps(sphere.z));
+
+        auto dot = [](__m256 ax, __m256 ay, __m256 az, __m256 bx, __m256 by, __m256 bz)
+        {
+            return _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ax, bx), _mm256_mul_ps(ay, by)), _mm256_mul_ps(az, bz));
+        };
+
+        const __m256 a = dot(directionX, directionY, directionZ, directionX, directionY, directionZ);
+        const __m256 b = _mm256_mul_ps(_mm256_set1_ps(2.0f), dot(ocX, ocY, ocZ, directionX, directionY, directionZ));
+        const __m256 c = _mm256_sub_ps(dot(ocX, ocY, ocZ, ocX, ocY, ocZ), _mm256_set1_ps(sphere.w * sphere.w));
+        const __m256 disc = _mm256_sub_ps(_mm256_mul_ps(b, b), _mm256_mul_ps(_mm256_set1_ps(4.0f), _mm256_mul_ps(a, c)));
+        const __m256 valid = _mm256_cmp_ps(disc, _mm256_setzero_ps(), _CMP_GE_OQ);
+        if (_mm256_movemask_ps(valid) == 0)
+        {
+            return;
+        }
+
+        const __m256 sqrtDisc = _mm256_sqrt_ps(_mm256_max_ps(disc, _mm256_setzero_ps()));
+        const __m256 twoA = _mm256_mul_ps(_mm256_set1_ps(2.0f), a);
+        const __m256 negB = _mm256_sub_ps(_mm256_setzero_ps(), b);
+        const __m256 t1 = _mm256_div_ps(_mm256_sub_ps(negB, sqrtDisc), twoA);
+        const __m256 t2 = _mm256_div_ps(_mm256_add_ps(negB, sqrtDisc), twoA);
+        const __m256 t = _mm256_min_ps(t1, t2);
+
+        const __m256 tMin = _mm256_set1_ps(CpuRayTracer::T_MIN);
+        const __m256 tMax = _mm256_load_ps(packet.tMax);
+        const __m256 nearHit = _mm256_and_ps(valid, _mm256_and_ps(_mm256_cmp_ps(t, tMin, _CMP_GE_OQ), _mm256_cmp_ps(t, tMax, _CMP_LE_OQ)));
+        const __m256 farHit = _mm256_and_ps(valid, _mm256_and_ps(_mm256_cmp_ps(t2, tMin, _CMP_GE_OQ), _mm256_cmp_ps(t2, tMax, _CMP_LE_OQ)));
+        const __m256 hit = _mm256_or_ps(nearHit, farHit);
+        const uint32_t hitMask = static_cast<uint32_t>(_mm256_movemask_ps(hit));
+        if (hitMask == 0)
+        {
+            return;
+        }
+
+        _mm256_store_ps(packet.tMax, _mm256_blendv_ps(tMax, _mm256_blendv_ps(t2, t, nearHit), hit));
+        for (uint32_t bits = hitMask; bits != 0; bits &= bits - 1)
+        {
+            packet.primitive[std::countr_zero(bits)] = primitive;
+        }
+#else
+        for (uint32_t lane = 0; lane < BVHRayPacket::SIZE; ++lane)
+        {
+            const glm::vec3 origin(packet.originX[lane], packet.originY[lane], packet.originZ[lane]);
+            const glm::vec3 direction(packet.directionX[lane], packet.directionY[lane], packet.directionZ[lane]);
+            if (intersectSphere(origin, direction, sphere, packet.tMax[lane]))
+            {
+                packet.primitive[lane] = primitive;
+            }
+        }
+#endif
+    }
+
+    struct ShadingContext
+    {
+        const CpuRayTracerScene* scene;
+        const ShadingConstants* constants;
+        glm::mat3 normalMatrix;
+        glm::vec3 lightDirection;
+    };
+
+    // shader.rchit
+    glm::vec4 shade(const ShadingContext& context, const glm::vec3& originOS, const glm::vec3& directionOS, uint32_t primitive, float t)
+    {
+        const CpuRayTracerScene& scene = *context.scene;
+        const uint32_t sphereIndex = scene.instanceCustomIndex + primitive;
+        const glm::vec3 hitPositionOS = originOS + t * directionOS;
+        const glm::vec3 normalOS = glm::normalize(hitPositionOS - glm::vec3(scene.spheres[sphereIndex]));
+        const glm::vec3 normalWS = glm::normalize(context.normalMatrix * normalOS);
+        const float diffuse = std::max(glm::dot(normalWS, context.lightDirection), 0.0f);
+
+        const uint32_t materialId = scene.sphereMaterialIds != nullptr ? (scene.sphereMaterialIds[sphereIndex >> 2] >> ((sphereIndex & 3u) * 8u)) & 0xFFu : 0u;
+        const VoxelID id = static_cast<VoxelID>(materialId);
+        const glm::vec3 albedo = scene.materials->getAlbedo(id);
+
+        const glm::vec3 ambient = context.constants->ambientColor * albedo;
+        const glm::vec3 diffuseColor = context.constants->lightColor * albedo * diffuse;
+        return glm::vec4(ambient + diffuseColor + albedo * scene.materials->getEmission(id), 1.0f);
+    }
+}
+
+void CpuRayTracer::getCameraRay(const glm::mat4& viewInverse, const glm::mat4& projInverse, uint32_t x, uint32_t y,
+    uint32_t width, uint32_t height, glm::vec3& origin, glm::vec3& direction)
+{
+    const glm::vec2 pixelCenter = glm::vec2(static_cast<float>(x), static_cast<float>(y)) + glm::vec2(0.5f);
+    const glm::vec2 inUV = pixelCenter / glm::vec2(static_cast<float>(width), static_cast<float>(height));
+    const glm::vec2 d = inUV * 2.0f - 1.0f;
+
+    const glm::vec4 cameraOrigin = viewInverse * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+    glm::vec4 target = projInverse * glm::vec4(d.x, d.y, 1.0f, 1.0f);
+    target = viewInverse * glm::vec4(glm::vec3(target) / target.w, 1.0f);
+
+    origin = glm::vec3(cameraOrigin);
+    direction = glm::normalize(glm::vec3(target) - glm::vec3(cameraOrigin));
+}
+
+void CpuRayTracer::render(const CpuRayTracerScene& scene, const glm::mat4& viewInverse, const glm::mat4& projInverse,
+    const ShadingConstants& constants, const CpuRenderSettings& settings, std::vector<glm::vec4>& image, ThreadPool& threadPool)
+{
+    if (scene.spheres == nullptr || scene.bvh == nullptr || scene.materials == nullptr)
+    {
+        throw std::runtime_error("CpuRayTracer: scene needs spheres, a BVH and a material registry.");
+    }
+    if ((settings.bvhWidth == 4 && scene.bvh4 == nullptr) || (settings.bvhWidth == 8 && scene.bvh8 == nullptr))
+    {
+        throw std::runtime_error("CpuRayTracer: scene has no BVH of the requested width.");
+    }
+
+    Timer timer;
+    timer.start();
+
+    const uint32_t width = settings.width;
+    const uint32_t height = settings.height;
+    image.assign(static_cast<size_t>(width) * height, glm::vec4(0.0f));
+
+    // Whole packets per tile
+    const uint32_t tileSize = std::max((settings.tileSize + PACKET_WIDTH - 1) / PACKET_WIDTH * PACKET_WIDTH, PACKET_WIDTH);
+    const uint32_t tilesX = (width + tileSize - 1) / tileSize;
+    const uint32_t tilesY = (height + tileSize - 1) / tileSize;
+
+    ShadingContext context;
+    context.scene = &scene;
+    context.constants = &constants;
+    context.normalMatrix = glm::transpose(glm::inverse(glm::mat3(scene.objectToWorld)));
+    context.lightDirection = glm::normalize(constants.lightDir);
+    const glm::mat4 worldToObject = glm::inverse(scene.objectToWorld);
+
+    std::atomic<uint64_t> hitCount{ 0 };
+    threadPool.parallelFor(tilesX * tilesY, [&](uint32_t tile)
+    {
+        const uint32_t tileX = (tile % tilesX) * tileSize;
+        const uint32_t tileY = (tile / tilesX) * tileSize;
+        const uint32_t tileEndX = std::min(tileX + tileSize, width);
+        const uint32_t tileEndY = std::min(tileY + tileSize, height);
+        uint64_t tileHits = 0;
+
+        auto objectSpaceRay = [&](uint32_t x, uint32_t y, glm::vec3& origin, glm::vec3& direction)
+        {
+            getCameraRay(viewInverse, projInverse, x, y, width, height, origin, direction);
+            origin = glm::vec3(worldToObject * glm::vec4(origin, 1.0f));
+            direction = glm::vec3(worldToObject * glm::vec4(direction, 0.0f));
+        };
+
+        auto store = [&](uint32_t x, uint32_t y, const glm::vec3& origin, const glm::vec3& direction, uint32_t primitive, float t)
+        {
+            glm::vec4& pixel = image[static_cast<size_t>(y) * width + x];
+            if (primitive == NO_HIT)
+            {
+                pixel = glm::vec4(MISS_COLOR, 1.0f);
+                return;
+            }
+            pixel = shade(context, origin, direction, primitive, t);
+            tileHits++;
+        };
+
+        auto traceTile = [&](const auto& tree)
+        {
+            if (!settings.packets)
+            {
+                for (uint32_t y = tileY; y < tileEndY; ++y)
+                {
+                    for (uint32_t x = tileX; x < tileEndX; ++x)
+                    {
+                        glm::vec3 origin;
+                        glm::vec3 direction;
+                        objectSpaceRay(x, y, origin, direction);
+
+                        float tMax = T_MAX;
+                        const uint32_t primitive = tree.intersect(origin, direction, tMax, [&](uint32_t candidate, float& t)
+                        {
+                            return intersectSphere(origin, direction, scene.spheres[scene.instanceCustomIndex + candidate], t);
+                        });
+                        store(x, y, origin, direction, primitive, tMax);
+                    }
+                }
+            }
+            else
+            {
+                const glm::vec4* instanceSpheres = scene.spheres + scene.instanceCustomIndex;
+                for (uint32_t y = tileY; y < tileEndY; y += PACKET_HEIGHT)
+                {
+                    for (uint32_t x = tileX; x < tileEndX; x += PACKET_WIDTH)
+                    {
+                        BVHRayPacket packet;
+                        for (uint32_t lane = 0; lane < BVHRayPacket::SIZE; ++lane)
+                        {
+                            const uint32_t px = x + lane % PACKET_WIDTH;
+                            const uint32_t py = y + lane / PACKET_WIDTH;
+                            glm::vec3 origin(0.0f);
+                            glm::vec3 direction(0.0f, 0.0f, 1.0f);
+                            const bool inside = px < tileEndX && py < tileEndY;
+                            if (inside)
+                            {
+                                objectSpaceRay(px, py, origin, direction);
+                            }
+
+                            const glm::vec3 inverse = BVH::safeInverse(direction);
+                            packet.originX[lane] = origin.x;
+                            packet.originY[lane] = origin.y;
+                            packet.originZ[lane] = origin.z;
+                            packet.directionX[lane] = direction.x;
+                            packet.directionY[lane] = direction.y;
+                            packet.directionZ[lane] = direction.z;
+                            packet.inverseX[lane] = inverse.x;
+                            packet.inverseY[lane] = inverse.y;
+                            packet.inverseZ[lane] = inverse.z;
+                            packet.tMax[lane] = inside ? T_MAX : -1.0f;
+                            packet.primitive[lane] = NO_HIT;
+                        }
+
+                        tree.intersect(packet, [&](uint32_t primitive)
+                        {
+                            intersectSpherePacket(packet, instanceSpheres[primitive], primitive);
+                        });
+
+                        for (uint32_t lane = 0; lane < BVHRayPacket::SIZE; ++lane)
+                        {
+                            const uint32_t px = x + lane % PACKET_WIDTH;
+                            const uint32_t py = y + lane / PACKET_WIDTH;
+                            if (px < tileEndX && py < tileEndY)
+                            {
+                                const glm::vec3 origin(packet.originX[lane], packet.originY[lane], packet.originZ[lane]);
+                                const glm::vec3 direction(packet.directionX[lane], packet.directionY[lane], packet.directionZ[lane]);
+                                store(px, py, origin, direction, packet.primitive[lane], packet.tMax[lane]);
+                            }
+                        }
+                    }
+                }
+            }
+        };
+
+        switch (settings.bvhWidth)
+        {
+        case 4:
+            traceTile(*scene.bvh4);
+            break;
+        case 8:
+            traceTile(*scene.bvh8);
+            break;
+        default:
+            traceTile(*scene.bvh);
+            break;
+        }
+
+        hitCount.fetch_add(tileHits, std::memory_order_relaxed);
+    });
+
+    timer.stop();
+    m_stats.rayCount = static_cast<uint64_t>(width) * height;
+    m_stats.hitCount = hitCount.load();
+    m_stats.milliseconds = timer.elapsedTime<std::chrono::microseconds>() / 1000.0;
+    m_stats.megaRaysPerSecond = m_stats.milliseconds > 0.0 ? m_stats.rayCount / (m_stats.milliseconds * 1000.0) : 0.0;
+}
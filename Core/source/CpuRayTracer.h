@@ -0,0 +1,93 @@
+#pragma once
+
+#include "BVH.h"
+#include "WideBVH.h"
+#include "MaterialRegistry.h"
+#include "Multithreading.h"
+
+#include "glm/glm.hpp"
+
+#include <cstdint>
+#include <vector>
+
+// Push constants of the closest hit shader, the CPU tracer shades with the same values
+struct ShadingConstants
+{
+    alignas(16) glm::vec3 lightDir = glm::normalize(glm::vec3(1.0f, -1.0f, -1.0f));
+    alignas(16) glm::vec3 lightColor = glm::vec3(1.0f, 1.0f, 1.0f);
+    alignas(16) glm::vec3 ambientColor = glm::vec3(0.1f, 0.1f, 0.1f);
+};
+
+// One instance of the sphere BLAS, as the engine builds it
+struct CpuRayTracerScene
+{
+    const glm::vec4* spheres = nullptr;         // xyz = center, w = radius, the sphere buffer contents
+    uint32_t sphereCount = 0;
+    const uint32_t* sphereMaterialIds = nullptr; // VoxelID of every sphere, four per uint
+    const MaterialRegistry* materials = nullptr;
+    const BVH* bvh = nullptr;                    // Built from the sphere AABBs in the same order
+    const BVH4* bvh4 = nullptr;                  // Optional, collapsed from bvh
+    const BVH8* bvh8 = nullptr;
+    glm::mat4 objectToWorld = glm::mat4(1.0f);
+    uint32_t instanceCustomIndex = 0;
+
+    static glm::mat4 toMatrix(const VkTransformMatrixKHR& transform)
+    {
+        glm::mat4 matrix(1.0f);
+        for (int row = 0; row < 3; ++row)
+        {
+            for (int column = 0; column < 4; ++column)
+            {
+                matrix[column][row] = transform.matrix[row][column];
+            }
+        }
+        return matrix;
+    }
+};
+
+struct CpuRenderSettings
+{
+    uint32_t width = 0;
+    uint32_t height = 0;
+    uint32_t tileSize = 16;     // Pixels per tile side, tiles are the unit of work for the pool
+    bool packets = true;        // 4x2 pixel packets traced together, otherwise one ray at a time
+    uint32_t bvhWidth = 2;      // Children per node of the tree traced: 2, or 4 and 8 if the scene has them
+};
+
+struct CpuRenderStats
+{
+    uint64_t rayCount = 0;
+    uint64_t hitCount = 0;
+    double milliseconds = 0.0;
+    double megaRaysPerSecond = 0.0;
+};
+
+// CPU version of the ray tracing pipeline, for rendering without RT hardware and golden images.
+//
+// Mirrors the shaders one to one: camera rays are unprojected through viewInverse/projInverse as
+// in shader.rgen, spheres are intersected with the quadratic of shader.rint, hits are shaded with
+// the ShadingConstants and material table as in shader.rchit, and misses get the shader.rmiss
+// background. The image is RGBA float with row 0 at the top, like the storage image.
+//
+// Tiles are traced in parallel on the thread pool. With packets on, each tile is walked in 4x2
+// pixel packets that traverse the BVH together, testing node bounds and spheres 8 rays at a time.
+// The binary BVH, or its 4 or 8 wide collapse, is traced depending on CpuRenderSettings::bvhWidth.
+class CpuRayTracer
+{
+public:
+    static constexpr float T_MIN = 0.005f;
+    static constexpr float T_MAX = 30000.0f;
+
+    void render(const CpuRayTracerScene& scene, const glm::mat4& viewInverse, const glm::mat4& projInverse,
+        const ShadingConstants& constants, const CpuRenderSettings& settings, std::vector<glm::vec4>& image,
+        ThreadPool& threadPool = ThreadPool::getInstance());
+
+    const CpuRenderStats& getStats() const { return m_stats; }
+
+    // World-space camera ray through the center of a pixel, as shader.rgen computes it
+    static void getCameraRay(const glm::mat4& viewInverse, const glm::mat4& projInverse, uint32_t x, uint32_t y,
+        uint32_t width, uint32_t height, glm::vec3& origin, glm::vec3& direction);
+
+private:
+    CpuRenderStats m_stats;
+};
@@ -0,0 +1,312 @@
+#include "EditJournal.h"
+#include "World.h"
+#include "DebugUtils.h"
+
+#include <cstring>
+#include <algorithm>
+
+namespace
+{
+    void writeVarint(std::vector<uint8_t>& out, uint32_t value)
+    {
+        while (value >= 0x80)
+        {
+            out.push_back(static_cast<uint8_t>(value | 0x80));
+            value >>= 7;
+        }
+        out.push_back(static_cast<uint8_t>(value));
+    }
+
+    uint32_t readVarint(const uint8_t*& data)
+    {
+        uint32_t value = 0;
+        uint32_t shift = 0;
+        while (*data & 0x80)
+        {
+            value |= static_cast<uint32_t>(*data++ & 0x7F) << shift;
+            shift += 7;
+        }
+        return value | static_cast<uint32_t>(*data++) << shift;
+    }
+
+    // (length, value) pairs for the given byte of every change
+    void writeValueRuns(std::vector<uint8_t>& out, const std::vector<uint32_t>& changes, uint32_t shift)
+    {
+        size_t i = 0;
+        while (i < changes.size())
+        {
+            const uint8_t value = static_cast<uint8_t>(changes[i] >> shift);
+            size_t end = i + 1;
+            while (end < changes.size() && static_cast<uint8_t>(changes[end] >> shift) == value)
+            {
+                end++;
+            }
+
+            writeVarint(out, static_cast<uint32_t>(end - i));
+            out.push_back(value);
+            i = end;
+        }
+    }
+
+    void readValueRuns(const uint8_t*& data, std::vector<uint32_t>& changes, uint32_t shift)
+    {
+        size_t i = 0;
+        while (i < changes.size())
+        {
+            const uint32_t length = readVarint(data);
+            const uint32_t value = static_cast<uint32_t>(*data++) << shift;
+            for (uint32_t end = static_cast<uint32_t>(i) + length; i < end; ++i)
+            {
+                changes[i] |= value;
+            }
+        }
+    }
+}
+
+EditJournal::EditJournal(size_t capacityBytes)
+    : m_capacity(capacityBytes)
+{
+}
+
+void EditJournal::beginGroup()
+{
+    m_groupDepth++;
+}
+
+void EditJournal::endGroup()
+{
+    if (m_groupDepth == 0)
+    {
+        LOG_ERROR("EditJournal: endGroup without a matching beginGroup");
+        return;
+    }
+
+    if (--m_groupDepth == 0)
+    {
+        closeStep();
+    }
+}
+
+void EditJournal::record(const glm::ivec3& chunkCoord, const std::vector<uint32_t>& changes)
+{
+    if (m_replaying || changes.empty())
+    {
+        return;
+    }
+
+    const ChunkKey key = packChunkKey(chunkCoord);
+    std::vector<uint32_t>* pending = m_pending.find(key);
+    if (pending == nullptr)
+    {
+        pending = &m_pending.insert(key, {});
+    }
+    pending->insert(pending->end(), changes.begin(), changes.end());
+
+    if (m_groupDepth == 0)
+    {
+        closeStep();
+    }
+}
+
+bool EditJournal::undo(World& world)
+{
+    if (m_groupDepth > 0)
+    {
+        LOG_ERROR("EditJournal: can't undo while a group is open");
+        return false;
+    }
+    if (!canUndo())
+    {
+        return false;
+    }
+
+    replay(m_steps[m_undoCount - 1], true, world);
+    m_undoCount--;
+    return true;
+}
+
+bool EditJournal::redo(World& world)
+{
+    if (m_groupDepth > 0)
+    {
+        LOG_ERROR("EditJournal: can't redo while a group is open");
+        return false;
+    }
+    if (!canRedo())
+    {
+        return false;
+    }
+
+    replay(m_steps[m_undoCount], false, world);
+    m_undoCount++;
+    return true;
+}
+
+void EditJournal::clear()
+{
+    m_steps.clear();
+    m_undoCount = 0;
+    m_pending.clear();
+    m_arena.clear();
+    m_arena.shrink_to_fit();
+}
+
+EditJournalStats EditJournal::getStats() const
+{
+    EditJournalStats stats;
+    stats.undoSteps = m_undoCount;
+    stats.redoSteps = static_cast<uint32_t>(m_steps.size()) - m_undoCount;
+    stats.evictedSteps = m_evictedSteps;
+    stats.arenaBytes = m_arena.size();
+    for (const Step& step : m_steps)
+    {
+        stats.usedBytes += step.size;
+        stats.voxelCount += step.voxelCount;
+    }
+    return stats;
+}
+
+void EditJournal::closeStep()
+{
+    m_encodeBuffer.clear();
+    uint64_t voxelCount = 0;
+
+    m_pending.forEach([&](ChunkKey key, std::vector<uint32_t>& changes)
+    {
+        VoxelEdit::collapseChanges(changes);
+
+        if (!changes.empty())
+        {
+            encodeChunk(key, changes, m_encodeBuffer);
+            voxelCount += changes.size();
+        }
+    });
+    m_pending.clear();
+
+    if (!m_encodeBuffer.empty())
+    {
+        storeStep(m_encodeBuffer, voxelCount);
+    }
+}
+
+void EditJournal::storeStep(const std::vector<uint8_t>& bytes, uint64_t voxelCount)
+{
+    // A new step replaces whatever could have been redone
+    m_steps.resize(m_undoCount);
+
+    const size_t size = bytes.size();
+    if (size > m_capacity)
+    {
+        // Older steps would no longer apply to the world without this one, so they go too
+        LOG_ERROR("EditJournal: edit of " << size << " bytes exceeds the journal capacity, history cleared");
+        m_evictedSteps += static_cast<uint32_t>(m_steps.size());
+        m_steps.clear();
+        m_undoCount = 0;
+        return;
+    }
+
+    const size_t writePosition = m_steps.empty() ? 0 : m_steps.back().offset + m_steps.back().size;
+    const bool wrap = writePosition + size > m_capacity;
+    const size_t offset = wrap ? 0 : writePosition;
+
+    // Steps behind the write position are from the previous lap and the oldest ones,
+    // they go first when wrapping, then whatever the new step overlaps
+    while (!m_steps.empty())
+    {
+        const Step& front = m_steps.front();
+        const bool stale = wrap && front.offset >= writePosition;
+        const bool overlaps = front.offset < offset + size && front.offset + front.size > offset;
+        if (!stale && !overlaps)
+        {
+            break;
+        }
+
+        m_steps.pop_front();
+        m_evictedSteps++;
+    }
+
+    if (offset + size > m_arena.size())
+    {
+        m_arena.resize(std::min(m_capacity, std::max(offset + size, m_arena.size() * 2)));
+    }
+    std::memcpy(m_arena.data() + offset, bytes.data(), size);
+
+    m_steps.push_back({ offset, size, voxelCount });
+    m_undoCount = static_cast<uint32_t>(m_steps.size());
+}
+
+void EditJournal::replay(const Step& step, bool undo, World& world)
+{
+    decode(m_arena.data() + step.offset, step.size, undo, m_decodeBuffer);
+
+    m_replaying = true;
+    world.applyChanges(m_decodeBuffer);
+    m_replaying = false;
+}
+
+// Chunk record: ChunkKey, run count, (gap, length) per run of consecutive indices, then the old
+// and the new values of all runs as (length, value) pairs
+void EditJournal::encodeChunk(ChunkKey key, const std::vector<uint32_t>& changes, std::vector<uint8_t>& out)
+{
+    const size_t keyOffset = out.size();
+    out.resize(keyOffset + sizeof(ChunkKey));
+    std::memcpy(out.data() + keyOffset, &key, sizeof(ChunkKey));
+
+    std::vector<uint32_t> runs;
+    for (size_t i = 0; i < changes.size();)
+    {
+        const uint32_t start = VoxelEdit::getChangeIndex(changes[i]);
+        size_t end = i + 1;
+        while (end < changes.size() && VoxelEdit::getChangeIndex(changes[end]) == start + (end - i))
+        {
+            end++;
+        }
+        runs.push_back(start);
+        runs.push_back(static_cast<uint32_t>(end - i));
+        i = end;
+    }
+
+    writeVarint(out, static_cast<uint32_t>(runs.size() / 2));
+    uint32_t previousEnd = 0;
+    for (size_t i = 0; i < runs.size(); i += 2)
+    {
+        writeVarint(out, runs[i] - previousEnd);
+        writeVarint(out, runs[i + 1]);
+        previousEnd = runs[i] + runs[i + 1];
+    }
+
+    writeValueRuns(out, changes, 16);
+    writeValueRuns(out, changes, 24);
+}
+
+void EditJournal::decode(const uint8_t* data, size_t size, bool undo, std::vector<ChunkDelta>& deltas)
+{
+    deltas.clear();
+
+    const uint8_t* end = data + size;
+    while (data < end)
+    {
+        ChunkKey key;
+        std::memcpy(&key, data, sizeof(ChunkKey));
+        data += sizeof(ChunkKey);
+
+        ChunkDelta& delta = deltas.emplace_back();
+        delta.chunkCoord = unpackChunkKey(key);
+
+        const uint32_t runCount = readVarint(data);
+        uint32_t position = 0;
+        for (uint32_t run = 0; run < runCount; ++run)
+        {
+            position += readVarint(data);
+            const uint32_t length = readVarint(data);
+            for (uint32_t i = 0; i < length; ++i)
+            {
+                delta.changes.push_back(position++);
+            }
+        }
+
+        // Undo writes the old values, so they go into the "new" byte
+        readValueRuns(data, delta.changes, undo ? 24 : 16);
+        readValueRuns(data, delta.changes, undo ? 16 : 24);
+    }
+}
@@ -0,0 +1,91 @@
+#pragma once
+
+#include "Chunk.h"
+#include "ChunkHashMap.h"
+#include "VoxelEdit.h"
+
+#include "glm/glm.hpp"
+
+#include <cstdint>
+#include <vector>
+#include <deque>
+
+class World;
+
+struct EditJournalStats
+{
+    uint32_t undoSteps = 0;
+    uint32_t redoSteps = 0;
+    uint32_t evictedSteps = 0;  // Dropped to stay under the capacity
+    size_t usedBytes = 0;       // Encoded steps currently held in the arena
+    size_t arenaBytes = 0;      // Allocated so far, never more than the capacity
+    uint64_t voxelCount = 0;    // Changed voxels across the held steps
+};
+
+// Undo/redo history of bulk world edits.
+//
+// Attach it with World::setEditJournal. Every setVoxel and applyEdit becomes one step; edits between
+// beginGroup() and endGroup() (a brush stroke) are merged into a single step. A step stores, per
+// chunk, the runs of changed voxel indices and the old and new values of those runs, all run-length
+// encoded, so carving a sphere out of stone costs a few bytes per row instead of a chunk copy.
+//
+// Steps live back to back in one ring-buffer arena of fixed capacity. When a new step doesn't fit,
+// the oldest steps are overwritten. Undo and redo decode a step into ChunkDeltas and write them with
+// World::applyChanges, so they get the same parallel chunk writes and batched relight as edits.
+//
+// CellularSimulation ticks aren't recorded, they would flood the history with one step per tick.
+// Instead steps are rebased when they replay: applyChanges skips every voxel that no longer holds
+// the value the step left there, so undo never erases sand or water that moved in since.
+class EditJournal
+{
+public:
+    static constexpr size_t DEFAULT_CAPACITY = 64ull << 20;
+
+    explicit EditJournal(size_t capacityBytes = DEFAULT_CAPACITY);
+
+    void beginGroup();
+    void endGroup();
+
+    // Called by World for every chunk an edit changed, changes packed with VoxelEdit::packChange.
+    // Outside a group the step is closed right away. Ignored while undoing or redoing.
+    void record(const glm::ivec3& chunkCoord, const std::vector<uint32_t>& changes);
+
+    // False if there is nothing to undo/redo or a group is still open
+    bool undo(World& world);
+    bool redo(World& world);
+
+    void clear();
+
+    bool canUndo() const { return m_undoCount > 0; }
+    bool canRedo() const { return m_undoCount < m_steps.size(); }
+    size_t getCapacity() const { return m_capacity; }
+    EditJournalStats getStats() const;
+
+private:
+    struct Step
+    {
+        size_t offset = 0;
+        size_t size = 0;
+        uint64_t voxelCount = 0;
+    };
+
+    void closeStep();
+    void storeStep(const std::vector<uint8_t>& bytes, uint64_t voxelCount);
+    void replay(const Step& step, bool undo, World& world);
+
+    static void encodeChunk(ChunkKey key, const std::vector<uint32_t>& changes, std::vector<uint8_t>& out);
+    static void decode(const uint8_t* data, size_t size, bool undo, std::vector<ChunkDelta>& deltas);
+
+    size_t m_capacity = 0;
+    std::vector<uint8_t> m_arena;   // Grows up to m_capacity, then wraps
+    std::deque<Step> m_steps;       // Oldest first
+    uint32_t m_undoCount = 0;       // m_steps[0, m_undoCount) can be undone, the rest redone
+    uint32_t m_evictedSteps = 0;
+
+    uint32_t m_groupDepth = 0;
+    bool m_replaying = false;
+    ChunkHashMap<std::vector<uint32_t>> m_pending; // Changes of the open step, oldest first
+
+    std::vector<uint8_t> m_encodeBuffer;
+    std::vector<ChunkDelta> m_decodeBuffer;
+};
@@ -0,0 +1,216 @@
+#include "ImageWriter.h"
+#include "DebugUtils.h"
+
+#include <fstream>
+#include <vector>
+#include <array>
+#include <algorithm>
+#include <cstring>
+
+namespace
+{
+    const std::array<uint32_t, 256>& crcTable()
+    {
+        static const std::array<uint32_t, 256> table = []()
+        {
+            std::array<uint32_t, 256> values{};
+            for (uint32_t n = 0; n < 256; ++n)
+            {
+                uint32_t c = n;
+                for (int k = 0; k < 8; ++k)
+                {
+                    c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                }
+                values[n] = c;
+            }
+            return values;
+        }();
+        return table;
+    }
+
+    void putBigEndian(std::vector<uint8_t>& out, uint32_t value)
+    {
+        out.push_back(static_cast<uint8_t>(value >> 24));
+        out.push_back(static_cast<uint8_t>(value >> 16));
+        out.push_back(static_cast<uint8_t>(value >> 8));
+        out.push_back(static_cast<uint8_t>(value));
+    }
+
+    template<typename T>
+    void putLittleEndian(std::vector<uint8_t>& out, T value)
+    {
+        uint8_t bytes[sizeof(T)];
+        std::memcpy(bytes, &value, sizeof(T)); // Every target we ship on is little endian
+        out.insert(out.end(), bytes, bytes + sizeof(T));
+    }
+
+    void putPngChunk(std::vector<uint8_t>& out, const char* type, const std::vector<uint8_t>& data)
+    {
+        putBigEndian(out, static_cast<uint32_t>(data.size()));
+        const size_t start = out.size();
+        out.insert(out.end(), type, type + 4);
+        out.insert(out.end(), data.begin(), data.end());
+
+        uint32_t crc = 0xFFFFFFFFu;
+        for (size_t i = start; i < out.size(); ++i)
+        {
+            crc = crcTable()[(crc ^ out[i]) & 0xFF] ^ (crc >> 8);
+        }
+        putBigEndian(out, crc ^ 0xFFFFFFFFu);
+    }
+
+    bool writeFile(const std::string& path, const std::vector<uint8_t>& bytes)
+    {
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        if (!file)
+        {
+            LOG_ERROR("ImageWriter: can't open " << path);
+            return false;
+        }
+
+        file.write(reinterpret_cast<const char*>(bytes.data()), static_cast<std::streamsize>(bytes.size()));
+        if (!file)
+        {
+            LOG_ERROR("ImageWriter: failed writing " << path);
+            return false;
+        }
+        return true;
+    }
+
+    void putExrAttribute(std::vector<uint8_t>& out, const char* name, const char* type, const std::vector<uint8_t>& value)
+    {
+        out.insert(out.end(), name, name + std::strlen(name) + 1);
+        out.insert(out.end(), type, type + std::strlen(type) + 1);
+        putLittleEndian(out, static_cast<int32_t>(value.size()));
+        out.insert(out.end(), value.begin(), value.end());
+    }
+}
+
+bool ImageWriter::writePng(const std::string& path, uint32_t width, uint32_t height, const float* rgba)
+{
+    if (width == 0 || height == 0 || rgba == nullptr)
+    {
+        LOG_ERROR("ImageWriter: empty image for " << path);
+        return false;
+    }
+
+    // Filter type 0 (none) in front of every row
+    const size_t rowBytes = 1 + static_cast<size_t>(width) * 4;
+    std::vector<uint8_t> raw(rowBytes * height);
+    for (uint32_t y = 0; y < height; ++y)
+    {
+        uint8_t* row = raw.data() + y * rowBytes;
+        row[0] = 0;
+        for (uint32_t i = 0; i < width * 4; ++i)
+        {
+            const float value = std::clamp(rgba[static_cast<size_t>(y) * width * 4 + i], 0.0f, 1.0f);
+            row[1 + i] = static_cast<uint8_t>(value * 255.0f + 0.5f);
+        }
+    }
+
+    // zlib stream made of stored deflate blocks
+    std::vector<uint8_t> zlib = { 0x78, 0x01 };
+    constexpr size_t MAX_STORED_BLOCK = 65535;
+    for (size_t offset = 0; offset < raw.size(); offset += MAX_STORED_BLOCK)
+    {
+        const uint16_t length = static_cast<uint16_t>(std::min(MAX_STORED_BLOCK, raw.size() - offset));
+        zlib.push_back(offset + length == raw.size() ? 1 : 0);
+        putLittleEndian(zlib, length);
+        putLittleEndian(zlib, static_cast<uint16_t>(~length));
+        zlib.insert(zlib.end(), raw.begin() + offset, raw.begin() + offset + length);
+    }
+
+    uint32_t adlerA = 1;
+    uint32_t adlerB = 0;
+    for (uint8_t byte : raw)
+    {
+        adlerA = (adlerA + byte) % 65521;
+        adlerB = (adlerB + adlerA) % 65521;
+    }
+    putBigEndian(zlib, (adlerB << 16) | adlerA);
+
+    std::vector<uint8_t> header;
+    putBigEndian(header, width);
+    putBigEndian(header, height);
+    header.insert(header.end(), { 8, 6, 0, 0, 0 }); // 8 bits, RGBA, deflate, adaptive filtering, no interlace
+
+    std::vector<uint8_t> file = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    putPngChunk(file, "IHDR", header);
+    putPngChunk(file, "IDAT", zlib);
+    putPngChunk(file, "IEND", {});
+    return writeFile(path, file);
+}
+
+bool ImageWriter::writeExr(const std::string& path, uint32_t width, uint32_t height, const float* rgba)
+{
+    if (width == 0 || height == 0 || rgba == nullptr)
+    {
+        LOG_ERROR("ImageWriter: empty image for " << path);
+        return false;
+    }
+
+    std::vector<uint8_t> file;
+    putLittleEndian(file, static_cast<uint32_t>(20000630)); // Magic number
+    putLittleEndian(file, static_cast<uint32_t>(2));        // Version 2, single-part scanline image
+
+    // Channels have to be listed alphabetically, they are stored in that order per scanline
+    constexpr char CHANNEL_NAMES[4] = { 'A', 'B', 'G', 'R' };
+    constexpr uint32_t CHANNEL_OFFSETS[4] = { 3, 2, 1, 0 };
+    std::vector<uint8_t> channels;
+    for (char name : CHANNEL_NAMES)
+    {
+        channels.push_back(static_cast<uint8_t>(name));
+        channels.push_back(0);
+        putLittleEndian(channels, static_cast<int32_t>(2)); // FLOAT
+        channels.insert(channels.end(), { 0, 0, 0, 0 });    // pLinear, reserved
+        putLittleEndian(channels, static_cast<int32_t>(1));
+        putLittleEndian(channels, static_cast<int32_t>(1));
+    }
+    channels.push_back(0);
+
+    std::vector<uint8_t> window;
+    putLittleEndian(window, static_cast<int32_t>(0));
+    putLittleEndian(window, static_cast<int32_t>(0));
+    putLittleEndian(window, static_cast<int32_t>(width - 1));
+    putLittleEndian(window, static_cast<int32_t>(height - 1));
+
+    std::vector<uint8_t> aspectRatio;
+    putLittleEndian(aspectRatio, 1.0f);
+    std::vector<uint8_t> windowCenter;
+    putLittleEndian(windowCenter, 0.0f);
+    putLittleEndian(windowCenter, 0.0f);
+
+    putExrAttribute(file, "channels", "chlist", channels);
+    putExrAttribute(file, "compression", "compression", { 0 });
+    putExrAttribute(file, "dataWindow", "box2i", window);
+    putExrAttribute(file, "displayWindow", "box2i", window);
+    putExrAttribute(file, "lineOrder", "lineOrder", { 0 });
+    putExrAttribute(file, "pixelAspectRatio", "float", aspectRatio);
+    putExrAttribute(file, "screenWindowCenter", "v2f", windowCenter);
+    putExrAttribute(file, "screenWindowWidth", "float", aspectRatio);
+    file.push_back(0);
+
+    // Offset table, then one chunk per scanline: y, byte count, the channels one after another
+    const uint32_t lineBytes = width * 4 * sizeof(float);
+    const uint64_t firstChunk = file.size() + static_cast<uint64_t>(height) * sizeof(uint64_t);
+    for (uint32_t y = 0; y < height; ++y)
+    {
+        putLittleEndian(file, firstChunk + static_cast<uint64_t>(y) * (8 + lineBytes));
+    }
+
+    for (uint32_t y = 0; y < height; ++y)
+    {
+        putLittleEndian(file, static_cast<int32_t>(y));
+        putLittleEndian(file, static_cast<int32_t>(lineBytes));
+        const float* row = rgba + static_cast<size_t>(y) * width * 4;
+        for (uint32_t channel : CHANNEL_OFFSETS)
+        {
+            for (uint32_t x = 0; x < width; ++x)
+            {
+                putLittleEndian(file, row[x * 4 + channel]);
+            }
+        }
+    }
+
+    return writeFile(path, file);
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+// Minimal writers for RGBA float images, row 0 at the top as in the ray tracing storage image.
+// No compression on either side: the files are for golden-image comparisons and inspection, so
+// bit-exact output without a codec dependency matters more than size.
+namespace ImageWriter
+{
+    // 8-bit RGBA, each channel clamped to [0, 1] without any transfer curve, like a UNORM copy of the image
+    bool writePng(const std::string& path, uint32_t width, uint32_t height, const float* rgba);
+
+    // 32-bit float RGBA, the exact values
+    bool writeExr(const std::string& path, uint32_t width, uint32_t height, const float* rgba);
+}
@@ -0,0 +1,197 @@
+#include "InstanceTable.h"
+
+#include <algorithm>
+
+InstanceHandle InstanceTable::add(const VkAccelerationStructureInstanceKHR& instance, uint32_t blas)
+{
+    uint32_t slot;
+    if (!m_freeSlots.empty())
+    {
+        slot = m_freeSlots.back();
+        m_freeSlots.pop_back();
+    }
+    else
+    {
+        slot = getSlotCount();
+        m_instances.emplace_back();
+        m_slotBlas.push_back(0);
+        m_slotIds.push_back(InstanceHandle::INVALID_ID);
+        m_slotDirty.push_back(0);
+    }
+
+    uint32_t id;
+    if (!m_freeIds.empty())
+    {
+        id = m_freeIds.back();
+        m_freeIds.pop_back();
+    }
+    else
+    {
+        id = static_cast<uint32_t>(m_ids.size());
+        m_ids.emplace_back();
+    }
+
+    m_ids[id].slot = slot;
+    m_instances[slot] = instance;
+    m_slotBlas[slot] = blas;
+    m_slotIds[slot] = id;
+    markDirty(slot);
+    m_liveCount++;
+    m_layoutVersion++;
+
+    return { id, m_ids[id].generation };
+}
+
+bool InstanceTable::remove(InstanceHandle handle)
+{
+    const uint32_t slot = getSlot(handle);
+    if (slot == INVALID_SLOT)
+    {
+        return false;
+    }
+
+    IdEntry& entry = m_ids[handle.id];
+    entry.slot = INVALID_SLOT;
+    entry.generation++;
+    m_freeIds.push_back(handle.id);
+
+    m_instances[slot] = {};
+    m_slotIds[slot] = InstanceHandle::INVALID_ID;
+    m_freeSlots.push_back(slot);
+    markDirty(slot);
+    m_liveCount--;
+    m_layoutVersion++;
+    return true;
+}
+
+bool InstanceTable::setTransform(InstanceHandle handle, const VkTransformMatrixKHR& transform)
+{
+    const uint32_t slot = getSlot(handle);
+    if (slot == INVALID_SLOT)
+    {
+        return false;
+    }
+
+    m_instances[slot].transform = transform;
+    markDirty(slot);
+    return true;
+}
+
+void InstanceTable::setReference(uint32_t slot, uint64_t accelerationStructureReference)
+{
+    m_instances[slot].accelerationStructureReference = accelerationStructureReference;
+    markDirty(slot);
+}
+
+uint32_t InstanceTable::getSlot(InstanceHandle handle) const
+{
+    if (handle.id >= m_ids.size() || m_ids[handle.id].generation != handle.generation)
+    {
+        return INVALID_SLOT;
+    }
+    return m_ids[handle.id].slot;
+}
+
+uint32_t InstanceTable::compact()
+{
+    if (m_freeSlots.empty())
+    {
+        return 0;
+    }
+
+    // Lowest hole takes the highest live instance until they meet, the tail is then all holes
+    std::sort(m_freeSlots.begin(), m_freeSlots.end());
+    uint32_t moved = 0;
+    uint32_t last = getSlotCount();
+    for (uint32_t hole : m_freeSlots)
+    {
+        while (last > hole && !isLive(last - 1))
+        {
+            --last;
+        }
+        if (last <= hole + 1)
+        {
+            break;
+        }
+
+        const uint32_t from = --last;
+        m_instances[hole] = m_instances[from];
+        m_slotBlas[hole] = m_slotBlas[from];
+        m_slotIds[hole] = m_slotIds[from];
+        m_ids[m_slotIds[hole]].slot = hole;
+        markDirty(hole);
+        moved++;
+    }
+
+    m_instances.resize(m_liveCount);
+    m_slotBlas.resize(m_liveCount);
+    m_slotIds.resize(m_liveCount);
+    m_slotDirty.resize(m_liveCount);
+    std::erase_if(m_dirtySlots, [this](uint32_t slot) { return slot >= m_liveCount; });
+    m_freeSlots.clear();
+    m_layoutVersion++;
+    return moved;
+}
+
+void InstanceTable::clear()
+{
+    m_instances.clear();
+    m_slotBlas.clear();
+    m_slotIds.clear();
+    m_freeSlots.clear();
+
+    // Ids stay around with a new generation, a handle from before must not match what reuses its id
+    m_freeIds.clear();
+    for (uint32_t id = static_cast<uint32_t>(m_ids.size()); id-- > 0;)
+    {
+        if (m_ids[id].slot != INVALID_SLOT)
+        {
+            m_ids[id].slot = INVALID_SLOT;
+            m_ids[id].generation++;
+        }
+        m_freeIds.push_back(id);
+    }
+    m_dirtySlots.clear();
+    m_slotDirty.clear();
+    m_liveCount = 0;
+    m_layoutVersion++;
+}
+
+void InstanceTable::takeDirtyRanges(std::vector<InstanceRange>& ranges, uint32_t mergeGap)
+{
+    ranges.clear();
+
+    std::sort(m_dirtySlots.begin(), m_dirtySlots.end());
+    for (uint32_t slot : m_dirtySlots)
+    {
+        m_slotDirty[slot] = 0;
+        if (!ranges.empty() && slot <= ranges.back().first + ranges.back().count + mergeGap)
+        {
+            ranges.back().count = slot - ranges.back().first + 1;
+        }
+        else
+        {
+            ranges.push_back({ slot, 1 });
+        }
+    }
+    m_dirtySlots.clear();
+}
+
+void InstanceTable::markAllDirty()
+{
+    m_dirtySlots.clear();
+    for (uint32_t slot = 0; slot < getSlotCount(); ++slot)
+    {
+        m_dirtySlots.push_back(slot);
+        m_slotDirty[slot] = 1;
+    }
+}
+
+void InstanceTable::markDirty(uint32_t slot)
+{
+    if (m_slotDirty[slot] == 0)
+    {
+        m_slotDirty[slot] = 1;
+        m_dirtySlots.push_back(slot);
+    }
+}
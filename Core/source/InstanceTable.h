@@ -0,0 +1,99 @@
+#pragma once
+
+#include "vulkan/vulkan.h"
+
+#include <cstdint>
+#include <vector>
+#include <limits>
+
+// Stable reference to an instance in an InstanceTable. Stays valid through compaction, a handle
+// to a removed instance is rejected even after its id is reused.
+struct InstanceHandle
+{
+    static constexpr uint32_t INVALID_ID = std::numeric_limits<uint32_t>::max();
+
+    uint32_t id = INVALID_ID;
+    uint32_t generation = 0;
+
+    bool isValid() const { return id != INVALID_ID; }
+    bool operator==(const InstanceHandle& other) const { return id == other.id && generation == other.generation; }
+};
+
+// Consecutive slots, for uploads
+struct InstanceRange
+{
+    uint32_t first = 0;
+    uint32_t count = 0;
+};
+
+// CPU side of the TLAS instance buffer: one slot per VkAccelerationStructureInstanceKHR, in the
+// order they are uploaded.
+//
+// Removing an instance leaves a hole, an inactive instance (accelerationStructureReference 0)
+// that the next add reuses through a free list, so adding and removing are O(1) and never move
+// other instances. compact() moves the last instances into the holes to shrink the slot count
+// again, handles go through an id table and keep pointing at their instance.
+//
+// Every changed slot is recorded, takeDirtyRanges() hands them out as sorted ranges so only
+// those parts of the instance buffer have to be written. getLayoutVersion() changes whenever a
+// slot turns live or into a hole, which a TLAS update can't follow.
+//
+// Doesn't touch the device, so it can be used and tested without one.
+class InstanceTable
+{
+public:
+    static constexpr uint32_t INVALID_SLOT = std::numeric_limits<uint32_t>::max();
+
+    InstanceHandle add(const VkAccelerationStructureInstanceKHR& instance, uint32_t blas);
+    bool remove(InstanceHandle handle);
+    bool setTransform(InstanceHandle handle, const VkTransformMatrixKHR& transform);
+
+    // For a BLAS that moved to another address, e.g. its compacted copy
+    void setReference(uint32_t slot, uint64_t accelerationStructureReference);
+
+    bool contains(InstanceHandle handle) const { return getSlot(handle) != INVALID_SLOT; }
+    uint32_t getSlot(InstanceHandle handle) const;
+
+    // Fills every hole below the last live slot, returns how many instances moved
+    uint32_t compact();
+    void clear();
+
+    // Ranges of slots changed since the last call, sorted. Runs separated by at most mergeGap
+    // unchanged slots are merged, one larger copy is usually cheaper than two small ones.
+    void takeDirtyRanges(std::vector<InstanceRange>& ranges, uint32_t mergeGap = 0);
+    void markAllDirty();
+    bool hasDirtySlots() const { return !m_dirtySlots.empty(); }
+
+    uint32_t getSlotCount() const { return static_cast<uint32_t>(m_instances.size()); }
+    uint32_t getLiveCount() const { return m_liveCount; }
+    uint32_t getHoleCount() const { return getSlotCount() - m_liveCount; }
+    bool isLive(uint32_t slot) const { return m_slotIds[slot] != InstanceHandle::INVALID_ID; }
+
+    const VkAccelerationStructureInstanceKHR* getInstances() const { return m_instances.data(); }
+    const VkAccelerationStructureInstanceKHR& getInstance(uint32_t slot) const { return m_instances[slot]; }
+    uint32_t getBlas(uint32_t slot) const { return m_slotBlas[slot]; }
+
+    uint64_t getLayoutVersion() const { return m_layoutVersion; }
+
+private:
+    struct IdEntry
+    {
+        uint32_t slot = INVALID_SLOT;
+        uint32_t generation = 0;
+    };
+
+    void markDirty(uint32_t slot);
+
+    std::vector<VkAccelerationStructureInstanceKHR> m_instances;
+    std::vector<uint32_t> m_slotBlas;
+    std::vector<uint32_t> m_slotIds;    // Id living in every slot, INVALID_ID for holes
+    std::vector<uint32_t> m_freeSlots;
+    std::vector<IdEntry> m_ids;
+    std::vector<uint32_t> m_freeIds;
+
+    std::vector<uint32_t> m_dirtySlots;
+    std::vector<uint8_t> m_slotDirty;
+
+    uint32_t m_liveCount = 0;
+    uint64_t m_layoutVersion = 0;
+};
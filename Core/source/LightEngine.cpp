@@ -0,0 +1,676 @@
+#include "LightEngine.h"
+#include "World.h"
+#include "PerformanceTimer.h"
+
+namespace
+{
+    constexpr uint32_t DIRECTION_DOWN = 2;
+
+    const glm::ivec3 DIRECTIONS[6] =
+    {
+        { -1, 0, 0 }, { 1, 0, 0 },
+        { 0, -1, 0 }, { 0, 1, 0 },
+        { 0, 0, -1 }, { 0, 0, 1 },
+    };
+
+    glm::ivec3 localPosition(uint32_t index)
+    {
+        return glm::ivec3(index & (CHUNK_SIZE_X - 1), (index >> CHUNK_SIZE_SHIFT) & (CHUNK_SIZE_Y - 1), index >> (CHUNK_SIZE_SHIFT * 2));
+    }
+
+    uint32_t colorOf(const glm::ivec3& chunkCoord)
+    {
+        const glm::ivec3 c = ((chunkCoord % 3) + 3) % 3;
+        return static_cast<uint32_t>(c.x + 3 * (c.y + 3 * c.z));
+    }
+}
+
+LightEngine::LightEngine()
+{
+    m_transparent[AIR_VOXEL] = true;
+    m_transparent[WATER_VOXEL] = true;
+    m_transparent[TORCH_VOXEL] = true;
+    m_emission[TORCH_VOXEL] = 14;
+}
+
+bool LightEngine::Cursor::resolve(const glm::ivec3& worldPosition, VoxelRef& ref)
+{
+    const glm::ivec3 chunkCoord = worldToChunkCoord(worldPosition);
+
+    Entry* entry = nullptr;
+    for (uint32_t i = 0; i < 2; ++i)
+    {
+        if (m_entries[i].valid && m_entries[i].chunkCoord == chunkCoord)
+        {
+            entry = &m_entries[i];
+            m_lastUsed = i;
+            break;
+        }
+    }
+
+    if (entry == nullptr)
+    {
+        m_lastUsed ^= 1;
+        entry = &m_entries[m_lastUsed];
+        entry->valid = true;
+        entry->chunkCoord = chunkCoord;
+        entry->chunk = nullptr;
+        entry->light = nullptr;
+
+        const bool inWindow = !m_hasWindow ||
+            (glm::all(glm::greaterThanEqual(chunkCoord, m_windowMin)) && glm::all(glm::lessThanEqual(chunkCoord, m_windowMax)));
+        if (inWindow)
+        {
+            const std::unique_ptr<ChunkLight>* light = m_engine.m_light.find(packChunkKey(chunkCoord));
+            if (light != nullptr)
+            {
+                entry->light = light->get();
+                entry->chunk = m_engine.m_world->getChunk(chunkCoord);
+            }
+        }
+    }
+
+    if (entry->chunk == nullptr || entry->light == nullptr)
+    {
+        return false;
+    }
+
+    const glm::ivec3 local = worldToLocalCoord(worldPosition);
+    ref.chunk = entry->chunk;
+    ref.light = entry->light;
+    ref.index = Chunk::index(local.x, local.y, local.z);
+    return true;
+}
+
+bool LightEngine::Cursor::resolveNeighbor(const glm::ivec3& worldPosition, const VoxelRef& from, uint32_t direction, VoxelRef& ref)
+{
+    constexpr int32_t STRIDES[6] =
+    {
+        -1, 1,
+        -static_cast<int32_t>(CHUNK_SIZE_X), static_cast<int32_t>(CHUNK_SIZE_X),
+        -static_cast<int32_t>(CHUNK_SIZE_X * CHUNK_SIZE_Y), static_cast<int32_t>(CHUNK_SIZE_X * CHUNK_SIZE_Y),
+    };
+
+    // Still inside the same chunk if the coordinate on the moving axis didn't wrap
+    const int32_t axis = static_cast<int32_t>(direction >> 1);
+    const int32_t local = worldPosition[axis] & static_cast<int32_t>(CHUNK_SIZE_X - 1);
+    const bool wrapped = (direction & 1) ? local == 0 : local == static_cast<int32_t>(CHUNK_SIZE_X) - 1;
+    if (!wrapped)
+    {
+        ref.chunk = from.chunk;
+        ref.light = from.light;
+        ref.index = static_cast<uint32_t>(static_cast<int32_t>(from.index) + STRIDES[direction]);
+        return true;
+    }
+
+    return resolve(worldPosition, ref);
+}
+
+void LightEngine::init(World& world)
+{
+    destroy();
+
+    m_world = &world;
+    m_world->setLightEngine(this);
+    m_world->forEachChunk([this](Chunk& chunk) { onChunkLoaded(chunk); });
+}
+
+void LightEngine::destroy()
+{
+    if (m_world == nullptr)
+    {
+        return;
+    }
+
+    m_world->setLightEngine(nullptr);
+    m_world = nullptr;
+    m_light.clear();
+    m_unlit.clear();
+    m_pendingEdits.clear();
+}
+
+void LightEngine::onChunkLoaded(const Chunk& chunk)
+{
+    m_unlit.push_back(packChunkKey(chunk.position));
+}
+
+void LightEngine::onChunkEvicted(const Chunk& chunk)
+{
+    const ChunkKey key = packChunkKey(chunk.position);
+    m_light.erase(key);
+
+    auto it = std::find(m_unlit.begin(), m_unlit.end(), key);
+    if (it != m_unlit.end())
+    {
+        *it = m_unlit.back();
+        m_unlit.pop_back();
+    }
+}
+
+void LightEngine::update(ThreadPool& threadPool)
+{
+    if (m_unlit.empty())
+    {
+        return;
+    }
+
+    PERF_SCOPE("Light Update");
+
+    std::vector<ChunkKey> keys;
+    keys.swap(m_unlit);
+    lightChunks(keys, threadPool);
+}
+
+void LightEngine::relightAll(ThreadPool& threadPool)
+{
+    PERF_SCOPE("Light Relight All");
+
+    m_light.clear();
+    m_unlit.clear();
+
+    std::vector<ChunkKey> keys;
+    m_world->forEachChunk([&keys](Chunk& chunk) { keys.push_back(packChunkKey(chunk.position)); });
+    lightChunks(keys, threadPool);
+}
+
+uint8_t LightEngine::getSkyLight(const glm::ivec3& worldPosition) const
+{
+    const std::unique_ptr<ChunkLight>* light = m_light.find(packChunkKey(worldToChunkCoord(worldPosition)));
+    if (light == nullptr)
+    {
+        return 0;
+    }
+
+    const glm::ivec3 local = worldToLocalCoord(worldPosition);
+    return (*light)->getSky(Chunk::index(local.x, local.y, local.z));
+}
+
+uint8_t LightEngine::getBlockLight(const glm::ivec3& worldPosition) const
+{
+    const std::unique_ptr<ChunkLight>* light = m_light.find(packChunkKey(worldToChunkCoord(worldPosition)));
+    if (light == nullptr)
+    {
+        return 0;
+    }
+
+    const glm::ivec3 local = worldToLocalCoord(worldPosition);
+    return (*light)->getBlock(Chunk::index(local.x, local.y, local.z));
+}
+
+const ChunkLight* LightEngine::getChunkLight(const glm::ivec3& chunkCoord) const
+{
+    const std::unique_ptr<ChunkLight>* light = m_light.find(packChunkKey(chunkCoord));
+    return light != nullptr ? light->get() : nullptr;
+}
+
+void LightEngine::onVoxelChanged(const glm::ivec3& worldPosition, VoxelID oldId, VoxelID newId)
+{
+    Cursor cursor(*this);
+
+    for (LightChannel channel : { LightChannel::Block, LightChannel::Sky })
+    {
+        m_addQueue.clear();
+        m_removeQueue.clear();
+
+        seedChange(channel, worldPosition, oldId, newId, cursor);
+        propagateRemove(channel, m_removeQueue, m_addQueue, cursor);
+
+        if (m_transparent[newId] && !m_transparent[oldId])
+        {
+            seedOpened(channel, worldPosition, cursor);
+        }
+        propagateAdd(channel, m_addQueue, cursor);
+    }
+}
+
+void LightEngine::onChunkEdited(const Chunk& chunk, std::vector<uint32_t> changes)
+{
+    if (!changes.empty())
+    {
+        m_pendingEdits.push_back({ chunk.getWorldOrigin(), std::move(changes) });
+    }
+}
+
+void LightEngine::applyEdits()
+{
+    if (m_pendingEdits.empty())
+    {
+        return;
+    }
+
+    PERF_SCOPE("Light Apply Edits");
+
+    Cursor cursor(*this);
+
+    // Same as onVoxelChanged, but every change is seeded before a single remove and refill pass
+    for (LightChannel channel : { LightChannel::Block, LightChannel::Sky })
+    {
+        m_addQueue.clear();
+        m_removeQueue.clear();
+
+        for (const PendingEdit& edit : m_pendingEdits)
+        {
+            for (uint32_t change : edit.changes)
+            {
+                seedChange(channel, edit.origin + localPosition(change & 0xFFFF), static_cast<VoxelID>(change >> 16), static_cast<VoxelID>(change >> 24), cursor);
+            }
+        }
+
+        propagateRemove(channel, m_removeQueue, m_addQueue, cursor);
+
+        for (const PendingEdit& edit : m_pendingEdits)
+        {
+            for (uint32_t change : edit.changes)
+            {
+                if (m_transparent[static_cast<VoxelID>(change >> 24)] && !m_transparent[static_cast<VoxelID>(change >> 16)])
+                {
+                    seedOpened(channel, edit.origin + localPosition(change & 0xFFFF), cursor);
+                }
+            }
+        }
+
+        propagateAdd(channel, m_addQueue, cursor);
+    }
+
+    m_pendingEdits.clear();
+}
+
+void LightEngine::seedChange(LightChannel channel, const glm::ivec3& worldPosition, VoxelID oldId, VoxelID newId, Cursor& cursor)
+{
+    VoxelRef ref;
+    if (!cursor.resolve(worldPosition, ref))
+    {
+        return;
+    }
+
+    const uint8_t level = getLevel(ref, channel);
+    const bool lostEmitter = channel == LightChannel::Block && m_emission[oldId] > 0;
+    if (level > 0 && (lostEmitter || !m_transparent[newId]))
+    {
+        setLevel(ref, channel, 0);
+        m_removeQueue.push(worldPosition, level);
+    }
+
+    if (channel == LightChannel::Block && m_emission[newId] > 0)
+    {
+        setLevel(ref, channel, std::max(getLevel(ref, channel), m_emission[newId]));
+        m_addQueue.push(worldPosition, m_emission[newId]);
+    }
+}
+
+void LightEngine::seedOpened(LightChannel channel, const glm::ivec3& worldPosition, Cursor& cursor)
+{
+    // Let the surrounding light flow into the new gap
+    for (const glm::ivec3& direction : DIRECTIONS)
+    {
+        VoxelRef neighbor;
+        if (cursor.resolve(worldPosition + direction, neighbor) && getLevel(neighbor, channel) > 0)
+        {
+            m_addQueue.push(worldPosition + direction, getLevel(neighbor, channel));
+        }
+    }
+}
+
+void LightEngine::propagateAdd(LightChannel channel, LightQueue& addQueue, Cursor& cursor)
+{
+    while (!addQueue.empty())
+    {
+        const LightNode node = addQueue.pop();
+
+        VoxelRef ref;
+        if (!cursor.resolve(node.position, ref))
+        {
+            continue;
+        }
+
+        // The voxel may have been brightened after it was queued, always spread the current value
+        const uint8_t level = getLevel(ref, channel);
+        if (level <= 1)
+        {
+            continue;
+        }
+
+        for (uint32_t d = 0; d < 6; ++d)
+        {
+            const glm::ivec3 position = node.position + DIRECTIONS[d];
+
+            VoxelRef neighbor;
+            if (!cursor.resolveNeighbor(position, ref, d, neighbor) || !m_transparent[neighbor.chunk->voxels[neighbor.index]])
+            {
+                continue;
+            }
+
+            const bool skyFall = channel == LightChannel::Sky && d == DIRECTION_DOWN && level == MAX_LIGHT_LEVEL;
+            const uint8_t newLevel = skyFall ? MAX_LIGHT_LEVEL : static_cast<uint8_t>(level - 1);
+            if (getLevel(neighbor, channel) < newLevel)
+            {
+                setLevel(neighbor, channel, newLevel);
+                addQueue.push(position, newLevel);
+            }
+        }
+    }
+}
+
+void LightEngine::propagateRemove(LightChannel channel, LightQueue& removeQueue, LightQueue& addQueue, Cursor& cursor)
+{
+    while (!removeQueue.empty())
+    {
+        const LightNode node = removeQueue.pop();
+
+        for (uint32_t d = 0; d < 6; ++d)
+        {
+            const glm::ivec3 position = node.position + DIRECTIONS[d];
+
+            VoxelRef neighbor;
+            if (!cursor.resolve(position, neighbor))
+            {
+                continue;
+            }
+
+            const uint8_t level = getLevel(neighbor, channel);
+            if (level == 0)
+            {
+                continue;
+            }
+
+            const bool skyFall = channel == LightChannel::Sky && d == DIRECTION_DOWN && node.level == MAX_LIGHT_LEVEL && level == MAX_LIGHT_LEVEL;
+            if (level < node.level || skyFall)
+            {
+                // Lit by the removed light, clear it and keep going
+                setLevel(neighbor, channel, 0);
+                removeQueue.push(position, level);
+
+                const uint8_t emission = m_emission[neighbor.chunk->voxels[neighbor.index]];
+                if (channel == LightChannel::Block && emission > 0)
+                {
+                    setLevel(neighbor, channel, emission);
+                    addQueue.push(position, emission);
+                }
+            }
+            else
+            {
+                // Lit from elsewhere, it refills what was cleared
+                addQueue.push(position, level);
+            }
+        }
+    }
+}
+
+void LightEngine::lightChunks(const std::vector<ChunkKey>& keys, ThreadPool& threadPool)
+{
+    ChunkHashMap<uint8_t> batch;
+    std::vector<ChunkKey> valid;
+    valid.reserve(keys.size());
+
+    for (ChunkKey key : keys)
+    {
+        if (m_world->getChunk(unpackChunkKey(key)) == nullptr || batch.contains(key))
+        {
+            continue;
+        }
+
+        m_light.insert(key, std::make_unique<ChunkLight>());
+        batch.insert(key, 1);
+        valid.push_back(key);
+    }
+
+    if (valid.empty())
+    {
+        return;
+    }
+
+    // Sky columns: group by (x, z), top to bottom within a group
+    std::vector<ChunkKey> columns = valid;
+    std::sort(columns.begin(), columns.end(), [](ChunkKey a, ChunkKey b)
+    {
+        const glm::ivec3 ca = unpackChunkKey(a);
+        const glm::ivec3 cb = unpackChunkKey(b);
+        if (ca.x != cb.x) return ca.x < cb.x;
+        if (ca.z != cb.z) return ca.z < cb.z;
+        return ca.y > cb.y;
+    });
+
+    std::vector<uint32_t> columnStarts;
+    for (uint32_t i = 0; i < columns.size(); ++i)
+    {
+        const glm::ivec3 c = unpackChunkKey(columns[i]);
+        if (i == 0 || c.x != unpackChunkKey(columns[i - 1]).x || c.z != unpackChunkKey(columns[i - 1]).z)
+        {
+            columnStarts.push_back(i);
+        }
+    }
+    columnStarts.push_back(static_cast<uint32_t>(columns.size()));
+
+    threadPool.parallelFor(static_cast<uint32_t>(columnStarts.size() - 1), [&](uint32_t column)
+    {
+        lightSkyColumn(columns.data() + columnStarts[column], columnStarts[column + 1] - columnStarts[column], batch);
+    });
+
+    // Flood fills, one colour at a time
+    std::array<std::vector<glm::ivec3>, 27> colors;
+    for (ChunkKey key : valid)
+    {
+        const glm::ivec3 chunkCoord = unpackChunkKey(key);
+        colors[colorOf(chunkCoord)].push_back(chunkCoord);
+    }
+
+    for (const std::vector<glm::ivec3>& group : colors)
+    {
+        threadPool.parallelFor(static_cast<uint32_t>(group.size()), [&](uint32_t i)
+        {
+            thread_local LightQueue queue;
+            floodChunk(group[i], batch, queue);
+        });
+    }
+
+    repairSkyBelow(valid, batch);
+}
+
+void LightEngine::lightSkyColumn(const ChunkKey* column, size_t count, const ChunkHashMap<uint8_t>& batch)
+{
+    // 1 where full sky light enters the current chunk from above
+    std::array<uint8_t, CHUNK_SIZE_X * CHUNK_SIZE_Z> open;
+
+    for (size_t i = 0; i < count; ++i)
+    {
+        const glm::ivec3 chunkCoord = unpackChunkKey(column[i]);
+        const glm::ivec3 aboveCoord = chunkCoord + glm::ivec3(0, 1, 0);
+
+        const bool continuesColumn = i > 0 && unpackChunkKey(column[i - 1]) == aboveCoord;
+        if (!continuesColumn)
+        {
+            const Chunk* above = m_world->getChunk(aboveCoord);
+            const ChunkLight* aboveLight = getChunkLight(aboveCoord);
+
+            if (above != nullptr && aboveLight != nullptr && !batch.contains(packChunkKey(aboveCoord)))
+            {
+                for (uint32_t z = 0; z < CHUNK_SIZE_Z; ++z)
+                {
+                    for (uint32_t x = 0; x < CHUNK_SIZE_X; ++x)
+                    {
+                        const uint32_t index = Chunk::index(x, 0, z);
+                        open[x + CHUNK_SIZE_X * z] = aboveLight->getSky(index) == MAX_LIGHT_LEVEL && m_transparent[above->voxels[index]];
+                    }
+                }
+            }
+            else
+            {
+                // Nothing lit above, treat it as open sky
+                open.fill(1);
+            }
+        }
+
+        Chunk* chunk = m_world->getChunk(chunkCoord);
+        const std::unique_ptr<ChunkLight>* lightEntry = m_light.find(column[i]);
+        ChunkLight* light = lightEntry != nullptr ? lightEntry->get() : nullptr;
+        if (chunk == nullptr || light == nullptr)
+        {
+            open.fill(1);
+            continue;
+        }
+
+        for (uint32_t z = 0; z < CHUNK_SIZE_Z; ++z)
+        {
+            for (uint32_t x = 0; x < CHUNK_SIZE_X; ++x)
+            {
+                uint8_t& columnOpen = open[x + CHUNK_SIZE_X * z];
+                for (int32_t y = CHUNK_SIZE_Y - 1; y >= 0 && columnOpen; --y)
+                {
+                    const uint32_t index = Chunk::index(x, y, z);
+                    if (!m_transparent[chunk->voxels[index]])
+                    {
+                        columnOpen = 0;
+                        break;
+                    }
+                    light->setSky(index, MAX_LIGHT_LEVEL);
+                }
+            }
+        }
+    }
+}
+
+bool LightEngine::canSpread(const Chunk& chunk, const ChunkLight& light, LightChannel channel, uint32_t index, uint8_t level) const
+{
+    // Most seeds sit in uniformly lit areas (open sky), only queue those that would brighten a neighbour
+    const glm::ivec3 local = localPosition(index);
+    for (uint32_t d = 0; d < 6; ++d)
+    {
+        const glm::ivec3 neighbor = local + DIRECTIONS[d];
+        if (glm::any(glm::lessThan(neighbor, glm::ivec3(0))) || glm::any(glm::greaterThanEqual(neighbor, glm::ivec3(CHUNK_SIZE_X))))
+        {
+            return true;
+        }
+
+        const uint32_t neighborIndex = Chunk::index(neighbor.x, neighbor.y, neighbor.z);
+        if (!m_transparent[chunk.voxels[neighborIndex]])
+        {
+            continue;
+        }
+
+        const uint8_t neighborLevel = channel == LightChannel::Sky ? light.getSky(neighborIndex) : light.getBlock(neighborIndex);
+        const bool skyFall = channel == LightChannel::Sky && d == DIRECTION_DOWN && level == MAX_LIGHT_LEVEL;
+        if (neighborLevel < (skyFall ? MAX_LIGHT_LEVEL : level - 1))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void LightEngine::floodChunk(const glm::ivec3& chunkCoord, const ChunkHashMap<uint8_t>& batch, LightQueue& queue)
+{
+    Cursor cursor(*this);
+    cursor.setWindow(chunkCoord - glm::ivec3(1), chunkCoord + glm::ivec3(1));
+
+    Chunk* chunk = m_world->getChunk(chunkCoord);
+    ChunkLight* light = m_light.find(packChunkKey(chunkCoord))->get();
+    const glm::ivec3 origin = chunk->getWorldOrigin();
+
+    for (uint32_t i = 0; i < CHUNK_VOLUME; ++i)
+    {
+        const uint8_t emission = m_emission[chunk->voxels[i]];
+        if (emission > light->getBlock(i))
+        {
+            light->setBlock(i, emission);
+        }
+    }
+
+    for (LightChannel channel : { LightChannel::Sky, LightChannel::Block })
+    {
+        queue.clear();
+
+        for (uint32_t i = 0; i < CHUNK_VOLUME; ++i)
+        {
+            const uint8_t level = channel == LightChannel::Sky ? light->getSky(i) : light->getBlock(i);
+            if (level > 1 && canSpread(*chunk, *light, channel, i, level))
+            {
+                queue.push(origin + localPosition(i), level);
+            }
+        }
+
+        // Pull in light from lit neighbours that aren't part of this batch
+        for (const glm::ivec3& direction : DIRECTIONS)
+        {
+            const glm::ivec3 neighborCoord = chunkCoord + direction;
+            if (batch.contains(packChunkKey(neighborCoord)) || getChunkLight(neighborCoord) == nullptr)
+            {
+                continue;
+            }
+
+            const ChunkLight* neighborLight = getChunkLight(neighborCoord);
+            const glm::ivec3 neighborOrigin = neighborCoord * glm::ivec3(CHUNK_SIZE_X);
+
+            // Layer of the neighbour that touches this chunk
+            const int32_t axis = direction.x != 0 ? 0 : (direction.y != 0 ? 1 : 2);
+            const int32_t layer = direction[axis] > 0 ? 0 : static_cast<int32_t>(CHUNK_SIZE_X) - 1;
+
+            for (int32_t v = 0; v < static_cast<int32_t>(CHUNK_SIZE_X); ++v)
+            {
+                for (int32_t u = 0; u < static_cast<int32_t>(CHUNK_SIZE_X); ++u)
+                {
+                    glm::ivec3 local;
+                    local[axis] = layer;
+                    local[(axis + 1) % 3] = u;
+                    local[(axis + 2) % 3] = v;
+
+                    const uint32_t index = Chunk::index(local.x, local.y, local.z);
+                    const uint8_t level = channel == LightChannel::Sky ? neighborLight->getSky(index) : neighborLight->getBlock(index);
+                    if (level > 1)
+                    {
+                        queue.push(neighborOrigin + local, level);
+                    }
+                }
+            }
+        }
+
+        propagateAdd(channel, queue, cursor);
+    }
+}
+
+void LightEngine::repairSkyBelow(const std::vector<ChunkKey>& keys, const ChunkHashMap<uint8_t>& batch)
+{
+    // Chunks below the batch were lit assuming open sky where the batch now sits
+    Cursor cursor(*this);
+    m_addQueue.clear();
+    m_removeQueue.clear();
+
+    for (ChunkKey key : keys)
+    {
+        const glm::ivec3 chunkCoord = unpackChunkKey(key);
+        const glm::ivec3 belowCoord = chunkCoord - glm::ivec3(0, 1, 0);
+        if (batch.contains(packChunkKey(belowCoord)))
+        {
+            continue;
+        }
+
+        const Chunk* chunk = m_world->getChunk(chunkCoord);
+        const ChunkLight* light = getChunkLight(chunkCoord);
+        const ChunkLight* belowLight = getChunkLight(belowCoord);
+        if (chunk == nullptr || light == nullptr || belowLight == nullptr)
+        {
+            continue;
+        }
+
+        const glm::ivec3 belowOrigin = belowCoord * glm::ivec3(CHUNK_SIZE_X);
+        for (uint32_t z = 0; z < CHUNK_SIZE_Z; ++z)
+        {
+            for (uint32_t x = 0; x < CHUNK_SIZE_X; ++x)
+            {
+                const uint32_t top = Chunk::index(x, CHUNK_SIZE_Y - 1, z);
+                const uint32_t bottom = Chunk::index(x, 0, z);
+                const bool skyAbove = light->getSky(bottom) == MAX_LIGHT_LEVEL && m_transparent[chunk->voxels[bottom]];
+                if (belowLight->getSky(top) == MAX_LIGHT_LEVEL && !skyAbove)
+                {
+                    const glm::ivec3 position = belowOrigin + glm::ivec3(x, CHUNK_SIZE_Y - 1, z);
+                    VoxelRef ref;
+                    cursor.resolve(position, ref);
+                    setLevel(ref, LightChannel::Sky, 0);
+                    m_removeQueue.push(position, MAX_LIGHT_LEVEL);
+                }
+            }
+        }
+    }
+
+    propagateRemove(LightChannel::Sky, m_removeQueue, m_addQueue, cursor);
+    propagateAdd(LightChannel::Sky, m_addQueue, cursor);
+}
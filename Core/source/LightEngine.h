@@ -0,0 +1,229 @@
+#pragma once
+
+#include "Chunk.h"
+#include "ChunkHashMap.h"
+#include "Multithreading.h"
+
+#include "glm/glm.hpp"
+
+#include <cstdint>
+#include <array>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <bit>
+
+class World;
+
+constexpr uint8_t MAX_LIGHT_LEVEL = 15;
+
+// Per-voxel light of one chunk: sky light in the low nibble, block light in the high nibble
+struct ChunkLight
+{
+    std::array<uint8_t, CHUNK_VOLUME> values{};
+    uint64_t version = 0; // Bumped whenever any value changes
+
+    uint8_t getSky(uint32_t index) const { return values[index] & 0x0F; }
+    uint8_t getBlock(uint32_t index) const { return values[index] >> 4; }
+    void setSky(uint32_t index, uint8_t level) { values[index] = static_cast<uint8_t>((values[index] & 0xF0) | level); version++; }
+    void setBlock(uint32_t index, uint8_t level) { values[index] = static_cast<uint8_t>((values[index] & 0x0F) | (level << 4)); version++; }
+};
+
+enum class LightChannel : uint8_t
+{
+    Sky,
+    Block,
+};
+
+struct LightNode
+{
+    glm::ivec3 position;
+    uint8_t level;
+};
+
+// FIFO ring buffer for the flood fills. Grows by doubling and is reused between updates,
+// so steady-state propagation doesn't allocate.
+class LightQueue
+{
+public:
+    explicit LightQueue(uint32_t initialCapacity = 4096)
+        : m_nodes(std::bit_ceil(initialCapacity))
+    {
+    }
+
+    void push(const glm::ivec3& position, uint8_t level)
+    {
+        if (m_tail - m_head == m_nodes.size())
+        {
+            grow();
+        }
+        m_nodes[m_tail++ & (m_nodes.size() - 1)] = { position, level };
+    }
+
+    LightNode pop() { return m_nodes[m_head++ & (m_nodes.size() - 1)]; }
+
+    bool empty() const { return m_head == m_tail; }
+    void clear() { m_head = m_tail = 0; }
+
+private:
+    void grow()
+    {
+        std::vector<LightNode> nodes(m_nodes.size() * 2);
+        const size_t count = m_tail - m_head;
+        for (size_t i = 0; i < count; ++i)
+        {
+            nodes[i] = m_nodes[(m_head + i) & (m_nodes.size() - 1)];
+        }
+        m_nodes.swap(nodes);
+        m_head = 0;
+        m_tail = count;
+    }
+
+    std::vector<LightNode> m_nodes;
+    size_t m_head = 0;
+    size_t m_tail = 0;
+};
+
+// Flood-fill voxel lighting on the CPU, 16 levels of sky and block light.
+//
+// Sky light enters from above at full strength and travels straight down without falling
+// off, everything else loses one level per voxel. Chunks above the resident area count as
+// open sky. Light only lives in resident, lit chunks; other chunks act as walls.
+//
+// Newly loaded chunks are lit in batches by update(): sky columns in parallel per chunk
+// column, then the flood fills in 27 colour passes where chunks of one colour are 3 apart,
+// so each fill can write into its chunk's direct neighbours without racing another worker
+// (light never travels further than 15 voxels). Edits are applied incrementally through
+// onVoxelChanged with the usual remove-then-refill BFS, crossing chunk borders freely.
+class LightEngine
+{
+public:
+    LightEngine();
+    ~LightEngine() { destroy(); }
+
+    LightEngine(const LightEngine&) = delete;
+    LightEngine& operator=(const LightEngine&) = delete;
+
+    // Attaches to the world, chunks already resident are queued for lighting
+    void init(World& world);
+    void destroy();
+
+    void setEmission(VoxelID id, uint8_t level) { m_emission[id] = std::min(level, MAX_LIGHT_LEVEL); }
+    void setTransparent(VoxelID id, bool transparent) { m_transparent[id] = transparent; }
+    uint8_t getEmission(VoxelID id) const { return m_emission[id]; }
+    bool isTransparent(VoxelID id) const { return m_transparent[id]; }
+
+    // Called by World on the main thread
+    void onChunkLoaded(const Chunk& chunk);
+    void onChunkEvicted(const Chunk& chunk);
+    void onVoxelChanged(const glm::ivec3& worldPosition, VoxelID oldId, VoxelID newId);
+
+    // Bulk edits (World::applyEdit) queue their changes per chunk, each packed as
+    // Chunk::index | oldId << 16 | newId << 24, and then relight them all in one pass
+    void onChunkEdited(const Chunk& chunk, std::vector<uint32_t> changes);
+    void applyEdits();
+
+    // Lights every chunk loaded since the last call
+    void update(ThreadPool& threadPool = ThreadPool::getInstance());
+
+    // Throws all light away and recomputes it for every resident chunk
+    void relightAll(ThreadPool& threadPool = ThreadPool::getInstance());
+
+    uint8_t getSkyLight(const glm::ivec3& worldPosition) const;
+    uint8_t getBlockLight(const glm::ivec3& worldPosition) const;
+    const ChunkLight* getChunkLight(const glm::ivec3& chunkCoord) const;
+
+    uint32_t getUnlitChunkCount() const { return static_cast<uint32_t>(m_unlit.size()); }
+
+private:
+    struct VoxelRef
+    {
+        Chunk* chunk = nullptr;
+        ChunkLight* light = nullptr;
+        uint32_t index = 0;
+    };
+
+    // Resolves world positions to chunk + light, caching the last two chunks since floods near a
+    // border keep alternating between them. A window limits the chunks that may be touched,
+    // positions outside of it behave like non-resident chunks.
+    class Cursor
+    {
+    public:
+        Cursor(const LightEngine& engine) : m_engine(engine) {}
+
+        void setWindow(const glm::ivec3& minChunk, const glm::ivec3& maxChunk)
+        {
+            m_windowMin = minChunk;
+            m_windowMax = maxChunk;
+            m_hasWindow = true;
+        }
+
+        bool resolve(const glm::ivec3& worldPosition, VoxelRef& ref);
+
+        // Neighbour of a resolved voxel, stays within the chunk without a lookup when it can
+        bool resolveNeighbor(const glm::ivec3& worldPosition, const VoxelRef& from, uint32_t direction, VoxelRef& ref);
+
+    private:
+        struct Entry
+        {
+            glm::ivec3 chunkCoord{ 0 };
+            Chunk* chunk = nullptr;
+            ChunkLight* light = nullptr;
+            bool valid = false;
+        };
+
+        const LightEngine& m_engine;
+        Entry m_entries[2];
+        uint32_t m_lastUsed = 0;
+        bool m_hasWindow = false;
+        glm::ivec3 m_windowMin{ 0 };
+        glm::ivec3 m_windowMax{ 0 };
+    };
+
+    static uint8_t getLevel(const VoxelRef& ref, LightChannel channel)
+    {
+        return channel == LightChannel::Sky ? ref.light->getSky(ref.index) : ref.light->getBlock(ref.index);
+    }
+
+    static void setLevel(const VoxelRef& ref, LightChannel channel, uint8_t level)
+    {
+        if (channel == LightChannel::Sky)
+        {
+            ref.light->setSky(ref.index, level);
+        }
+        else
+        {
+            ref.light->setBlock(ref.index, level);
+        }
+    }
+
+    void lightChunks(const std::vector<ChunkKey>& keys, ThreadPool& threadPool);
+    void lightSkyColumn(const ChunkKey* column, size_t count, const ChunkHashMap<uint8_t>& batch);
+    bool canSpread(const Chunk& chunk, const ChunkLight& light, LightChannel channel, uint32_t index, uint8_t level) const;
+    void floodChunk(const glm::ivec3& chunkCoord, const ChunkHashMap<uint8_t>& batch, LightQueue& queue);
+    void repairSkyBelow(const std::vector<ChunkKey>& keys, const ChunkHashMap<uint8_t>& batch);
+
+    void seedChange(LightChannel channel, const glm::ivec3& worldPosition, VoxelID oldId, VoxelID newId, Cursor& cursor);
+    void seedOpened(LightChannel channel, const glm::ivec3& worldPosition, Cursor& cursor);
+
+    void propagateAdd(LightChannel channel, LightQueue& addQueue, Cursor& cursor);
+    void propagateRemove(LightChannel channel, LightQueue& removeQueue, LightQueue& addQueue, Cursor& cursor);
+
+    World* m_world = nullptr;
+    ChunkHashMap<std::unique_ptr<ChunkLight>> m_light;
+    std::vector<ChunkKey> m_unlit;
+
+    std::array<uint8_t, 256> m_emission{};
+    std::array<bool, 256> m_transparent{};
+
+    struct PendingEdit
+    {
+        glm::ivec3 origin; // World-space origin of the edited chunk
+        std::vector<uint32_t> changes;
+    };
+
+    // Incremental updates run on the main thread and reuse these
+    LightQueue m_addQueue;
+    LightQueue m_removeQueue;
+    std::vector<PendingEdit> m_pendingEdits;
+};
@@ -0,0 +1,151 @@
+#pragma once
+
+#include "Chunk.h"
+
+#include "glm/glm.hpp"
+
+#include <cstdint>
+#include <array>
+#include <algorithm>
+
+constexpr uint32_t MATERIAL_COUNT = 256; // One entry per possible VoxelID
+
+struct Material
+{
+    glm::vec3 albedo = glm::vec3(0.8f, 0.2f, 0.2f);
+    float roughness = 1.0f;
+    float metallic = 0.0f;
+    float emission = 0.0f;
+};
+
+// Layout of one entry in the GPU material buffer (std430), indexed by VoxelID
+struct GpuMaterial
+{
+    glm::vec4 albedo; // rgb, a unused
+    glm::vec4 params; // x = roughness, y = metallic, z = emission, w unused
+};
+
+static_assert(sizeof(GpuMaterial) == 32, "GpuMaterial must match the Material struct in the shaders");
+
+// Surface properties keyed by VoxelID.
+//
+// The CPU side is stored as one cache-line aligned array per property so passes that only need
+// one of them (e.g. emission when seeding light) stream through a single 1 KB
+// array. Every change stamps the entry with a new version, GPU mirrors remember the version they
+// last received and writeChanges() fills in only the entries that moved since then.
+class alignas(64) MaterialRegistry
+{
+public:
+    MaterialRegistry()
+    {
+        const Material fallback{};
+        for (uint32_t id = 0; id < MATERIAL_COUNT; ++id)
+        {
+            store(static_cast<VoxelID>(id), fallback);
+        }
+
+        set(STONE_VOXEL, { glm::vec3(0.50f, 0.50f, 0.52f), 0.9f, 0.0f, 0.0f });
+        set(DIRT_VOXEL, { glm::vec3(0.45f, 0.32f, 0.20f), 1.0f, 0.0f, 0.0f });
+        set(GRASS_VOXEL, { glm::vec3(0.30f, 0.60f, 0.20f), 0.9f, 0.0f, 0.0f });
+        set(SAND_VOXEL, { glm::vec3(0.86f, 0.80f, 0.56f), 1.0f, 0.0f, 0.0f });
+        set(WATER_VOXEL, { glm::vec3(0.15f, 0.35f, 0.75f), 0.05f, 0.0f, 0.0f });
+        set(TORCH_VOXEL, { glm::vec3(1.00f, 0.75f, 0.40f), 1.0f, 0.0f, 4.0f });
+    }
+
+    // Unchanged values don't bump the version, so setting a material every frame is free
+    void set(VoxelID id, const Material& material)
+    {
+        const Material sanitized = sanitize(material);
+        if (equal(get(id), sanitized))
+        {
+            return;
+        }
+
+        store(id, sanitized);
+    }
+
+    Material get(VoxelID id) const
+    {
+        Material material;
+        material.albedo = glm::vec3(m_albedoR[id], m_albedoG[id], m_albedoB[id]);
+        material.roughness = m_roughness[id];
+        material.metallic = m_metallic[id];
+        material.emission = m_emission[id];
+        return material;
+    }
+
+    glm::vec3 getAlbedo(VoxelID id) const { return glm::vec3(m_albedoR[id], m_albedoG[id], m_albedoB[id]); }
+    float getRoughness(VoxelID id) const { return m_roughness[id]; }
+    float getMetallic(VoxelID id) const { return m_metallic[id]; }
+    float getEmission(VoxelID id) const { return m_emission[id]; }
+
+    // Bumped on every change, a mirror holding this version is up to date
+    uint64_t getVersion() const { return m_version; }
+
+    // Writes every entry changed after sinceVersion to dst[id] (dst holds MATERIAL_COUNT entries,
+    // usually mapped GPU memory) and returns how many were written. Pass 0 to write everything.
+    uint32_t writeChanges(uint64_t sinceVersion, GpuMaterial* dst) const
+    {
+        if (sinceVersion >= m_version)
+        {
+            return 0;
+        }
+
+        uint32_t written = 0;
+        for (uint32_t id = 0; id < MATERIAL_COUNT; ++id)
+        {
+            if (m_entryVersions[id] > sinceVersion)
+            {
+                dst[id] = pack(static_cast<VoxelID>(id));
+                written++;
+            }
+        }
+        return written;
+    }
+
+    // Whole table in GPU layout, for the initial upload
+    void writeAll(GpuMaterial* dst) const { writeChanges(0, dst); }
+
+    GpuMaterial pack(VoxelID id) const
+    {
+        GpuMaterial entry;
+        entry.albedo = glm::vec4(m_albedoR[id], m_albedoG[id], m_albedoB[id], 1.0f);
+        entry.params = glm::vec4(m_roughness[id], m_metallic[id], m_emission[id], 0.0f);
+        return entry;
+    }
+
+private:
+    static bool equal(const Material& a, const Material& b)
+    {
+        return a.albedo == b.albedo && a.roughness == b.roughness && a.metallic == b.metallic && a.emission == b.emission;
+    }
+
+    static Material sanitize(Material material)
+    {
+        material.albedo = glm::clamp(material.albedo, glm::vec3(0.0f), glm::vec3(1.0f));
+        material.roughness = std::clamp(material.roughness, 0.0f, 1.0f);
+        material.metallic = std::clamp(material.metallic, 0.0f, 1.0f);
+        material.emission = std::max(material.emission, 0.0f);
+        return material;
+    }
+
+    void store(VoxelID id, const Material& material)
+    {
+        m_albedoR[id] = material.albedo.r;
+        m_albedoG[id] = material.albedo.g;
+        m_albedoB[id] = material.albedo.b;
+        m_roughness[id] = material.roughness;
+        m_metallic[id] = material.metallic;
+        m_emission[id] = material.emission;
+        m_entryVersions[id] = ++m_version;
+    }
+
+    alignas(64) std::array<float, MATERIAL_COUNT> m_albedoR{};
+    alignas(64) std::array<float, MATERIAL_COUNT> m_albedoG{};
+    alignas(64) std::array<float, MATERIAL_COUNT> m_albedoB{};
+    alignas(64) std::array<float, MATERIAL_COUNT> m_roughness{};
+    alignas(64) std::array<float, MATERIAL_COUNT> m_metallic{};
+    alignas(64) std::array<float, MATERIAL_COUNT> m_emission{};
+    alignas(64) std::array<uint64_t, MATERIAL_COUNT> m_entryVersions{};
+    uint64_t m_version = 0;
+};
@@ -4,13 +4,160 @@
 #include <mutex>
 #include <atomic>
 #include <memory>
+#include <condition_variable>
+#include <functional>
+#include <deque>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
 
 class ThreadPool
 {
+public:
+    static ThreadPool& getInstance()
+    {
+        static ThreadPool instance;
+        return instance;
+    }
 
-};
+    explicit ThreadPool(uint32_t threadCount = 0)
+    {
+        if (threadCount == 0)
+        {
+            threadCount = std::max(1u, std::thread::hardware_concurrency());
+        }
 
-class ThreadWoker
-{
+        m_workers.reserve(threadCount);
+        for (uint32_t i = 0; i < threadCount; ++i)
+        {
+            m_workers.emplace_back([this]() { workerLoop(); });
+        }
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stopping = true;
+        }
+        m_jobAvailable.notify_all();
+
+        for (auto& worker : m_workers)
+        {
+            worker.join();
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+    ThreadPool(ThreadPool&&) = delete;
+    ThreadPool& operator=(ThreadPool&&) = delete;
+
+    void submit(std::function<void()> job)
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_jobs.push_back(std::move(job));
+            m_pendingJobs++;
+        }
+        m_jobAvailable.notify_one();
+    }
+
+    // Blocks until every job submitted so far (by anyone) has finished
+    void waitIdle()
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_idle.wait(lock, [this]() { return m_pendingJobs == 0; });
+    }
+
+    // Runs func(i) for i in [0, count) across the pool and the calling thread, returns when all are done.
+    // The caller works through the range too, so it is safe to call from inside a job.
+    template<typename Func>
+    void parallelFor(uint32_t count, Func&& func)
+    {
+        if (count == 0)
+        {
+            return;
+        }
+
+        struct SharedState
+        {
+            std::atomic<uint32_t> next{ 0 };
+            std::atomic<uint32_t> finished{ 0 };
+            std::mutex mutex;
+            std::condition_variable done;
+        };
+
+        auto state = std::make_shared<SharedState>();
+
+        // Helpers may start after the caller has returned, they only touch the shared state
+        // until they see the range is exhausted, and func only while an index is claimed
+        auto* funcPtr = &func;
+        auto work = [state, funcPtr, count]()
+        {
+            uint32_t index;
+            while ((index = state->next.fetch_add(1, std::memory_order_relaxed)) < count)
+            {
+                (*funcPtr)(index);
+                if (state->finished.fetch_add(1, std::memory_order_acq_rel) + 1 == count)
+                {
+                    std::lock_guard<std::mutex> lock(state->mutex);
+                    state->done.notify_all();
+                }
+            }
+        };
 
-};
\ No newline at end of file
+        const uint32_t helperCount = std::min(getThreadCount(), count - 1);
+        for (uint32_t i = 0; i < helperCount; ++i)
+        {
+            submit(work);
+        }
+
+        work();
+
+        std::unique_lock<std::mutex> lock(state->mutex);
+        state->done.wait(lock, [&state, count]() { return state->finished.load(std::memory_order_acquire) == count; });
+    }
+
+    uint32_t getThreadCount() const { return static_cast<uint32_t>(m_workers.size()); }
+
+private:
+    void workerLoop()
+    {
+        while (true)
+        {
+            std::function<void()> job;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_jobAvailable.wait(lock, [this]() { return m_stopping || !m_jobs.empty(); });
+
+                if (m_stopping && m_jobs.empty())
+                {
+                    return;
+                }
+
+                job = std::move(m_jobs.front());
+                m_jobs.pop_front();
+            }
+
+            job();
+
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_pendingJobs--;
+                if (m_pendingJobs == 0)
+                {
+                    m_idle.notify_all();
+                }
+            }
+        }
+    }
+
+    std::vector<std::thread> m_workers;
+    std::deque<std::function<void()>> m_jobs;
+    std::mutex m_mutex;
+    std::condition_variable m_jobAvailable;
+    std::condition_variable m_idle;
+    uint64_t m_pendingJobs = 0;
+    bool m_stopping = false;
+};
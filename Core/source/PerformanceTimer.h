@@ -51,7 +51,14 @@ public:
         }
     }
 
+    // Values other than timings (ratios, counts, decisions), latest value per name
+    void setCounter(const std::string& counterName, double value)
+    {
+        counters[counterName] = value;
+    }
+
     std::unordered_map<std::string, double> perfStats;
+    std::unordered_map<std::string, double> counters;
 
 private:
     PerformanceTimer() = default;
@@ -63,10 +70,12 @@ private:
     #define PERF_BEGIN(sectionName) PerformanceTimer::getInstance().beginSection(sectionName)
     #define PERF_END(sectionName) PerformanceTimer::getInstance().endSection(sectionName)
     #define PERF_RESET(sectionName) PerformanceTimer::getInstance().resetSection(sectionName)
+    #define PERF_COUNTER(counterName, value) PerformanceTimer::getInstance().setCounter(counterName, value)
 #else
     #define PERF_BEGIN(sectionName)
     #define PERF_END(sectionName)
     #define PERF_RESET(sectionName)
+    #define PERF_COUNTER(counterName, value)
 #endif
 
 // RAII-style performance timing
@@ -0,0 +1,790 @@
+#include "RegionFile.h"
+#include "DebugUtils.h"
+
+#include <cstring>
+#include <stdexcept>
+#include <filesystem>
+#include <algorithm>
+#include <array>
+#include <bit>
+
+#ifdef _WIN32
+    #define WIN32_LEAN_AND_MEAN
+    #define NOMINMAX
+    #include <windows.h>
+#else
+    #include <fcntl.h>
+    #include <unistd.h>
+    #include <sys/stat.h>
+#endif
+
+namespace
+{
+    constexpr uint32_t REGION_MAGIC = 0x47525856; // "VXRG"
+    constexpr uint32_t REGION_VERSION = 1;
+    constexpr uint32_t TABLE_ENTRY_SIZE = 8;
+    constexpr uint32_t TABLE_SECTORS = REGION_CHUNK_COUNT * TABLE_ENTRY_SIZE / REGION_SECTOR_SIZE;
+    constexpr uint32_t HEADER_SECTORS = 1 + TABLE_SECTORS;
+
+    enum class CompressionType : uint8_t
+    {
+        None = 0,
+        LZ = 1,
+    };
+
+    struct ChunkRecordHeader
+    {
+        uint32_t payloadSize;
+        uint32_t rawSize;
+        uint8_t compression;
+        uint8_t padding[3];
+    };
+    static_assert(sizeof(ChunkRecordHeader) == 12, "ChunkRecordHeader must be tightly packed");
+
+    // ---- Platform file access, positioned reads/writes so concurrent readers don't share a file pointer ----
+
+    intptr_t openFile(const std::string& path)
+    {
+#ifdef _WIN32
+        HANDLE handle = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, FILE_SHARE_READ, nullptr, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+        return handle == INVALID_HANDLE_VALUE ? -1 : reinterpret_cast<intptr_t>(handle);
+#else
+        return ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+#endif
+    }
+
+    void closeFile(intptr_t handle)
+    {
+#ifdef _WIN32
+        CloseHandle(reinterpret_cast<HANDLE>(handle));
+#else
+        ::close(static_cast<int>(handle));
+#endif
+    }
+
+    uint64_t fileSize(intptr_t handle)
+    {
+#ifdef _WIN32
+        LARGE_INTEGER size{};
+        GetFileSizeEx(reinterpret_cast<HANDLE>(handle), &size);
+        return static_cast<uint64_t>(size.QuadPart);
+#else
+        struct stat info{};
+        fstat(static_cast<int>(handle), &info);
+        return static_cast<uint64_t>(info.st_size);
+#endif
+    }
+
+    bool readAt(intptr_t handle, void* data, size_t size, uint64_t offset)
+    {
+#ifdef _WIN32
+        OVERLAPPED overlapped{};
+        overlapped.Offset = static_cast<DWORD>(offset);
+        overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+        DWORD bytesRead = 0;
+        return ReadFile(reinterpret_cast<HANDLE>(handle), data, static_cast<DWORD>(size), &bytesRead, &overlapped) && bytesRead == size;
+#else
+        return ::pread(static_cast<int>(handle), data, size, static_cast<off_t>(offset)) == static_cast<ssize_t>(size);
+#endif
+    }
+
+    bool writeAt(intptr_t handle, const void* data, size_t size, uint64_t offset)
+    {
+#ifdef _WIN32
+        OVERLAPPED overlapped{};
+        overlapped.Offset = static_cast<DWORD>(offset);
+        overlapped.OffsetHigh = static_cast<DWORD>(offset >> 32);
+        DWORD bytesWritten = 0;
+        return WriteFile(reinterpret_cast<HANDLE>(handle), data, static_cast<DWORD>(size), &bytesWritten, &overlapped) && bytesWritten == size;
+#else
+        return ::pwrite(static_cast<int>(handle), data, size, static_cast<off_t>(offset)) == static_cast<ssize_t>(size);
+#endif
+    }
+
+    // ---- LZ compression, LZ4 block style: token (literal len | match len), literals, 16 bit offset ----
+
+    constexpr uint32_t LZ_MIN_MATCH = 4;
+    constexpr uint32_t LZ_HASH_BITS = 12;
+    constexpr uint32_t LZ_MAX_OFFSET = 65535;
+
+    inline uint32_t read32(const uint8_t* p)
+    {
+        uint32_t value;
+        std::memcpy(&value, p, sizeof(value));
+        return value;
+    }
+
+    inline void writeLength(std::vector<uint8_t>& out, size_t length)
+    {
+        while (length >= 255)
+        {
+            out.push_back(255);
+            length -= 255;
+        }
+        out.push_back(static_cast<uint8_t>(length));
+    }
+
+    void emitSequence(std::vector<uint8_t>& out, const uint8_t* literals, size_t literalLength, uint32_t offset, size_t matchLength)
+    {
+        const size_t matchCode = matchLength != 0 ? matchLength - LZ_MIN_MATCH : 0;
+        const uint8_t token = static_cast<uint8_t>((std::min<size_t>(literalLength, 15) << 4) | std::min<size_t>(matchCode, 15));
+        out.push_back(token);
+
+        if (literalLength >= 15)
+        {
+            writeLength(out, literalLength - 15);
+        }
+        out.insert(out.end(), literals, literals + literalLength);
+
+        if (matchLength == 0)
+        {
+            return;
+        }
+
+        out.push_back(static_cast<uint8_t>(offset & 0xFF));
+        out.push_back(static_cast<uint8_t>(offset >> 8));
+        if (matchCode >= 15)
+        {
+            writeLength(out, matchCode - 15);
+        }
+    }
+
+    void lzCompress(const uint8_t* src, size_t size, std::vector<uint8_t>& out)
+    {
+        int32_t table[1 << LZ_HASH_BITS];
+        std::fill(std::begin(table), std::end(table), -1);
+
+        size_t anchor = 0;
+        size_t i = 0;
+        while (i + LZ_MIN_MATCH <= size)
+        {
+            const uint32_t sequence = read32(src + i);
+            const uint32_t hash = (sequence * 2654435761u) >> (32 - LZ_HASH_BITS);
+            const int32_t candidate = table[hash];
+            table[hash] = static_cast<int32_t>(i);
+
+            if (candidate >= 0 && i - candidate <= LZ_MAX_OFFSET && read32(src + candidate) == sequence)
+            {
+                size_t length = LZ_MIN_MATCH;
+                while (i + length < size && src[candidate + length] == src[i + length])
+                {
+                    length++;
+                }
+
+                emitSequence(out, src + anchor, i - anchor, static_cast<uint32_t>(i - candidate), length);
+                i += length;
+                anchor = i;
+            }
+            else
+            {
+                i++;
+            }
+        }
+
+        // Trailing literals, a sequence without a match marks the end of the block
+        emitSequence(out, src + anchor, size - anchor, 0, 0);
+    }
+
+    bool readLength(const uint8_t*& ip, const uint8_t* end, size_t& length)
+    {
+        uint8_t byte;
+        do
+        {
+            if (ip >= end)
+            {
+                return false;
+            }
+            byte = *ip++;
+            length += byte;
+        } while (byte == 255);
+        return true;
+    }
+
+    bool lzDecompress(const uint8_t* src, size_t size, uint8_t* dst, size_t dstSize)
+    {
+        const uint8_t* ip = src;
+        const uint8_t* end = src + size;
+        uint8_t* op = dst;
+        uint8_t* opEnd = dst + dstSize;
+
+        while (ip < end)
+        {
+            const uint8_t token = *ip++;
+
+            size_t literalLength = token >> 4;
+            if (literalLength == 15 && !readLength(ip, end, literalLength))
+            {
+                return false;
+            }
+            if (literalLength > static_cast<size_t>(end - ip) || literalLength > static_cast<size_t>(opEnd - op))
+            {
+                return false;
+            }
+            std::memcpy(op, ip, literalLength);
+            ip += literalLength;
+            op += literalLength;
+
+            if (ip == end)
+            {
+                break;
+            }
+
+            if (end - ip < 2)
+            {
+                return false;
+            }
+            const size_t offset = ip[0] | (static_cast<size_t>(ip[1]) << 8);
+            ip += 2;
+
+            size_t matchLength = token & 0x0F;
+            if (matchLength == 15 && !readLength(ip, end, matchLength))
+            {
+                return false;
+            }
+            matchLength += LZ_MIN_MATCH;
+
+            if (offset == 0 || offset > static_cast<size_t>(op - dst) || matchLength > static_cast<size_t>(opEnd - op))
+            {
+                return false;
+            }
+
+            // Byte copy on purpose, matches may overlap the bytes they produce
+            const uint8_t* match = op - offset;
+            for (size_t i = 0; i < matchLength; ++i)
+            {
+                op[i] = match[i];
+            }
+            op += matchLength;
+        }
+
+        return op == opEnd;
+    }
+
+    // ---- Palette encoding: [paletteSize - 1][palette...][bitsPerVoxel][packed indices] ----
+
+    void paletteEncode(const VoxelID* voxels, std::vector<uint8_t>& out)
+    {
+        int16_t remap[256];
+        std::fill(std::begin(remap), std::end(remap), -1);
+
+        uint8_t palette[256];
+        uint32_t paletteSize = 0;
+        for (uint32_t i = 0; i < CHUNK_VOLUME; ++i)
+        {
+            const VoxelID id = voxels[i];
+            if (remap[id] < 0)
+            {
+                remap[id] = static_cast<int16_t>(paletteSize);
+                palette[paletteSize++] = id;
+            }
+        }
+
+        uint32_t bits = 0;
+        if (paletteSize > 1)
+        {
+            bits = std::bit_ceil(static_cast<uint32_t>(std::bit_width(paletteSize - 1)));
+        }
+
+        out.push_back(static_cast<uint8_t>(paletteSize - 1));
+        out.insert(out.end(), palette, palette + paletteSize);
+        out.push_back(static_cast<uint8_t>(bits));
+
+        if (bits == 0)
+        {
+            return;
+        }
+
+        const size_t packedStart = out.size();
+        out.resize(packedStart + CHUNK_VOLUME * bits / 8, 0);
+        uint8_t* packed = out.data() + packedStart;
+
+        const uint32_t perByte = 8 / bits;
+        for (uint32_t i = 0; i < CHUNK_VOLUME; ++i)
+        {
+            packed[i / perByte] |= static_cast<uint8_t>(remap[voxels[i]] << ((i % perByte) * bits));
+        }
+    }
+
+    bool paletteDecode(const uint8_t* data, size_t size, Chunk& chunk)
+    {
+        if (size < 2)
+        {
+            return false;
+        }
+
+        const uint32_t paletteSize = static_cast<uint32_t>(data[0]) + 1;
+        if (size < 2 + paletteSize)
+        {
+            return false;
+        }
+
+        const uint8_t* palette = data + 1;
+        const uint32_t bits = data[1 + paletteSize];
+        const uint8_t* packed = data + 2 + paletteSize;
+
+        if (bits == 0)
+        {
+            if (size != 2 + paletteSize)
+            {
+                return false;
+            }
+            chunk.fill(palette[0]);
+            return true;
+        }
+
+        if ((bits != 1 && bits != 2 && bits != 4 && bits != 8) || size != 2 + paletteSize + CHUNK_VOLUME * bits / 8)
+        {
+            return false;
+        }
+
+        // Decoded aside so a bad index halfway through leaves the chunk as it was
+        thread_local std::array<VoxelID, CHUNK_VOLUME> decoded;
+
+        const uint32_t perByte = 8 / bits;
+        const uint32_t mask = (1u << bits) - 1;
+        for (uint32_t i = 0; i < CHUNK_VOLUME; ++i)
+        {
+            const uint32_t index = (packed[i / perByte] >> ((i % perByte) * bits)) & mask;
+            if (index >= paletteSize)
+            {
+                return false;
+            }
+            decoded[i] = palette[index];
+        }
+
+        chunk.voxels = decoded;
+        chunk.rebuildDerivedData();
+        return true;
+    }
+}
+
+void ChunkCodec::encode(const Chunk& chunk, std::vector<uint8_t>& out)
+{
+    encode(chunk.voxels.data(), out);
+}
+
+void ChunkCodec::encode(const VoxelID* voxels, std::vector<uint8_t>& out)
+{
+    thread_local std::vector<uint8_t> paletteData;
+    paletteData.clear();
+    paletteEncode(voxels, paletteData);
+
+    out.clear();
+    out.resize(sizeof(ChunkRecordHeader));
+    lzCompress(paletteData.data(), paletteData.size(), out);
+
+    ChunkRecordHeader header{};
+    header.rawSize = static_cast<uint32_t>(paletteData.size());
+    header.compression = static_cast<uint8_t>(CompressionType::LZ);
+
+    // Not worth it, store the palette data as is
+    if (out.size() - sizeof(ChunkRecordHeader) >= paletteData.size())
+    {
+        out.resize(sizeof(ChunkRecordHeader));
+        out.insert(out.end(), paletteData.begin(), paletteData.end());
+        header.compression = static_cast<uint8_t>(CompressionType::None);
+    }
+
+    header.payloadSize = static_cast<uint32_t>(out.size() - sizeof(ChunkRecordHeader));
+    std::memcpy(out.data(), &header, sizeof(header));
+}
+
+bool ChunkCodec::decode(const uint8_t* data, size_t size, Chunk& chunk)
+{
+    if (size < sizeof(ChunkRecordHeader))
+    {
+        return false;
+    }
+
+    ChunkRecordHeader header;
+    std::memcpy(&header, data, sizeof(header));
+
+    const uint8_t* payload = data + sizeof(ChunkRecordHeader);
+    if (header.payloadSize > size - sizeof(ChunkRecordHeader))
+    {
+        return false;
+    }
+
+    if (header.compression == static_cast<uint8_t>(CompressionType::None))
+    {
+        return paletteDecode(payload, header.payloadSize, chunk);
+    }
+
+    if (header.compression != static_cast<uint8_t>(CompressionType::LZ))
+    {
+        return false;
+    }
+
+    thread_local std::vector<uint8_t> paletteData;
+    paletteData.resize(header.rawSize);
+    if (!lzDecompress(payload, header.payloadSize, paletteData.data(), paletteData.size()))
+    {
+        return false;
+    }
+    return paletteDecode(paletteData.data(), paletteData.size(), chunk);
+}
+
+void RegionFile::open(const std::string& path)
+{
+    close();
+
+    m_handle = openFile(path);
+    if (m_handle == -1)
+    {
+        throw std::runtime_error("Failed to open region file: " + path);
+    }
+    m_path = path;
+
+    m_table.assign(REGION_CHUNK_COUNT, {});
+
+    const uint64_t size = fileSize(m_handle);
+    if (size == 0)
+    {
+        std::vector<uint8_t> header(static_cast<size_t>(HEADER_SECTORS) * REGION_SECTOR_SIZE, 0);
+        const uint32_t magic[2] = { REGION_MAGIC, REGION_VERSION };
+        std::memcpy(header.data(), magic, sizeof(magic));
+        if (!writeAt(m_handle, header.data(), header.size(), 0))
+        {
+            close();
+            throw std::runtime_error("Failed to initialize region file: " + path);
+        }
+        m_usedSectors.assign(HEADER_SECTORS, true);
+        return;
+    }
+
+    std::vector<uint8_t> header(static_cast<size_t>(HEADER_SECTORS) * REGION_SECTOR_SIZE);
+    uint32_t magic[2] = {};
+    if (size < header.size() || !readAt(m_handle, header.data(), header.size(), 0))
+    {
+        close();
+        throw std::runtime_error("Region file is truncated: " + path);
+    }
+
+    std::memcpy(magic, header.data(), sizeof(magic));
+    if (magic[0] != REGION_MAGIC || magic[1] != REGION_VERSION)
+    {
+        close();
+        throw std::runtime_error("Not a region file or unsupported version: " + path);
+    }
+
+    const uint32_t fileSectors = static_cast<uint32_t>((size + REGION_SECTOR_SIZE - 1) / REGION_SECTOR_SIZE);
+    m_usedSectors.assign(fileSectors, false);
+    std::fill(m_usedSectors.begin(), m_usedSectors.begin() + HEADER_SECTORS, true);
+
+    const uint8_t* table = header.data() + REGION_SECTOR_SIZE;
+    for (uint32_t i = 0; i < REGION_CHUNK_COUNT; ++i)
+    {
+        SectorRange range;
+        std::memcpy(&range.firstSector, table + i * TABLE_ENTRY_SIZE, sizeof(uint32_t));
+        std::memcpy(&range.sectorCount, table + i * TABLE_ENTRY_SIZE + 4, sizeof(uint32_t));
+
+        if (range.sectorCount == 0)
+        {
+            continue;
+        }
+        if (range.firstSector < HEADER_SECTORS || range.firstSector + range.sectorCount > fileSectors)
+        {
+            LOG_ERROR("RegionFile: chunk " << i << " has an out of range sector entry in " << path);
+            continue;
+        }
+
+        m_table[i] = range;
+        for (uint32_t s = 0; s < range.sectorCount; ++s)
+        {
+            m_usedSectors[range.firstSector + s] = true;
+        }
+    }
+}
+
+void RegionFile::close()
+{
+    std::unique_lock lock(m_mutex);
+    if (m_handle != -1)
+    {
+        closeFile(m_handle);
+        m_handle = -1;
+    }
+    m_table.clear();
+    m_usedSectors.clear();
+}
+
+bool RegionFile::hasChunk(uint32_t localIndex) const
+{
+    std::shared_lock lock(m_mutex);
+    return localIndex < m_table.size() && m_table[localIndex].sectorCount != 0;
+}
+
+bool RegionFile::readChunk(uint32_t localIndex, Chunk& chunk) const
+{
+    std::shared_lock lock(m_mutex);
+
+    if (m_handle == -1 || localIndex >= m_table.size() || m_table[localIndex].sectorCount == 0)
+    {
+        return false;
+    }
+
+    const SectorRange range = m_table[localIndex];
+
+    thread_local std::vector<uint8_t> record;
+    record.resize(static_cast<size_t>(range.sectorCount) * REGION_SECTOR_SIZE);
+    if (!readAt(m_handle, record.data(), record.size(), static_cast<uint64_t>(range.firstSector) * REGION_SECTOR_SIZE))
+    {
+        LOG_ERROR("RegionFile: failed to read chunk " << localIndex << " from " << m_path);
+        return false;
+    }
+
+    if (!ChunkCodec::decode(record.data(), record.size(), chunk))
+    {
+        LOG_ERROR("RegionFile: chunk " << localIndex << " in " << m_path << " is corrupt");
+        return false;
+    }
+    return true;
+}
+
+void RegionFile::writeChunk(uint32_t localIndex, const Chunk& chunk)
+{
+    writeChunk(localIndex, chunk.voxels.data());
+}
+
+void RegionFile::writeChunk(uint32_t localIndex, const VoxelID* voxels)
+{
+    thread_local std::vector<uint8_t> record;
+    ChunkCodec::encode(voxels, record);
+
+    const uint32_t sectorCount = static_cast<uint32_t>((record.size() + REGION_SECTOR_SIZE - 1) / REGION_SECTOR_SIZE);
+    record.resize(static_cast<size_t>(sectorCount) * REGION_SECTOR_SIZE, 0);
+
+    std::unique_lock lock(m_mutex);
+
+    if (m_handle == -1 || localIndex >= m_table.size())
+    {
+        throw std::runtime_error("RegionFile::writeChunk on a closed file or invalid chunk index.");
+    }
+
+    SectorRange& range = m_table[localIndex];
+    if (range.sectorCount >= sectorCount && range.sectorCount != 0)
+    {
+        // Still fits, shrink in place and hand back the tail
+        freeSectors({ range.firstSector + sectorCount, range.sectorCount - sectorCount });
+        range.sectorCount = sectorCount;
+    }
+    else
+    {
+        freeSectors(range);
+        range.firstSector = allocateSectors(sectorCount);
+        range.sectorCount = sectorCount;
+    }
+
+    if (!writeAt(m_handle, record.data(), record.size(), static_cast<uint64_t>(range.firstSector) * REGION_SECTOR_SIZE))
+    {
+        throw std::runtime_error("Failed to write chunk to region file: " + m_path);
+    }
+
+    writeTableEntry(localIndex);
+}
+
+uint32_t RegionFile::allocateSectors(uint32_t sectorCount)
+{
+    // First fit over the free runs, otherwise append
+    uint32_t runStart = 0;
+    uint32_t runLength = 0;
+    for (uint32_t s = HEADER_SECTORS; s < m_usedSectors.size(); ++s)
+    {
+        if (m_usedSectors[s])
+        {
+            runLength = 0;
+            continue;
+        }
+
+        if (runLength == 0)
+        {
+            runStart = s;
+        }
+        if (++runLength == sectorCount)
+        {
+            break;
+        }
+    }
+
+    if (runLength < sectorCount)
+    {
+        // A free run touching the end of the file can be extended
+        runStart = runLength > 0 && runStart + runLength == m_usedSectors.size() ? runStart : static_cast<uint32_t>(m_usedSectors.size());
+        m_usedSectors.resize(std::max<size_t>(m_usedSectors.size(), static_cast<size_t>(runStart) + sectorCount), false);
+    }
+
+    for (uint32_t s = 0; s < sectorCount; ++s)
+    {
+        m_usedSectors[runStart + s] = true;
+    }
+    return runStart;
+}
+
+void RegionFile::freeSectors(const SectorRange& range)
+{
+    for (uint32_t s = 0; s < range.sectorCount; ++s)
+    {
+        m_usedSectors[range.firstSector + s] = false;
+    }
+}
+
+void RegionFile::writeTableEntry(uint32_t localIndex)
+{
+    uint32_t entry[2] = { m_table[localIndex].firstSector, m_table[localIndex].sectorCount };
+    const uint64_t offset = REGION_SECTOR_SIZE + static_cast<uint64_t>(localIndex) * TABLE_ENTRY_SIZE;
+    if (!writeAt(m_handle, entry, sizeof(entry), offset))
+    {
+        throw std::runtime_error("Failed to update region file table: " + m_path);
+    }
+}
+
+void RegionStore::init(const std::string& directory)
+{
+    closeAll();
+    m_directory = directory;
+    std::filesystem::create_directories(m_directory);
+}
+
+void RegionStore::closeAll()
+{
+    flush();
+
+    std::lock_guard<std::mutex> lock(m_regionsMutex);
+    m_regions.clear();
+}
+
+RegionFile& RegionStore::getRegion(const glm::ivec3& chunkCoord)
+{
+    const glm::ivec3 region = RegionFile::regionCoord(chunkCoord);
+    const ChunkKey key = packChunkKey(region);
+
+    std::lock_guard<std::mutex> lock(m_regionsMutex);
+
+    auto it = m_regions.find(key);
+    if (it != m_regions.end())
+    {
+        return *it->second;
+    }
+
+    auto file = std::make_unique<RegionFile>();
+    const std::string name = "r." + std::to_string(region.x) + "." + std::to_string(region.y) + "." + std::to_string(region.z) + ".vxr";
+    file->open((std::filesystem::path(m_directory) / name).string());
+
+    return *m_regions.emplace(key, std::move(file)).first->second;
+}
+
+bool RegionStore::loadChunk(Chunk& chunk)
+{
+    // A save that hasn't reached the file yet is newer than what's on disk
+    ChunkSnapshotPtr pending;
+    {
+        std::lock_guard<std::mutex> lock(m_pendingMutex);
+        auto it = m_pendingSaves.find(packChunkKey(chunk.position));
+        if (it != m_pendingSaves.end())
+        {
+            pending = it->second.snapshot;
+        }
+    }
+
+    if (pending)
+    {
+        pending->copyTo(chunk.voxels.data());
+        chunk.rebuildDerivedData();
+        chunk.savedVersion = chunk.version;
+        return true;
+    }
+
+    if (!getRegion(chunk.position).readChunk(RegionFile::localIndex(chunk.position), chunk))
+    {
+        return false;
+    }
+
+    chunk.savedVersion = chunk.version;
+    return true;
+}
+
+void RegionStore::saveChunk(Chunk& chunk)
+{
+    getRegion(chunk.position).writeChunk(RegionFile::localIndex(chunk.position), chunk);
+    chunk.savedVersion = chunk.version;
+}
+
+void RegionStore::saveSnapshot(const ChunkSnapshot& snapshot)
+{
+    thread_local std::array<VoxelID, CHUNK_VOLUME> voxels;
+    snapshot.copyTo(voxels.data());
+    getRegion(snapshot.getPosition()).writeChunk(RegionFile::localIndex(snapshot.getPosition()), voxels.data());
+}
+
+void RegionStore::saveAsync(ChunkSnapshotPtr snapshot, ThreadPool& threadPool)
+{
+    const ChunkKey key = packChunkKey(snapshot->getPosition());
+    {
+        std::lock_guard<std::mutex> lock(m_pendingMutex);
+        PendingSave& pending = m_pendingSaves[key];
+        pending.snapshot = std::move(snapshot);
+        if (pending.writing)
+        {
+            return; // The job writing this chunk picks the newer snapshot up when it is done
+        }
+        pending.writing = true;
+    }
+
+    threadPool.submit([this, key]()
+    {
+        std::unique_lock<std::mutex> lock(m_pendingMutex);
+        while (true)
+        {
+            auto it = m_pendingSaves.find(key);
+            ChunkSnapshotPtr snapshot = it->second.snapshot;
+
+            lock.unlock();
+            try
+            {
+                saveSnapshot(*snapshot);
+            }
+            catch (const std::exception& e)
+            {
+                // Dropped like a completed save, otherwise the pending entry would never go and flush() would hang
+                const glm::ivec3& position = snapshot->getPosition();
+                LOG_ERROR("RegionStore: failed to save chunk (" << position.x << ", " << position.y << ", " << position.z << "): " << e.what());
+                m_failedSaves.fetch_add(1, std::memory_order_relaxed);
+            }
+            lock.lock();
+
+            // Saves of one chunk are serialized through the writing flag so an older version can never land last
+            it = m_pendingSaves.find(key);
+            if (it->second.snapshot == snapshot)
+            {
+                m_pendingSaves.erase(it);
+                break;
+            }
+        }
+
+        if (m_pendingSaves.empty())
+        {
+            m_pendingDone.notify_all();
+        }
+    });
+}
+
+void RegionStore::flush()
+{
+    std::unique_lock<std::mutex> lock(m_pendingMutex);
+    m_pendingDone.wait(lock, [this]() { return m_pendingSaves.empty(); });
+}
+
+ChunkLoadFunction RegionStore::makeChunkLoader(ChunkLoadFunction fallback)
+{
+    return [this, fallback = std::move(fallback)](Chunk& chunk)
+    {
+        if (loadChunk(chunk))
+        {
+            return;
+        }
+
+        fallback(chunk);
+        // Regenerated chunks don't need saving until they are edited
+        chunk.savedVersion = chunk.version;
+    };
+}
@@ -0,0 +1,152 @@
+#pragma once
+
+#include "Chunk.h"
+#include "ChunkResidency.h"
+#include "ChunkSnapshot.h"
+#include "Multithreading.h"
+
+#include <cstdint>
+#include <vector>
+#include <string>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <condition_variable>
+#include <atomic>
+#include <unordered_map>
+
+constexpr uint32_t REGION_SIZE = 32;                    // Chunks per axis in one region file
+constexpr uint32_t REGION_SIZE_SHIFT = 5;
+constexpr uint32_t REGION_CHUNK_COUNT = REGION_SIZE * REGION_SIZE * REGION_SIZE;
+constexpr uint32_t REGION_SECTOR_SIZE = 4096;
+
+static_assert((1u << REGION_SIZE_SHIFT) == REGION_SIZE, "REGION_SIZE_SHIFT does not match REGION_SIZE");
+
+// Palette + LZ encoding of a single chunk, independent of any file
+namespace ChunkCodec
+{
+    // Palette-compresses the voxels (1/2/4/8 bits per voxel) and then LZ compresses the result
+    void encode(const Chunk& chunk, std::vector<uint8_t>& out);
+    void encode(const VoxelID* voxels, std::vector<uint8_t>& out); // CHUNK_VOLUME voxels in Chunk::index order
+
+    // Returns false if the data is malformed, the chunk is left untouched in that case
+    bool decode(const uint8_t* data, size_t size, Chunk& chunk);
+}
+
+// One file holding REGION_SIZE^3 chunks.
+//
+// Layout: sector 0 holds the file header, the following sectors hold an offset table with
+// one { firstSector, sectorCount } entry per chunk, chunk records start after that. Every
+// record starts on a 4 KB sector boundary so a chunk is read with one positioned read.
+// Rewriting a chunk reuses its sectors when it still fits, otherwise the first free run
+// (or the end of the file) is used; only the affected table entry is rewritten.
+class RegionFile
+{
+public:
+    RegionFile() = default;
+    ~RegionFile() { close(); }
+
+    RegionFile(const RegionFile&) = delete;
+    RegionFile& operator=(const RegionFile&) = delete;
+    RegionFile(RegionFile&&) = delete;
+    RegionFile& operator=(RegionFile&&) = delete;
+
+    // Opens or creates the file, throws if it can't be opened or isn't a region file
+    void open(const std::string& path);
+    void close();
+
+    bool hasChunk(uint32_t localIndex) const;
+
+    // Thread-safe, readers run concurrently with each other
+    bool readChunk(uint32_t localIndex, Chunk& chunk) const;
+    void writeChunk(uint32_t localIndex, const Chunk& chunk);
+    void writeChunk(uint32_t localIndex, const VoxelID* voxels);
+
+    uint32_t getSectorCount() const { return static_cast<uint32_t>(m_usedSectors.size()); }
+
+    static uint32_t localIndex(const glm::ivec3& chunkCoord)
+    {
+        const uint32_t mask = REGION_SIZE - 1;
+        return (static_cast<uint32_t>(chunkCoord.x) & mask) +
+               REGION_SIZE * ((static_cast<uint32_t>(chunkCoord.y) & mask) +
+               REGION_SIZE * (static_cast<uint32_t>(chunkCoord.z) & mask));
+    }
+
+    static glm::ivec3 regionCoord(const glm::ivec3& chunkCoord)
+    {
+        return glm::ivec3(
+            chunkCoord.x >> REGION_SIZE_SHIFT,
+            chunkCoord.y >> REGION_SIZE_SHIFT,
+            chunkCoord.z >> REGION_SIZE_SHIFT);
+    }
+
+private:
+    struct SectorRange
+    {
+        uint32_t firstSector = 0;
+        uint32_t sectorCount = 0;
+    };
+
+    uint32_t allocateSectors(uint32_t sectorCount);
+    void freeSectors(const SectorRange& range);
+    void writeTableEntry(uint32_t localIndex);
+
+    intptr_t m_handle = -1;
+    std::string m_path;
+
+    std::vector<SectorRange> m_table;
+    std::vector<bool> m_usedSectors;
+
+    mutable std::shared_mutex m_mutex;
+};
+
+// Maps chunk coordinates to region files in a directory, opening them on demand
+class RegionStore
+{
+public:
+    RegionStore() = default;
+    explicit RegionStore(const std::string& directory) { init(directory); }
+    ~RegionStore() { flush(); }
+
+    RegionStore(const RegionStore&) = delete;
+    RegionStore& operator=(const RegionStore&) = delete;
+
+    void init(const std::string& directory);
+    void closeAll(); // Waits for pending saves first
+
+    // Thread-safe. Loads see chunks whose background save is still pending.
+    bool loadChunk(Chunk& chunk);
+    void saveChunk(Chunk& chunk);
+    void saveSnapshot(const ChunkSnapshot& snapshot);
+
+    // Writes the snapshot on the pool so the caller never waits on compression or disk.
+    // Saving the same chunk again before that finished only keeps the newest snapshot.
+    void saveAsync(ChunkSnapshotPtr snapshot, ThreadPool& threadPool = ThreadPool::getInstance());
+
+    // Blocks until every saveAsync has reached its region file or failed
+    void flush();
+
+    // saveAsync jobs that threw, each one is logged. The chunk's edits since its last save are lost.
+    uint32_t getFailedSaveCount() const { return m_failedSaves.load(std::memory_order_relaxed); }
+
+    // Loads the chunk from disk if it was saved before, otherwise runs the fallback (usually the terrain generator)
+    ChunkLoadFunction makeChunkLoader(ChunkLoadFunction fallback);
+
+private:
+    RegionFile& getRegion(const glm::ivec3& chunkCoord);
+
+    struct PendingSave
+    {
+        ChunkSnapshotPtr snapshot; // Newest version waiting to be written
+        bool writing = false;      // A job owns this chunk's saves
+    };
+
+    std::string m_directory;
+    std::mutex m_regionsMutex;
+    std::unordered_map<ChunkKey, std::unique_ptr<RegionFile>> m_regions;
+
+    std::mutex m_pendingMutex;
+    std::condition_variable m_pendingDone;
+    std::unordered_map<ChunkKey, PendingSave> m_pendingSaves;
+    std::atomic<uint32_t> m_failedSaves{ 0 };
+};
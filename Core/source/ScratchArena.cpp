@@ -0,0 +1,64 @@
+#include "ScratchArena.h"
+
+#include <algorithm>
+
+void ScratchArena::reset(VkDeviceSize capacity, VkDeviceSize alignment)
+{
+    m_capacity = capacity;
+    m_alignment = std::max<VkDeviceSize>(alignment, 1);
+    m_used = 0;
+}
+
+VkDeviceSize ScratchArena::allocate(VkDeviceSize size)
+{
+    const VkDeviceSize offset = (m_used + m_alignment - 1) & ~(m_alignment - 1);
+    if (offset > m_capacity || size > m_capacity - offset)
+    {
+        return NO_SPACE;
+    }
+
+    m_used = offset + size;
+    return offset;
+}
+
+void ScratchArena::planBatches(const VkDeviceSize* scratchSizes, uint32_t count, VkDeviceSize alignment, VkDeviceSize maxScratchSize,
+    std::vector<BlasBuildBatch>& batches, std::vector<VkDeviceSize>& scratchOffsets)
+{
+    batches.clear();
+    scratchOffsets.resize(count);
+
+    ScratchArena arena(maxScratchSize, alignment);
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        VkDeviceSize offset = arena.allocate(scratchSizes[i]);
+        if (offset == NO_SPACE || batches.empty())
+        {
+            // After an oversized build the next batch is already open and empty
+            if (batches.empty() || batches.back().count != 0)
+            {
+                batches.push_back({ i, 0, 0 });
+            }
+            arena.rewind();
+            offset = arena.allocate(scratchSizes[i]);
+
+            // Too large for any batch, it gets the whole arena to itself
+            if (offset == NO_SPACE)
+            {
+                scratchOffsets[i] = 0;
+                batches.back().count = 1;
+                batches.back().scratchSize = scratchSizes[i];
+                batches.push_back({ i + 1, 0, 0 });
+                continue;
+            }
+        }
+
+        scratchOffsets[i] = offset;
+        batches.back().count++;
+        batches.back().scratchSize = arena.getUsed();
+    }
+
+    if (!batches.empty() && batches.back().count == 0)
+    {
+        batches.pop_back();
+    }
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "vulkan/vulkan.h"
+
+#include <cstdint>
+#include <vector>
+#include <limits>
+
+// Consecutive builds recorded with one vkCmdBuildAccelerationStructuresKHR
+struct BlasBuildBatch
+{
+    uint32_t first = 0;
+    uint32_t count = 0;
+    VkDeviceSize scratchSize = 0;   // Arena bytes the batch uses, offsets included
+};
+
+// Linear sub-allocator over one scratch buffer. Builds recorded in the same
+// vkCmdBuildAccelerationStructuresKHR run concurrently and each needs its own range, aligned to
+// minAccelerationStructureScratchOffsetAlignment. Ranges are only given back all at once, by
+// rewind() once the builds using them completed.
+//
+// Only deals in offsets, so it can be used and tested without a device.
+class ScratchArena
+{
+public:
+    static constexpr VkDeviceSize NO_SPACE = std::numeric_limits<VkDeviceSize>::max();
+
+    ScratchArena() = default;
+    ScratchArena(VkDeviceSize capacity, VkDeviceSize alignment) { reset(capacity, alignment); }
+
+    // alignment has to be a power of two, 0 counts as 1
+    void reset(VkDeviceSize capacity, VkDeviceSize alignment);
+    void rewind() { m_used = 0; }
+
+    // Offset of a free range of size bytes, NO_SPACE if it doesn't fit
+    VkDeviceSize allocate(VkDeviceSize size);
+
+    VkDeviceSize getCapacity() const { return m_capacity; }
+    VkDeviceSize getUsed() const { return m_used; }
+    VkDeviceSize getAlignment() const { return m_alignment; }
+
+    // Splits builds, in order, into batches whose scratch fits in maxScratchSize and writes the
+    // offset of every build within its batch. A build larger than maxScratchSize gets a batch of
+    // its own sized for it, so the arena has to be as large as the largest returned scratchSize.
+    static void planBatches(const VkDeviceSize* scratchSizes, uint32_t count, VkDeviceSize alignment, VkDeviceSize maxScratchSize,
+        std::vector<BlasBuildBatch>& batches, std::vector<VkDeviceSize>& scratchOffsets);
+
+private:
+    VkDeviceSize m_capacity = 0;
+    VkDeviceSize m_alignment = 1;
+    VkDeviceSize m_used = 0;
+};
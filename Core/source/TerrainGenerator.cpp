@@ -0,0 +1,353 @@
+#include "TerrainGenerator.h"
+#include "PerformanceTimer.h"
+
+#include <immintrin.h>
+
+#include <cmath>
+#include <algorithm>
+
+namespace
+{
+    constexpr uint32_t OCTAVE_SEED_STEP = 0x9E3779B9u;
+    constexpr uint32_t CAVE_SEED_OFFSET = 0x85EBCA6Bu;
+
+    inline uint32_t hashLattice(int32_t x, int32_t y, int32_t z, uint32_t seed)
+    {
+        uint32_t h = seed ^ (static_cast<uint32_t>(x) * 0x8DA6B343u) ^ (static_cast<uint32_t>(y) * 0xD8163841u) ^ (static_cast<uint32_t>(z) * 0xCB1AB31Fu);
+        h ^= h >> 15;
+        h *= 0x2C1B3C6Du;
+        h ^= h >> 12;
+        h *= 0x297A2D39u;
+        h ^= h >> 15;
+        return h;
+    }
+
+    // Maps the top 24 bits of a hash to [-1, 1]
+    inline float latticeValue(uint32_t h)
+    {
+        return static_cast<float>(h >> 8) * (2.0f / 16777215.0f) - 1.0f;
+    }
+
+    inline float fade(float t)
+    {
+        return t * t * (3.0f - 2.0f * t);
+    }
+
+    inline float lerp(float a, float b, float t)
+    {
+        return a + (b - a) * t;
+    }
+
+#if !defined(__AVX2__)
+    float valueNoise2D(float x, float z, uint32_t seed)
+    {
+        const float fx = std::floor(x);
+        const float fz = std::floor(z);
+        const int32_t ix = static_cast<int32_t>(fx);
+        const int32_t iz = static_cast<int32_t>(fz);
+        const float tx = fade(x - fx);
+        const float tz = fade(z - fz);
+
+        const float v00 = latticeValue(hashLattice(ix, 0, iz, seed));
+        const float v10 = latticeValue(hashLattice(ix + 1, 0, iz, seed));
+        const float v01 = latticeValue(hashLattice(ix, 0, iz + 1, seed));
+        const float v11 = latticeValue(hashLattice(ix + 1, 0, iz + 1, seed));
+
+        return lerp(lerp(v00, v10, tx), lerp(v01, v11, tx), tz);
+    }
+
+    float valueNoise3D(float x, float y, float z, uint32_t seed)
+    {
+        const float fx = std::floor(x);
+        const float fy = std::floor(y);
+        const float fz = std::floor(z);
+        const int32_t ix = static_cast<int32_t>(fx);
+        const int32_t iy = static_cast<int32_t>(fy);
+        const int32_t iz = static_cast<int32_t>(fz);
+        const float tx = fade(x - fx);
+        const float ty = fade(y - fy);
+        const float tz = fade(z - fz);
+
+        const float v000 = latticeValue(hashLattice(ix, iy, iz, seed));
+        const float v100 = latticeValue(hashLattice(ix + 1, iy, iz, seed));
+        const float v010 = latticeValue(hashLattice(ix, iy + 1, iz, seed));
+        const float v110 = latticeValue(hashLattice(ix + 1, iy + 1, iz, seed));
+        const float v001 = latticeValue(hashLattice(ix, iy, iz + 1, seed));
+        const float v101 = latticeValue(hashLattice(ix + 1, iy, iz + 1, seed));
+        const float v011 = latticeValue(hashLattice(ix, iy + 1, iz + 1, seed));
+        const float v111 = latticeValue(hashLattice(ix + 1, iy + 1, iz + 1, seed));
+
+        const float z0 = lerp(lerp(v000, v100, tx), lerp(v010, v110, tx), ty);
+        const float z1 = lerp(lerp(v001, v101, tx), lerp(v011, v111, tx), ty);
+        return lerp(z0, z1, tz);
+    }
+#endif
+
+#if defined(__AVX2__)
+    inline __m256i hashLattice8(__m256i x, __m256i y, __m256i z, uint32_t seed)
+    {
+        __m256i h = _mm256_set1_epi32(static_cast<int32_t>(seed));
+        h = _mm256_xor_si256(h, _mm256_mullo_epi32(x, _mm256_set1_epi32(static_cast<int32_t>(0x8DA6B343u))));
+        h = _mm256_xor_si256(h, _mm256_mullo_epi32(y, _mm256_set1_epi32(static_cast<int32_t>(0xD8163841u))));
+        h = _mm256_xor_si256(h, _mm256_mullo_epi32(z, _mm256_set1_epi32(static_cast<int32_t>(0xCB1AB31Fu))));
+        h = _mm256_xor_si256(h, _mm256_srli_epi32(h, 15));
+        h = _mm256_mullo_epi32(h, _mm256_set1_epi32(static_cast<int32_t>(0x2C1B3C6Du)));
+        h = _mm256_xor_si256(h, _mm256_srli_epi32(h, 12));
+        h = _mm256_mullo_epi32(h, _mm256_set1_epi32(static_cast<int32_t>(0x297A2D39u)));
+        h = _mm256_xor_si256(h, _mm256_srli_epi32(h, 15));
+        return h;
+    }
+
+    inline __m256 latticeValue8(__m256i h)
+    {
+        const __m256 value = _mm256_cvtepi32_ps(_mm256_srli_epi32(h, 8));
+        return _mm256_sub_ps(_mm256_mul_ps(value, _mm256_set1_ps(2.0f / 16777215.0f)), _mm256_set1_ps(1.0f));
+    }
+
+    inline __m256 fade8(__m256 t)
+    {
+        return _mm256_mul_ps(_mm256_mul_ps(t, t), _mm256_sub_ps(_mm256_set1_ps(3.0f), _mm256_mul_ps(_mm256_set1_ps(2.0f), t)));
+    }
+
+    inline __m256 lerp8(__m256 a, __m256 b, __m256 t)
+    {
+        return _mm256_add_ps(a, _mm256_mul_ps(_mm256_sub_ps(b, a), t));
+    }
+
+    __m256 valueNoise2D8(__m256 x, __m256 z, uint32_t seed)
+    {
+        const __m256 fx = _mm256_floor_ps(x);
+        const __m256 fz = _mm256_floor_ps(z);
+        const __m256i ix = _mm256_cvttps_epi32(fx);
+        const __m256i iz = _mm256_cvttps_epi32(fz);
+        const __m256i ix1 = _mm256_add_epi32(ix, _mm256_set1_epi32(1));
+        const __m256i iz1 = _mm256_add_epi32(iz, _mm256_set1_epi32(1));
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256 tx = fade8(_mm256_sub_ps(x, fx));
+        const __m256 tz = fade8(_mm256_sub_ps(z, fz));
+
+        const __m256 v00 = latticeValue8(hashLattice8(ix, zero, iz, seed));
+        const __m256 v10 = latticeValue8(hashLattice8(ix1, zero, iz, seed));
+        const __m256 v01 = latticeValue8(hashLattice8(ix, zero, iz1, seed));
+        const __m256 v11 = latticeValue8(hashLattice8(ix1, zero, iz1, seed));
+
+        return lerp8(lerp8(v00, v10, tx), lerp8(v01, v11, tx), tz);
+    }
+
+    __m256 valueNoise3D8(__m256 x, __m256 y, __m256 z, uint32_t seed)
+    {
+        const __m256 fx = _mm256_floor_ps(x);
+        const __m256 fy = _mm256_floor_ps(y);
+        const __m256 fz = _mm256_floor_ps(z);
+        const __m256i one = _mm256_set1_epi32(1);
+        const __m256i ix = _mm256_cvttps_epi32(fx);
+        const __m256i iy = _mm256_cvttps_epi32(fy);
+        const __m256i iz = _mm256_cvttps_epi32(fz);
+        const __m256i ix1 = _mm256_add_epi32(ix, one);
+        const __m256i iy1 = _mm256_add_epi32(iy, one);
+        const __m256i iz1 = _mm256_add_epi32(iz, one);
+        const __m256 tx = fade8(_mm256_sub_ps(x, fx));
+        const __m256 ty = fade8(_mm256_sub_ps(y, fy));
+        const __m256 tz = fade8(_mm256_sub_ps(z, fz));
+
+        const __m256 v000 = latticeValue8(hashLattice8(ix, iy, iz, seed));
+        const __m256 v100 = latticeValue8(hashLattice8(ix1, iy, iz, seed));
+        const __m256 v010 = latticeValue8(hashLattice8(ix, iy1, iz, seed));
+        const __m256 v110 = latticeValue8(hashLattice8(ix1, iy1, iz, seed));
+        const __m256 v001 = latticeValue8(hashLattice8(ix, iy, iz1, seed));
+        const __m256 v101 = latticeValue8(hashLattice8(ix1, iy, iz1, seed));
+        const __m256 v011 = latticeValue8(hashLattice8(ix, iy1, iz1, seed));
+        const __m256 v111 = latticeValue8(hashLattice8(ix1, iy1, iz1, seed));
+
+        const __m256 z0 = lerp8(lerp8(v000, v100, tx), lerp8(v010, v110, tx), ty);
+        const __m256 z1 = lerp8(lerp8(v001, v101, tx), lerp8(v011, v111, tx), ty);
+        return lerp8(z0, z1, tz);
+    }
+
+    // The surface height of 8 columns, shared by generate() and getSurfaceHeight() so both round the same
+    __m256 heightNoise8(const TerrainConfig& config, __m256 x, __m256 z)
+    {
+        __m256 sum = _mm256_setzero_ps();
+        float amplitude = 1.0f;
+        float frequency = config.horizontalScale;
+        float norm = 0.0f;
+
+        for (uint32_t octave = 0; octave < config.octaves; ++octave)
+        {
+            const __m256 freq = _mm256_set1_ps(frequency);
+            const __m256 noise = valueNoise2D8(_mm256_mul_ps(x, freq), _mm256_mul_ps(z, freq), config.seed + octave * OCTAVE_SEED_STEP);
+            sum = _mm256_add_ps(sum, _mm256_mul_ps(_mm256_set1_ps(amplitude), noise));
+            norm += amplitude;
+            amplitude *= 0.5f;
+            frequency *= 2.0f;
+        }
+
+        return _mm256_add_ps(_mm256_set1_ps(config.baseHeight),
+            _mm256_mul_ps(_mm256_set1_ps(config.heightAmplitude), _mm256_div_ps(sum, _mm256_set1_ps(norm))));
+    }
+#else
+    float heightNoise(const TerrainConfig& config, float x, float z)
+    {
+        float sum = 0.0f;
+        float amplitude = 1.0f;
+        float frequency = config.horizontalScale;
+        float norm = 0.0f;
+
+        for (uint32_t octave = 0; octave < config.octaves; ++octave)
+        {
+            sum += amplitude * valueNoise2D(x * frequency, z * frequency, config.seed + octave * OCTAVE_SEED_STEP);
+            norm += amplitude;
+            amplitude *= 0.5f;
+            frequency *= 2.0f;
+        }
+
+        return config.baseHeight + config.heightAmplitude * (sum / norm);
+    }
+
+    float caveNoise(const TerrainConfig& config, float x, float y, float z)
+    {
+        const uint32_t seed = config.seed + CAVE_SEED_OFFSET;
+        const float scale = config.caveScale;
+        return 0.666f * valueNoise3D(x * scale, y * scale, z * scale, seed) +
+               0.334f * valueNoise3D(x * scale * 2.0f, y * scale * 2.0f, z * scale * 2.0f, seed + OCTAVE_SEED_STEP);
+    }
+#endif
+}
+
+void TerrainGenerator::generateHeights(const glm::ivec3& origin, int32_t* heights) const
+{
+    for (uint32_t z = 0; z < CHUNK_SIZE_Z; ++z)
+    {
+        const float wz = static_cast<float>(origin.z + static_cast<int32_t>(z));
+        int32_t* row = heights + z * CHUNK_SIZE_X;
+
+#if defined(__AVX2__)
+        for (uint32_t x = 0; x < CHUNK_SIZE_X; x += 8)
+        {
+            const __m256 wx = _mm256_cvtepi32_ps(_mm256_add_epi32(
+                _mm256_set1_epi32(origin.x + static_cast<int32_t>(x)),
+                _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7)));
+            const __m256 height = heightNoise8(m_config, wx, _mm256_set1_ps(wz));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(row + x), _mm256_cvttps_epi32(_mm256_floor_ps(height)));
+        }
+#else
+        for (uint32_t x = 0; x < CHUNK_SIZE_X; ++x)
+        {
+            const float wx = static_cast<float>(origin.x + static_cast<int32_t>(x));
+            row[x] = static_cast<int32_t>(std::floor(heightNoise(m_config, wx, wz)));
+        }
+#endif
+    }
+}
+
+void TerrainGenerator::generate(Chunk& chunk) const
+{
+    const glm::ivec3 origin = chunk.getWorldOrigin();
+
+    alignas(32) int32_t heights[CHUNK_SIZE_X * CHUNK_SIZE_Z];
+    generateHeights(origin, heights);
+
+    const int32_t maxHeight = *std::max_element(std::begin(heights), std::end(heights));
+
+    if (origin.y > maxHeight && origin.y > m_config.seaLevel)
+    {
+        chunk.fill(AIR_VOXEL);
+        return;
+    }
+
+    const int32_t beachLevel = m_config.seaLevel + m_config.beachHeight;
+    VoxelID* voxels = chunk.voxels.data();
+
+    alignas(32) float caveRow[CHUNK_SIZE_X];
+
+    for (uint32_t z = 0; z < CHUNK_SIZE_Z; ++z)
+    {
+        const int32_t* heightRow = heights + z * CHUNK_SIZE_X;
+        const float wz = static_cast<float>(origin.z + static_cast<int32_t>(z));
+
+        for (uint32_t y = 0; y < CHUNK_SIZE_Y; ++y)
+        {
+            const int32_t wy = origin.y + static_cast<int32_t>(y);
+            const bool rowHasCaves = m_config.caves && wy <= maxHeight;
+
+            if (rowHasCaves)
+            {
+#if defined(__AVX2__)
+                const uint32_t seed = m_config.seed + CAVE_SEED_OFFSET;
+                const __m256 scale = _mm256_set1_ps(m_config.caveScale);
+                const __m256 scale2 = _mm256_set1_ps(m_config.caveScale * 2.0f);
+                const __m256 wy8 = _mm256_set1_ps(static_cast<float>(wy));
+                const __m256 wz8 = _mm256_set1_ps(wz);
+
+                for (uint32_t x = 0; x < CHUNK_SIZE_X; x += 8)
+                {
+                    const __m256 wx = _mm256_cvtepi32_ps(_mm256_add_epi32(
+                        _mm256_set1_epi32(origin.x + static_cast<int32_t>(x)),
+                        _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7)));
+
+                    const __m256 low = valueNoise3D8(_mm256_mul_ps(wx, scale), _mm256_mul_ps(wy8, scale), _mm256_mul_ps(wz8, scale), seed);
+                    const __m256 high = valueNoise3D8(_mm256_mul_ps(wx, scale2), _mm256_mul_ps(wy8, scale2), _mm256_mul_ps(wz8, scale2), seed + OCTAVE_SEED_STEP);
+                    _mm256_store_ps(caveRow + x, _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(0.666f), low), _mm256_mul_ps(_mm256_set1_ps(0.334f), high)));
+                }
+#else
+                for (uint32_t x = 0; x < CHUNK_SIZE_X; ++x)
+                {
+                    caveRow[x] = caveNoise(m_config, static_cast<float>(origin.x + static_cast<int32_t>(x)), static_cast<float>(wy), wz);
+                }
+#endif
+            }
+
+            VoxelID* voxelRow = voxels + Chunk::index(0, y, z);
+            for (uint32_t x = 0; x < CHUNK_SIZE_X; ++x)
+            {
+                const int32_t height = heightRow[x];
+                const bool beach = height <= beachLevel;
+
+                VoxelID id;
+                if (wy > height)
+                {
+                    id = wy <= m_config.seaLevel ? WATER_VOXEL : AIR_VOXEL;
+                }
+                else if (rowHasCaves && caveRow[x] > m_config.caveThreshold)
+                {
+                    id = AIR_VOXEL;
+                }
+                else if (wy == height)
+                {
+                    id = beach ? SAND_VOXEL : GRASS_VOXEL;
+                }
+                else if (wy > height - m_config.dirtDepth)
+                {
+                    id = beach ? SAND_VOXEL : DIRT_VOXEL;
+                }
+                else
+                {
+                    id = STONE_VOXEL;
+                }
+                voxelRow[x] = id;
+            }
+        }
+    }
+
+    chunk.rebuildDerivedData();
+}
+
+void TerrainGenerator::generateChunks(const std::vector<Chunk*>& chunks, ThreadPool& threadPool) const
+{
+    PERF_SCOPE("Terrain Generation");
+
+    threadPool.parallelFor(static_cast<uint32_t>(chunks.size()), [this, &chunks](uint32_t index)
+    {
+        generate(*chunks[index]);
+    });
+}
+
+int32_t TerrainGenerator::getSurfaceHeight(int32_t x, int32_t z) const
+{
+#if defined(__AVX2__)
+    const __m256 height = heightNoise8(m_config, _mm256_set1_ps(static_cast<float>(x)), _mm256_set1_ps(static_cast<float>(z)));
+    return static_cast<int32_t>(std::floor(_mm256_cvtss_f32(height)));
+#else
+    return static_cast<int32_t>(std::floor(heightNoise(m_config, static_cast<float>(x), static_cast<float>(z))));
+#endif
+}
@@ -0,0 +1,89 @@
+#include "TlasQuality.h"
+#include "PerformanceTimer.h"
+
+#include <algorithm>
+#include <limits>
+
+void TlasQuality::reset(const std::vector<uint32_t>& builtSlots, uint32_t slotCount, const InstanceBoundsFunction& getBounds)
+{
+    m_costRatio = 1.0f;
+    m_bounds.clear();
+    m_indices.assign(slotCount, InstanceTable::INVALID_SLOT);
+    if (!isTracking())
+    {
+        m_tree.clear();
+        return;
+    }
+
+    PERF_SCOPE("TLAS Quality Rebuild");
+
+    VkAabbPositionsKHR bounds;
+    for (uint32_t slot : builtSlots)
+    {
+        if (getBounds(slot, bounds))
+        {
+            m_indices[slot] = static_cast<uint32_t>(m_bounds.size());
+            m_bounds.push_back(bounds);
+        }
+    }
+
+    m_tree.buildLinear(m_bounds.data(), static_cast<uint32_t>(m_bounds.size()));
+    m_rebuildCost = m_tree.computeSahCost();
+}
+
+TLASBuildDecision TlasQuality::decide(bool sameInstanceList, const std::vector<InstanceRange>& dirtyRanges, const InstanceBoundsFunction& getBounds)
+{
+    m_lastDecision = sameInstanceList ? TLASBuildDecision::Refit : TLASBuildDecision::Rebuild;
+    if (sameInstanceList && isTracking() && refit(dirtyRanges, getBounds) > m_settings.rebuildCostRatio)
+    {
+        m_lastDecision = TLASBuildDecision::QualityRebuild;
+        m_qualityRebuildCount++;
+    }
+
+    if (m_lastDecision == TLASBuildDecision::Refit)
+    {
+        m_refitsSinceRebuild++;
+    }
+    else
+    {
+        m_refitsSinceRebuild = 0;
+    }
+    return m_lastDecision;
+}
+
+void TlasQuality::clear()
+{
+    m_tree.clear();
+    m_bounds.clear();
+    m_indices.clear();
+    m_rebuildCost = 0.0f;
+    m_costRatio = 1.0f;
+    m_refitsSinceRebuild = 0;
+    m_qualityRebuildCount = 0;
+    m_lastDecision = TLASBuildDecision::None;
+}
+
+float TlasQuality::refit(const std::vector<InstanceRange>& dirtyRanges, const InstanceBoundsFunction& getBounds)
+{
+    if (m_tree.isEmpty() || dirtyRanges.empty())
+    {
+        return m_costRatio;
+    }
+
+    PERF_SCOPE("TLAS Quality Refit");
+
+    for (const InstanceRange& range : dirtyRanges)
+    {
+        for (uint32_t slot = range.first; slot < range.first + range.count; ++slot)
+        {
+            if (slot < m_indices.size() && m_indices[slot] != InstanceTable::INVALID_SLOT)
+            {
+                getBounds(slot, m_bounds[m_indices[slot]]);
+            }
+        }
+    }
+
+    m_tree.refit(m_bounds.data(), static_cast<uint32_t>(m_bounds.size()));
+    m_costRatio = m_tree.computeSahCost() / std::max(m_rebuildCost, std::numeric_limits<float>::min());
+    return m_costRatio;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include "BVH.h"
+#include "InstanceTable.h"
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+struct TLASUpdateSettings
+{
+    // Rebuild once refitting made the instance tree this much more expensive to trace than right
+    // after the last rebuild, 0 always refits while the instance list allows it
+    float rebuildCostRatio = 1.3f;
+};
+
+enum class TLASBuildDecision
+{
+    None,
+    Refit,
+    Rebuild,            // The instance list changed, a refit can't follow
+    QualityRebuild      // Refitting degraded the tree past TLASUpdateSettings::rebuildCostRatio
+};
+
+// World-space bounds of the instance in a slot, false for a hole
+using InstanceBoundsFunction = std::function<bool(uint32_t slot, VkAabbPositionsKHR& bounds)>;
+
+// Decides between refitting and rebuilding the TLAS for AccelerationStructureManager::updateTLAS.
+//
+// A refit keeps the tree the last rebuild chose for the old positions, so it gets worse the
+// further instances move. The quality is tracked on a CPU LBVH over the world bounds of the
+// built instances that is refitted alongside: once its SAH cost exceeds the cost after the last
+// rebuild by TLASUpdateSettings::rebuildCostRatio, the TLAS is rebuilt instead.
+//
+// Only sees instance slots and their bounds, the GPU tree itself is never read back.
+class TlasQuality
+{
+public:
+    // Switching the tracking on needs a reset() from the current TLAS
+    void setSettings(const TLASUpdateSettings& settings) { m_settings = settings; }
+    const TLASUpdateSettings& getSettings() const { return m_settings; }
+    bool isTracking() const { return m_settings.rebuildCostRatio > 0.0f; }
+
+    // Builds the tree over the live instances of a TLAS just built from builtSlots, its cost is
+    // the new reference
+    void reset(const std::vector<uint32_t>& builtSlots, uint32_t slotCount, const InstanceBoundsFunction& getBounds);
+
+    // For the next build: Rebuild unless it keeps the instance list of the last one, otherwise the
+    // instances in dirtyRanges are moved in the tree and Refit or QualityRebuild depending on its
+    // cost. After a rebuild of either kind call reset() with the new list.
+    TLASBuildDecision decide(bool sameInstanceList, const std::vector<InstanceRange>& dirtyRanges, const InstanceBoundsFunction& getBounds);
+
+    void clear();
+
+    // SAH cost of the tree relative to the last rebuild
+    float getCostRatio() const { return m_costRatio; }
+    uint32_t getRefitsSinceRebuild() const { return m_refitsSinceRebuild; }
+    uint32_t getQualityRebuildCount() const { return m_qualityRebuildCount; }
+    TLASBuildDecision getLastDecision() const { return m_lastDecision; }
+
+private:
+    // Moves the changed instances in the tree and returns its cost relative to the last rebuild
+    float refit(const std::vector<InstanceRange>& dirtyRanges, const InstanceBoundsFunction& getBounds);
+
+    TLASUpdateSettings m_settings;
+
+    // The tree over the built live instances, their bounds and the index of every slot in them
+    // (InstanceTable::INVALID_SLOT if not built)
+    BVH m_tree;
+    std::vector<VkAabbPositionsKHR> m_bounds;
+    std::vector<uint32_t> m_indices;
+    float m_rebuildCost = 0.0f;
+
+    float m_costRatio = 1.0f;
+    uint32_t m_refitsSinceRebuild = 0;
+    uint32_t m_qualityRebuildCount = 0;
+    TLASBuildDecision m_lastDecision = TLASBuildDecision::None;
+};
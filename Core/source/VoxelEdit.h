@@ -0,0 +1,319 @@
+#pragma once
+
+#include "Chunk.h"
+
+#include "glm/glm.hpp"
+
+#include <immintrin.h>
+
+#include <cstdint>
+#include <cmath>
+#include <vector>
+#include <algorithm>
+
+// Box of voxels copied out of the world with World::copyRegion, x fastest
+struct VoxelClipboard
+{
+    glm::ivec3 size{ 0 };
+    std::vector<VoxelID> voxels;
+
+    size_t index(int32_t x, int32_t y, int32_t z) const
+    {
+        return static_cast<size_t>(x) + static_cast<size_t>(size.x) * (static_cast<size_t>(y) + static_cast<size_t>(size.y) * static_cast<size_t>(z));
+    }
+
+    VoxelID get(int32_t x, int32_t y, int32_t z) const { return voxels[index(x, y, z)]; }
+};
+
+enum class EditShape : uint8_t
+{
+    Sphere, // Voxels whose centre lies within radius of center
+    Box,    // Inclusive [min, max]
+    Line,   // Capsule of radius around the segment from -> to
+    Paste,  // Clipboard with its (0, 0, 0) voxel at origin
+};
+
+// One bulk edit for World::applyEdit, build it with the factory functions
+struct EditOp
+{
+    EditShape shape = EditShape::Sphere;
+    VoxelID id = AIR_VOXEL; // Written by Sphere, Box and Line
+
+    glm::vec3 from{ 0.0f }; // Sphere centre or line start
+    glm::vec3 to{ 0.0f };   // Line end
+    float radius = 0.0f;
+
+    glm::ivec3 min{ 0 };    // Box corners, paste origin in min
+    glm::ivec3 max{ 0 };
+
+    const VoxelClipboard* clipboard = nullptr; // Must outlive applyEdit
+    bool pasteAir = false;                     // Paste air voxels too instead of skipping them
+
+    static EditOp sphere(const glm::vec3& center, float radius, VoxelID id)
+    {
+        EditOp op;
+        op.shape = EditShape::Sphere;
+        op.from = center;
+        op.radius = radius;
+        op.id = id;
+        return op;
+    }
+
+    static EditOp box(const glm::ivec3& min, const glm::ivec3& max, VoxelID id)
+    {
+        EditOp op;
+        op.shape = EditShape::Box;
+        op.min = glm::min(min, max);
+        op.max = glm::max(min, max);
+        op.id = id;
+        return op;
+    }
+
+    static EditOp line(const glm::vec3& from, const glm::vec3& to, float radius, VoxelID id)
+    {
+        EditOp op;
+        op.shape = EditShape::Line;
+        op.from = from;
+        op.to = to;
+        op.radius = radius;
+        op.id = id;
+        return op;
+    }
+
+    static EditOp paste(const VoxelClipboard& clipboard, const glm::ivec3& origin, bool pasteAir = false)
+    {
+        EditOp op;
+        op.shape = EditShape::Paste;
+        op.clipboard = &clipboard;
+        op.min = origin;
+        op.pasteAir = pasteAir;
+        return op;
+    }
+};
+
+// Voxel changes of one chunk, each packed with VoxelEdit::packChange. World::applyChanges writes
+// the new values where the voxels still hold the old ones, swapping old and new gives the inverse delta.
+struct ChunkDelta
+{
+    glm::ivec3 chunkCoord{ 0 };
+    std::vector<uint32_t> changes;
+};
+
+struct EditResult
+{
+    uint32_t chunkCount = 0;    // Resident chunks that changed
+    uint64_t changedVoxels = 0;
+};
+
+namespace VoxelEdit
+{
+    // Chunk::index in the low 16 bits, the old VoxelID in bits 16..23 and the new one in 24..31
+    constexpr uint32_t packChange(uint32_t index, VoxelID oldId, VoxelID newId)
+    {
+        return index | static_cast<uint32_t>(oldId) << 16 | static_cast<uint32_t>(newId) << 24;
+    }
+
+    constexpr uint32_t getChangeIndex(uint32_t change) { return change & 0xFFFFu; }
+    constexpr VoxelID getChangeOld(uint32_t change) { return static_cast<VoxelID>(change >> 16); }
+    constexpr VoxelID getChangeNew(uint32_t change) { return static_cast<VoxelID>(change >> 24); }
+
+    // Sorts changes listed oldest first by index and folds repeats of a voxel into one change from its
+    // first old to its last new value, voxels that ended up unchanged are dropped
+    inline void collapseChanges(std::vector<uint32_t>& changes)
+    {
+        std::stable_sort(changes.begin(), changes.end(), [](uint32_t a, uint32_t b)
+        {
+            return getChangeIndex(a) < getChangeIndex(b);
+        });
+
+        size_t merged = 0;
+        for (size_t i = 0; i < changes.size();)
+        {
+            const uint32_t index = getChangeIndex(changes[i]);
+            const VoxelID oldId = getChangeOld(changes[i]);
+            while (i + 1 < changes.size() && getChangeIndex(changes[i + 1]) == index)
+            {
+                i++;
+            }
+            const VoxelID newId = getChangeNew(changes[i++]);
+
+            if (oldId != newId)
+            {
+                changes[merged++] = packChange(index, oldId, newId);
+            }
+        }
+        changes.resize(merged);
+    }
+
+    // Inclusive world-space voxel bounds, false if the op can't touch anything
+    inline bool getBounds(const EditOp& op, glm::ivec3& min, glm::ivec3& max)
+    {
+        switch (op.shape)
+        {
+        case EditShape::Sphere:
+        case EditShape::Line:
+        {
+            if (!(op.radius >= 0.0f))
+            {
+                return false;
+            }
+            const glm::vec3 end = op.shape == EditShape::Line ? op.to : op.from;
+            min = glm::ivec3(glm::floor(glm::min(op.from, end) - op.radius));
+            max = glm::ivec3(glm::floor(glm::max(op.from, end) + op.radius));
+            return true;
+        }
+        case EditShape::Box:
+            min = op.min;
+            max = op.max;
+            return true;
+        case EditShape::Paste:
+            if (op.clipboard == nullptr || glm::any(glm::lessThanEqual(op.clipboard->size, glm::ivec3(0))))
+            {
+                return false;
+            }
+            min = op.min;
+            max = op.min + op.clipboard->size - 1;
+            return true;
+        }
+        return false;
+    }
+
+    namespace Detail
+    {
+        // Squared distance from p to the segment a + t * d, t in [0, 1]
+        inline float segmentDistance2(const glm::vec3& p, const glm::vec3& a, const glm::vec3& d, float invLength2)
+        {
+            const float t = std::clamp(glm::dot(p - a, d) * invLength2, 0.0f, 1.0f);
+            const glm::vec3 offset = p - (a + t * d);
+            return glm::dot(offset, offset);
+        }
+    }
+
+    // Voxels [x0, x1] of row (y, z) covered by a Sphere, Box or Line op, false if none
+    inline bool getRowSpan(const EditOp& op, int32_t y, int32_t z, int32_t& x0, int32_t& x1)
+    {
+        switch (op.shape)
+        {
+        case EditShape::Sphere:
+        {
+            const float dy = static_cast<float>(y) + 0.5f - op.from.y;
+            const float dz = static_cast<float>(z) + 0.5f - op.from.z;
+            const float remaining = op.radius * op.radius - dy * dy - dz * dz;
+            if (remaining < 0.0f)
+            {
+                return false;
+            }
+
+            // Voxel centres x + 0.5 within half of the centre
+            const float half = std::sqrt(remaining);
+            x0 = static_cast<int32_t>(std::ceil(op.from.x - half - 0.5f));
+            x1 = static_cast<int32_t>(std::floor(op.from.x + half - 0.5f));
+            return x0 <= x1;
+        }
+        case EditShape::Box:
+            if (y < op.min.y || y > op.max.y || z < op.min.z || z > op.max.z)
+            {
+                return false;
+            }
+            x0 = op.min.x;
+            x1 = op.max.x;
+            return true;
+        case EditShape::Line:
+        {
+            // The capsule is convex, so each row crosses it in one interval. Find the row's closest
+            // point to the segment, then binary search both ends of the interval from there.
+            const glm::vec3 d = op.to - op.from;
+            const float length2 = glm::dot(d, d);
+            const float invLength2 = length2 > 0.0f ? 1.0f / length2 : 0.0f;
+            const float r2 = op.radius * op.radius;
+            const float py = static_cast<float>(y) + 0.5f;
+            const float pz = static_cast<float>(z) + 0.5f;
+
+            const float oy = op.from.y - py;
+            const float oz = op.from.z - pz;
+            const float yz2 = d.y * d.y + d.z * d.z;
+            const float t = yz2 > 0.0f ? std::clamp(-(oy * d.y + oz * d.z) / yz2, 0.0f, 1.0f) : 0.0f;
+            const float closestX = op.from.x + t * d.x;
+
+            auto inside = [&](int32_t x)
+            {
+                return Detail::segmentDistance2(glm::vec3(static_cast<float>(x) + 0.5f, py, pz), op.from, d, invLength2) <= r2;
+            };
+
+            // The voxel centres on either side of the closest point, if neither is inside none is
+            int32_t center = static_cast<int32_t>(std::floor(closestX - 0.5f));
+            if (!inside(center) && !inside(++center))
+            {
+                return false;
+            }
+
+            const int32_t reach = static_cast<int32_t>(std::ceil(std::abs(d.x) + op.radius)) + 1;
+
+            int32_t lo = center - reach; // Outside
+            int32_t hi = center;         // Inside
+            while (hi - lo > 1)
+            {
+                const int32_t mid = lo + (hi - lo) / 2;
+                (inside(mid) ? hi : lo) = mid;
+            }
+            x0 = hi;
+
+            lo = center;                 // Inside
+            hi = center + reach;         // Outside
+            while (hi - lo > 1)
+            {
+                const int32_t mid = lo + (hi - lo) / 2;
+                (inside(mid) ? lo : hi) = mid;
+            }
+            x1 = lo;
+            return true;
+        }
+        case EditShape::Paste:
+            break;
+        }
+        return false;
+    }
+
+    // Writes src[x] for every x in [x0, x1] of a 32 voxel chunk row where write is wanted
+    // (skipAir leaves the row alone where src is air). Returns a bit per voxel that changed.
+    inline uint32_t writeRow(VoxelID* row, const VoxelID* src, uint32_t x0, uint32_t x1, bool skipAir)
+    {
+        static_assert(CHUNK_SIZE_X == 32, "writeRow works on 32 voxel rows");
+
+#if defined(__AVX2__)
+        const __m256i lane = _mm256_setr_epi8(
+            0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15,
+            16, 17, 18, 19, 20, 21, 22, 23, 24, 25, 26, 27, 28, 29, 30, 31);
+        const __m256i old = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(row));
+        const __m256i value = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src));
+
+        __m256i write = _mm256_and_si256(
+            _mm256_cmpgt_epi8(lane, _mm256_set1_epi8(static_cast<char>(x0) - 1)),
+            _mm256_cmpgt_epi8(_mm256_set1_epi8(static_cast<char>(x1) + 1), lane));
+        if (skipAir)
+        {
+            write = _mm256_andnot_si256(_mm256_cmpeq_epi8(value, _mm256_setzero_si256()), write);
+        }
+
+        const uint32_t same = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(old, value)));
+        const uint32_t changed = static_cast<uint32_t>(_mm256_movemask_epi8(write)) & ~same;
+        if (changed != 0)
+        {
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(row), _mm256_blendv_epi8(old, value, write));
+        }
+        return changed;
+#else
+        uint32_t changed = 0;
+        for (uint32_t x = x0; x <= x1; ++x)
+        {
+            if ((skipAir && src[x] == AIR_VOXEL) || row[x] == src[x])
+            {
+                continue;
+            }
+            row[x] = src[x];
+            changed |= 1u << x;
+        }
+        return changed;
+#endif
+    }
+}
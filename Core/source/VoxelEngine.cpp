@@ -1,4 +1,5 @@
 ﻿#include "VoxelEngine.h"
+#include "ImageWriter.h"
 
 #define VMA_IMPLEMENTATION
 #include "vk_mem_alloc.h"
@@ -383,58 +384,43 @@ void VoxelEngine::createBLAS()
         return min + random * (max - min);
     };
 
-    const int numRandomSpheres = 25000000; 
-    for (int i = 0; i < numRandomSpheres; ++i)
-    {
-        float x = randFloat(-10000.0f, 10000.0f);
-        float y = randFloat(-10000.0f, 10000.0f);
-        float z = randFloat(-10000.0f, 10000.0f);
-        float radius = randFloat(3.5f, 12.0f);
-        spheres.push_back({ {x, y, z, radius} });
-    }
+    // Spheres are generated block by block and turned into AABBs right away, into the block buffer
+    // addBlasStreamed hashes and copies into the staging buffer. No array of all AABBs is kept,
+    // only the spheres stay on the host, for the sphere buffer.
+    const uint32_t numRandomSpheres = 25000000;
+    const uint32_t firstRandomSphere = static_cast<uint32_t>(spheres.size());
+    spheres.reserve(firstRandomSphere + numRandomSpheres);
 
-    uint32_t firstDynamicBlasIndex = static_cast<uint32_t>(-1); 
+    accelerationStructureManager.setFramesInFlight(MAX_FRAMES_IN_FLIGHT);
+    accelerationStructureManager.setCompactionEnabled(true); // The sphere BLAS is never rebuilt
+    accelerationStructureManager.addBlasStreamed(firstRandomSphere + numRandomSpheres, [&](uint32_t first, uint32_t count, VkAabbPositionsKHR* aabbs)
+    {
+        for (uint32_t i = std::max(first, firstRandomSphere); i < first + count; ++i)
+        {
+            float x = randFloat(-10000.0f, 10000.0f);
+            float y = randFloat(-10000.0f, 10000.0f);
+            float z = randFloat(-10000.0f, 10000.0f);
+            float radius = randFloat(3.5f, 12.0f);
+            spheres.push_back({ {x, y, z, radius} });
+        }
+        spheresToAabbs(&spheres[first].positionRadius, count, aabbs);
+    });
 
-    std::vector<VkAabbPositionsKHR> aabbVec;
+    // Spheres have no voxel data yet, give each a random solid material so the table is exercised
+    sphereMaterialIds.assign((spheres.size() + 3) / 4, 0);
     for (size_t i = 0; i < spheres.size(); ++i)
     {
-        const auto& sphere = spheres[i];
-
-        VkAabbPositionsKHR aabb = {
-            sphere.positionRadius.x - sphere.positionRadius.w,
-            sphere.positionRadius.y - sphere.positionRadius.w,
-            sphere.positionRadius.z - sphere.positionRadius.w,
-            sphere.positionRadius.x + sphere.positionRadius.w,
-            sphere.positionRadius.y + sphere.positionRadius.w,
-            sphere.positionRadius.z + sphere.positionRadius.w,
-        };
-
-        aabbVec.push_back(aabb);
+        const uint32_t id = STONE_VOXEL + static_cast<uint32_t>(std::rand()) % (TORCH_VOXEL - STONE_VOXEL + 1);
+        sphereMaterialIds[i / 4] |= id << ((i % 4) * 8);
     }
 
-	accelerationStructureManager.addBlas(aabbVec.data(), sizeof(VkAabbPositionsKHR) * aabbVec.size());
-
     VkTransformMatrixKHR transform = {
         1.0f, 0.0f, 0.0f, 0.0f,
         0.0f, 1.0f, 0.0f, 0.0f,
         0.0f, 0.0f, 1.0f, 0.0f,
     };
 
-   uint32_t instanceIndex = accelerationStructureManager.instantiateBlas(0, transform);
-
-	if (firstDynamicBlasIndex == static_cast<uint32_t>(-1))
-	{
-		 firstDynamicBlasIndex = instanceIndex;
-	}
-
-    if (firstDynamicBlasIndex != static_cast<uint32_t>(-1)) 
-    {
-        movingIndex = firstDynamicBlasIndex; 
-    } 
-    else if (!spheres.empty()) 
-    {
-        movingIndex = 0; 
-    }
+    movingInstance = accelerationStructureManager.instantiateBlas(0, transform);
 
     createSphereBuffer();    
 }
@@ -528,7 +514,7 @@ void VoxelEngine::createDescriptorSetsRT()
     poolSizes[2].type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
     poolSizes[2].descriptorCount = MAX_FRAMES_IN_FLIGHT;
     poolSizes[3].type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
-    poolSizes[3].descriptorCount = MAX_FRAMES_IN_FLIGHT;
+    poolSizes[3].descriptorCount = MAX_FRAMES_IN_FLIGHT * 3; // Spheres, sphere materials and the material table
 
     VkDescriptorPoolCreateInfo poolInfo{};
     poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
@@ -631,6 +617,34 @@ void VoxelEngine::updateDescriptorSetRT(uint32_t index)
     debugImageWrite.pImageInfo = &debugImageInfo;
     descriptorWrites.push_back(debugImageWrite);
 
+    VkDescriptorBufferInfo materialBufferInfo{};
+    materialBufferInfo.buffer = materialBuffers[index].handle;
+    materialBufferInfo.offset = 0;
+    materialBufferInfo.range = VK_WHOLE_SIZE;
+
+    VkWriteDescriptorSet materialWrite{};
+    materialWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    materialWrite.dstSet = descriptorSetsRT[index];
+    materialWrite.dstBinding = 5;
+    materialWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    materialWrite.descriptorCount = 1;
+    materialWrite.pBufferInfo = &materialBufferInfo;
+    descriptorWrites.push_back(materialWrite);
+
+    VkDescriptorBufferInfo sphereMaterialBufferInfo{};
+    sphereMaterialBufferInfo.buffer = sphereMaterialBuffer.handle;
+    sphereMaterialBufferInfo.offset = 0;
+    sphereMaterialBufferInfo.range = VK_WHOLE_SIZE;
+
+    VkWriteDescriptorSet sphereMaterialWrite{};
+    sphereMaterialWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    sphereMaterialWrite.dstSet = descriptorSetsRT[index];
+    sphereMaterialWrite.dstBinding = 6;
+    sphereMaterialWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+    sphereMaterialWrite.descriptorCount = 1;
+    sphereMaterialWrite.pBufferInfo = &sphereMaterialBufferInfo;
+    descriptorWrites.push_back(sphereMaterialWrite);
+
     vkUpdateDescriptorSets(VulkanContext::device, static_cast<uint32_t>(descriptorWrites.size()), descriptorWrites.data(), 0, nullptr);
 }
 
@@ -672,6 +686,18 @@ void VoxelEngine::createRayTracingPipeline()
     accumulationImageLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
     accumulationImageLayoutBinding.descriptorCount = 1;
     accumulationImageLayoutBinding.stageFlags = VK_SHADER_STAGE_RAYGEN_BIT_KHR;
+
+	VkDescriptorSetLayoutBinding materialBufferBinding{};
+	materialBufferBinding.binding = 5;
+	materialBufferBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	materialBufferBinding.descriptorCount = 1;
+	materialBufferBinding.stageFlags = VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR;
+
+	VkDescriptorSetLayoutBinding sphereMaterialBufferBinding{};
+	sphereMaterialBufferBinding.binding = 6;
+	sphereMaterialBufferBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	sphereMaterialBufferBinding.descriptorCount = 1;
+	sphereMaterialBufferBinding.stageFlags = VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR;
 	
 
 	std::vector<VkDescriptorSetLayoutBinding> bindings = {
@@ -679,7 +705,9 @@ void VoxelEngine::createRayTracingPipeline()
 	    resultImageLayoutBinding,
 		uniformBufferBinding,
 		sphereBufferBinding,
-		accumulationImageLayoutBinding
+		accumulationImageLayoutBinding,
+		materialBufferBinding,
+		sphereMaterialBufferBinding
 	};
 
 
@@ -693,7 +721,7 @@ void VoxelEngine::createRayTracingPipeline()
 	VkPushConstantRange pushConstantRange = {};
 	pushConstantRange.stageFlags = VK_SHADER_STAGE_CLOSEST_HIT_BIT_KHR; // Include closest hit stage
 	pushConstantRange.offset = 0;
-	pushConstantRange.size = sizeof(Constants);
+	pushConstantRange.size = sizeof(ShadingConstants);
 
 	VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo{};
 	pipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
@@ -856,6 +884,33 @@ void VoxelEngine::createSphereBuffer()
     sphereBuffer.create(VulkanContext::vmaAllocator, VulkanContext::device, bufferSize, VK_BUFFER_USAGE_SHADER_DEVICE_ADDRESS_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VulkanContext::vkGetBufferDeviceAddressKHR);
 
     sphereBuffer.uploadData(VulkanContext::vmaAllocator, VulkanContext::device, VulkanContext::graphicsQueue, spheres.data(), bufferSize);
+
+    VkDeviceSize materialIdsSize = sizeof(uint32_t) * sphereMaterialIds.size();
+    sphereMaterialBuffer.create(VulkanContext::vmaAllocator, VulkanContext::device, materialIdsSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VulkanContext::vkGetBufferDeviceAddressKHR);
+
+    sphereMaterialBuffer.uploadData(VulkanContext::vmaAllocator, VulkanContext::device, VulkanContext::graphicsQueue, sphereMaterialIds.data(), materialIdsSize);
+}
+
+void VoxelEngine::createMaterialBuffers()
+{
+    const VkDeviceSize bufferSize = sizeof(GpuMaterial) * MATERIAL_COUNT;
+
+    materialBuffers.resize(MAX_FRAMES_IN_FLIGHT);
+    materialBufferVersions.assign(MAX_FRAMES_IN_FLIGHT, 0);
+
+    for (uint32_t i = 0; i < MAX_FRAMES_IN_FLIGHT; ++i)
+    {
+        materialBuffers[i].create(VulkanContext::vmaAllocator, VulkanContext::device, bufferSize, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT, VulkanContext::vkGetBufferDeviceAddressKHR);
+        updateMaterialBuffer(i);
+    }
+}
+
+void VoxelEngine::updateMaterialBuffer(uint32_t frame)
+{
+    // Host-coherent and persistently mapped, the entries are visible at the next submit
+    GpuMaterial* mapped = static_cast<GpuMaterial*>(materialBuffers[frame].getMappedMemory());
+    materials.writeChanges(materialBufferVersions[frame], mapped);
+    materialBufferVersions[frame] = materials.getVersion();
 }
 
 void VoxelEngine::recordFrameCommands(VkCommandBuffer commandBuffer, uint32_t imageIndex, uint32_t currentFrame)
@@ -1047,6 +1102,40 @@ void VoxelEngine::updateUniformBuffersRT()
 	}
 }
 
+void VoxelEngine::renderCpuReference(const VkTransformMatrixKHR& transform)
+{
+    PERF_SCOPE("CPU Reference");
+
+    if (cpuReferenceBvh.isEmpty())
+    {
+        std::vector<VkAabbPositionsKHR> aabbs(spheres.size());
+        spheresToAabbs(&spheres[0].positionRadius, static_cast<uint32_t>(spheres.size()), aabbs.data());
+        cpuReferenceBvh.build(aabbs.data(), static_cast<uint32_t>(aabbs.size()));
+        cpuReferenceBvh4.collapse(cpuReferenceBvh);
+    }
+
+    // The moving instance is the only one and its custom index starts at the first sphere
+    CpuRayTracerScene scene;
+    scene.spheres = &spheres[0].positionRadius;
+    scene.sphereCount = static_cast<uint32_t>(spheres.size());
+    scene.sphereMaterialIds = sphereMaterialIds.data();
+    scene.materials = &materials;
+    scene.bvh = &cpuReferenceBvh;
+    scene.bvh4 = &cpuReferenceBvh4;
+    scene.objectToWorld = CpuRayTracerScene::toMatrix(transform);
+
+    CpuRenderSettings settings;
+    settings.width = swapChainExtent.width;
+    settings.height = swapChainExtent.height;
+    settings.bvhWidth = 4;
+
+    std::vector<glm::vec4> image;
+    cpuRayTracer.render(scene, uniformData.view_inverse, uniformData.proj_inverse, constants, settings, image);
+
+    ImageWriter::writePng("cpu_reference.png", settings.width, settings.height, &image[0].x);
+    ImageWriter::writeExr("cpu_reference.exr", settings.width, settings.height, &image[0].x);
+}
+
 void VoxelEngine::createCamera()
 {
 	fpsCamera = FirstPersonCamera({ 0.0f, 0.0f, 0.0f }, FOV, static_cast<float>(swapChainExtent.width) / static_cast<float>(swapChainExtent.height));
@@ -1143,6 +1232,12 @@ void VoxelEngine::drawFrameRT()
 	
     // Update uniform buffers for the current frame BEFORE recording commands
     updateUniformBuffersRT();
+    updateMaterialBuffer(currentFrame);
+
+    if (instanceCulling)
+    {
+        accelerationStructureManager.cullInstances(instanceCuller, fpsCamera.getViewProjectionMatrix(), fpsCamera.getPosition());
+    }
     
     // Acquire an image from the swap chain
     uint32_t imageIndex;
@@ -1315,4 +1410,10 @@ void VoxelEngine::cleanupRayTracing()
 	}
 	
 	sphereBuffer.destroy(VulkanContext::vmaAllocator);
+	sphereMaterialBuffer.destroy(VulkanContext::vmaAllocator);
+
+	for (auto& materialBuffer : materialBuffers)
+	{
+		materialBuffer.destroy(VulkanContext::vmaAllocator);
+	}
 }
@@ -22,6 +22,8 @@
 #include "AccelerationStructure.h"
 #include "Buffer.h"
 #include "PerformanceTimer.h"
+#include "MaterialRegistry.h"
+#include "CpuRayTracer.h"
 
 #include <iostream>
 #include <fstream>
@@ -120,6 +122,10 @@ public:
                 {
                     ImGui::Text("%s: %.2f micro seconds", key.c_str(), value);
                 }
+                for (const auto& [key, value] : PerformanceTimer::getInstance().counters)
+                {
+                    ImGui::Text("%s: %.3f", key.c_str(), value);
+                }
                 ImGui::Text("Sphere Count: %d", spheres.size());
 
 				ImGui::End();
@@ -129,6 +135,55 @@ public:
             ImGui::SliderFloat("Angle", &angle, 0.0f, 90.f, "%.2f");
             ImGui::End();
 
+            ImGui::Begin("Culling");
+            ImGui::Checkbox("Cull Instances", &instanceCulling);
+            bool occlusion = instanceCuller.isOcclusionEnabled();
+            ImGui::Checkbox("Occlusion", &occlusion);
+            instanceCuller.setOcclusionEnabled(occlusion);
+            ImGui::Text("Tested: %u", instanceCuller.getStats().tested);
+            ImGui::Text("Frustum Culled: %u", instanceCuller.getStats().frustumCulled);
+            ImGui::Text("Occlusion Culled: %u", instanceCuller.getStats().occlusionCulled);
+            ImGui::Text("TLAS Instances: %u / %u", accelerationStructureManager.getBuiltInstanceCount(), accelerationStructureManager.getInstanceCount());
+            ImGui::Text("Instances Uploaded: %u", accelerationStructureManager.getUploadedInstanceCount());
+            TLASUpdateSettings updateSettings = accelerationStructureManager.getUpdateSettings();
+            if (ImGui::SliderFloat("Rebuild Cost Ratio", &updateSettings.rebuildCostRatio, 0.0f, 3.0f, "%.2f"))
+            {
+                accelerationStructureManager.setUpdateSettings(updateSettings);
+            }
+            static const char* buildDecisionNames[] = { "None", "Refit", "Rebuild", "Quality Rebuild" };
+            ImGui::Text("TLAS Build: %s (cost %.3f)", buildDecisionNames[static_cast<int>(accelerationStructureManager.getLastBuildDecision())], accelerationStructureManager.getCostRatio());
+            const BlasCacheStats& blasCacheStats = accelerationStructureManager.getBlasCacheStats();
+            ImGui::Text("BLAS Cache: %u BLASes, %u pending destruction", blasCacheStats.entryCount, blasCacheStats.pendingDestructions);
+            ImGui::Text("BLAS Cache Hits: %.1f%% of %llu, %.2f MB saved", blasCacheStats.getHitRate() * 100.0f,
+                static_cast<unsigned long long>(blasCacheStats.lookups), blasCacheStats.bytesSaved / (1024.0 * 1024.0));
+            const BlasCompactionStats& compactionStats = accelerationStructureManager.getBlasCompactionStats();
+            ImGui::Text("BLAS Compaction: %u compacted, %.2f -> %.2f MB, %u pending", compactionStats.compacted,
+                compactionStats.originalBytes / (1024.0 * 1024.0), compactionStats.compactedBytes / (1024.0 * 1024.0), compactionStats.pending);
+            ImGui::End();
+
+            ImGui::Begin("Materials");
+            for (VoxelID id = STONE_VOXEL; id <= TORCH_VOXEL; ++id)
+            {
+                Material material = materials.get(id);
+                ImGui::PushID(id);
+                ImGui::Text("Voxel %d", id);
+                ImGui::ColorEdit3("Albedo", &material.albedo.r);
+                ImGui::SliderFloat("Emission", &material.emission, 0.0f, 16.0f, "%.2f");
+                ImGui::PopID();
+                materials.set(id, material);
+            }
+            ImGui::End();
+
+            ImGui::Begin("CPU Reference");
+            if (ImGui::Button("Render"))
+            {
+                cpuReferenceRequested = true;
+            }
+            ImGui::Text("Rays: %llu", static_cast<unsigned long long>(cpuRayTracer.getStats().rayCount));
+            ImGui::Text("Time: %.2f ms", cpuRayTracer.getStats().milliseconds);
+            ImGui::Text("Throughput: %.2f Mrays/s", cpuRayTracer.getStats().megaRaysPerSecond);
+            ImGui::End();
+
 
 			
 			ImGui::ShowDemoWindow();
@@ -145,7 +200,13 @@ public:
 			   0.0f, sin(angle * degToRad), cos(angle * degToRad), 0.0f,
             };
 
-            accelerationStructureManager.moveBlasInstance(movingIndex, transform);
+            accelerationStructureManager.moveBlasInstance(movingInstance, transform);
+
+            if (cpuReferenceRequested)
+            {
+                renderCpuReference(transform);
+                cpuReferenceRequested = false;
+            }
 
 			drawFrameRT();
 			
@@ -174,12 +235,7 @@ private:
         glm::vec3 position;
     };
 
-	struct Constants 
-    {
-	    alignas(16) glm::vec3 lightDir = glm::normalize(glm::vec3(1.0f, -1.0f, -1.0f));
-		alignas(16) glm::vec3 lightColor = glm::vec3(1.0f, 1.0f, 1.0f);
-		alignas(16) glm::vec3 ambientColor = glm::vec3(0.1f, 0.1f, 0.1f);	
-    } constants;
+    ShadingConstants constants;
 
     struct ImguiHandler
     {
@@ -410,7 +466,11 @@ private:
 	VkDescriptorSetLayout descriptorSetLayoutRT = VK_NULL_HANDLE;
 
     AccelerationStructureManager accelerationStructureManager;
-    uint32_t movingIndex = 0;
+    InstanceHandle movingInstance;
+
+    // Only primary rays are traced, so instances outside the view can be left out of the TLAS
+    ChunkCuller instanceCuller;
+    bool instanceCulling = true;
 
     std::vector<VkRayTracingShaderGroupCreateInfoKHR> shaderGroups{};
 
@@ -428,6 +488,21 @@ private:
 		{ {5, 5, 5, 3.0f} } 
 	};    
     Buffer<BufferType::DeviceLocal> sphereBuffer;
+
+    // VoxelID of every sphere, four per uint
+    std::vector<uint32_t> sphereMaterialIds;
+    Buffer<BufferType::DeviceLocal> sphereMaterialBuffer;
+
+    // One mirror per frame in flight so a delta upload never touches a table the GPU is reading
+    MaterialRegistry materials;
+    std::vector<Buffer<BufferType::HostVisible>> materialBuffers;
+    std::vector<uint64_t> materialBufferVersions;
+
+    // Same frame traced on the CPU, the BVH over the spheres is built on first use
+    CpuRayTracer cpuRayTracer;
+    BVH cpuReferenceBvh;
+    BVH4 cpuReferenceBvh4;
+    bool cpuReferenceRequested = false;
     
     static void framebufferResizeCallback(GLFWwindow* window, int width, int height)
     {
@@ -484,10 +559,16 @@ private:
 
     void createSphereBuffer();
 
+    void createMaterialBuffers();
+
+    void updateMaterialBuffer(uint32_t frame);
+
     void recordFrameCommands(VkCommandBuffer commandBuffer, uint32_t imageIndex, uint32_t currentFrame);
 
     void updateUniformBuffersRT();
 
+    void renderCpuReference(const VkTransformMatrixKHR& transform);
+
     void createCamera();
 
     void handleInput(GLFWwindow* window, float dt);
@@ -504,6 +585,7 @@ private:
 		createStorageImages();
 		createCamera();
 		createUniformBuffers();
+		createMaterialBuffers();
 		createBLAS();
 		createTLAS();
 		createRayTracingPipeline();
@@ -140,8 +140,11 @@ namespace VulkanContext
 	PFN_vkGetBufferDeviceAddressKHR vkGetBufferDeviceAddressKHR = nullptr;
 	PFN_vkCreateRayTracingPipelinesKHR vkCreateRayTracingPipelinesKHR = nullptr;
 	PFN_vkCmdTraceRaysKHR vkCmdTraceRaysKHR = nullptr;
+	PFN_vkCmdWriteAccelerationStructuresPropertiesKHR vkCmdWriteAccelerationStructuresPropertiesKHR = nullptr;
+	PFN_vkCmdCopyAccelerationStructureKHR vkCmdCopyAccelerationStructureKHR = nullptr;
 
 	VkPhysicalDeviceRayTracingPipelinePropertiesKHR rtProperties = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_RAY_TRACING_PIPELINE_PROPERTIES_KHR };
+	VkPhysicalDeviceAccelerationStructurePropertiesKHR accelerationStructureProperties = { VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ACCELERATION_STRUCTURE_PROPERTIES_KHR };
 
 
     const std::vector<const char*> validationLayers = 
@@ -575,6 +578,8 @@ namespace VulkanContext
 		}
 
         rtProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_RAY_TRACING_PIPELINE_PROPERTIES_KHR;
+        rtProperties.pNext = &accelerationStructureProperties;
+        accelerationStructureProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_ACCELERATION_STRUCTURE_PROPERTIES_KHR;
         VkPhysicalDeviceProperties2 prop2{VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2};
         prop2.pNext = &rtProperties;
 		vkGetPhysicalDeviceProperties2(physicalDevice, &prop2);
@@ -632,6 +637,8 @@ namespace VulkanContext
 		REGISTER_PFN(vkGetBufferDeviceAddressKHR);
 		REGISTER_PFN(vkCreateRayTracingPipelinesKHR);
 		REGISTER_PFN(vkCmdTraceRaysKHR);
+		REGISTER_PFN(vkCmdWriteAccelerationStructuresPropertiesKHR);
+		REGISTER_PFN(vkCmdCopyAccelerationStructureKHR);
 	}
 
 	void createCommandPool()
@@ -33,8 +33,11 @@ namespace VulkanContext
 	extern PFN_vkGetBufferDeviceAddressKHR vkGetBufferDeviceAddressKHR;
 	extern PFN_vkCreateRayTracingPipelinesKHR vkCreateRayTracingPipelinesKHR;
 	extern PFN_vkCmdTraceRaysKHR vkCmdTraceRaysKHR;
+	extern PFN_vkCmdWriteAccelerationStructuresPropertiesKHR vkCmdWriteAccelerationStructuresPropertiesKHR;
+	extern PFN_vkCmdCopyAccelerationStructureKHR vkCmdCopyAccelerationStructureKHR;
 
     extern VkPhysicalDeviceRayTracingPipelinePropertiesKHR rtProperties;
+    extern VkPhysicalDeviceAccelerationStructurePropertiesKHR accelerationStructureProperties; // Scratch alignment for batched builds
     
     extern const std::vector<const char*> validationLayers;
     extern const std::vector<const char*> deviceExtensions;
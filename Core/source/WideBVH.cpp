@@ -0,0 +1,138 @@
+#include "WideBVH.h"
+#include "Timer.h"
+
+namespace
+{
+    float surfaceArea(const BVHNode& node)
+    {
+        const glm::vec3 extent = glm::max(node.boundsMax - node.boundsMin, glm::vec3(0.0f));
+        return 2.0f * (extent.x * extent.y + extent.y * extent.z + extent.z * extent.x);
+    }
+}
+
+template<uint32_t Width>
+void WideBVH<Width>::collapse(const BVH& bvh)
+{
+    Timer timer;
+    timer.start();
+
+    clear();
+    const std::vector<BVHNode>& binaryNodes = bvh.getNodes();
+    if (binaryNodes.empty())
+    {
+        return;
+    }
+
+    m_primitiveIndices = bvh.getPrimitiveIndices();
+
+    // A binary tree of N nodes has (N + 1) / 2 leaves, a full wide node takes Width of them
+    m_nodes.reserve(binaryNodes.size() / (Width - 1) + 1);
+    m_nodes.emplace_back();
+
+    struct Task
+    {
+        uint32_t binaryIndex;
+        uint32_t wideIndex;
+        uint32_t depth;
+    };
+
+    std::vector<Task> tasks;
+    tasks.push_back({ 0, 0, 1 });
+    uint32_t usedSlots = 0;
+    while (!tasks.empty())
+    {
+        const Task task = tasks.back();
+        tasks.pop_back();
+        m_stats.maxDepth = std::max(m_stats.maxDepth, task.depth);
+
+        // Open the largest interior child until the node is full, a leaf root stays a single child
+        uint32_t children[Width];
+        uint32_t childCount = 0;
+        const BVHNode& root = binaryNodes[task.binaryIndex];
+        if (root.isLeaf())
+        {
+            children[childCount++] = task.binaryIndex;
+        }
+        else
+        {
+            children[childCount++] = root.leftFirst;
+            children[childCount++] = root.leftFirst + 1;
+        }
+
+        while (childCount < Width)
+        {
+            uint32_t largest = Width;
+            float largestArea = -1.0f;
+            for (uint32_t i = 0; i < childCount; ++i)
+            {
+                const BVHNode& child = binaryNodes[children[i]];
+                if (!child.isLeaf() && surfaceArea(child) > largestArea)
+                {
+                    largest = i;
+                    largestArea = surfaceArea(child);
+                }
+            }
+            if (largest == Width)
+            {
+                break;
+            }
+
+            const uint32_t opened = children[largest];
+            children[largest] = binaryNodes[opened].leftFirst;
+            children[childCount++] = binaryNodes[opened].leftFirst + 1;
+        }
+
+        Node node;
+        for (uint32_t slot = 0; slot < Width; ++slot)
+        {
+            if (slot >= childCount)
+            {
+                node.minX[slot] = node.minY[slot] = node.minZ[slot] = std::numeric_limits<float>::infinity();
+                node.maxX[slot] = node.maxY[slot] = node.maxZ[slot] = std::numeric_limits<float>::infinity();
+                node.child[slot] = Node::EMPTY;
+                node.count[slot] = 0;
+                continue;
+            }
+
+            const BVHNode& child = binaryNodes[children[slot]];
+            node.minX[slot] = child.boundsMin.x;
+            node.minY[slot] = child.boundsMin.y;
+            node.minZ[slot] = child.boundsMin.z;
+            node.maxX[slot] = child.boundsMax.x;
+            node.maxY[slot] = child.boundsMax.y;
+            node.maxZ[slot] = child.boundsMax.z;
+            if (child.isLeaf())
+            {
+                node.child[slot] = child.leftFirst;
+                node.count[slot] = child.primitiveCount;
+                m_stats.leafCount++;
+            }
+            else
+            {
+                node.child[slot] = static_cast<uint32_t>(m_nodes.size());
+                node.count[slot] = 0;
+                m_nodes.emplace_back();
+                tasks.push_back({ children[slot], node.child[slot], task.depth + 1 });
+            }
+        }
+        m_nodes[task.wideIndex] = node;
+        usedSlots += childCount;
+    }
+
+    timer.stop();
+    m_stats.nodeCount = static_cast<uint32_t>(m_nodes.size());
+    m_stats.averageChildCount = static_cast<float>(usedSlots) / m_stats.nodeCount;
+    m_stats.memoryBytes = m_nodes.size() * sizeof(Node) + m_primitiveIndices.size() * sizeof(uint32_t);
+    m_stats.collapseMilliseconds = timer.elapsedTime<std::chrono::microseconds>() / 1000.0;
+}
+
+template<uint32_t Width>
+void WideBVH<Width>::clear()
+{
+    m_nodes.clear();
+    m_primitiveIndices.clear();
+    m_stats = {};
+}
+
+template class WideBVH<4>;
+template class WideBVH<8>;
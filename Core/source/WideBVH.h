@@ -0,0 +1,264 @@
+#pragma once
+
+#include "BVH.h"
+
+#include <immintrin.h>
+
+#include <cstdint>
+#include <vector>
+#include <limits>
+
+// Node of a 4 or 8 wide BVH. Child bounds are stored per axis so one SIMD register holds the same
+// plane of every child. Unused slots come last, with child == EMPTY and a box at +infinity that
+// no ray can enter.
+template<uint32_t Width>
+struct alignas(64) WideBVHNode
+{
+    static constexpr uint32_t EMPTY = std::numeric_limits<uint32_t>::max();
+
+    float minX[Width];
+    float minY[Width];
+    float minZ[Width];
+    float maxX[Width];
+    float maxY[Width];
+    float maxZ[Width];
+    uint32_t child[Width];  // Node index for interior children, first primitive for leaves
+    uint32_t count[Width];  // Primitive count of leaves, 0 for interior children
+};
+static_assert(sizeof(WideBVHNode<4>) == 128 && sizeof(WideBVHNode<8>) == 256, "WideBVHNode is meant to fill whole cache lines");
+
+struct WideBVHStats
+{
+    uint32_t nodeCount = 0;
+    uint32_t leafCount = 0;
+    uint32_t maxDepth = 0;
+    float averageChildCount = 0.0f; // Used slots per node, Width is a full tree
+    size_t memoryBytes = 0;
+    double collapseMilliseconds = 0.0;
+};
+
+// BVH with 4 or 8 children per node, collapsed from a binary BVH.
+//
+// Every wide node takes over a binary node and repeatedly opens its interior child with the
+// largest surface area, until it has Width children or only leaves are left. Leaves and the
+// primitive order are those of the binary tree, so primitive indices mean the same in both.
+//
+// Traversal tests all children of a node at once: a single ray against the Width child boxes with
+// SSE (BVH4) or AVX2 (BVH8), and a BVHRayPacket child by child with its 8 rays in the lanes.
+template<uint32_t Width>
+class WideBVH
+{
+    static_assert(Width == 4 || Width == 8, "WideBVH supports 4 and 8 wide nodes");
+
+public:
+    using Node = WideBVHNode<Width>;
+
+    // Every node pushes at most Width - 1 siblings, and the collapsed tree is no deeper than the binary one
+    static constexpr uint32_t MAX_STACK = (Width - 1) * BVH::MAX_DEPTH + 1;
+
+    void collapse(const BVH& bvh);
+    void clear();
+
+    // Same contracts as BVH::intersect
+    template<typename IntersectFunc>
+    uint32_t intersect(const glm::vec3& origin, const glm::vec3& direction, float& tMax, IntersectFunc&& intersect) const;
+
+    template<typename IntersectFunc>
+    void intersect(BVHRayPacket& packet, IntersectFunc&& intersect) const;
+
+    const std::vector<Node>& getNodes() const { return m_nodes; }
+    const std::vector<uint32_t>& getPrimitiveIndices() const { return m_primitiveIndices; }
+    const WideBVHStats& getStats() const { return m_stats; }
+    bool isEmpty() const { return m_nodes.empty(); }
+
+private:
+    struct StackEntry
+    {
+        uint32_t child;
+        uint32_t count;
+        float entry;
+    };
+
+    // Children of the node the ray enters before tMax, as a bit mask, with their entry distances
+    static uint32_t intersectChildren(const Node& node, const glm::vec3& origin, const glm::vec3& inverseDirection, float tMax, float* entryDistances);
+
+    std::vector<Node> m_nodes;
+    std::vector<uint32_t> m_primitiveIndices;
+    WideBVHStats m_stats;
+};
+
+using BVH4 = WideBVH<4>;
+using BVH8 = WideBVH<8>;
+
+template<uint32_t Width>
+uint32_t WideBVH<Width>::intersectChildren(const Node& node, const glm::vec3& origin, const glm::vec3& inverseDirection, float tMax, float* entryDistances)
+{
+#if defined(__AVX2__)
+    if constexpr (Width == 8)
+    {
+        const __m256 originX = _mm256_set1_ps(origin.x);
+        const __m256 originY = _mm256_set1_ps(origin.y);
+        const __m256 originZ = _mm256_set1_ps(origin.z);
+        const __m256 inverseX = _mm256_set1_ps(inverseDirection.x);
+        const __m256 inverseY = _mm256_set1_ps(inverseDirection.y);
+        const __m256 inverseZ = _mm256_set1_ps(inverseDirection.z);
+
+        const __m256 t0x = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.minX), originX), inverseX);
+        const __m256 t1x = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.maxX), originX), inverseX);
+        const __m256 t0y = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.minY), originY), inverseY);
+        const __m256 t1y = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.maxY), originY), inverseY);
+        const __m256 t0z = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.minZ), originZ), inverseZ);
+        const __m256 t1z = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.maxZ), originZ), inverseZ);
+
+        const __m256 entry = _mm256_max_ps(
+            _mm256_max_ps(_mm256_min_ps(t0x, t1x), _mm256_min_ps(t0y, t1y)),
+            _mm256_max_ps(_mm256_min_ps(t0z, t1z), _mm256_setzero_ps()));
+        const __m256 exit = _mm256_min_ps(
+            _mm256_min_ps(_mm256_max_ps(t0x, t1x), _mm256_max_ps(t0y, t1y)),
+            _mm256_min_ps(_mm256_max_ps(t0z, t1z), _mm256_set1_ps(tMax)));
+        _mm256_storeu_ps(entryDistances, entry);
+        return static_cast<uint32_t>(_mm256_movemask_ps(_mm256_cmp_ps(entry, exit, _CMP_LE_OQ)));
+    }
+#endif
+#if defined(__AVX2__) || defined(__SSE2__) || defined(_M_X64)
+    if constexpr (Width == 4)
+    {
+        const __m128 originX = _mm_set1_ps(origin.x);
+        const __m128 originY = _mm_set1_ps(origin.y);
+        const __m128 originZ = _mm_set1_ps(origin.z);
+        const __m128 inverseX = _mm_set1_ps(inverseDirection.x);
+        const __m128 inverseY = _mm_set1_ps(inverseDirection.y);
+        const __m128 inverseZ = _mm_set1_ps(inverseDirection.z);
+
+        const __m128 t0x = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.minX), originX), inverseX);
+        const __m128 t1x = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.maxX), originX), inverseX);
+        const __m128 t0y = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.minY), originY), inverseY);
+        const __m128 t1y = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.maxY), originY), inverseY);
+        const __m128 t0z = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.minZ), originZ), inverseZ);
+        const __m128 t1z = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.maxZ), originZ), inverseZ);
+
+        const __m128 entry = _mm_max_ps(
+            _mm_max_ps(_mm_min_ps(t0x, t1x), _mm_min_ps(t0y, t1y)),
+            _mm_max_ps(_mm_min_ps(t0z, t1z), _mm_setzero_ps()));
+        const __m128 exit = _mm_min_ps(
+            _mm_min_ps(_mm_max_ps(t0x, t1x), _mm_max_ps(t0y, t1y)),
+            _mm_min_ps(_mm_max_ps(t0z, t1z), _mm_set1_ps(tMax)));
+        _mm_storeu_ps(entryDistances, entry);
+        return static_cast<uint32_t>(_mm_movemask_ps(_mm_cmple_ps(entry, exit)));
+    }
+#endif
+
+    uint32_t mask = 0;
+    for (uint32_t i = 0; i < Width; ++i)
+    {
+        const glm::vec2 hit = BVH::intersectBounds(origin, inverseDirection,
+            glm::vec3(node.minX[i], node.minY[i], node.minZ[i]), glm::vec3(node.maxX[i], node.maxY[i], node.maxZ[i]), tMax);
+        entryDistances[i] = hit.x;
+        mask |= (hit.x <= hit.y ? 1u : 0u) << i;
+    }
+    return mask;
+}
+
+template<uint32_t Width>
+template<typename IntersectFunc>
+uint32_t WideBVH<Width>::intersect(const glm::vec3& origin, const glm::vec3& direction, float& tMax, IntersectFunc&& intersect) const
+{
+    uint32_t hit = std::numeric_limits<uint32_t>::max();
+    if (m_nodes.empty())
+    {
+        return hit;
+    }
+
+    const glm::vec3 inverseDirection = BVH::safeInverse(direction);
+    StackEntry stack[MAX_STACK];
+    uint32_t stackSize = 0;
+    stack[stackSize++] = { 0, 0, 0.0f };
+    while (stackSize > 0)
+    {
+        const StackEntry current = stack[--stackSize];
+        if (current.entry > tMax)
+        {
+            continue;
+        }
+
+        if (current.count != 0)
+        {
+            for (uint32_t i = current.child; i < current.child + current.count; ++i)
+            {
+                if (intersect(m_primitiveIndices[i], tMax))
+                {
+                    hit = m_primitiveIndices[i];
+                }
+            }
+            continue;
+        }
+
+        const Node& node = m_nodes[current.child];
+        float entryDistances[Width];
+        uint32_t mask = intersectChildren(node, origin, inverseDirection, tMax, entryDistances);
+
+        // Pushed far to near so the nearest child is visited next
+        const uint32_t first = stackSize;
+        for (; mask != 0; mask &= mask - 1)
+        {
+            const uint32_t slot = std::countr_zero(mask);
+            StackEntry entry = { node.child[slot], node.count[slot], entryDistances[slot] };
+            uint32_t position = stackSize++;
+            for (; position > first && stack[position - 1].entry < entry.entry; --position)
+            {
+                stack[position] = stack[position - 1];
+            }
+            stack[position] = entry;
+        }
+    }
+    return hit;
+}
+
+template<uint32_t Width>
+template<typename IntersectFunc>
+void WideBVH<Width>::intersect(BVHRayPacket& packet, IntersectFunc&& intersect) const
+{
+    if (m_nodes.empty())
+    {
+        return;
+    }
+
+    // Ordered by the entry distance of the first ray entering each child, like the binary packet traversal
+    StackEntry stack[MAX_STACK];
+    uint32_t stackSize = 0;
+    stack[stackSize++] = { 0, 0, 0.0f };
+    while (stackSize > 0)
+    {
+        const StackEntry current = stack[--stackSize];
+        if (current.count != 0)
+        {
+            for (uint32_t i = current.child; i < current.child + current.count; ++i)
+            {
+                intersect(m_primitiveIndices[i]);
+            }
+            continue;
+        }
+
+        const Node& node = m_nodes[current.child];
+        const uint32_t first = stackSize;
+        for (uint32_t slot = 0; slot < Width && node.child[slot] != Node::EMPTY; ++slot)
+        {
+            alignas(32) float entryDistances[BVHRayPacket::SIZE];
+            const uint32_t mask = BVH::intersectBounds(packet,
+                glm::vec3(node.minX[slot], node.minY[slot], node.minZ[slot]),
+                glm::vec3(node.maxX[slot], node.maxY[slot], node.maxZ[slot]), entryDistances);
+            if (mask == 0)
+            {
+                continue;
+            }
+
+            StackEntry entry = { node.child[slot], node.count[slot], entryDistances[std::countr_zero(mask)] };
+            uint32_t position = stackSize++;
+            for (; position > first && stack[position - 1].entry < entry.entry; --position)
+            {
+                stack[position] = stack[position - 1];
+            }
+            stack[position] = entry;
+        }
+    }
+}
@@ -1 +1,645 @@
-#include "World.h"
\ No newline at end of file
+﻿#include "World.h"
+#include "LightEngine.h"
+#include "EditJournal.h"
+#include "CellularSimulation.h"
+#include "PerformanceTimer.h"
+
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <bit>
+
+namespace
+{
+	struct ChunkEdit
+	{
+		explicit ChunkEdit(Chunk* editedChunk) : chunk(editedChunk) {}
+
+		Chunk* chunk = nullptr;
+		uint64_t dirtyBricks = 0;
+		uint32_t changedVoxels = 0;
+		glm::ivec3 changedMin{ static_cast<int32_t>(CHUNK_SIZE_X) }; // Local bounds of the changed voxels
+		glm::ivec3 changedMax{ -1 };
+		std::vector<uint32_t> changes; // Only filled when someone listens, packed with VoxelEdit::packChange
+	};
+
+	// Rebuilds the derived data of a chunk once after all of its voxels were written
+	void finishChunkEdit(ChunkEdit& edit)
+	{
+		if (edit.changedVoxels == 0)
+		{
+			return;
+		}
+
+		Chunk& chunk = *edit.chunk;
+		chunk.occupancy.build(chunk.voxels.data());
+		chunk.mips.build(chunk.voxels.data());
+		chunk.dirtyBricks |= edit.dirtyBricks;
+		chunk.bumpVersion();
+	}
+
+	void editChunk(const EditOp& op, const glm::ivec3& min, const glm::ivec3& max, bool recordChanges, ChunkEdit& edit)
+	{
+		Chunk& chunk = *edit.chunk;
+		const glm::ivec3 origin = chunk.getWorldOrigin();
+		const glm::ivec3 lo = glm::max(min - origin, glm::ivec3(0));
+		const glm::ivec3 hi = glm::min(max - origin, glm::ivec3(CHUNK_SIZE_X - 1));
+
+		alignas(32) VoxelID values[CHUNK_SIZE_X];
+		alignas(32) VoxelID old[CHUNK_SIZE_X];
+		if (op.shape != EditShape::Paste)
+		{
+			std::memset(values, op.id, sizeof(values));
+		}
+
+		for (int32_t z = lo.z; z <= hi.z; ++z)
+		{
+			for (int32_t y = lo.y; y <= hi.y; ++y)
+			{
+				int32_t x0 = lo.x;
+				int32_t x1 = hi.x;
+				if (op.shape == EditShape::Paste)
+				{
+					const VoxelClipboard& clipboard = *op.clipboard;
+					const VoxelID* src = clipboard.voxels.data() + clipboard.index(origin.x + x0 - op.min.x, origin.y + y - op.min.y, origin.z + z - op.min.z);
+					std::memcpy(values + x0, src, static_cast<size_t>(x1 - x0 + 1));
+				}
+				else
+				{
+					int32_t spanMin;
+					int32_t spanMax;
+					if (!VoxelEdit::getRowSpan(op, origin.y + y, origin.z + z, spanMin, spanMax))
+					{
+						continue;
+					}
+					x0 = std::max(x0, spanMin - origin.x);
+					x1 = std::min(x1, spanMax - origin.x);
+					if (x0 > x1)
+					{
+						continue;
+					}
+				}
+
+				VoxelID* row = chunk.voxels.data() + Chunk::index(0, y, z);
+				if (recordChanges)
+				{
+					std::memcpy(old, row, sizeof(old));
+				}
+
+				const bool skipAir = op.shape == EditShape::Paste && !op.pasteAir;
+				const uint32_t changed = VoxelEdit::writeRow(row, values, x0, x1, skipAir);
+				if (changed == 0)
+				{
+					continue;
+				}
+
+				edit.changedVoxels += std::popcount(changed);
+				edit.changedMin = glm::min(edit.changedMin, glm::ivec3(std::countr_zero(changed), y, z));
+				edit.changedMax = glm::max(edit.changedMax, glm::ivec3(31 - std::countl_zero(changed), y, z));
+				for (uint32_t bx = 0; bx < ChunkOccupancy::BRICKS_PER_AXIS; ++bx)
+				{
+					if ((changed >> (bx * ChunkOccupancy::BRICK_SIZE)) & 0xFFu)
+					{
+						edit.dirtyBricks |= 1ull << ChunkOccupancy::brickIndex(bx, y >> ChunkOccupancy::BRICK_SHIFT, z >> ChunkOccupancy::BRICK_SHIFT);
+					}
+				}
+
+				if (recordChanges)
+				{
+					for (uint32_t bits = changed; bits != 0; bits &= bits - 1)
+					{
+						const uint32_t x = std::countr_zero(bits);
+						edit.changes.push_back(VoxelEdit::packChange(Chunk::index(x, y, z), old[x], row[x]));
+					}
+				}
+			}
+		}
+
+		finishChunkEdit(edit);
+	}
+
+	void writeChunkDelta(const ChunkDelta& delta, bool recordChanges, ChunkEdit& edit)
+	{
+		Chunk& chunk = *edit.chunk;
+		for (uint32_t change : delta.changes)
+		{
+			const uint32_t index = VoxelEdit::getChangeIndex(change);
+			const VoxelID newId = VoxelEdit::getChangeNew(change);
+			const VoxelID oldId = chunk.voxels[index];
+			// Voxels changed since outside the delta's history (simulation) keep their value
+			if (oldId == newId || oldId != VoxelEdit::getChangeOld(change))
+			{
+				continue;
+			}
+
+			chunk.voxels[index] = newId;
+			edit.changedVoxels++;
+
+			const uint32_t x = index & (CHUNK_SIZE_X - 1);
+			const uint32_t y = (index >> CHUNK_SIZE_SHIFT) & (CHUNK_SIZE_Y - 1);
+			const uint32_t z = index >> (CHUNK_SIZE_SHIFT * 2);
+			edit.dirtyBricks |= 1ull << ChunkOccupancy::brickIndex(x >> ChunkOccupancy::BRICK_SHIFT, y >> ChunkOccupancy::BRICK_SHIFT, z >> ChunkOccupancy::BRICK_SHIFT);
+			edit.changedMin = glm::min(edit.changedMin, glm::ivec3(x, y, z));
+			edit.changedMax = glm::max(edit.changedMax, glm::ivec3(x, y, z));
+
+			if (recordChanges)
+			{
+				edit.changes.push_back(VoxelEdit::packChange(index, oldId, newId));
+			}
+		}
+
+		finishChunkEdit(edit);
+	}
+
+	// Main thread half of a bulk edit: journal, simulation wake-ups, light notifications and one batched relight
+	EditResult commitEdits(std::vector<ChunkEdit>& edits, LightEngine* lightEngine, EditJournal* journal, CellularSimulation* simulation)
+	{
+		EditResult result;
+
+		if (journal != nullptr)
+		{
+			journal->beginGroup();
+		}
+
+		for (ChunkEdit& edit : edits)
+		{
+			if (edit.changedVoxels == 0)
+			{
+				continue;
+			}
+
+			result.chunkCount++;
+			result.changedVoxels += edit.changedVoxels;
+
+			if (journal != nullptr)
+			{
+				journal->record(edit.chunk->position, edit.changes);
+			}
+
+			if (simulation != nullptr)
+			{
+				const glm::ivec3 origin = edit.chunk->getWorldOrigin();
+				simulation->activateRegion(origin + edit.changedMin, origin + edit.changedMax);
+			}
+
+			if (lightEngine != nullptr)
+			{
+				lightEngine->onChunkEdited(*edit.chunk, std::move(edit.changes));
+			}
+		}
+
+		if (journal != nullptr)
+		{
+			journal->endGroup();
+		}
+
+		if (lightEngine != nullptr)
+		{
+			lightEngine->applyEdits();
+		}
+		return result;
+	}
+}
+
+void World::init(const ChunkResidencyConfig& residencyConfig, ChunkLoadFunction loader, RegionStore* regionStore)
+{
+	m_regionStore = regionStore;
+	m_residency.init(residencyConfig, std::move(loader));
+	m_residency.setOnChunkLoaded([this](Chunk& chunk) { onChunkLoaded(chunk); });
+	m_residency.setOnChunkEvicted([this](Chunk& chunk) { onChunkEvicted(chunk); });
+}
+
+void World::update(const FirstPersonCamera& camera)
+{
+	m_residency.update(camera);
+	publishSnapshots();
+}
+
+void World::destroy()
+{
+	m_residency.destroy();
+	m_chunks.clear();
+	m_aprons.clear();
+	m_snapshots.clear();
+
+	if (m_regionStore != nullptr)
+	{
+		m_regionStore->flush();
+	}
+}
+
+Chunk* World::getChunk(const glm::ivec3& chunkCoord) const
+{
+	Chunk* const* chunk = m_chunks.find(packChunkKey(chunkCoord));
+	return chunk != nullptr ? *chunk : nullptr;
+}
+
+bool World::setVoxel(int32_t x, int32_t y, int32_t z, VoxelID id)
+{
+	const glm::ivec3 voxelCoord(x, y, z);
+	Chunk* chunk = getChunk(worldToChunkCoord(voxelCoord));
+	if (chunk == nullptr)
+	{
+		return false;
+	}
+
+	const glm::ivec3 local = worldToLocalCoord(voxelCoord);
+	const VoxelID oldId = chunk->get(local.x, local.y, local.z);
+	if (oldId == id)
+	{
+		return true;
+	}
+
+	chunk->set(local.x, local.y, local.z, id);
+
+	if (m_editJournal != nullptr)
+	{
+		m_editJournal->record(chunk->position, { VoxelEdit::packChange(Chunk::index(local.x, local.y, local.z), oldId, id) });
+	}
+
+	if (m_lightEngine != nullptr)
+	{
+		m_lightEngine->onVoxelChanged(voxelCoord, oldId, id);
+	}
+
+	if (m_simulation != nullptr)
+	{
+		m_simulation->activate(voxelCoord);
+	}
+	return true;
+}
+
+EditResult World::applyEdit(const EditOp& op, ThreadPool& threadPool)
+{
+	PERF_SCOPE("Apply Edit");
+
+	glm::ivec3 min;
+	glm::ivec3 max;
+	if (!VoxelEdit::getBounds(op, min, max))
+	{
+		return {};
+	}
+
+	std::vector<ChunkEdit> edits;
+	const glm::ivec3 minChunk = worldToChunkCoord(min);
+	const glm::ivec3 maxChunk = worldToChunkCoord(max);
+	for (int32_t z = minChunk.z; z <= maxChunk.z; ++z)
+	{
+		for (int32_t y = minChunk.y; y <= maxChunk.y; ++y)
+		{
+			for (int32_t x = minChunk.x; x <= maxChunk.x; ++x)
+			{
+				Chunk* chunk = getChunk(glm::ivec3(x, y, z), m_lookupCache);
+				if (chunk != nullptr)
+				{
+					edits.emplace_back(chunk);
+				}
+			}
+		}
+	}
+
+	const bool recordChanges = m_lightEngine != nullptr || m_editJournal != nullptr;
+	threadPool.parallelFor(static_cast<uint32_t>(edits.size()), [&](uint32_t i)
+	{
+		editChunk(op, min, max, recordChanges, edits[i]);
+	});
+
+	return commitEdits(edits, m_lightEngine, m_editJournal, m_simulation);
+}
+
+EditResult World::applyChanges(const std::vector<ChunkDelta>& deltas, ThreadPool& threadPool)
+{
+	PERF_SCOPE("Apply Changes");
+
+	std::vector<ChunkEdit> edits;
+	std::vector<const ChunkDelta*> sources;
+	for (const ChunkDelta& delta : deltas)
+	{
+		Chunk* chunk = getChunk(delta.chunkCoord, m_lookupCache);
+		if (chunk != nullptr && !delta.changes.empty())
+		{
+			edits.emplace_back(chunk);
+			sources.push_back(&delta);
+		}
+	}
+
+	const bool recordChanges = m_lightEngine != nullptr || m_editJournal != nullptr;
+	threadPool.parallelFor(static_cast<uint32_t>(edits.size()), [&](uint32_t i)
+	{
+		writeChunkDelta(*sources[i], recordChanges, edits[i]);
+	});
+
+	return commitEdits(edits, m_lightEngine, m_editJournal, m_simulation);
+}
+
+void World::copyRegion(const glm::ivec3& min, const glm::ivec3& max, VoxelClipboard& clipboard) const
+{
+	const glm::ivec3 lo = glm::min(min, max);
+	const glm::ivec3 hi = glm::max(min, max);
+	clipboard.size = hi - lo + 1;
+	clipboard.voxels.assign(static_cast<size_t>(clipboard.size.x) * clipboard.size.y * clipboard.size.z, AIR_VOXEL);
+
+	const glm::ivec3 minChunk = worldToChunkCoord(lo);
+	const glm::ivec3 maxChunk = worldToChunkCoord(hi);
+	for (int32_t cz = minChunk.z; cz <= maxChunk.z; ++cz)
+	{
+		for (int32_t cy = minChunk.y; cy <= maxChunk.y; ++cy)
+		{
+			for (int32_t cx = minChunk.x; cx <= maxChunk.x; ++cx)
+			{
+				const Chunk* chunk = getChunk(glm::ivec3(cx, cy, cz));
+				if (chunk == nullptr)
+				{
+					continue;
+				}
+
+				const glm::ivec3 origin = chunk->getWorldOrigin();
+				const glm::ivec3 from = glm::max(lo, origin);
+				const glm::ivec3 to = glm::min(hi, origin + glm::ivec3(CHUNK_SIZE_X - 1));
+				for (int32_t z = from.z; z <= to.z; ++z)
+				{
+					for (int32_t y = from.y; y <= to.y; ++y)
+					{
+						const VoxelID* src = chunk->voxels.data() + Chunk::index(from.x - origin.x, y - origin.y, z - origin.z);
+						VoxelID* dst = clipboard.voxels.data() + clipboard.index(from.x - lo.x, y - lo.y, z - lo.z);
+						std::memcpy(dst, src, static_cast<size_t>(to.x - from.x + 1));
+					}
+				}
+			}
+		}
+	}
+}
+
+void World::cullChunks(ChunkCuller& culler, const glm::mat4& viewProjection, const glm::vec3& cameraPosition, float occluderDistance, std::vector<Chunk*>& visible)
+{
+	PERF_SCOPE("Cull Chunks");
+
+	culler.begin(viewProjection, cameraPosition);
+	m_cullCandidates.clear();
+
+	const glm::vec3 chunkSize(CHUNK_SIZE_X, CHUNK_SIZE_Y, CHUNK_SIZE_Z);
+	const float occluderDistance2 = occluderDistance * occluderDistance;
+
+	// Occluders have to be in the depth buffer before any chunk is tested
+	m_chunks.forEach([&](ChunkKey, Chunk*& chunk)
+	{
+		const glm::vec3 min(chunk->getWorldOrigin());
+		const glm::vec3 offset = glm::max(glm::max(min - cameraPosition, cameraPosition - (min + chunkSize)), glm::vec3(0.0f));
+		if (glm::dot(offset, offset) <= occluderDistance2)
+		{
+			culler.addChunkOccluders(*chunk);
+		}
+
+		culler.add(min, min + chunkSize, static_cast<uint32_t>(m_cullCandidates.size()));
+		m_cullCandidates.push_back(chunk);
+	});
+
+	culler.cull(m_cullVisible);
+
+	visible.clear();
+	for (uint32_t index : m_cullVisible)
+	{
+		visible.push_back(m_cullCandidates[index]);
+	}
+}
+
+const ChunkApron* World::getApron(const glm::ivec3& chunkCoord)
+{
+	Chunk* chunk = getChunk(chunkCoord);
+	if (chunk == nullptr)
+	{
+		return nullptr;
+	}
+
+	std::unique_ptr<ChunkApron>& apron = m_aprons[packChunkKey(chunkCoord)];
+	if (!apron)
+	{
+		apron = std::make_unique<ChunkApron>();
+	}
+
+	for (int32_t z = -1; z <= 1; ++z)
+	{
+		for (int32_t y = -1; y <= 1; ++y)
+		{
+			for (int32_t x = -1; x <= 1; ++x)
+			{
+				const glm::ivec3 offset(x, y, z);
+				const Chunk* neighbor = (x | y | z) == 0 ? chunk : getChunk(chunkCoord + offset);
+				apron->refreshRegion(offset, neighbor);
+			}
+		}
+	}
+
+	return apron.get();
+}
+
+ChunkSnapshotPtr World::acquireSnapshot(const glm::ivec3& chunkCoord)
+{
+	const std::shared_ptr<const ChunkSnapshotSlot> slot = getSnapshotSlot(chunkCoord);
+	return slot ? slot->load() : nullptr;
+}
+
+std::shared_ptr<const ChunkSnapshotSlot> World::getSnapshotSlot(const glm::ivec3& chunkCoord)
+{
+	Chunk* chunk = getChunk(chunkCoord);
+	if (chunk == nullptr)
+	{
+		return nullptr;
+	}
+
+	const ChunkKey key = packChunkKey(chunkCoord);
+	std::shared_ptr<ChunkSnapshotSlot>* slot = m_snapshots.find(key);
+	if (slot == nullptr)
+	{
+		slot = &m_snapshots.insert(key, std::make_shared<ChunkSnapshotSlot>());
+		chunk->dirtyBricks = ~0ull;
+	}
+
+	if (chunk->dirtyBricks != 0)
+	{
+		publishSnapshot(*chunk, **slot);
+	}
+	return *slot;
+}
+
+void World::publishSnapshots()
+{
+	PERF_SCOPE("Publish Snapshots");
+
+	m_snapshots.forEach([this](ChunkKey key, std::shared_ptr<ChunkSnapshotSlot>& slot)
+	{
+		Chunk* const* chunk = m_chunks.find(key);
+		if (chunk != nullptr && (*chunk)->dirtyBricks != 0)
+		{
+			publishSnapshot(**chunk, *slot);
+		}
+	});
+}
+
+ChunkSnapshotSlot* World::findSnapshotSlot(const glm::ivec3& chunkCoord)
+{
+	std::shared_ptr<ChunkSnapshotSlot>* slot = m_snapshots.find(packChunkKey(chunkCoord));
+	return slot != nullptr ? slot->get() : nullptr;
+}
+
+void World::publishSnapshot(Chunk& chunk, ChunkSnapshotSlot& slot)
+{
+	const ChunkSnapshotPtr previous = slot.load();
+	slot.publish(ChunkSnapshot::create(chunk, previous.get()));
+	chunk.dirtyBricks = 0;
+}
+
+RaycastHit World::raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, ChunkHashMap<Chunk*>::LookupCache& cache) const
+{
+	RaycastHit result;
+
+	const float length = glm::length(direction);
+	if (length == 0.0f || !(maxDistance >= 0.0f))
+	{
+		return result;
+	}
+
+	constexpr float INF = std::numeric_limits<float>::infinity();
+	const glm::vec3 dir = direction / length;
+	const glm::ivec3 step(dir.x >= 0.0f ? 1 : -1, dir.y >= 0.0f ? 1 : -1, dir.z >= 0.0f ? 1 : -1);
+	const glm::vec3 invDir(
+		dir.x != 0.0f ? 1.0f / dir.x : INF,
+		dir.y != 0.0f ? 1.0f / dir.y : INF,
+		dir.z != 0.0f ? 1.0f / dir.z : INF);
+
+	glm::ivec3 voxel(glm::floor(origin));
+	glm::ivec3 chunkCoord = worldToChunkCoord(voxel);
+	Chunk* const* chunk = m_chunks.find(packChunkKey(chunkCoord), cache);
+
+	float t = 0.0f;
+	int32_t enteredAxis = -1;
+
+	while (t <= maxDistance)
+	{
+		const glm::ivec3 voxelChunk = worldToChunkCoord(voxel);
+		if (voxelChunk != chunkCoord)
+		{
+			chunkCoord = voxelChunk;
+			chunk = m_chunks.find(packChunkKey(chunkCoord), cache);
+		}
+
+		// Size of the empty cell the ray is in: a whole chunk, an 8^3 brick or a single voxel
+		int32_t cellSize = 1;
+		if (chunk == nullptr || (*chunk)->occupancy.isEmpty())
+		{
+			cellSize = CHUNK_SIZE_X;
+		}
+		else
+		{
+			const glm::ivec3 local = worldToLocalCoord(voxel);
+			const ChunkOccupancy& occupancy = (*chunk)->occupancy;
+
+			if (occupancy.isBrickEmpty(local.x >> ChunkOccupancy::BRICK_SHIFT, local.y >> ChunkOccupancy::BRICK_SHIFT, local.z >> ChunkOccupancy::BRICK_SHIFT))
+			{
+				cellSize = ChunkOccupancy::BRICK_SIZE;
+			}
+			else if (occupancy.isSolid(local.x, local.y, local.z))
+			{
+				result.hit = true;
+				result.id = (*chunk)->get(local.x, local.y, local.z);
+				result.voxel = voxel;
+				result.distance = t;
+				if (enteredAxis >= 0)
+				{
+					result.normal[enteredAxis] = -step[enteredAxis];
+				}
+				return result;
+			}
+		}
+
+		// Exit the cell through the nearest boundary. Sizes are powers of two so masking gives
+		// the cell's min corner for negative coordinates too
+		const glm::ivec3 cellMin = voxel & glm::ivec3(-cellSize);
+		glm::vec3 tExit;
+		for (int32_t axis = 0; axis < 3; ++axis)
+		{
+			const float boundary = static_cast<float>(step[axis] > 0 ? cellMin[axis] + cellSize : cellMin[axis]);
+			tExit[axis] = dir[axis] != 0.0f ? (boundary - origin[axis]) * invDir[axis] : INF;
+		}
+
+		enteredAxis = tExit.x < tExit.y ? (tExit.x < tExit.z ? 0 : 2) : (tExit.y < tExit.z ? 1 : 2);
+		t = std::max(t, tExit[enteredAxis]);
+
+		if (cellSize == 1)
+		{
+			voxel[enteredAxis] += step[enteredAxis];
+			continue;
+		}
+
+		// Land in the neighbouring cell, clamping the other axes so float error can't move the ray sideways out of the cell
+		const glm::vec3 exitPoint = origin + dir * t;
+		for (int32_t axis = 0; axis < 3; ++axis)
+		{
+			if (axis == enteredAxis)
+			{
+				voxel[axis] = step[axis] > 0 ? cellMin[axis] + cellSize : cellMin[axis] - 1;
+			}
+			else
+			{
+				voxel[axis] = std::clamp(static_cast<int32_t>(std::floor(exitPoint[axis])), cellMin[axis], cellMin[axis] + cellSize - 1);
+			}
+		}
+	}
+
+	return result;
+}
+
+void World::raycastBatch(const std::vector<Ray>& rays, std::vector<RaycastHit>& hits, ThreadPool& threadPool) const
+{
+	PERF_SCOPE("Raycast Batch");
+
+	constexpr uint32_t RAYS_PER_JOB = 256;
+
+	hits.resize(rays.size());
+	const uint32_t rayCount = static_cast<uint32_t>(rays.size());
+	const uint32_t jobCount = (rayCount + RAYS_PER_JOB - 1) / RAYS_PER_JOB;
+
+	threadPool.parallelFor(jobCount, [this, &rays, &hits, rayCount](uint32_t job)
+	{
+		ChunkHashMap<Chunk*>::LookupCache cache;
+
+		const uint32_t end = std::min(rayCount, (job + 1) * RAYS_PER_JOB);
+		for (uint32_t i = job * RAYS_PER_JOB; i < end; ++i)
+		{
+			hits[i] = raycast(rays[i].origin, rays[i].direction, rays[i].maxDistance, cache);
+		}
+	});
+}
+
+void World::onChunkLoaded(Chunk& chunk)
+{
+	m_chunks.insert(packChunkKey(chunk.position), &chunk);
+
+	if (m_lightEngine != nullptr)
+	{
+		m_lightEngine->onChunkLoaded(chunk);
+	}
+}
+
+void World::onChunkEvicted(Chunk& chunk)
+{
+	m_chunks.erase(packChunkKey(chunk.position));
+	m_aprons.erase(packChunkKey(chunk.position));
+
+	if (m_lightEngine != nullptr)
+	{
+		m_lightEngine->onChunkEvicted(chunk);
+	}
+
+	ChunkSnapshotSlot* slot = findSnapshotSlot(chunk.position);
+	if (m_regionStore != nullptr && chunk.isModified())
+	{
+		// Compression and disk writes happen on the pool, only the dirty bricks are copied here
+		// when the chunk was already tracked
+		const ChunkSnapshotPtr previous = slot != nullptr ? slot->load() : nullptr;
+		m_regionStore->saveAsync(ChunkSnapshot::create(chunk, previous.get()));
+		chunk.savedVersion = chunk.version;
+	}
+
+	m_snapshots.erase(packChunkKey(chunk.position));
+}
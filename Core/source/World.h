@@ -1,21 +1,165 @@
-//#pragma once
-//
-//#include "Chunk.h"
-//
-//#include <stdint.h>
-//
-//class World
-//{
-//public:
-//	static constexpr uint32_t MAX_CHUNKS = 1000;
-//	World()
-//	{
-//		chunkPool.init(MAX_CHUNKS);
-//		chunkASManager.init(MAX_CHUNKS);
-//	}
-//
-//private:
-//	VoxelDataPool chunkPool;
-//	ChunkASManager chunkASManager;
-//
-//};
\ No newline at end of file
+#pragma once
+
+#include "Chunk.h"
+#include "ChunkResidency.h"
+#include "ChunkHashMap.h"
+#include "ChunkApron.h"
+#include "ChunkSnapshot.h"
+#include "VoxelEdit.h"
+#include "ChunkCulling.h"
+#include "FirstPersonCamera.h"
+#include "RegionFile.h"
+#include "Multithreading.h"
+
+#include <vector>
+#include <memory>
+#include <unordered_map>
+
+#include <stdint.h>
+
+class LightEngine;
+class EditJournal;
+class CellularSimulation;
+
+struct Ray
+{
+	glm::vec3 origin{ 0.0f };
+	glm::vec3 direction{ 0.0f, 0.0f, 1.0f };  // Doesn't need to be normalized
+	float maxDistance = 0.0f;
+};
+
+struct RaycastHit
+{
+	bool hit = false;
+	VoxelID id = AIR_VOXEL;
+	glm::ivec3 voxel{ 0 };   // World-space voxel that was hit
+	glm::ivec3 normal{ 0 };  // Face that was entered, zero if the ray started inside the voxel
+	float distance = 0.0f;   // Along the normalized direction
+};
+
+class World
+{
+public:
+	World() = default;
+	~World() { destroy(); }
+
+	World(const World&) = delete;
+	World& operator=(const World&) = delete;
+
+	// With a region store, modified chunks are written back to disk when they are evicted.
+	// Pass regionStore->makeChunkLoader(...) as the loader to read them back in.
+	void init(const ChunkResidencyConfig& residencyConfig, ChunkLoadFunction loader, RegionStore* regionStore = nullptr);
+
+	void update(const FirstPersonCamera& camera);
+
+	void destroy();
+
+	Chunk* getChunk(const glm::ivec3& chunkCoord) const;
+	Chunk* getChunk(const glm::ivec3& chunkCoord, ChunkHashMap<Chunk*>::LookupCache& cache) const
+	{
+		Chunk* const* chunk = m_chunks.find(packChunkKey(chunkCoord), cache);
+		return chunk != nullptr ? *chunk : nullptr;
+	}
+
+	template<typename Func>
+	void forEachChunk(Func&& func)
+	{
+		m_chunks.forEach([&func](ChunkKey, Chunk*& chunk) { func(*chunk); });
+	}
+
+	// Writes one voxel and keeps dependent systems (lighting, edit journal) up to date, false if the chunk isn't resident
+	bool setVoxel(int32_t x, int32_t y, int32_t z, VoxelID id);
+
+	// Bulk edit: the op is split per resident chunk and the chunks are edited in parallel, whole
+	// rows at a time. Each changed chunk gets its derived data rebuilt, one version bump and one
+	// notification to the light engine, which then relights everything in a single pass.
+	EditResult applyEdit(const EditOp& op, ThreadPool& threadPool = ThreadPool::getInstance());
+
+	// Writes the new value of every packed change through the same parallel per-chunk path,
+	// changes in chunks that aren't resident are dropped. A change only applies while its voxel
+	// still holds the old value, so writes made since without the journal (CellularSimulation)
+	// aren't overwritten. Used by EditJournal for undo/redo.
+	EditResult applyChanges(const std::vector<ChunkDelta>& deltas, ThreadPool& threadPool = ThreadPool::getInstance());
+
+	// Copies the inclusive box [min, max] for pasting with EditOp::paste, non-resident chunks read as air
+	void copyRegion(const glm::ivec3& min, const glm::ivec3& max, VoxelClipboard& clipboard) const;
+
+	// Notified about chunk loads, evictions and voxel edits, see LightEngine::init
+	void setLightEngine(LightEngine* lightEngine) { m_lightEngine = lightEngine; }
+	LightEngine* getLightEngine() const { return m_lightEngine; }
+
+	// Receives the changes of every setVoxel/applyEdit/applyChanges call so they can be undone, see EditJournal
+	void setEditJournal(EditJournal* journal) { m_editJournal = journal; }
+
+	// Woken around every voxel changed by setVoxel/applyEdit/applyChanges, so sand and water react to edits
+	void setSimulation(CellularSimulation* simulation) { m_simulation = simulation; }
+
+	// World-space voxel lookup, returns AIR_VOXEL for chunks that aren't resident.
+	// The overload without a cache uses the world's own last-hit cache and is main thread only.
+	VoxelID getVoxel(int32_t x, int32_t y, int32_t z) const { return getVoxel(x, y, z, m_lookupCache); }
+	VoxelID getVoxel(int32_t x, int32_t y, int32_t z, ChunkHashMap<Chunk*>::LookupCache& cache) const
+	{
+		const glm::ivec3 voxelCoord(x, y, z);
+		Chunk* const* chunk = m_chunks.find(packChunkKey(worldToChunkCoord(voxelCoord)), cache);
+		if (chunk == nullptr)
+		{
+			return AIR_VOXEL;
+		}
+
+		const glm::ivec3 local = worldToLocalCoord(voxelCoord);
+		return (*chunk)->get(local.x, local.y, local.z);
+	}
+
+	// Amanatides-Woo DDA through the resident chunks, non-resident chunks count as air.
+	// Empty chunks and empty 8^3 bricks are crossed in one step using the occupancy masks.
+	// Must not run concurrently with update(), which adds and removes chunks.
+	RaycastHit raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance) const { return raycast(origin, direction, maxDistance, m_lookupCache); }
+	RaycastHit raycast(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, ChunkHashMap<Chunk*>::LookupCache& cache) const;
+
+	// Traces the rays across the pool, hits[i] belongs to rays[i]
+	void raycastBatch(const std::vector<Ray>& rays, std::vector<RaycastHit>& hits, ThreadPool& threadPool = ThreadPool::getInstance()) const;
+
+	// Padded copy of the chunk and the bordering voxels of its neighbours, see ChunkApron.
+	// Built on first use and lazily refreshed from version stamps, nullptr if the chunk isn't resident.
+	// Main thread only, the pointer stays valid until the chunk is evicted.
+	const ChunkApron* getApron(const glm::ivec3& chunkCoord);
+
+	// Immutable copy of the chunk for background readers (saving, meshing), nullptr if it isn't resident.
+	// The first call starts tracking the chunk; from then on update() publishes a new version after
+	// edits, cloning only the touched bricks. Main thread only, the snapshot itself can go anywhere.
+	ChunkSnapshotPtr acquireSnapshot(const glm::ivec3& chunkCoord);
+
+	// Slot that always holds the chunk's latest published snapshot, for readers that outlive one
+	// frame. Stops receiving versions once the chunk is evicted. Main thread only.
+	std::shared_ptr<const ChunkSnapshotSlot> getSnapshotSlot(const glm::ivec3& chunkCoord);
+
+	// Publishes new versions of every tracked chunk edited since the last call, update() does this
+	void publishSnapshots();
+
+	// Resident chunks whose bounds survive frustum and occlusion culling, in no particular order.
+	// Chunks within occluderDistance of the camera (in voxels) contribute their solid bricks as occluders.
+	void cullChunks(ChunkCuller& culler, const glm::mat4& viewProjection, const glm::vec3& cameraPosition, float occluderDistance, std::vector<Chunk*>& visible);
+
+	ChunkResidencyManager& getResidencyManager() { return m_residency; }
+	uint32_t getChunkCount() const { return static_cast<uint32_t>(m_chunks.size()); }
+
+private:
+	void onChunkLoaded(Chunk& chunk);
+	void onChunkEvicted(Chunk& chunk);
+	ChunkSnapshotSlot* findSnapshotSlot(const glm::ivec3& chunkCoord);
+	static void publishSnapshot(Chunk& chunk, ChunkSnapshotSlot& slot);
+
+	ChunkResidencyManager m_residency;
+	RegionStore* m_regionStore = nullptr;
+	LightEngine* m_lightEngine = nullptr;
+	EditJournal* m_editJournal = nullptr;
+	CellularSimulation* m_simulation = nullptr;
+	ChunkHashMap<Chunk*> m_chunks;
+	std::unordered_map<ChunkKey, std::unique_ptr<ChunkApron>> m_aprons;
+	ChunkHashMap<std::shared_ptr<ChunkSnapshotSlot>> m_snapshots;
+	mutable ChunkHashMap<Chunk*>::LookupCache m_lookupCache;
+
+	// Scratch for cullChunks, kept to avoid per-frame allocations
+	std::vector<Chunk*> m_cullCandidates;
+	std::vector<uint32_t> m_cullVisible;
+};
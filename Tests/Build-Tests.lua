@@ -0,0 +1,52 @@
+project "Tests"
+   kind "ConsoleApp"
+   language "C++"
+   cppdialect "C++20"
+   vectorextensions "AVX2"
+   targetdir "Binaries/%{cfg.buildcfg}"
+   staticruntime "off"
+
+   files { "source/**.h", "source/**.cpp" }
+
+   includedirs
+   {
+        "%{IncludeDir.VulkanSDK}",
+        "%{IncludeDir.glm}",
+        "%{IncludeDir.vma}",
+        "source",
+
+	  -- Include Core
+	  "../Core/source"
+   }
+
+   links
+   {
+      "Core",
+   }
+
+   -- Golden images and other checked-in inputs are looked up in data/ relative to here
+   debugdir "."
+
+   targetdir ("../Binaries/" .. outputdir .. "/%{prj.name}")
+   objdir ("../Binaries/Intermediates/" .. outputdir .. "/%{prj.name}")
+
+   filter "system:windows"
+       systemversion "latest"
+       defines { "WINDOWS" }
+
+   filter "configurations:Debug"
+       defines { "DEBUG" }
+       runtime "Debug"
+       symbols "On"
+
+   filter "configurations:Release"
+       defines { "RELEASE" }
+       runtime "Release"
+       optimize "On"
+       symbols "On"
+
+   filter "configurations:Dist"
+        defines { "DIST" }
+        runtime "Release"
+        optimize "On"
+        symbols "Off"
@@ -0,0 +1,153 @@
+#include "TestFramework.h"
+
+#include "AabbKernels.h"
+#include "BlasCache.h"
+#include "Timer.h"
+
+#include <cfloat>
+#include <cstring>
+#include <random>
+#include <vector>
+#include <algorithm>
+
+// The two ways VoxelEngine::createBLAS has produced the upload of its random spheres, without a
+// device: host memory stands in for the mapped staging buffer. Both hash, bound and fill the
+// staging memory like AccelerationStructureManager::addBlas / addBlasStreamed do.
+namespace
+{
+    // AccelerationStructureManager::AABB_STREAM_BLOCK_SIZE
+    constexpr uint32_t STREAM_BLOCK_SIZE = 4096;
+
+    struct StagedBlas
+    {
+        std::vector<VkAabbPositionsKHR> staging;
+        uint64_t hash = 0;
+        glm::vec3 boundsMin = glm::vec3(FLT_MAX);
+        glm::vec3 boundsMax = glm::vec3(-FLT_MAX);
+    };
+
+    // Same ranges as createBLAS, from a seeded generator instead of std::rand
+    struct SphereGenerator
+    {
+        std::mt19937 random;
+        std::uniform_real_distribution<float> position{ -10000.0f, 10000.0f };
+        std::uniform_real_distribution<float> radius{ 3.5f, 12.0f };
+
+        explicit SphereGenerator(uint32_t seed) : random(seed) {}
+
+        glm::vec4 next()
+        {
+            const float x = position(random);
+            const float y = position(random);
+            const float z = position(random);
+            return glm::vec4(x, y, z, radius(random));
+        }
+    };
+
+    // Before: all spheres, then all AABBs, both grown by push_back, then copied into the staging memory
+    void stageFullArray(uint32_t count, uint32_t seed, std::vector<glm::vec4>& spheres, StagedBlas& staged)
+    {
+        SphereGenerator generator(seed);
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            spheres.push_back(generator.next());
+        }
+
+        std::vector<VkAabbPositionsKHR> aabbs;
+        for (const glm::vec4& sphere : spheres)
+        {
+            aabbs.push_back({ sphere.x - sphere.w, sphere.y - sphere.w, sphere.z - sphere.w, sphere.x + sphere.w, sphere.y + sphere.w, sphere.z + sphere.w });
+        }
+
+        staged.hash = BlasCache::hashAabbs(aabbs.data(), count);
+        expandAabbBounds(aabbs.data(), count, staged.boundsMin, staged.boundsMax);
+        staged.staging.resize(count);
+        std::memcpy(staged.staging.data(), aabbs.data(), aabbs.size() * sizeof(VkAabbPositionsKHR));
+    }
+
+    // Now: reserved spheres, generated and converted a block at a time through one cached block
+    void stageStreamed(uint32_t count, uint32_t seed, std::vector<glm::vec4>& spheres, StagedBlas& staged)
+    {
+        SphereGenerator generator(seed);
+        spheres.reserve(count);
+        staged.staging.resize(count);
+
+        AabbHasher hasher;
+        std::vector<VkAabbPositionsKHR> block(std::min(count, STREAM_BLOCK_SIZE));
+        for (uint32_t first = 0; first < count; first += STREAM_BLOCK_SIZE)
+        {
+            const uint32_t blockCount = std::min(count - first, STREAM_BLOCK_SIZE);
+            for (uint32_t i = 0; i < blockCount; ++i)
+            {
+                spheres.push_back(generator.next());
+            }
+            spheresToAabbs(&spheres[first], blockCount, block.data());
+
+            hasher.update(block.data(), blockCount);
+            expandAabbBounds(block.data(), blockCount, staged.boundsMin, staged.boundsMax);
+            std::memcpy(staged.staging.data() + first, block.data(), blockCount * sizeof(VkAabbPositionsKHR));
+        }
+        staged.hash = hasher.digest();
+    }
+}
+
+TEST_CASE(AabbStreamingMatchesFullArray)
+{
+    // Not a multiple of the block size, so the last block is partial
+    const uint32_t count = 3 * STREAM_BLOCK_SIZE + 77;
+    std::vector<glm::vec4> fullSpheres;
+    std::vector<glm::vec4> streamedSpheres;
+    StagedBlas full;
+    StagedBlas streamed;
+    stageFullArray(count, 5, fullSpheres, full);
+    stageStreamed(count, 5, streamedSpheres, streamed);
+
+    CHECK(fullSpheres == streamedSpheres);
+    CHECK_EQ(streamed.hash, full.hash);
+    CHECK(streamed.boundsMin == full.boundsMin && streamed.boundsMax == full.boundsMax);
+    REQUIRE(streamed.staging.size() == count);
+    CHECK(std::memcmp(streamed.staging.data(), full.staging.data(), count * sizeof(VkAabbPositionsKHR)) == 0);
+}
+
+// Peak resident memory and time of createBLAS's 25M spheres up to the build, streamed and with a
+// full AABB array. The peak only grows over the process, so the streamed variant runs first and
+// the benchmark is best run on its own: Tests --bench AabbStreamingPeakMemory
+BENCHMARK(AabbStreamingPeakMemory)
+{
+    const uint32_t count = 25000000;
+
+    // Spheres grown to 2^25, AABBs while growing to 2^25 and the staging memory
+    const size_t estimatedBytes = static_cast<size_t>(count) * 110;
+    const size_t physicalBytes = getPhysicalMemoryBytes();
+    if (physicalBytes != 0 && estimatedBytes > physicalBytes / 10 * 8)
+    {
+        reportMetric("skipped, estimated memory", estimatedBytes / double(1 << 20), "MiB");
+        return;
+    }
+
+    const size_t basePeak = getPeakResidentBytes();
+    reportMetric("peak before", basePeak / double(1 << 20), "MiB");
+
+    uint64_t streamedHash = 0;
+    {
+        std::vector<glm::vec4> spheres;
+        StagedBlas staged;
+        Timer timer;
+        stageStreamed(count, 1, spheres, staged);
+        timer.stop();
+        streamedHash = staged.hash;
+        reportMetric("streamed, time", timer.elapsedTime(), "ms");
+        reportMetric("streamed, peak increase", (getPeakResidentBytes() - basePeak) / double(1 << 20), "MiB");
+    }
+
+    {
+        std::vector<glm::vec4> spheres;
+        StagedBlas staged;
+        Timer timer;
+        stageFullArray(count, 1, spheres, staged);
+        timer.stop();
+        CHECK_EQ(staged.hash, streamedHash);
+        reportMetric("full array, time", timer.elapsedTime(), "ms");
+        reportMetric("full array, peak increase", (getPeakResidentBytes() - basePeak) / double(1 << 20), "MiB");
+    }
+}
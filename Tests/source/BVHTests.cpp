@@ -0,0 +1,391 @@
+#include "TestFramework.h"
+#include "TestScene.h"
+
+#include "BVH.h"
+#include "WideBVH.h"
+#include "Timer.h"
+
+#include <cstring>
+
+namespace
+{
+    constexpr uint32_t NO_HIT = std::numeric_limits<uint32_t>::max();
+
+    struct TestRay
+    {
+        glm::vec3 origin;
+        glm::vec3 direction;
+    };
+
+    struct RayHit
+    {
+        uint32_t primitive = NO_HIT;
+        float t = 0.0f;
+
+        bool operator==(const RayHit&) const = default;
+    };
+
+    // The same sphere at about the same distance. Where intersectSphere is inlined decides how the
+    // compiler fuses its multiply-adds, which moves t by a few ulps between the single ray and
+    // packet callers in optimized builds.
+    bool isSameHit(const RayHit& a, const RayHit& b)
+    {
+        return a.primitive == b.primitive && std::abs(a.t - b.t) <= 1e-4f * std::max(1.0f, std::abs(b.t));
+    }
+
+    // Camera rays in 4x2 pixel blocks, so every run of 8 makes one coherent packet
+    std::vector<TestRay> makeCameraRays(const SphereScene& scene, uint32_t width, uint32_t height)
+    {
+        std::vector<TestRay> rays;
+        rays.reserve(static_cast<size_t>(width) * height);
+        for (uint32_t by = 0; by < height; by += 2)
+        {
+            for (uint32_t bx = 0; bx < width; bx += 4)
+            {
+                for (uint32_t i = 0; i < BVHRayPacket::SIZE; ++i)
+                {
+                    TestRay ray;
+                    getSceneCameraRay(scene, bx + i % 4, by + i / 4, width, height, ray.origin, ray.direction);
+                    rays.push_back(ray);
+                }
+            }
+        }
+        return rays;
+    }
+
+    // Rays starting anywhere in the scene, in any direction
+    std::vector<TestRay> makeRandomRays(const SphereScene& scene, uint32_t count, uint32_t seed)
+    {
+        std::mt19937 random(seed);
+        std::uniform_real_distribution<float> position(0.0f, scene.extent);
+        std::normal_distribution<float> direction;
+        std::vector<TestRay> rays(count);
+        for (TestRay& ray : rays)
+        {
+            ray.origin = glm::vec3(position(random), position(random), position(random));
+            ray.direction = glm::normalize(glm::vec3(direction(random), direction(random), direction(random)));
+        }
+        return rays;
+    }
+
+    RayHit traceBruteForce(const SphereScene& scene, const TestRay& ray)
+    {
+        RayHit hit;
+        hit.t = std::numeric_limits<float>::max();
+        for (uint32_t i = 0; i < scene.spheres.size(); ++i)
+        {
+            if (intersectSphere(ray.origin, ray.direction, scene.spheres[i], hit.t))
+            {
+                hit.primitive = i;
+            }
+        }
+        return hit;
+    }
+
+    template<typename Tree>
+    RayHit traceSingle(const Tree& tree, const SphereScene& scene, const TestRay& ray)
+    {
+        RayHit hit;
+        hit.t = std::numeric_limits<float>::max();
+        hit.primitive = tree.intersect(ray.origin, ray.direction, hit.t, [&](uint32_t primitive, float& tMax)
+        {
+            return intersectSphere(ray.origin, ray.direction, scene.spheres[primitive], tMax);
+        });
+        return hit;
+    }
+
+    // Rays [first, first + count) as one packet, lanes past count left empty
+    template<typename Tree>
+    void tracePacket(const Tree& tree, const SphereScene& scene, const TestRay* rays, uint32_t count, RayHit* hits)
+    {
+        BVHRayPacket packet;
+        for (uint32_t lane = 0; lane < BVHRayPacket::SIZE; ++lane)
+        {
+            const TestRay& ray = rays[lane < count ? lane : 0];
+            setPacketRay(packet, lane, ray.origin, ray.direction, lane < count ? std::numeric_limits<float>::max() : -1.0f);
+        }
+
+        tree.intersect(packet, [&](uint32_t primitive)
+        {
+            intersectSpherePacket(packet, scene, primitive);
+        });
+
+        for (uint32_t lane = 0; lane < count; ++lane)
+        {
+            hits[lane] = { packet.primitive[lane], packet.tMax[lane] };
+        }
+    }
+
+    template<typename Tree>
+    uint32_t countPacketMismatches(const Tree& tree, const SphereScene& scene, const std::vector<TestRay>& rays, const std::vector<RayHit>& expected)
+    {
+        uint32_t mismatches = 0;
+        for (size_t first = 0; first < rays.size(); first += BVHRayPacket::SIZE)
+        {
+            // Every third packet is partly empty
+            const uint32_t count = (first / BVHRayPacket::SIZE) % 3 == 2 ? 5 : static_cast<uint32_t>(std::min<size_t>(BVHRayPacket::SIZE, rays.size() - first));
+            RayHit hits[BVHRayPacket::SIZE];
+            tracePacket(tree, scene, rays.data() + first, count, hits);
+            for (uint32_t lane = 0; lane < count; ++lane)
+            {
+                mismatches += isSameHit(hits[lane], expected[first + lane]) ? 0 : 1;
+            }
+        }
+        return mismatches;
+    }
+
+    template<typename Tree>
+    double measureSingleRays(const Tree& tree, const SphereScene& scene, const std::vector<TestRay>& rays, uint64_t& hitCount)
+    {
+        Timer timer;
+        for (const TestRay& ray : rays)
+        {
+            hitCount += traceSingle(tree, scene, ray).primitive != NO_HIT ? 1 : 0;
+        }
+        timer.stop();
+        return rays.size() / (timer.elapsedTime<std::chrono::microseconds>() * 1e-6) * 1e-6;
+    }
+
+    template<typename Tree>
+    double measurePackets(const Tree& tree, const SphereScene& scene, const std::vector<TestRay>& rays, uint64_t& hitCount)
+    {
+        Timer timer;
+        for (size_t first = 0; first < rays.size(); first += BVHRayPacket::SIZE)
+        {
+            RayHit hits[BVHRayPacket::SIZE];
+            tracePacket(tree, scene, rays.data() + first, BVHRayPacket::SIZE, hits);
+            for (const RayHit& hit : hits)
+            {
+                hitCount += hit.primitive != NO_HIT ? 1 : 0;
+            }
+        }
+        timer.stop();
+        return rays.size() / (timer.elapsedTime<std::chrono::microseconds>() * 1e-6) * 1e-6;
+    }
+}
+
+TEST_CASE(BVHTraversalMatchesBruteForce)
+{
+    const SphereScene scene = makeSphereScene(20000, 1);
+    std::vector<TestRay> rays = makeCameraRays(scene, 64, 32);
+    const std::vector<TestRay> randomRays = makeRandomRays(scene, 2048, 2);
+    rays.insert(rays.end(), randomRays.begin(), randomRays.end());
+
+    std::vector<RayHit> expected;
+    uint32_t hitCount = 0;
+    for (const TestRay& ray : rays)
+    {
+        expected.push_back(traceBruteForce(scene, ray));
+        hitCount += expected.back().primitive != NO_HIT ? 1 : 0;
+    }
+    // Mostly hits, and some rays leaving past the scene's edges
+    CHECK(hitCount > rays.size() / 2 && hitCount < rays.size());
+
+    BVH sahTree;
+    sahTree.build(scene.aabbs.data(), static_cast<uint32_t>(scene.aabbs.size()));
+    BVH linearTree;
+    linearTree.buildLinear(scene.aabbs.data(), static_cast<uint32_t>(scene.aabbs.size()));
+
+    for (const BVH* tree : { &sahTree, &linearTree })
+    {
+        uint32_t mismatches = 0;
+        for (size_t i = 0; i < rays.size(); ++i)
+        {
+            mismatches += traceSingle(*tree, scene, rays[i]) == expected[i] ? 0 : 1;
+        }
+        CHECK_EQ(mismatches, 0u);
+        CHECK_EQ(countPacketMismatches(*tree, scene, rays, expected), 0u);
+    }
+}
+
+TEST_CASE(WideBVHTraversalMatchesBinary)
+{
+    const SphereScene scene = makeSphereScene(20000, 3);
+    std::vector<TestRay> rays = makeCameraRays(scene, 64, 32);
+    const std::vector<TestRay> randomRays = makeRandomRays(scene, 2048, 4);
+    rays.insert(rays.end(), randomRays.begin(), randomRays.end());
+
+    for (bool linear : { false, true })
+    {
+        BVH bvh;
+        if (linear)
+        {
+            bvh.buildLinear(scene.aabbs.data(), static_cast<uint32_t>(scene.aabbs.size()));
+        }
+        else
+        {
+            bvh.build(scene.aabbs.data(), static_cast<uint32_t>(scene.aabbs.size()));
+        }
+        BVH4 bvh4;
+        bvh4.collapse(bvh);
+        BVH8 bvh8;
+        bvh8.collapse(bvh);
+
+        // Same leaves and primitive order as the binary tree
+        CHECK(bvh4.getPrimitiveIndices() == bvh.getPrimitiveIndices());
+        CHECK(bvh8.getPrimitiveIndices() == bvh.getPrimitiveIndices());
+        CHECK_EQ(bvh4.getStats().leafCount, bvh.getStats().leafCount);
+        CHECK_EQ(bvh8.getStats().leafCount, bvh.getStats().leafCount);
+        CHECK(bvh8.getStats().nodeCount < bvh4.getStats().nodeCount && bvh4.getStats().nodeCount < bvh.getStats().nodeCount);
+
+        // The binary single-ray hits are the reference for every other traversal
+        std::vector<RayHit> expected;
+        for (const TestRay& ray : rays)
+        {
+            expected.push_back(traceSingle(bvh, scene, ray));
+        }
+
+        uint32_t mismatches4 = 0;
+        uint32_t mismatches8 = 0;
+        for (size_t i = 0; i < rays.size(); ++i)
+        {
+            mismatches4 += traceSingle(bvh4, scene, rays[i]) == expected[i] ? 0 : 1;
+            mismatches8 += traceSingle(bvh8, scene, rays[i]) == expected[i] ? 0 : 1;
+        }
+        CHECK_EQ(mismatches4, 0u);
+        CHECK_EQ(mismatches8, 0u);
+        CHECK_EQ(countPacketMismatches(bvh4, scene, rays, expected), 0u);
+        CHECK_EQ(countPacketMismatches(bvh8, scene, rays, expected), 0u);
+    }
+
+    // A single leaf has no interior node to collapse
+    const SphereScene tiny = makeSphereScene(1, 5);
+    BVH bvh;
+    bvh.build(tiny.aabbs.data(), 1);
+    BVH8 bvh8;
+    bvh8.collapse(bvh);
+    const TestRay ray = { glm::vec3(tiny.spheres[0]) - glm::vec3(10.0f, 0.0f, 0.0f), glm::vec3(1.0f, 0.0f, 0.0f) };
+    CHECK(traceSingle(bvh8, tiny, ray) == traceSingle(bvh, tiny, ray));
+    CHECK_EQ(traceSingle(bvh8, tiny, ray).primitive, 0u);
+}
+
+TEST_CASE(BVHLinearBuildIsThreadCountInvariant)
+{
+    const SphereScene scene = makeSphereScene(100000, 6);
+    for (uint32_t mortonBits : { 30u, 63u })
+    {
+        LBVHBuildSettings settings;
+        settings.mortonBits = mortonBits;
+        ThreadPool onePool(1);
+        BVH reference;
+        reference.buildLinear(scene.aabbs.data(), static_cast<uint32_t>(scene.aabbs.size()), settings, onePool);
+
+        // Every internal node is emitted on its own, the pool's size mustn't show in the tree
+        for (uint32_t threadCount : { 3u, 16u })
+        {
+            ThreadPool threadPool(threadCount);
+            BVH bvh;
+            bvh.buildLinear(scene.aabbs.data(), static_cast<uint32_t>(scene.aabbs.size()), settings, threadPool);
+            CHECK(bvh.getPrimitiveIndices() == reference.getPrimitiveIndices());
+            REQUIRE(bvh.getNodes().size() == reference.getNodes().size());
+            CHECK(std::memcmp(bvh.getNodes().data(), reference.getNodes().data(), bvh.getNodes().size() * sizeof(BVHNode)) == 0);
+        }
+    }
+}
+
+BENCHMARK(BVHQualityAndThroughput)
+{
+    const size_t physicalBytes = getPhysicalMemoryBytes();
+    auto fits = [physicalBytes](size_t bytes) { return physicalBytes == 0 || bytes < physicalBytes / 10 * 8; };
+
+    const std::vector<uint32_t> sizes = { 1000000, 5000000, 25000000 };
+    for (uint32_t count : sizes)
+    {
+        // Scene, SAH build scratch and the tree
+        const size_t estimatedBytes = static_cast<size_t>(count) * 176;
+        const std::string prefix = std::to_string(count / 1000000) + "M spheres, ";
+        if (!fits(estimatedBytes))
+        {
+            reportMetric(prefix + "skipped, estimated memory", estimatedBytes / double(1 << 20), "MiB");
+            continue;
+        }
+
+        SphereScene scene = makeSphereScene(count, 1);
+        BVH bvh;
+        bvh.build(scene.aabbs.data(), count);
+        std::vector<VkAabbPositionsKHR>().swap(scene.aabbs);
+
+        const BVHStats& stats = bvh.getStats();
+        const size_t nodeBytes = bvh.getNodes().size() * sizeof(BVHNode);
+        reportMetric(prefix + "SAH build", stats.buildMilliseconds, "ms");
+        reportMetric(prefix + "SAH cost", stats.sahCost, "");
+        reportMetric(prefix + "nodes", stats.nodeCount, "");
+        reportMetric(prefix + "average leaf size", stats.averageLeafSize, "");
+        reportMetric(prefix + "max depth", stats.maxDepth, "");
+        reportMetric(prefix + "node memory", nodeBytes / double(1 << 20), "MiB");
+
+        const std::vector<TestRay> rays = makeCameraRays(scene, 512, 512);
+        uint64_t hitCount = 0;
+        uint64_t rayCount = 2 * rays.size();
+        reportMetric(prefix + "binary, single rays", measureSingleRays(bvh, scene, rays, hitCount), "Mrays/s");
+        reportMetric(prefix + "binary, packets", measurePackets(bvh, scene, rays, hitCount), "Mrays/s");
+
+        // The wide trees one at a time next to the binary one they collapse. Their nodes take
+        // about as much (BVH4) and up to 1.7x (BVH8) the binary node memory with these one-sphere leaves.
+        const size_t inUseBytes = count * (sizeof(glm::vec4) + sizeof(uint32_t)) + nodeBytes;
+        auto measureWide = [&]<uint32_t Width>(WideBVH<Width> wide)
+        {
+            const std::string name = prefix + "BVH" + std::to_string(Width);
+            const size_t wideBytes = (Width == 8 ? nodeBytes * 2 : nodeBytes / 4 * 5) + count * sizeof(uint32_t);
+            if (!fits(inUseBytes + wideBytes))
+            {
+                reportMetric(name + " skipped, estimated memory", (inUseBytes + wideBytes) / double(1 << 20), "MiB");
+                return;
+            }
+
+            wide.collapse(bvh);
+            reportMetric(name + " collapse", wide.getStats().collapseMilliseconds, "ms");
+            reportMetric(name + " average children", wide.getStats().averageChildCount, "");
+            reportMetric(name + " node memory", wide.getStats().memoryBytes / double(1 << 20), "MiB");
+            reportMetric(name + ", single rays", measureSingleRays(wide, scene, rays, hitCount), "Mrays/s");
+            reportMetric(name + ", packets", measurePackets(wide, scene, rays, hitCount), "Mrays/s");
+            rayCount += 2 * rays.size();
+        };
+        measureWide(BVH4());
+        measureWide(BVH8());
+
+        reportMetric(prefix + "hit rate", static_cast<double>(hitCount) / rayCount, "");
+        reportMetric(prefix + "peak resident", getPeakResidentBytes() / double(1 << 20), "MiB");
+    }
+}
+
+BENCHMARK(BVHLinearBuildScaling)
+{
+    const std::vector<uint32_t> sizes = { 1000000, 5000000, 25000000 };
+    const std::vector<uint32_t> threadCounts = { 1, 2, 4, 8, 16 };
+    for (uint32_t count : sizes)
+    {
+        // Scene, Morton codes and sort buffers, and the tree
+        const size_t estimatedBytes = static_cast<size_t>(count) * 176;
+        const std::string prefix = std::to_string(count / 1000000) + "M spheres, ";
+        if (getPhysicalMemoryBytes() != 0 && estimatedBytes > getPhysicalMemoryBytes() / 10 * 8)
+        {
+            reportMetric(prefix + "skipped, estimated memory", estimatedBytes / double(1 << 20), "MiB");
+            continue;
+        }
+
+        const SphereScene scene = makeSphereScene(count, 1);
+        BVH bvh;
+        for (uint32_t threadCount : threadCounts)
+        {
+            // The calling thread works through the parallel loops next to the pool's threads
+            ThreadPool threadPool(threadCount);
+            bvh.buildLinear(scene.aabbs.data(), count, {}, threadPool);
+            const std::string name = prefix + std::to_string(threadCount) + " pool threads";
+            reportMetric(name + ", build", bvh.getStats().buildMilliseconds, "ms");
+            reportMetric(name + ", build rate", count / (bvh.getStats().buildMilliseconds * 1000.0), "Mprims/s");
+
+            bvh.refit(scene.aabbs.data(), count, threadPool);
+            reportMetric(name + ", refit", bvh.getStats().refitMilliseconds, "ms");
+        }
+        reportMetric(prefix + "30-bit codes, SAH cost", bvh.computeSahCost(), "");
+
+        LBVHBuildSettings settings;
+        settings.mortonBits = 63;
+        ThreadPool threadPool(threadCounts.back());
+        bvh.buildLinear(scene.aabbs.data(), count, settings, threadPool);
+        reportMetric(prefix + "63-bit codes, build", bvh.getStats().buildMilliseconds, "ms");
+        reportMetric(prefix + "63-bit codes, SAH cost", bvh.computeSahCost(), "");
+        reportMetric(prefix + "peak resident", getPeakResidentBytes() / double(1 << 20), "MiB");
+    }
+}
@@ -0,0 +1,245 @@
+#include "TestFramework.h"
+
+#include "BlasCache.h"
+#include "TerrainGenerator.h"
+#include "Timer.h"
+
+#include <memory>
+#include <vector>
+#include <algorithm>
+
+namespace
+{
+    std::vector<VkAabbPositionsKHR> makeAabbs(uint32_t count)
+    {
+        std::vector<VkAabbPositionsKHR> aabbs(count);
+        float* values = &aabbs[0].minX;
+        for (uint32_t i = 0; i < count * 6; ++i)
+        {
+            values[i] = static_cast<float>(i) * 0.5f;
+        }
+        return aabbs;
+    }
+
+    std::vector<uint32_t> collect(BlasCache& cache)
+    {
+        std::vector<uint32_t> released;
+        cache.collect(released);
+        return released;
+    }
+}
+
+TEST_CASE(BlasCacheHashIsXxh64)
+{
+    // Reference XXH64 with seed 0 over the raw floats
+    CHECK_EQ(BlasCache::hashAabbs(nullptr, 0), 0xEF46DB3751D8E999ull);
+    CHECK_EQ(BlasCache::hashAabbs(makeAabbs(1).data(), 1), 0x6C7B70F3FCD6B177ull);
+    CHECK_EQ(BlasCache::hashAabbs(makeAabbs(3).data(), 3), 0xE6BDC0378FC518D2ull);
+    CHECK_EQ(BlasCache::hashAabbs(makeAabbs(7).data(), 7), 0xDB5E0C9B53C2EADBull);
+
+    // Blocks of any size, against the 32-byte stripes, hash like the whole array
+    const std::vector<VkAabbPositionsKHR> aabbs = makeAabbs(100);
+    const uint64_t expected = BlasCache::hashAabbs(aabbs.data(), 100);
+    for (uint32_t blockSize : { 1u, 3u, 4u, 7u, 64u })
+    {
+        AabbHasher hasher;
+        for (uint32_t first = 0; first < 100; first += blockSize)
+        {
+            hasher.update(aabbs.data() + first, std::min(blockSize, 100 - first));
+        }
+        CHECK_EQ(hasher.digest(), expected);
+    }
+}
+
+TEST_CASE(BlasCacheRefcountsAndDeferredCollect)
+{
+    BlasCache cache(2);
+    const uint64_t hash = BlasCache::hashAabbs(makeAabbs(3).data(), 3);
+    CHECK_EQ(cache.acquire(hash, 3), BlasCache::NOT_FOUND);
+    cache.insert(5, hash, 3, 1000);
+    CHECK(cache.contains(5));
+    CHECK(!cache.contains(4));
+
+    // A second owner shares the BLAS, the same hash with another primitive count doesn't
+    CHECK_EQ(cache.acquire(hash, 3), 5u);
+    CHECK_EQ(cache.acquire(hash, 4), BlasCache::NOT_FOUND);
+    CHECK_EQ(cache.getOwnerCount(5), 2u);
+    CHECK_EQ(cache.getStats().bytesSaved, 1000u);
+    CHECK_EQ(cache.getStats().hits, 1u);
+    CHECK_EQ(cache.getStats().lookups, 3u);
+
+    // Instances keep it referenced after its owners are gone
+    cache.addInstance(5);
+    cache.addInstance(5);
+    cache.releaseOwner(5);
+    CHECK_EQ(cache.getStats().bytesSaved, 0u);
+    cache.releaseOwner(5);
+    cache.releaseOwner(5); // Once too often, ignored
+    CHECK_EQ(cache.getOwnerCount(5), 0u);
+    CHECK(cache.isReferenced(5));
+    cache.releaseInstance(5);
+    CHECK(cache.isReferenced(5));
+    CHECK_EQ(cache.getStats().pendingDestructions, 0u);
+
+    // The last reference leaves it pending, the frames in flight still see it
+    cache.releaseInstance(5);
+    CHECK(!cache.isReferenced(5));
+    CHECK(cache.contains(5));
+    CHECK_EQ(cache.getStats().pendingDestructions, 1u);
+    CHECK(collect(cache).empty());
+    CHECK(cache.contains(5));
+
+    const std::vector<uint32_t> released = collect(cache);
+    REQUIRE(released.size() == 1);
+    CHECK_EQ(released[0], 5u);
+    CHECK(!cache.contains(5));
+    CHECK_EQ(cache.getStats().entryCount, 0u);
+    CHECK_EQ(cache.getStats().pendingDestructions, 0u);
+    CHECK(collect(cache).empty());
+    CHECK_EQ(cache.acquire(hash, 3), BlasCache::NOT_FOUND);
+}
+
+TEST_CASE(BlasCacheRevivesPendingBlas)
+{
+    BlasCache cache(3);
+    const uint64_t hash = BlasCache::hashAabbs(makeAabbs(7).data(), 7);
+    cache.insert(0, hash, 7, 500);
+    cache.releaseOwner(0);
+    CHECK(collect(cache).empty());
+    CHECK(collect(cache).empty());
+
+    // A lookup of the same content brings it back before its last frame
+    CHECK_EQ(cache.acquire(hash, 7), 0u);
+    CHECK_EQ(cache.getStats().pendingDestructions, 0u);
+    for (uint32_t frame = 0; frame < 5; ++frame)
+    {
+        CHECK(collect(cache).empty());
+    }
+    CHECK(cache.contains(0));
+
+    // Released again, the wait starts over from this frame
+    cache.releaseOwner(0);
+    CHECK(collect(cache).empty());
+    CHECK(collect(cache).empty());
+
+    // An instance revives it too, and a release and revive within one frame leaves nothing behind
+    cache.addInstance(0);
+    cache.releaseInstance(0);
+    cache.addInstance(0);
+    CHECK_EQ(cache.getStats().pendingDestructions, 0u);
+    for (uint32_t frame = 0; frame < 5; ++frame)
+    {
+        CHECK(collect(cache).empty());
+    }
+
+    cache.releaseInstance(0);
+    CHECK(collect(cache).empty());
+    CHECK(collect(cache).empty());
+    CHECK_EQ(collect(cache).size(), 1u);
+    CHECK(!cache.contains(0));
+}
+
+TEST_CASE(BlasCacheRemoveAndResize)
+{
+    BlasCache cache(2);
+    const uint64_t hashA = BlasCache::hashAabbs(makeAabbs(1).data(), 1);
+    const uint64_t hashB = BlasCache::hashAabbs(makeAabbs(3).data(), 3);
+    cache.insert(0, hashA, 1, 100);
+    cache.insert(1, hashB, 3, 300);
+    CHECK_EQ(cache.acquire(hashB, 3), 1u);
+    CHECK_EQ(cache.acquire(hashB, 3), 1u);
+    CHECK_EQ(cache.getStats().bytesSaved, 600u);
+
+    // A compacted copy changes what the duplicates would have cost
+    cache.setMemorySize(1, 120);
+    CHECK_EQ(cache.getStats().bytesSaved, 240u);
+
+    // Removing drops it from lookups and the savings at once
+    cache.remove(1);
+    CHECK(!cache.contains(1));
+    CHECK_EQ(cache.getStats().bytesSaved, 0u);
+    CHECK_EQ(cache.acquire(hashB, 3), BlasCache::NOT_FOUND);
+
+    // A pending BLAS removed before its time is never handed out by collect
+    cache.releaseOwner(0);
+    CHECK_EQ(cache.getStats().pendingDestructions, 1u);
+    cache.remove(0);
+    CHECK_EQ(cache.getStats().pendingDestructions, 0u);
+    CHECK_EQ(cache.getStats().entryCount, 0u);
+    for (uint32_t frame = 0; frame < 4; ++frame)
+    {
+        CHECK(collect(cache).empty());
+    }
+
+    // The slot can be used again
+    cache.insert(0, hashB, 3, 300);
+    CHECK_EQ(cache.acquire(hashB, 3), 0u);
+}
+
+// Terrain chunks as the BLASes they would make, one AABB per solid voxel in chunk space, through
+// the cache like addBlases does it. Identical chunks, like the ones deep in stone, share a BLAS.
+// Without a device the AABB array size stands in for the BLAS memory, the real one is larger.
+BENCHMARK(BlasCacheTerrainChunks)
+{
+    const TerrainGenerator terrain;
+    BlasCache cache;
+    auto chunk = std::make_unique<Chunk>();
+    std::vector<VkAabbPositionsKHR> aabbs;
+
+    uint32_t blasCount = 0;
+    uint64_t aabbCount = 0;
+    double hashMilliseconds = 0.0;
+    for (int32_t z = 0; z < 16; ++z)
+    {
+        for (int32_t y = -6; y < 2; ++y)
+        {
+            for (int32_t x = 0; x < 16; ++x)
+            {
+                chunk->position = glm::ivec3(x, y, z);
+                terrain.generate(*chunk);
+
+                aabbs.clear();
+                for (uint32_t vz = 0; vz < CHUNK_SIZE_Z; ++vz)
+                {
+                    for (uint32_t vy = 0; vy < CHUNK_SIZE_Y; ++vy)
+                    {
+                        for (uint32_t vx = 0; vx < CHUNK_SIZE_X; ++vx)
+                        {
+                            if (chunk->get(vx, vy, vz) != AIR_VOXEL)
+                            {
+                                const float fx = static_cast<float>(vx);
+                                const float fy = static_cast<float>(vy);
+                                const float fz = static_cast<float>(vz);
+                                aabbs.push_back({ fx, fy, fz, fx + 1.0f, fy + 1.0f, fz + 1.0f });
+                            }
+                        }
+                    }
+                }
+                if (aabbs.empty())
+                {
+                    continue;
+                }
+
+                const uint32_t primitiveCount = static_cast<uint32_t>(aabbs.size());
+                Timer timer;
+                const uint64_t hash = BlasCache::hashAabbs(aabbs.data(), primitiveCount);
+                timer.stop();
+                hashMilliseconds += timer.elapsedTime<std::chrono::microseconds>() * 1e-3;
+                aabbCount += primitiveCount;
+
+                if (cache.acquire(hash, primitiveCount) == BlasCache::NOT_FOUND)
+                {
+                    cache.insert(blasCount++, hash, primitiveCount, primitiveCount * sizeof(VkAabbPositionsKHR));
+                }
+            }
+        }
+    }
+
+    const BlasCacheStats& stats = cache.getStats();
+    CHECK_EQ(stats.entryCount, blasCount);
+    reportMetric("chunks with solid voxels", static_cast<double>(stats.lookups), "");
+    reportMetric("unique BLASes", blasCount, "");
+    reportMetric("hit rate", stats.getHitRate() * 100.0, "%");
+    reportMetric("bytes saved", stats.bytesSaved / double(1 << 20), "MiB");
+    reportMetric("hashing", aabbCount * sizeof(VkAabbPositionsKHR) / (hashMilliseconds * 1e3), "MB/s");
+}
@@ -0,0 +1,151 @@
+#include "TestFramework.h"
+
+#include "BlasCompaction.h"
+
+#include <vector>
+
+namespace
+{
+    std::vector<BlasCompactionCopy> takeCopies(BlasCompaction& compaction, VkDeviceSize maxBytes)
+    {
+        std::vector<BlasCompactionCopy> copies;
+        compaction.takeCopies(copies, maxBytes);
+        return copies;
+    }
+
+    std::vector<uint32_t> collect(BlasCompaction& compaction)
+    {
+        std::vector<uint32_t> retired;
+        compaction.collect(retired);
+        return retired;
+    }
+}
+
+TEST_CASE(BlasCompactionRequestCopyRetire)
+{
+    BlasCompaction compaction(2);
+    CHECK(compaction.request(0, 1000));
+    CHECK(!compaction.request(0, 1000));
+    CHECK(compaction.request(3, 2000));
+    CHECK(compaction.request(5, 1000));
+    CHECK(compaction.request(7, 500));
+    CHECK(compaction.getState(3) == BlasCompactionState::SizeQueried);
+    CHECK(compaction.getState(4) == BlasCompactionState::None);
+    CHECK(compaction.getState(100) == BlasCompactionState::None);
+    CHECK_EQ(compaction.getStats().pending, 4u);
+
+    // Saving 5% isn't worth a copy, the BLAS stays as it is
+    compaction.setCompactedSize(5, 950);
+    CHECK(compaction.getState(5) == BlasCompactionState::None);
+    CHECK_EQ(compaction.getStats().pending, 3u);
+    CHECK_EQ(compaction.getStats().skipped, 1u);
+
+    // Ready in the order the sizes come in, a second size or one never requested is ignored
+    compaction.setCompactedSize(3, 800);
+    compaction.setCompactedSize(0, 400);
+    compaction.setCompactedSize(7, 200);
+    compaction.setCompactedSize(3, 100);
+    compaction.setCompactedSize(9, 10);
+    CHECK(compaction.getState(9) == BlasCompactionState::None);
+    CHECK(compaction.getState(7) == BlasCompactionState::ReadyToCopy);
+    CHECK(compaction.hasReadyCopies());
+
+    // At least one copy, even over the budget
+    std::vector<BlasCompactionCopy> copies = takeCopies(compaction, 0);
+    REQUIRE(copies.size() == 1);
+    CHECK_EQ(copies[0].blas, 3u);
+    CHECK_EQ(copies[0].compactedSize, 800ull);
+    CHECK(compaction.getState(3) == BlasCompactionState::Copied);
+    CHECK_EQ(compaction.getStats().pending, 2u);
+    CHECK_EQ(compaction.getStats().retiring, 1u);
+    CHECK_EQ(compaction.getStats().compacted, 1u);
+    CHECK_EQ(compaction.getStats().originalBytes, 2000ull);
+    CHECK_EQ(compaction.getStats().compactedBytes, 800ull);
+    CHECK(collect(compaction).empty());
+
+    // Taken until the original bytes reach the budget
+    copies = takeCopies(compaction, 1500);
+    REQUIRE(copies.size() == 2);
+    CHECK_EQ(copies[0].blas, 0u);
+    CHECK_EQ(copies[1].blas, 7u);
+    CHECK(!compaction.hasReadyCopies());
+    CHECK(takeCopies(compaction, 1500).empty());
+    CHECK_EQ(compaction.getStats().pending, 0u);
+
+    // Each original retires framesInFlight frames after its own copy
+    std::vector<uint32_t> retired = collect(compaction);
+    REQUIRE(retired.size() == 1);
+    CHECK_EQ(retired[0], 3u);
+    CHECK(compaction.getState(3) == BlasCompactionState::None);
+    CHECK(compaction.getState(0) == BlasCompactionState::Copied);
+
+    retired = collect(compaction);
+    REQUIRE(retired.size() == 2);
+    CHECK_EQ(retired[0], 0u);
+    CHECK_EQ(retired[1], 7u);
+    CHECK(collect(compaction).empty());
+
+    const BlasCompactionStats& stats = compaction.getStats();
+    CHECK_EQ(stats.pending, 0u);
+    CHECK_EQ(stats.retiring, 0u);
+    CHECK_EQ(stats.compacted, 3u);
+    CHECK_EQ(stats.skipped, 1u);
+    CHECK_EQ(stats.originalBytes, 3500ull);
+    CHECK_EQ(stats.compactedBytes, 1400ull);
+
+    // A retired BLAS, say rebuilt, can be compacted again
+    CHECK(compaction.request(3, 2000));
+}
+
+TEST_CASE(BlasCompactionCancelInEachState)
+{
+    BlasCompaction compaction(2);
+    compaction.request(0, 100);
+    compaction.request(1, 100);
+    compaction.request(2, 100);
+    compaction.setCompactedSize(1, 50);
+    compaction.setCompactedSize(2, 50);
+    REQUIRE(takeCopies(compaction, 0).size() == 1);
+    CHECK(compaction.getState(0) == BlasCompactionState::SizeQueried);
+    CHECK(compaction.getState(1) == BlasCompactionState::Copied);
+    CHECK(compaction.getState(2) == BlasCompactionState::ReadyToCopy);
+    CHECK_EQ(compaction.getStats().pending, 2u);
+
+    // Waiting for its size: a late size is ignored and not counted
+    compaction.cancel(0);
+    CHECK(compaction.getState(0) == BlasCompactionState::None);
+    compaction.setCompactedSize(0, 10);
+    CHECK(compaction.getState(0) == BlasCompactionState::None);
+    CHECK_EQ(compaction.getStats().skipped, 0u);
+
+    // Ready: never handed out for a copy
+    compaction.cancel(2);
+    CHECK(compaction.getState(2) == BlasCompactionState::None);
+    CHECK(!compaction.hasReadyCopies());
+    CHECK(takeCopies(compaction, 1000).empty());
+    CHECK_EQ(compaction.getStats().pending, 0u);
+
+    // Copied: the original still retires once the frames in flight are done with it
+    compaction.cancel(1);
+    CHECK(compaction.getState(1) == BlasCompactionState::Copied);
+    CHECK(collect(compaction).empty());
+    const std::vector<uint32_t> retired = collect(compaction);
+    REQUIRE(retired.size() == 1);
+    CHECK_EQ(retired[0], 1u);
+
+    // Nothing to cancel
+    compaction.cancel(1);
+    compaction.cancel(50);
+    CHECK_EQ(compaction.getStats().pending, 0u);
+    CHECK_EQ(compaction.getStats().retiring, 0u);
+
+    // And cleared with all states in it
+    compaction.request(0, 100);
+    compaction.request(1, 100);
+    compaction.setCompactedSize(1, 10);
+    compaction.clear();
+    CHECK(compaction.getState(0) == BlasCompactionState::None);
+    CHECK(compaction.getState(1) == BlasCompactionState::None);
+    CHECK(!compaction.hasReadyCopies());
+    CHECK_EQ(compaction.getStats().pending, 0u);
+}
@@ -0,0 +1,88 @@
+#include "TestFramework.h"
+#include "TestWorld.h"
+
+#include "CellularSimulation.h"
+#include "Timer.h"
+
+namespace
+{
+    uint32_t settle(CellularSimulation& simulation, World& world, ThreadPool& threadPool)
+    {
+        uint32_t ticks = 0;
+        for (; ticks < 500 && simulation.getStats().activeCells > 0; ++ticks)
+        {
+            simulation.tick(world, threadPool);
+        }
+        return ticks;
+    }
+}
+
+TEST_CASE(CellularSimulationWakesOnWorldEdits)
+{
+    World world;
+    loadTestWorld(world, 2, loadFlatGround);
+
+    ThreadPool threadPool(2);
+    CellularSimulation simulation;
+    world.setSimulation(&simulation);
+
+    // Sand placed in the air starts falling without being activated by hand
+    const glm::ivec3 regionMin(-16, -8, -16);
+    const glm::ivec3 regionMax(16, 16, 16);
+    world.applyEdit(EditOp::box(glm::ivec3(-2, 10, -2), glm::ivec3(2, 12, 2), SAND_VOXEL), threadPool);
+    CHECK(simulation.getStats().activeCells > 0);
+    settle(simulation, world, threadPool);
+    CHECK_EQ(simulation.getStats().activeCells, 0u);
+    CHECK_EQ(countVoxels(world, SAND_VOXEL, regionMin, regionMax), 75u);
+    CHECK_EQ(countVoxels(world, SAND_VOXEL, glm::ivec3(-2, 10, -2), glm::ivec3(2, 12, 2)), 0u);
+    REQUIRE(world.getVoxel(0, 0, 0) == SAND_VOXEL);
+
+    // Digging out a single voxel of support lets the sand above drop into it
+    CHECK(world.setVoxel(0, -1, 0, AIR_VOXEL));
+    CHECK(simulation.getStats().activeCells > 0);
+    settle(simulation, world, threadPool);
+    CHECK_EQ(world.getVoxel(0, -1, 0), SAND_VOXEL);
+
+    // A pit dug with a bulk edit swallows the pile, less the voxel of sand it carved away itself
+    world.applyEdit(EditOp::box(glm::ivec3(-8, -4, -8), glm::ivec3(8, -1, 8), AIR_VOXEL), threadPool);
+    CHECK(simulation.getStats().activeCells > 0);
+    settle(simulation, world, threadPool);
+    CHECK_EQ(simulation.getStats().activeCells, 0u);
+    CHECK_EQ(countVoxels(world, SAND_VOXEL, glm::ivec3(-8, -4, -8), glm::ivec3(8, -1, 8)), 74u);
+
+    // Edits that change nothing wake nothing
+    world.applyEdit(EditOp::box(glm::ivec3(-4, 4, -4), glm::ivec3(4, 6, 4), AIR_VOXEL), threadPool);
+    CHECK_EQ(simulation.getStats().activeCells, 0u);
+}
+
+BENCHMARK(CellularSimulationTicksAt1MActiveCells)
+{
+    World world;
+    loadTestWorld(world, 4, loadFlatGround);
+
+    CellularSimulation simulation;
+    world.setSimulation(&simulation);
+
+    // 128 x 64 x 128 sand falling through the air, every cell moves each tick until it lands
+    world.applyEdit(EditOp::box(glm::ivec3(-64, 32, -64), glm::ivec3(63, 95, 63), SAND_VOXEL));
+    reportMetric("active cells at start", static_cast<double>(simulation.getStats().activeCells), "");
+
+    constexpr uint32_t TICKS = 16;
+    uint64_t steppedCells = 0;
+    uint64_t movedCells = 0;
+    Timer timer;
+    for (uint32_t tick = 0; tick < TICKS; ++tick)
+    {
+        steppedCells += simulation.getStats().activeCells;
+        simulation.tick(world);
+        movedCells += simulation.getStats().movedCells;
+    }
+    timer.stop();
+
+    const double seconds = timer.elapsedTime<std::chrono::microseconds>() * 1e-6;
+    reportMetric("ticks", TICKS / seconds, "ticks/s");
+    reportMetric("stepped cells", steppedCells / seconds * 1e-6, "Mcells/s");
+    reportMetric("mean active cells", static_cast<double>(steppedCells) / TICKS, "");
+    reportMetric("mean moved cells", static_cast<double>(movedCells) / TICKS, "");
+    reportMetric("active chunks", simulation.getStats().activeChunks, "");
+}
@@ -0,0 +1,201 @@
+#include "TestFramework.h"
+#include "TestWorld.h"
+
+#include "TerrainGenerator.h"
+#include "Timer.h"
+
+#include <bit>
+
+namespace
+{
+    constexpr int32_t SIZE = static_cast<int32_t>(CHUNK_SIZE_X);
+
+    uint32_t countApronMismatches(const World& world, const ChunkApron& apron, const glm::ivec3& chunkCoord)
+    {
+        const glm::ivec3 origin = chunkCoord * SIZE;
+        uint32_t mismatches = 0;
+        for (int32_t z = -1; z <= SIZE; ++z)
+        {
+            for (int32_t y = -1; y <= SIZE; ++y)
+            {
+                for (int32_t x = -1; x <= SIZE; ++x)
+                {
+                    mismatches += apron.get(x, y, z) != world.getVoxel(origin.x + x, origin.y + y, origin.z + z) ? 1 : 0;
+                }
+            }
+        }
+        return mismatches;
+    }
+
+    // Exposed face count over the chunk, the neighbour lookups going through the world
+    uint32_t countExposedFacesWithoutApron(const World& world, const glm::ivec3& chunkCoord)
+    {
+        const glm::ivec3 origin = chunkCoord * SIZE;
+        uint32_t faces = 0;
+        for (int32_t z = origin.z; z < origin.z + SIZE; ++z)
+        {
+            for (int32_t y = origin.y; y < origin.y + SIZE; ++y)
+            {
+                for (int32_t x = origin.x; x < origin.x + SIZE; ++x)
+                {
+                    if (world.getVoxel(x, y, z) == AIR_VOXEL)
+                    {
+                        continue;
+                    }
+                    faces += (world.getVoxel(x - 1, y, z) == AIR_VOXEL) + (world.getVoxel(x + 1, y, z) == AIR_VOXEL) +
+                        (world.getVoxel(x, y - 1, z) == AIR_VOXEL) + (world.getVoxel(x, y + 1, z) == AIR_VOXEL) +
+                        (world.getVoxel(x, y, z - 1) == AIR_VOXEL) + (world.getVoxel(x, y, z + 1) == AIR_VOXEL);
+                }
+            }
+        }
+        return faces;
+    }
+
+    uint32_t countExposedFaces(const ChunkApron& apron)
+    {
+        uint32_t faces = 0;
+        for (int32_t z = 0; z < SIZE; ++z)
+        {
+            for (int32_t y = 0; y < SIZE; ++y)
+            {
+                for (int32_t x = 0; x < SIZE; ++x)
+                {
+                    faces += std::popcount(apron.getExposedFaces(x, y, z));
+                }
+            }
+        }
+        return faces;
+    }
+}
+
+TEST_CASE(ChunkApronMatchesWorld)
+{
+    const TerrainGenerator terrain;
+    World world;
+    loadTestWorld(world, 2, terrain.makeChunkLoader());
+
+    for (const glm::ivec3& chunkCoord : { glm::ivec3(0, -1, 0), glm::ivec3(1, 0, -1), glm::ivec3(0, 2, 0) })
+    {
+        const ChunkApron* apron = world.getApron(chunkCoord);
+        REQUIRE(apron != nullptr);
+        // (0, 2, 0) borders chunks outside the load radius, which read as air
+        CHECK_EQ(countApronMismatches(world, *apron, chunkCoord), 0u);
+        CHECK_EQ(countExposedFaces(*apron), countExposedFacesWithoutApron(world, chunkCoord));
+    }
+    CHECK(world.getApron(glm::ivec3(0, 5, 0)) == nullptr);
+
+    // Edits on the shared face show up in the neighbour's apron
+    CHECK(world.setVoxel(SIZE, -1, 5, AIR_VOXEL));
+    CHECK(world.setVoxel(SIZE, 0, SIZE, TORCH_VOXEL));
+    const ChunkApron* apron = world.getApron(glm::ivec3(0, -1, 0));
+    CHECK_EQ(apron->get(SIZE, SIZE - 1, 5), AIR_VOXEL);
+    CHECK_EQ(apron->get(SIZE, SIZE, SIZE), TORCH_VOXEL);
+    CHECK_EQ(countApronMismatches(world, *apron, glm::ivec3(0, -1, 0)), 0u);
+}
+
+TEST_CASE(ChunkApronStampsSurviveReload)
+{
+    auto center = std::make_unique<Chunk>();
+    auto neighbor = std::make_unique<Chunk>();
+    center->fill(STONE_VOXEL);
+    neighbor->position = glm::ivec3(1, 0, 0);
+    neighbor->fill(DIRT_VOXEL);
+
+    auto apron = std::make_unique<ChunkApron>();
+    CHECK(apron->refreshRegion(glm::ivec3(0), center.get()));
+    CHECK(apron->refreshRegion(glm::ivec3(1, 0, 0), neighbor.get()));
+    CHECK(!apron->refreshRegion(glm::ivec3(1, 0, 0), neighbor.get()));
+    CHECK_EQ(apron->get(SIZE, 3, 3), DIRT_VOXEL);
+
+    // Evicted, then loaded again into the same allocation with the same number of edits behind
+    // it; a per-chunk counter would land on the old version and keep the stale dirt
+    *neighbor = Chunk();
+    neighbor->position = glm::ivec3(1, 0, 0);
+    neighbor->fill(SAND_VOXEL);
+    CHECK(apron->refreshRegion(glm::ivec3(1, 0, 0), neighbor.get()));
+    CHECK_EQ(apron->get(SIZE, 3, 3), SAND_VOXEL);
+
+    // Non-resident neighbours read as air, until one appears
+    CHECK(apron->refreshRegion(glm::ivec3(-1, 0, 0), nullptr));
+    CHECK(!apron->refreshRegion(glm::ivec3(-1, 0, 0), nullptr));
+    CHECK_EQ(apron->get(-1, 3, 3), AIR_VOXEL);
+    CHECK(apron->refreshRegion(glm::ivec3(-1, 0, 0), center.get()));
+    CHECK_EQ(apron->get(-1, 3, 3), STONE_VOXEL);
+
+    // Every load and edit takes a fresh generation
+    const uint64_t version = center->version;
+    center->set(0, 0, 0, AIR_VOXEL);
+    CHECK(center->version > version && center->version > neighbor->version);
+}
+
+BENCHMARK(ChunkApronBoundaryKernels)
+{
+    const TerrainGenerator terrain;
+    World world;
+    loadTestWorld(world, 3, terrain.makeChunkLoader());
+
+    // The surface chunks, the ones with faces to find
+    std::vector<glm::ivec3> chunkCoords;
+    for (int32_t z = -2; z <= 2; ++z)
+    {
+        for (int32_t y = -1; y <= 0; ++y)
+        {
+            for (int32_t x = -2; x <= 2; ++x)
+            {
+                chunkCoords.push_back(glm::ivec3(x, y, z));
+            }
+        }
+    }
+    constexpr uint32_t ROUNDS = 4;
+    uint64_t checksum = 0;
+
+    Timer timer;
+    for (uint32_t round = 0; round < ROUNDS; ++round)
+    {
+        for (const glm::ivec3& chunkCoord : chunkCoords)
+        {
+            checksum += countExposedFacesWithoutApron(world, chunkCoord);
+        }
+    }
+    timer.stop();
+    reportMetric("exposed faces over getVoxel", ROUNDS * chunkCoords.size() / (timer.elapsedTime<std::chrono::microseconds>() * 1e-6), "chunks/s");
+
+    // First use copies all 27 regions
+    timer.start();
+    for (const glm::ivec3& chunkCoord : chunkCoords)
+    {
+        checksum += countExposedFaces(*world.getApron(chunkCoord));
+    }
+    timer.stop();
+    reportMetric("exposed faces, apron built", chunkCoords.size() / (timer.elapsedTime<std::chrono::microseconds>() * 1e-6), "chunks/s");
+
+    // Unchanged sources, every refresh is 27 stamp compares
+    timer.start();
+    for (uint32_t round = 0; round < ROUNDS; ++round)
+    {
+        for (const glm::ivec3& chunkCoord : chunkCoords)
+        {
+            checksum += countExposedFaces(*world.getApron(chunkCoord));
+        }
+    }
+    timer.stop();
+    reportMetric("exposed faces, apron up to date", ROUNDS * chunkCoords.size() / (timer.elapsedTime<std::chrono::microseconds>() * 1e-6), "chunks/s");
+
+    // One voxel edited in every chunk, each apron recopies itself and the touched neighbours
+    timer.start();
+    for (uint32_t round = 0; round < ROUNDS; ++round)
+    {
+        for (const glm::ivec3& chunkCoord : chunkCoords)
+        {
+            const glm::ivec3 voxel = chunkCoord * SIZE + glm::ivec3(static_cast<int32_t>(round));
+            world.setVoxel(voxel.x, voxel.y, voxel.z, round & 1 ? STONE_VOXEL : AIR_VOXEL);
+        }
+        for (const glm::ivec3& chunkCoord : chunkCoords)
+        {
+            checksum += countExposedFaces(*world.getApron(chunkCoord));
+        }
+    }
+    timer.stop();
+    reportMetric("edit + exposed faces, apron refreshed", ROUNDS * chunkCoords.size() / (timer.elapsedTime<std::chrono::microseconds>() * 1e-6), "chunks/s");
+    reportMetric("checksum", static_cast<double>(checksum), "");
+}
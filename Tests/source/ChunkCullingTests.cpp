@@ -0,0 +1,298 @@
+#include "TestFramework.h"
+
+#include "ChunkCulling.h"
+#include "FirstPersonCamera.h"
+
+#include <bit>
+#include <limits>
+#include <memory>
+#include <random>
+#include <algorithm>
+
+namespace
+{
+    struct Box
+    {
+        glm::vec3 min;
+        glm::vec3 max;
+    };
+
+    Box makeRandomBox(std::mt19937& random, const glm::vec3& center, float spread, float maxSize)
+    {
+        std::uniform_real_distribution<float> offset(-spread, spread);
+        std::uniform_real_distribution<float> size(0.5f, maxSize);
+        const glm::vec3 min = center + glm::vec3(offset(random), offset(random), offset(random));
+        return { min, min + glm::vec3(size(random), size(random), size(random)) };
+    }
+
+    // A camera at a random spot looking in a random direction
+    FirstPersonCamera makeRandomCamera(std::mt19937& random)
+    {
+        std::uniform_real_distribution<float> position(-50.0f, 50.0f);
+        std::uniform_real_distribution<float> pitch(-80.0f, 80.0f);
+        std::uniform_real_distribution<float> yaw(-180.0f, 180.0f);
+        FirstPersonCamera camera(glm::vec3(position(random), position(random), position(random)), 70.0f,
+            static_cast<float>(CullingDepthBuffer::WIDTH) / static_cast<float>(CullingDepthBuffer::HEIGHT));
+        camera.setLookDirection(pitch(random), yaw(random));
+        return camera;
+    }
+
+    // Distance of the box's furthest corner past the plane it's furthest behind, relative to the plane normal
+    float getFrustumMargin(const Frustum& frustum, const Box& box)
+    {
+        float margin = std::numeric_limits<float>::max();
+        for (const glm::vec4& plane : frustum.planes)
+        {
+            const glm::vec3 corner(plane.x >= 0.0f ? box.max.x : box.min.x, plane.y >= 0.0f ? box.max.y : box.min.y, plane.z >= 0.0f ? box.max.z : box.min.z);
+            margin = std::min(margin, (glm::dot(glm::vec3(plane), corner) + plane.w) / glm::length(glm::vec3(plane)));
+        }
+        return margin;
+    }
+
+    // Whether the segment from origin to point passes through the inside of the box before point
+    bool isSegmentBlocked(const glm::vec3& origin, const glm::vec3& point, const Box& box)
+    {
+        // Shrunk a little, so rays grazing a face or ending on it count as unblocked
+        const glm::vec3 min = box.min + 1e-3f;
+        const glm::vec3 max = box.max - 1e-3f;
+        const glm::vec3 direction = point - origin;
+        float tNear = 0.0f;
+        float tFar = 1.0f - 1e-4f;
+        for (int32_t axis = 0; axis < 3; ++axis)
+        {
+            if (std::abs(direction[axis]) < 1e-12f)
+            {
+                if (origin[axis] <= min[axis] || origin[axis] >= max[axis])
+                {
+                    return false;
+                }
+                continue;
+            }
+            float t0 = (min[axis] - origin[axis]) / direction[axis];
+            float t1 = (max[axis] - origin[axis]) / direction[axis];
+            if (t0 > t1)
+            {
+                std::swap(t0, t1);
+            }
+            tNear = std::max(tNear, t0);
+            tFar = std::min(tFar, t1);
+        }
+        return tNear < tFar;
+    }
+
+    uint64_t getBrickBoxMask(const BrickBox& box)
+    {
+        uint64_t mask = 0;
+        for (uint32_t z = box.min.z; z <= box.max.z; ++z)
+        {
+            for (uint32_t y = box.min.y; y <= box.max.y; ++y)
+            {
+                for (uint32_t x = box.min.x; x <= box.max.x; ++x)
+                {
+                    mask |= 1ull << ChunkOccupancy::brickIndex(x, y, z);
+                }
+            }
+        }
+        return mask;
+    }
+
+    // The boxes are disjoint, in range and together are exactly the bricks
+    bool coversExactly(uint64_t bricks)
+    {
+        BrickBox boxes[64];
+        const uint32_t count = ChunkCuller::mergeBricks(bricks, boxes);
+        uint64_t covered = 0;
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            if (glm::any(glm::greaterThan(boxes[i].min, boxes[i].max)) || glm::any(glm::greaterThanEqual(boxes[i].max, glm::uvec3(ChunkOccupancy::BRICKS_PER_AXIS))))
+            {
+                return false;
+            }
+            const uint64_t mask = getBrickBoxMask(boxes[i]);
+            if ((covered & mask) != 0)
+            {
+                return false;
+            }
+            covered |= mask;
+        }
+        return covered == bricks;
+    }
+}
+
+// The frustum test of cull(), 8 boxes at a time with AVX2 and the rest one by one, against
+// Frustum::intersects. Boxes within a rounding error of a plane may go either way and are skipped.
+TEST_CASE(ChunkCullerFrustumMatchesScalar)
+{
+    std::mt19937 random(21);
+    ChunkCuller culler;
+    culler.setOcclusionEnabled(false);
+    std::vector<uint32_t> visible;
+    uint32_t inside = 0;
+    uint32_t outside = 0;
+    for (uint32_t frame = 0; frame < 200; ++frame)
+    {
+        FirstPersonCamera camera = makeRandomCamera(random);
+        const glm::mat4 viewProjection = camera.getViewProjectionMatrix();
+        const Frustum frustum = Frustum::fromViewProjection(viewProjection);
+        culler.begin(viewProjection, camera.getPosition());
+
+        const uint32_t count = 1 + random() % 70;
+        std::vector<uint32_t> expected;
+        std::vector<uint32_t> ambiguous;
+        for (uint32_t i = 0; i < count; ++i)
+        {
+            const Box box = makeRandomBox(random, camera.getPosition(), 150.0f, 20.0f);
+            culler.add(box.min, box.max, i);
+
+            if (std::abs(getFrustumMargin(frustum, box)) < 1e-2f)
+            {
+                ambiguous.push_back(i);
+            }
+            else if (frustum.intersects(box.min, box.max))
+            {
+                expected.push_back(i);
+            }
+        }
+        culler.cull(visible);
+
+        CHECK_EQ(culler.getStats().tested, count);
+        CHECK_EQ(culler.getStats().frustumCulled + culler.getStats().visible, count);
+        CHECK_EQ(culler.getStats().occlusionCulled, 0u);
+        std::erase_if(visible, [&](uint32_t id) { return std::find(ambiguous.begin(), ambiguous.end(), id) != ambiguous.end(); });
+        CHECK(visible == expected);
+        inside += static_cast<uint32_t>(expected.size());
+        outside += count - static_cast<uint32_t>(expected.size() + ambiguous.size());
+    }
+
+    // Both outcomes well exercised
+    CHECK(inside > 1000 && outside > 1000);
+}
+
+// Occlusion culling may keep hidden boxes, but must never drop one that a ray from the camera
+// reaches: every box it culls is sampled on a grid and at random, and no sample in the frustum
+// may have a clear line of sight. Occluders are loose boxes and the full bricks of chunks.
+TEST_CASE(ChunkCullerNeverCullsSeenBoxes)
+{
+    std::mt19937 random(5);
+    ChunkCuller culler;
+    std::vector<uint32_t> visible;
+    auto chunk = std::make_unique<Chunk>();
+    uint32_t occlusionCulled = 0;
+    uint32_t falselyCulled = 0;
+
+    for (uint32_t frame = 0; frame < 60; ++frame)
+    {
+        FirstPersonCamera camera = makeRandomCamera(random);
+        const glm::mat4 viewProjection = camera.getViewProjectionMatrix();
+        const glm::vec3 eye = camera.getPosition();
+        const glm::vec3 forward = glm::normalize(glm::vec3(glm::inverse(viewProjection) * glm::vec4(0.0f, 0.0f, 1.0f, 1.0f)) / (glm::inverse(viewProjection) * glm::vec4(0.0f, 0.0f, 1.0f, 1.0f)).w - eye);
+        culler.begin(viewProjection, eye);
+
+        // Walls across the view, and a chunk of random full bricks in front of the camera
+        std::vector<Box> occluders;
+        for (uint32_t i = 0; i < 12; ++i)
+        {
+            occluders.push_back(makeRandomBox(random, eye + forward * 25.0f, 18.0f, 16.0f));
+            culler.addOccluder(occluders.back().min, occluders.back().max);
+        }
+
+        chunk->position = glm::ivec3(glm::floor((eye + forward * 40.0f) / static_cast<float>(CHUNK_SIZE_X)));
+        chunk->fill(AIR_VOXEL);
+        const uint64_t brickMask = static_cast<uint64_t>(random()) << 32 | random();
+        const uint64_t bricks = brickMask & (static_cast<uint64_t>(random()) << 32 | random());
+        for (uint64_t bits = bricks; bits != 0; bits &= bits - 1)
+        {
+            const uint32_t brick = std::countr_zero(bits);
+            const glm::ivec3 brickMin = glm::ivec3(brick % 4, brick / 4 % 4, brick / 16) * static_cast<int32_t>(ChunkOccupancy::BRICK_SIZE);
+            for (int32_t z = 0; z < 8; ++z)
+            {
+                for (int32_t y = 0; y < 8; ++y)
+                {
+                    for (int32_t x = 0; x < 8; ++x)
+                    {
+                        chunk->set(brickMin.x + x, brickMin.y + y, brickMin.z + z, STONE_VOXEL);
+                    }
+                }
+            }
+            const glm::vec3 origin = glm::vec3(chunk->getWorldOrigin() + brickMin);
+            occluders.push_back({ origin, origin + static_cast<float>(ChunkOccupancy::BRICK_SIZE) });
+        }
+        culler.addChunkOccluders(*chunk);
+
+        // Candidates around and behind the occluders
+        std::vector<Box> candidates;
+        for (uint32_t i = 0; i < 120; ++i)
+        {
+            candidates.push_back(makeRandomBox(random, eye + forward * 60.0f, 50.0f, 6.0f));
+            culler.add(candidates.back().min, candidates.back().max, i);
+        }
+        culler.cull(visible);
+        occlusionCulled += culler.getStats().occlusionCulled;
+
+        const Frustum frustum = Frustum::fromViewProjection(viewProjection);
+        for (uint32_t i = 0; i < candidates.size(); ++i)
+        {
+            const Box& box = candidates[i];
+            if (!frustum.intersects(box.min, box.max) || std::find(visible.begin(), visible.end(), i) != visible.end())
+            {
+                continue;
+            }
+
+            std::vector<glm::vec3> samples;
+            for (uint32_t s = 0; s < 125; ++s)
+            {
+                samples.push_back(glm::mix(box.min, box.max, glm::vec3(s % 5, s / 5 % 5, s / 25) * 0.25f));
+            }
+            std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+            for (uint32_t s = 0; s < 64; ++s)
+            {
+                samples.push_back(glm::mix(box.min, box.max, glm::vec3(unit(random), unit(random), unit(random))));
+            }
+
+            const bool seen = std::any_of(samples.begin(), samples.end(), [&](const glm::vec3& sample)
+            {
+                return frustum.intersects(sample, sample) && std::none_of(occluders.begin(), occluders.end(), [&](const Box& occluder)
+                {
+                    return isSegmentBlocked(eye, sample, occluder);
+                });
+            });
+            falselyCulled += seen ? 1 : 0;
+        }
+    }
+
+    CHECK_EQ(falselyCulled, 0u);
+    CHECK(occlusionCulled > 200);
+}
+
+TEST_CASE(ChunkCullerMergesExactlyTheFullBricks)
+{
+    CHECK(coversExactly(0));
+    CHECK(coversExactly(~0ull));
+    CHECK(coversExactly(0x5555555555555555ull));
+    CHECK(coversExactly(1ull << 63));
+
+    BrickBox boxes[64];
+    CHECK_EQ(ChunkCuller::mergeBricks(~0ull, boxes), 1u);
+    CHECK(boxes[0].min == glm::uvec3(0) && boxes[0].max == glm::uvec3(3));
+    CHECK_EQ(ChunkCuller::mergeBricks(0, boxes), 0u);
+
+    std::mt19937_64 random(9);
+    for (uint32_t run = 0; run < 2000; ++run)
+    {
+        // Sparse to dense
+        uint64_t bricks = random();
+        for (uint32_t i = 0; i < run % 4; ++i)
+        {
+            bricks = run % 8 < 4 ? bricks & random() : bricks | random();
+        }
+        CHECK(coversExactly(bricks));
+    }
+
+    // From a chunk: one missing voxel takes out its brick only
+    auto chunk = std::make_unique<Chunk>();
+    chunk->fill(STONE_VOXEL);
+    chunk->set(9, 17, 30, AIR_VOXEL);
+    const uint64_t full = chunk->occupancy.computeFullBrickBits();
+    CHECK_EQ(full, ~(1ull << ChunkOccupancy::brickIndex(1, 2, 3)));
+    CHECK(coversExactly(full));
+}
@@ -0,0 +1,212 @@
+#include "TestFramework.h"
+#include "TestWorld.h"
+
+#include "ChunkHashMap.h"
+#include "Timer.h"
+
+#include <random>
+#include <algorithm>
+#include <unordered_map>
+
+TEST_CASE(ChunkKeyPackingRoundTrips)
+{
+    const glm::ivec3 coords[] = { { 0, 0, 0 }, { -1, -1, -1 }, { 12345, -54321, 777 }, { CHUNK_KEY_AXIS_BIAS - 1, -CHUNK_KEY_AXIS_BIAS, 0 } };
+    for (const glm::ivec3& coord : coords)
+    {
+        CHECK(unpackChunkKey(packChunkKey(coord)) == coord);
+    }
+
+    CHECK(worldToChunkCoord(glm::ivec3(-1, 31, 32)) == glm::ivec3(-1, 0, 1));
+    CHECK(worldToLocalCoord(glm::ivec3(-1, 31, 32)) == glm::ivec3(31, 31, 0));
+}
+
+TEST_CASE(ChunkHashMapInsertFindErase)
+{
+    ChunkHashMap<uint32_t> map(16);
+    std::unordered_map<ChunkKey, uint32_t> reference;
+
+    // Enough keys for several rehashes, with erases leaving tombstones in between
+    std::mt19937 rng(42);
+    std::uniform_int_distribution<int32_t> coord(-64, 64);
+    for (uint32_t i = 0; i < 20000; ++i)
+    {
+        const ChunkKey key = packChunkKey(glm::ivec3(coord(rng), coord(rng), coord(rng)));
+        if (i % 3 == 2)
+        {
+            CHECK_EQ(map.erase(key), reference.erase(key) == 1);
+        }
+        else
+        {
+            map.insert(key, i);
+            reference[key] = i;
+        }
+    }
+
+    CHECK_EQ(map.size(), static_cast<uint32_t>(reference.size()));
+    for (const auto& [key, value] : reference)
+    {
+        const uint32_t* found = map.find(key);
+        REQUIRE(found != nullptr);
+        CHECK_EQ(*found, value);
+    }
+
+    uint32_t visited = 0;
+    map.forEach([&](ChunkKey key, uint32_t& value)
+    {
+        visited++;
+        CHECK(reference.count(key) == 1 && reference[key] == value);
+    });
+    CHECK_EQ(visited, map.size());
+
+    CHECK(map.find(packChunkKey(glm::ivec3(1000, 1000, 1000))) == nullptr);
+}
+
+TEST_CASE(ChunkHashMapLookupCacheGoesStale)
+{
+    ChunkHashMap<uint32_t> map;
+    const ChunkKey a = packChunkKey(glm::ivec3(1, 2, 3));
+    const ChunkKey b = packChunkKey(glm::ivec3(-4, 5, -6));
+    map.insert(a, 1);
+    map.insert(b, 2);
+
+    ChunkHashMap<uint32_t>::LookupCache cache;
+    REQUIRE(map.find(a, cache) != nullptr);
+    CHECK_EQ(*map.find(a, cache), 1u);
+
+    // An erase moves the generation on, the cached slot must not be trusted anymore
+    map.erase(a);
+    CHECK(map.find(a, cache) == nullptr);
+    CHECK_EQ(*map.find(b, cache), 2u);
+
+    // Growing rehashes everything into new slots
+    for (int32_t i = 0; i < 1000; ++i)
+    {
+        map.insert(packChunkKey(glm::ivec3(i, 0, 0)), static_cast<uint32_t>(i + 10));
+    }
+    REQUIRE(map.find(b, cache) != nullptr);
+    CHECK_EQ(*map.find(b, cache), 2u);
+}
+
+TEST_CASE(WorldGetVoxelAcrossChunks)
+{
+    World world;
+    loadTestWorld(world, 2, loadFlatGround);
+
+    CHECK_EQ(world.getVoxel(0, -1, 0), STONE_VOXEL);
+    CHECK_EQ(world.getVoxel(-20, -32, 31), STONE_VOXEL);
+    CHECK_EQ(world.getVoxel(5, 0, -40), AIR_VOXEL);
+    // Outside the resident sphere reads as air
+    CHECK_EQ(world.getVoxel(0, -1000, 0), AIR_VOXEL);
+
+    CHECK(world.setVoxel(-1, 3, -1, SAND_VOXEL));
+    CHECK_EQ(world.getVoxel(-1, 3, -1), SAND_VOXEL);
+    CHECK(!world.setVoxel(0, 1000, 0, SAND_VOXEL));
+}
+
+BENCHMARK(WorldGetVoxelThroughput)
+{
+    World world;
+    const int32_t radius = 6;
+    loadTestWorld(world, radius, loadFlatGround);
+    reportMetric("resident chunks", world.getChunkCount(), "");
+
+    constexpr uint32_t LOOKUPS = 16u << 20;
+    const int32_t extent = radius * static_cast<int32_t>(CHUNK_SIZE_X) / 2;
+
+    // Coherent: scanlines through the world, the last-hit cache catches 31 of 32 lookups
+    Timer timer;
+    uint64_t checksum = 0;
+    uint32_t done = 0;
+    for (int32_t z = -extent; z < extent && done < LOOKUPS; ++z)
+    {
+        for (int32_t y = -extent; y < extent && done < LOOKUPS; ++y)
+        {
+            for (int32_t x = -extent; x < extent; ++x)
+            {
+                checksum += world.getVoxel(x, y, z);
+            }
+            done += static_cast<uint32_t>(2 * extent);
+        }
+    }
+    timer.stop();
+    reportMetric("coherent getVoxel", done / timer.elapsedTime<std::chrono::microseconds>(), "M/s");
+
+    // Random: every lookup probes the hash map
+    std::mt19937 rng(7);
+    std::uniform_int_distribution<int32_t> coord(-extent, extent - 1);
+    std::vector<glm::ivec3> points(1u << 20);
+    for (glm::ivec3& point : points)
+    {
+        point = glm::ivec3(coord(rng), coord(rng), coord(rng));
+    }
+
+    timer.start();
+    for (uint32_t i = 0; i < LOOKUPS; ++i)
+    {
+        const glm::ivec3& p = points[i & (points.size() - 1)];
+        checksum += world.getVoxel(p.x, p.y, p.z);
+    }
+    timer.stop();
+    reportMetric("random getVoxel", LOOKUPS / timer.elapsedTime<std::chrono::microseconds>(), "M/s");
+
+    // The same random probes through std::unordered_map for reference
+    std::unordered_map<ChunkKey, Chunk*> reference;
+    world.forEachChunk([&](Chunk& chunk) { reference[packChunkKey(chunk.position)] = &chunk; });
+
+    timer.start();
+    for (uint32_t i = 0; i < LOOKUPS; ++i)
+    {
+        const glm::ivec3& p = points[i & (points.size() - 1)];
+        auto it = reference.find(packChunkKey(worldToChunkCoord(p)));
+        if (it != reference.end())
+        {
+            const glm::ivec3 local = worldToLocalCoord(p);
+            checksum += it->second->get(local.x, local.y, local.z);
+        }
+    }
+    timer.stop();
+    reportMetric("random std::unordered_map", LOOKUPS / timer.elapsedTime<std::chrono::microseconds>(), "M/s");
+    reportMetric("checksum", static_cast<double>(checksum), "");
+}
+
+BENCHMARK(ChunkHashMapProbeThroughput)
+{
+    // Only the probes, half hits and half misses, over as many keys as a large view distance keeps resident
+    constexpr uint32_t KEYS = 64u << 10;
+    constexpr uint32_t PROBES = 32u << 20;
+
+    std::mt19937 rng(3);
+    std::uniform_int_distribution<int32_t> coord(-256, 255);
+    std::vector<ChunkKey> keys(2 * KEYS);
+    for (ChunkKey& key : keys)
+    {
+        key = packChunkKey(glm::ivec3(coord(rng), coord(rng) / 8, coord(rng)));
+    }
+
+    ChunkHashMap<uint32_t> map;
+    std::unordered_map<ChunkKey, uint32_t> reference;
+    for (uint32_t i = 0; i < KEYS; ++i)
+    {
+        map.insert(keys[i], i);
+        reference[keys[i]] = i;
+    }
+    std::shuffle(keys.begin(), keys.end(), rng);
+
+    uint64_t found = 0;
+    Timer timer;
+    for (uint32_t i = 0; i < PROBES; ++i)
+    {
+        found += map.find(keys[i & (keys.size() - 1)]) != nullptr;
+    }
+    timer.stop();
+    reportMetric("ChunkHashMap find", PROBES / timer.elapsedTime<std::chrono::microseconds>(), "M/s");
+
+    timer.start();
+    for (uint32_t i = 0; i < PROBES; ++i)
+    {
+        found += reference.find(keys[i & (keys.size() - 1)]) != reference.end();
+    }
+    timer.stop();
+    reportMetric("std::unordered_map find", PROBES / timer.elapsedTime<std::chrono::microseconds>(), "M/s");
+    reportMetric("hits", static_cast<double>(found), "");
+}
@@ -0,0 +1,58 @@
+#include "TestFramework.h"
+
+#include "TerrainGenerator.h"
+
+#include <random>
+
+namespace
+{
+    void checkMipsMatchRebuild(const Chunk& chunk)
+    {
+        ChunkMipChain rebuilt;
+        rebuilt.build(chunk.voxels.data());
+        for (uint32_t level = 1; level < ChunkMipChain::LEVEL_COUNT; ++level)
+        {
+            CHECK(std::equal(rebuilt.getLevel(level), rebuilt.getLevel(level) + ChunkMipChain::levelVolume(level), chunk.mips.getLevel(level)));
+        }
+    }
+}
+
+TEST_CASE(ChunkMipsMajorityVote)
+{
+    const uint8_t uniform[8] = { 3, 3, 3, 3, 3, 3, 3, 3 };
+    CHECK_EQ(ChunkMipChain::majorityVote(uniform), 3);
+
+    const uint8_t majority[8] = { 1, 2, 2, 2, 0, 0, 2, 1 };
+    CHECK_EQ(ChunkMipChain::majorityVote(majority), 2);
+
+    // Ties go to the first non-air child so thin surfaces survive
+    const uint8_t tie[8] = { 0, 0, 0, 0, 4, 4, 4, 4 };
+    CHECK_EQ(ChunkMipChain::majorityVote(tie), 4);
+    const uint8_t thin[8] = { 0, 0, 0, 5, 0, 1, 0, 1 };
+    CHECK_EQ(ChunkMipChain::majorityVote(thin), 0);
+}
+
+TEST_CASE(ChunkMipsIncrementalMatchesRebuild)
+{
+    const TerrainGenerator terrain;
+    auto chunk = std::make_unique<Chunk>();
+    chunk->position = glm::ivec3(0, -1, 0);
+    terrain.generate(*chunk);
+    checkMipsMatchRebuild(*chunk);
+
+    std::mt19937 rng(8);
+    std::uniform_int_distribution<uint32_t> coord(0, CHUNK_SIZE_X - 1);
+    std::uniform_int_distribution<uint32_t> id(0, 4);
+    for (uint32_t i = 0; i < 20000; ++i)
+    {
+        chunk->set(coord(rng), coord(rng), coord(rng), static_cast<VoxelID>(id(rng)));
+    }
+    checkMipsMatchRebuild(*chunk);
+
+    // A ChunkLod coarsened in place ends up with the chunk's own coarser mip
+    ChunkLod lod;
+    lod.assign(*chunk, 1);
+    lod.coarsen(4);
+    CHECK_EQ(lod.level, 4u);
+    CHECK(std::equal(lod.voxels.begin(), lod.voxels.end(), chunk->mips.getLevel(4)));
+}
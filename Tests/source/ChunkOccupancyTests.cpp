@@ -0,0 +1,224 @@
+#include "TestFramework.h"
+
+#include "Chunk.h"
+#include "TerrainGenerator.h"
+#include "Timer.h"
+
+#include <random>
+
+namespace
+{
+    constexpr uint32_t SIZE = ChunkOccupancy::SIZE;
+
+    bool bruteSolid(const Chunk& chunk, int32_t x, int32_t y, int32_t z)
+    {
+        return chunk.get(x, y, z) != AIR_VOXEL;
+    }
+
+    // Reference answers straight from the voxel bytes
+    int32_t bruteFirstSolid(const Chunk& chunk, glm::ivec3 p, int32_t axis, int32_t step)
+    {
+        for (; p[axis] >= 0 && p[axis] < static_cast<int32_t>(SIZE); p[axis] += step)
+        {
+            if (bruteSolid(chunk, p.x, p.y, p.z))
+            {
+                return p[axis];
+            }
+        }
+        return -1;
+    }
+
+    bool bruteBoxEmpty(const Chunk& chunk, const glm::ivec3& min, const glm::ivec3& max)
+    {
+        for (int32_t z = min.z; z <= max.z; ++z)
+        {
+            for (int32_t y = min.y; y <= max.y; ++y)
+            {
+                for (int32_t x = min.x; x <= max.x; ++x)
+                {
+                    if (bruteSolid(chunk, x, y, z))
+                    {
+                        return false;
+                    }
+                }
+            }
+        }
+        return true;
+    }
+
+    void checkOccupancyMatchesVoxels(const Chunk& chunk, std::mt19937& rng)
+    {
+        const ChunkOccupancy& occupancy = chunk.occupancy;
+
+        // Incrementally maintained summaries must equal a rebuild from scratch
+        ChunkOccupancy rebuilt;
+        rebuilt.build(chunk.voxels.data());
+        CHECK_EQ(occupancy.getSliceBits(), rebuilt.getSliceBits());
+        CHECK_EQ(occupancy.getBrickBits(), rebuilt.getBrickBits());
+        uint32_t solid = 0;
+        for (uint32_t z = 0; z < SIZE; ++z)
+        {
+            CHECK_EQ(occupancy.getColumnBits(z), rebuilt.getColumnBits(z));
+            for (uint32_t y = 0; y < SIZE; ++y)
+            {
+                CHECK_EQ(occupancy.getRow(y, z), rebuilt.getRow(y, z));
+                for (uint32_t x = 0; x < SIZE; ++x)
+                {
+                    solid += bruteSolid(chunk, x, y, z) ? 1 : 0;
+                }
+            }
+        }
+        CHECK_EQ(occupancy.countSolid(), solid);
+
+        for (uint32_t bz = 0; bz < ChunkOccupancy::BRICKS_PER_AXIS; ++bz)
+        {
+            for (uint32_t by = 0; by < ChunkOccupancy::BRICKS_PER_AXIS; ++by)
+            {
+                for (uint32_t bx = 0; bx < ChunkOccupancy::BRICKS_PER_AXIS; ++bx)
+                {
+                    const glm::ivec3 min = glm::ivec3(bx, by, bz) * static_cast<int32_t>(ChunkOccupancy::BRICK_SIZE);
+                    CHECK_EQ(occupancy.isBrickEmpty(bx, by, bz), bruteBoxEmpty(chunk, min, min + glm::ivec3(ChunkOccupancy::BRICK_SIZE - 1)));
+                }
+            }
+        }
+
+        std::uniform_int_distribution<int32_t> coord(0, SIZE - 1);
+        for (uint32_t i = 0; i < 2000; ++i)
+        {
+            const glm::ivec3 p(coord(rng), coord(rng), coord(rng));
+            CHECK_EQ(occupancy.firstSolidPositiveX(p.x, p.y, p.z), bruteFirstSolid(chunk, p, 0, 1));
+            CHECK_EQ(occupancy.firstSolidNegativeX(p.x, p.y, p.z), bruteFirstSolid(chunk, p, 0, -1));
+            CHECK_EQ(occupancy.firstSolidPositiveY(p.x, p.y, p.z), bruteFirstSolid(chunk, p, 1, 1));
+            CHECK_EQ(occupancy.firstSolidNegativeY(p.x, p.y, p.z), bruteFirstSolid(chunk, p, 1, -1));
+            CHECK_EQ(occupancy.firstSolidPositiveZ(p.x, p.y, p.z), bruteFirstSolid(chunk, p, 2, 1));
+            CHECK_EQ(occupancy.firstSolidNegativeZ(p.x, p.y, p.z), bruteFirstSolid(chunk, p, 2, -1));
+
+            const glm::ivec3 q(coord(rng), coord(rng), coord(rng));
+            const glm::ivec3 min = glm::min(p, q);
+            const glm::ivec3 max = glm::max(p, q);
+            CHECK_EQ(occupancy.isBoxEmpty(min.x, min.y, min.z, max.x, max.y, max.z), bruteBoxEmpty(chunk, min, max));
+        }
+    }
+}
+
+TEST_CASE(ChunkOccupancyTracksSetAndClear)
+{
+    std::mt19937 rng(17);
+    std::uniform_int_distribution<int32_t> coord(0, SIZE - 1);
+
+    // A sparse chunk grown voxel by voxel, then carved back down; every step goes through Chunk::set
+    auto chunk = std::make_unique<Chunk>();
+    for (uint32_t i = 0; i < 3000; ++i)
+    {
+        chunk->set(coord(rng), coord(rng) / 4, coord(rng), STONE_VOXEL);
+    }
+    checkOccupancyMatchesVoxels(*chunk, rng);
+
+    for (uint32_t i = 0; i < 6000; ++i)
+    {
+        chunk->set(coord(rng), coord(rng) / 4, coord(rng), AIR_VOXEL);
+    }
+    checkOccupancyMatchesVoxels(*chunk, rng);
+
+    // Clearing the last voxel of a brick, row and slice
+    chunk->fill(AIR_VOXEL);
+    chunk->set(9, 17, 25, DIRT_VOXEL);
+    CHECK(!chunk->occupancy.isEmpty());
+    chunk->set(9, 17, 25, AIR_VOXEL);
+    CHECK(chunk->occupancy.isEmpty());
+    CHECK_EQ(chunk->occupancy.getBrickBits(), 0ull);
+    checkOccupancyMatchesVoxels(*chunk, rng);
+}
+
+TEST_CASE(ChunkOccupancyMatchesTerrain)
+{
+    const TerrainGenerator terrain;
+    std::mt19937 rng(23);
+    for (int32_t y = -2; y <= 1; ++y)
+    {
+        auto chunk = std::make_unique<Chunk>();
+        chunk->position = glm::ivec3(2, y, -1);
+        terrain.generate(*chunk);
+        checkOccupancyMatchesVoxels(*chunk, rng);
+    }
+
+    Chunk full;
+    full.fill(STONE_VOXEL);
+    CHECK(full.occupancy.isFull());
+    CHECK_EQ(full.occupancy.computeFullBrickBits(), ~0ull);
+}
+
+BENCHMARK(ChunkOccupancyQueries)
+{
+    const TerrainGenerator terrain;
+    std::vector<std::unique_ptr<Chunk>> chunks;
+    for (int32_t y = -2; y <= 1; ++y)
+    {
+        for (int32_t x = 0; x < 8; ++x)
+        {
+            auto chunk = std::make_unique<Chunk>();
+            chunk->position = glm::ivec3(x, y, 0);
+            terrain.generate(*chunk);
+            chunks.push_back(std::move(chunk));
+        }
+    }
+
+    constexpr uint32_t BUILDS = 20000;
+    ChunkOccupancy occupancy;
+    Timer timer;
+    for (uint32_t i = 0; i < BUILDS; ++i)
+    {
+        occupancy.build(chunks[i % chunks.size()]->voxels.data());
+    }
+    timer.stop();
+    reportMetric("build from voxels", BUILDS / (timer.elapsedTime<std::chrono::microseconds>() * 1e-6), "chunks/s");
+
+    std::mt19937 rng(1);
+    std::uniform_int_distribution<int32_t> coord(0, SIZE - 1);
+    std::vector<glm::ivec3> points(4096);
+    for (glm::ivec3& point : points)
+    {
+        point = glm::ivec3(coord(rng), coord(rng), coord(rng));
+    }
+
+    constexpr uint32_t QUERIES = 8u << 20;
+    int64_t checksum = 0;
+    timer.start();
+    for (uint32_t i = 0; i < QUERIES; ++i)
+    {
+        const glm::ivec3& p = points[i & 4095];
+        const ChunkOccupancy& chunkOccupancy = chunks[i % chunks.size()]->occupancy;
+        checksum += chunkOccupancy.firstSolidPositiveX(p.x, p.y, p.z) + chunkOccupancy.firstSolidNegativeY(p.x, p.y, p.z);
+    }
+    timer.stop();
+    reportMetric("firstSolid +X and -Y", 2.0 * QUERIES / timer.elapsedTime<std::chrono::microseconds>(), "M queries/s");
+
+    // Brick-sized boxes, bitmask against scanning the voxel bytes
+    timer.start();
+    for (uint32_t i = 0; i < QUERIES; ++i)
+    {
+        const glm::ivec3 p = points[i & 4095] & glm::ivec3(~7);
+        checksum += chunks[i % chunks.size()]->occupancy.isBoxEmpty(p.x, p.y, p.z, p.x + 7, p.y + 7, p.z + 7);
+    }
+    timer.stop();
+    reportMetric("isBoxEmpty 8^3", QUERIES / timer.elapsedTime<std::chrono::microseconds>(), "M queries/s");
+
+    constexpr uint32_t SCANS = QUERIES / 64;
+    timer.start();
+    for (uint32_t i = 0; i < SCANS; ++i)
+    {
+        const glm::ivec3 p = points[i & 4095] & glm::ivec3(~7);
+        checksum += bruteBoxEmpty(*chunks[i % chunks.size()], p, p + glm::ivec3(7));
+    }
+    timer.stop();
+    reportMetric("voxel scan 8^3", SCANS / timer.elapsedTime<std::chrono::microseconds>(), "M queries/s");
+
+    timer.start();
+    for (uint32_t i = 0; i < BUILDS * 10; ++i)
+    {
+        checksum += chunks[i % chunks.size()]->occupancy.countSolid();
+    }
+    timer.stop();
+    reportMetric("countSolid", BUILDS * 10 / (timer.elapsedTime<std::chrono::microseconds>() * 1e-6), "chunks/s");
+    reportMetric("checksum", static_cast<double>(checksum), "");
+}
@@ -0,0 +1,225 @@
+#include "TestFramework.h"
+#include "TestWorld.h"
+
+#include "ChunkResidency.h"
+
+#include <atomic>
+#include <cmath>
+#include <thread>
+
+namespace
+{
+    // Camera flying a figure eight with the view direction along the path
+    void scriptedCamera(uint32_t step, glm::vec3& position, glm::vec3& forward)
+    {
+        const float t = static_cast<float>(step) * 0.05f;
+        const float radius = 12.0f * static_cast<float>(CHUNK_SIZE_X);
+        position = glm::vec3(radius * std::sin(t), 8.0f * std::sin(t * 0.5f), radius * std::sin(t) * std::cos(t));
+        forward = glm::vec3(std::cos(t), 0.25f * std::cos(t * 0.5f), std::cos(2.0f * t));
+    }
+
+    void runScriptedCamera(const ChunkResidencyConfig& config, uint32_t steps)
+    {
+        ThreadPool threadPool(4);
+        ChunkResidencyManager residency;
+        residency.init(config, loadFlatGround, threadPool);
+
+        // Full-resolution chunks as the callbacks see them, independent of the manager's own accounting
+        int64_t liveChunks = 0;
+        residency.setOnChunkLoaded([&](Chunk&) { liveChunks++; });
+        residency.setOnChunkEvicted([&](Chunk&) { liveChunks--; });
+
+        glm::vec3 position;
+        glm::vec3 forward;
+        for (uint32_t step = 0; step < steps; ++step)
+        {
+            scriptedCamera(step, position, forward);
+            residency.update(position, forward);
+
+            CHECK(residency.getCommittedBytes() <= residency.getMemoryBudget());
+            CHECK(liveChunks >= 0);
+            CHECK(static_cast<size_t>(liveChunks) * ChunkResidencyManager::getChunkMemorySize() <= residency.getResidentBytes());
+            CHECK(residency.getPendingCount() <= config.maxJobsInFlight);
+
+            if (step % 16 == 0)
+            {
+                residency.flush();
+                CHECK(residency.getCommittedBytes() <= residency.getMemoryBudget());
+                CHECK_EQ(residency.getPendingBytes(), size_t(0));
+            }
+        }
+
+        // Standing still, the camera's own chunk is the most wanted one
+        residency.flush();
+        residency.update(position, forward);
+        residency.flush();
+        CHECK(residency.isResident(worldToChunkCoord(glm::ivec3(glm::floor(position)))));
+        CHECK(residency.getCommittedBytes() <= residency.getMemoryBudget());
+
+        residency.destroy();
+        CHECK_EQ(liveChunks, int64_t(0));
+        CHECK_EQ(residency.getResidentCount(), 0u);
+    }
+
+    uint32_t countChunksWithin(int32_t radius)
+    {
+        uint32_t count = 0;
+        for (int32_t z = -radius; z <= radius; ++z)
+        {
+            for (int32_t y = -radius; y <= radius; ++y)
+            {
+                for (int32_t x = -radius; x <= radius; ++x)
+                {
+                    count += x * x + y * y + z * z <= radius * radius ? 1 : 0;
+                }
+            }
+        }
+        return count;
+    }
+
+    // Updates with a still camera until nothing is left to load
+    void settle(ChunkResidencyManager& residency)
+    {
+        do
+        {
+            residency.update(glm::vec3(0.5f), glm::vec3(0.0f, 0.0f, 1.0f));
+            residency.flush();
+            residency.update(glm::vec3(0.5f), glm::vec3(0.0f, 0.0f, 1.0f));
+        } while (residency.getPendingCount() != 0);
+    }
+}
+
+TEST_CASE(ChunkResidencyScriptedCameraStaysInBudget)
+{
+    ChunkResidencyConfig config;
+    config.loadRadius = 4;
+    config.maxJobsInFlight = 8;
+    // Less than the 257 chunks of the load sphere, so the budget is saturated the whole way
+    config.memoryBudgetBytes = 96 * ChunkResidencyManager::getChunkMemorySize();
+    runScriptedCamera(config, 400);
+}
+
+TEST_CASE(ChunkResidencyScriptedCameraWithLodsStaysInBudget)
+{
+    ChunkResidencyConfig config;
+    config.loadRadius = 2;
+    config.lodLevels = 2;
+    config.maxJobsInFlight = 16;
+    config.memoryBudgetBytes = 48 * ChunkResidencyManager::getChunkMemorySize();
+    runScriptedCamera(config, 400);
+}
+
+TEST_CASE(ChunkResidencyLodRingsStayInMemoryBudget)
+{
+    constexpr int32_t RADIUS = 2;
+    constexpr uint32_t LOD_LEVELS = 3;
+    ThreadPool threadPool(4);
+
+    ChunkResidencyConfig config;
+    config.loadRadius = RADIUS;
+    config.maxJobsInFlight = 4096;
+
+    // Full resolution only, the memory the view distance costs without LODs
+    size_t innerBytes;
+    {
+        ChunkResidencyManager residency;
+        residency.init(config, loadFlatGround, threadPool);
+        settle(residency);
+        CHECK_EQ(residency.getResidentCount(), countChunksWithin(RADIUS));
+        innerBytes = residency.getResidentBytes();
+    }
+
+    // Three rings of LODs push the view distance out 8x, the budget is 4.5x the inner sphere
+    config.lodLevels = LOD_LEVELS;
+    config.memoryBudgetBytes = innerBytes * 9 / 2;
+
+    ChunkResidencyManager residency;
+    residency.init(config, loadFlatGround, threadPool);
+    settle(residency);
+
+    const int32_t viewDistance = RADIUS << LOD_LEVELS;
+    CHECK_EQ(residency.getResidentCount(), countChunksWithin(viewDistance));
+    CHECK_EQ(residency.getResidentLodCount(), countChunksWithin(viewDistance) - countChunksWithin(RADIUS));
+    CHECK(residency.getCommittedBytes() <= residency.getMemoryBudget());
+
+    // The rings really are there, at the level their distance asks for
+    CHECK(residency.findChunk(glm::ivec3(0, 0, RADIUS)) != nullptr);
+    const ChunkLod* farthest = residency.findChunkLod(glm::ivec3(0, 0, viewDistance));
+    REQUIRE(farthest != nullptr);
+    CHECK_EQ(farthest->level, LOD_LEVELS);
+    CHECK(residency.findChunkLod(glm::ivec3(0, viewDistance + 1, 0)) == nullptr);
+
+    reportMetric("view distance", static_cast<double>(viewDistance) / RADIUS, "x");
+    reportMetric("memory", static_cast<double>(residency.getResidentBytes()) / innerBytes, "x");
+}
+
+TEST_CASE(ChunkResidencyDestroyRightAfterLoads)
+{
+    // Loads finishing while the manager is flushed and destroyed must not touch it afterwards
+    ThreadPool threadPool(4);
+    std::atomic<uint32_t> loads{ 0 };
+    for (uint32_t i = 0; i < 64; ++i)
+    {
+        auto residency = std::make_unique<ChunkResidencyManager>();
+
+        ChunkResidencyConfig config;
+        config.loadRadius = 1;
+        residency->init(config, [&loads](Chunk& chunk) { loadFlatGround(chunk); loads++; }, threadPool);
+        residency->update(glm::vec3(0.0f), glm::vec3(0.0f, 0.0f, 1.0f));
+        residency.reset();
+    }
+    threadPool.waitIdle();
+    CHECK_EQ(loads.load(), 64u * 7u); // The radius 1 sphere is the camera chunk and its 6 neighbours
+}
+
+TEST_CASE(ChunkResidencyEvictsLoadsThatArriveUnwanted)
+{
+    // Loads around the start are held back until the camera has moved on and half filled the
+    // budget at its new spot, so they land as residents no scan wants while wanted ones exist
+    std::atomic<bool> released{ false };
+    ThreadPool threadPool(8);
+    ChunkResidencyManager residency;
+
+    ChunkResidencyConfig config;
+    config.loadRadius = 1;
+    config.maxJobsInFlight = 16;
+    config.memoryBudgetBytes = 9 * ChunkResidencyManager::getChunkMemorySize();
+    residency.init(config, [&released](Chunk& chunk)
+    {
+        if (chunk.position.x < 5)
+        {
+            released.wait(false);
+        }
+        loadFlatGround(chunk);
+    }, threadPool);
+
+    const glm::vec3 forward(0.0f, 0.0f, 1.0f);
+    const glm::vec3 start(16.0f);
+    const glm::vec3 destination = start + glm::vec3(10.0f * CHUNK_SIZE_X, 0.0f, 0.0f);
+    residency.update(start, forward);
+    CHECK_EQ(residency.getPendingCount(), 7u);
+
+    // Room for 2 of the 7 chunks around the destination
+    residency.update(destination, forward);
+    CHECK_EQ(residency.getPendingCount(), 9u);
+    while (residency.getResidentCount() < 2)
+    {
+        std::this_thread::yield();
+        residency.update(destination, forward);
+    }
+
+    released = true;
+    released.notify_all();
+    residency.flush();
+    CHECK_EQ(residency.getResidentCount(), 9u);
+
+    // Stale chunks make room for the rest of the destination
+    residency.update(destination, forward);
+    residency.flush();
+    const glm::ivec3 destinationChunk(10, 0, 0);
+    for (const glm::ivec3& offset : { glm::ivec3(0), glm::ivec3(1, 0, 0), glm::ivec3(-1, 0, 0), glm::ivec3(0, 1, 0), glm::ivec3(0, -1, 0), glm::ivec3(0, 0, 1), glm::ivec3(0, 0, -1) })
+    {
+        CHECK(residency.isResident(destinationChunk + offset));
+    }
+    CHECK_EQ(residency.getResidentCount(), 9u);
+}
@@ -0,0 +1,131 @@
+#include "TestFramework.h"
+#include "TestWorld.h"
+
+#include <atomic>
+#include <thread>
+
+namespace
+{
+    constexpr uint32_t STEPS = 3000;
+
+    // Every step writes its number into two voxels of brick 0 and copies them into brick 63, all
+    // before the same publish. A snapshot holding different numbers in the two bricks would have
+    // been torn by an edit.
+    void writeStep(World& world, const glm::ivec3& chunkCoord, uint32_t step)
+    {
+        const glm::ivec3 origin = chunkCoord * static_cast<int32_t>(CHUNK_SIZE_X);
+        const VoxelID high = static_cast<VoxelID>(step >> 8);
+        const VoxelID low = static_cast<VoxelID>(step & 0xFF);
+        world.setVoxel(origin.x + 1, origin.y + 1, origin.z + 1, high);
+        world.setVoxel(origin.x + 2, origin.y + 1, origin.z + 1, low);
+        world.applyEdit(EditOp::box(origin + glm::ivec3(30, 30, 30), origin + glm::ivec3(30, 30, 30), high));
+        world.applyEdit(EditOp::box(origin + glm::ivec3(31, 30, 30), origin + glm::ivec3(31, 30, 30), low));
+    }
+
+    uint32_t readStep(const VoxelID* voxels, uint32_t brickCorner)
+    {
+        return static_cast<uint32_t>(voxels[Chunk::index(brickCorner, brickCorner, brickCorner)]) << 8 |
+            voxels[Chunk::index(brickCorner + 1, brickCorner, brickCorner)];
+    }
+}
+
+TEST_CASE(ChunkSnapshotConcurrentEditsAndReads)
+{
+    World world;
+    loadTestWorld(world, 1, loadFlatGround);
+
+    const glm::ivec3 chunkCoords[] = { glm::ivec3(0, 0, 0), glm::ivec3(0, -1, 0), glm::ivec3(1, 0, 0) };
+    std::vector<std::shared_ptr<const ChunkSnapshotSlot>> slots;
+    for (const glm::ivec3& chunkCoord : chunkCoords)
+    {
+        writeStep(world, chunkCoord, 0);
+        slots.push_back(world.getSnapshotSlot(chunkCoord));
+        REQUIRE(slots.back() != nullptr);
+    }
+
+    std::atomic<bool> done{ false };
+    std::atomic<uint32_t> failures{ 0 };
+    std::atomic<uint64_t> snapshotsRead{ 0 };
+
+    // Readers copy out whole snapshots and check them while the main thread keeps publishing
+    auto reader = [&](uint32_t seed)
+    {
+        std::vector<VoxelID> voxels(CHUNK_VOLUME);
+        std::vector<uint32_t> lastStep(slots.size(), 0);
+        std::vector<uint64_t> lastVersion(slots.size(), 0);
+        uint32_t i = seed;
+        while (!done.load(std::memory_order_acquire))
+        {
+            const size_t slot = i++ % slots.size();
+            const ChunkSnapshotPtr snapshot = slots[slot]->load();
+            snapshot->copyTo(voxels.data());
+
+            const uint32_t step = readStep(voxels.data(), 1);
+            const bool consistent = step == readStep(voxels.data(), 30) &&
+                snapshot->get(1, 1, 1) == voxels[Chunk::index(1, 1, 1)] &&
+                // Untouched bricks still hold the ground they were shared from
+                voxels[Chunk::index(12, 12, 12)] == (snapshot->getPosition().y < 0 ? STONE_VOXEL : AIR_VOXEL);
+            const bool ordered = step >= lastStep[slot] && snapshot->getVersion() >= lastVersion[slot];
+            if (!consistent || !ordered)
+            {
+                failures.fetch_add(1);
+            }
+            lastStep[slot] = step;
+            lastVersion[slot] = snapshot->getVersion();
+            snapshotsRead.fetch_add(1, std::memory_order_relaxed);
+        }
+    };
+
+    std::vector<std::thread> readers;
+    for (uint32_t i = 0; i < 3; ++i)
+    {
+        readers.emplace_back(reader, i);
+    }
+
+    uint32_t lastWritten[3] = {};
+    for (uint32_t step = 1; step <= STEPS; ++step)
+    {
+        writeStep(world, chunkCoords[step % 3], step);
+        lastWritten[step % 3] = step;
+        if (step % 2 == 0)
+        {
+            writeStep(world, chunkCoords[(step + 1) % 3], step);
+            lastWritten[(step + 1) % 3] = step;
+        }
+        world.publishSnapshots();
+
+        // Every publish clones only the two edited bricks
+        if (slots[step % 3]->load()->getClonedBrickCount() != 2)
+        {
+            failures.fetch_add(1);
+        }
+    }
+
+    // Moving away until the budget runs out evicts the chunks under the readers, their slots
+    // stay readable but stop changing
+    for (uint32_t i = 1; i <= 4; ++i)
+    {
+        world.update(FirstPersonCamera(glm::vec3(0.0f, 0.0f, 100.0f * i * CHUNK_SIZE_X)));
+        world.getResidencyManager().flush();
+    }
+    CHECK(world.getChunk(chunkCoords[0]) == nullptr);
+    const uint64_t readBeforeEviction = snapshotsRead.load();
+    while (snapshotsRead.load() < readBeforeEviction + 1000)
+    {
+        std::this_thread::yield();
+    }
+
+    done.store(true, std::memory_order_release);
+    for (std::thread& thread : readers)
+    {
+        thread.join();
+    }
+
+    CHECK_EQ(failures.load(), 0u);
+    for (size_t i = 0; i < slots.size(); ++i)
+    {
+        std::vector<VoxelID> voxels(CHUNK_VOLUME);
+        slots[i]->load()->copyTo(voxels.data());
+        CHECK_EQ(readStep(voxels.data(), 1), lastWritten[i]);
+    }
+}
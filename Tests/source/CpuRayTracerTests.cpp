@@ -0,0 +1,119 @@
+#include "TestFramework.h"
+#include "TestScene.h"
+#include "GoldenImage.h"
+
+#include "CpuRayTracer.h"
+#include "FirstPersonCamera.h"
+
+namespace
+{
+    // Rays grazing a sphere may flip between hit and miss with the last bit of the intersection
+    constexpr uint32_t MAX_GRAZING_PIXELS = 8;
+
+    // A sphere scene with the engine's materials, and every BVH width the tracer can use
+    struct RenderScene
+    {
+        SphereScene spheres;
+        std::vector<uint32_t> materialIds;
+        MaterialRegistry materials;
+        BVH bvh;
+        BVH4 bvh4;
+        BVH8 bvh8;
+        CpuRayTracerScene scene;
+
+        RenderScene(uint32_t count, uint32_t seed)
+            : spheres(makeSphereScene(count, seed))
+        {
+            // Four VoxelIDs per uint, as in the sphere material buffer
+            const VoxelID ids[] = { STONE_VOXEL, DIRT_VOXEL, GRASS_VOXEL, SAND_VOXEL, WATER_VOXEL, TORCH_VOXEL };
+            std::mt19937 random(seed);
+            materialIds.assign((count + 3) / 4, 0);
+            for (uint32_t i = 0; i < count; ++i)
+            {
+                materialIds[i / 4] |= static_cast<uint32_t>(ids[random() % std::size(ids)]) << (i % 4 * 8);
+            }
+
+            bvh.build(spheres.aabbs.data(), count);
+            bvh4.collapse(bvh);
+            bvh8.collapse(bvh);
+
+            scene.spheres = spheres.spheres.data();
+            scene.sphereCount = count;
+            scene.sphereMaterialIds = materialIds.data();
+            scene.materials = &materials;
+            scene.bvh = &bvh;
+            scene.bvh4 = &bvh4;
+            scene.bvh8 = &bvh8;
+        }
+    };
+
+    // Above one corner of the scene, looking down across it
+    FirstPersonCamera makeCamera(const SphereScene& spheres, uint32_t width, uint32_t height)
+    {
+        FirstPersonCamera camera(glm::vec3(-0.1f, 0.8f, -0.1f) * spheres.extent, 60.0f, static_cast<float>(width) / static_cast<float>(height));
+        camera.setLookDirection(-30.0f, 45.0f);
+        return camera;
+    }
+
+    std::vector<glm::vec4> render(CpuRayTracer& tracer, const RenderScene& scene, const CpuRenderSettings& settings, ThreadPool& threadPool)
+    {
+        FirstPersonCamera camera = makeCamera(scene.spheres, settings.width, settings.height);
+        std::vector<glm::vec4> image;
+        tracer.render(scene.scene, camera.getInverseViewMatrix(), camera.getInverseProjectionMatrix(), ShadingConstants(), settings, image, threadPool);
+        return image;
+    }
+}
+
+TEST_CASE(CpuRayTracerMatchesGoldenImage)
+{
+    const RenderScene scene(4000, 11);
+    ThreadPool threadPool(2);
+    CpuRayTracer tracer;
+
+    // Not a multiple of the 4x2 packets or the tiles, so partial packets get traced too
+    CpuRenderSettings settings;
+    settings.width = 158;
+    settings.height = 117;
+    settings.tileSize = 13;
+    settings.packets = false;
+    settings.bvhWidth = 2;
+    const std::vector<glm::vec4> reference = render(tracer, scene, settings, threadPool);
+    CHECK_EQ(tracer.getStats().rayCount, static_cast<uint64_t>(settings.width) * settings.height);
+    CHECK(tracer.getStats().hitCount > tracer.getStats().rayCount / 2 && tracer.getStats().hitCount < tracer.getStats().rayCount);
+    CHECK(matchesGoldenImage("CpuRayTracerSpheres", settings.width, settings.height, reference, MAX_GRAZING_PIXELS));
+
+    // Every traversal renders the same image, the packets' SIMD sphere test rounding a little differently
+    const std::vector<uint8_t> quantized = quantizeImage(reference);
+    for (bool packets : { false, true })
+    {
+        for (uint32_t bvhWidth : { 2u, 4u, 8u })
+        {
+            settings.packets = packets;
+            settings.bvhWidth = bvhWidth;
+            const uint32_t differences = countPixelDifferences(quantizeImage(render(tracer, scene, settings, threadPool)), quantized);
+            CHECK(packets ? differences <= MAX_GRAZING_PIXELS : differences == 0);
+        }
+    }
+}
+
+BENCHMARK(CpuRayTracerThroughput)
+{
+    const RenderScene scene(1000000, 11);
+    CpuRayTracer tracer;
+
+    CpuRenderSettings settings;
+    settings.width = 1280;
+    settings.height = 720;
+    reportMetric("threads", ThreadPool::getInstance().getThreadCount(), "");
+    for (bool packets : { false, true })
+    {
+        for (uint32_t bvhWidth : { 2u, 4u, 8u })
+        {
+            settings.packets = packets;
+            settings.bvhWidth = bvhWidth;
+            render(tracer, scene, settings, ThreadPool::getInstance());
+            const std::string name = std::string(packets ? "packets" : "single rays") + ", BVH" + std::to_string(bvhWidth);
+            reportMetric(name, tracer.getStats().megaRaysPerSecond, "Mrays/s");
+        }
+    }
+}
@@ -0,0 +1,177 @@
+#include "TestFramework.h"
+#include "TestWorld.h"
+
+#include "CellularSimulation.h"
+#include "EditJournal.h"
+#include "TerrainGenerator.h"
+#include "Timer.h"
+
+#include <map>
+
+namespace
+{
+    using WorldVoxels = std::map<ChunkKey, std::vector<VoxelID>>;
+
+    WorldVoxels captureVoxels(World& world)
+    {
+        WorldVoxels voxels;
+        world.forEachChunk([&voxels](Chunk& chunk)
+        {
+            voxels[packChunkKey(chunk.position)].assign(chunk.voxels.begin(), chunk.voxels.end());
+        });
+        return voxels;
+    }
+}
+
+TEST_CASE(EditJournalUndoRedoRoundTrips)
+{
+    const TerrainGenerator terrain;
+    World world;
+    loadTestWorld(world, 2, terrain.makeChunkLoader());
+
+    ThreadPool threadPool(2);
+    EditJournal journal;
+    world.setEditJournal(&journal);
+
+    VoxelClipboard clipboard;
+    world.copyRegion(glm::ivec3(-4, -8, -4), glm::ivec3(4, 2, 4), clipboard);
+
+    std::vector<WorldVoxels> states;
+    states.push_back(captureVoxels(world));
+
+    // Every kind of step: bulk ops across chunk borders, single voxels, and a grouped stroke
+    world.applyEdit(EditOp::sphere(glm::vec3(0.0f, -2.0f, 0.0f), 9.0f, AIR_VOXEL), threadPool);
+    states.push_back(captureVoxels(world));
+    world.applyEdit(EditOp::box(glm::ivec3(-20, 3, -5), glm::ivec3(20, 6, 5), STONE_VOXEL), threadPool);
+    states.push_back(captureVoxels(world));
+    world.setVoxel(31, 0, 31, TORCH_VOXEL);
+    states.push_back(captureVoxels(world));
+    world.setVoxel(32, 0, 31, WATER_VOXEL);
+    states.push_back(captureVoxels(world));
+    world.applyEdit(EditOp::paste(clipboard, glm::ivec3(20, 10, -30), true), threadPool);
+    states.push_back(captureVoxels(world));
+
+    journal.beginGroup();
+    world.applyEdit(EditOp::line(glm::vec3(-30.0f, 0.0f, 0.0f), glm::vec3(30.0f, 8.0f, 10.0f), 2.5f, SAND_VOXEL), threadPool);
+    world.setVoxel(0, 20, 0, DIRT_VOXEL);
+    world.setVoxel(0, 20, 0, GRASS_VOXEL);
+    world.applyEdit(EditOp::sphere(glm::vec3(0.0f, 20.0f, 0.0f), 3.0f, AIR_VOXEL), threadPool);
+    journal.endGroup();
+    states.push_back(captureVoxels(world));
+
+    const size_t stepCount = states.size() - 1;
+    CHECK_EQ(journal.getStats().undoSteps, stepCount);
+
+    for (size_t i = stepCount; i > 0; --i)
+    {
+        REQUIRE(journal.undo(world));
+        CHECK(captureVoxels(world) == states[i - 1]);
+    }
+    CHECK(!journal.undo(world));
+
+    for (size_t i = 1; i <= stepCount; ++i)
+    {
+        REQUIRE(journal.redo(world));
+        CHECK(captureVoxels(world) == states[i]);
+    }
+    CHECK(!journal.redo(world));
+
+    // A new edit after undoing drops what could have been redone
+    journal.undo(world);
+    journal.undo(world);
+    REQUIRE(world.getVoxel(5, 5, 5) != DIRT_VOXEL);
+    world.setVoxel(5, 5, 5, DIRT_VOXEL);
+    CHECK(!journal.canRedo());
+    CHECK_EQ(journal.getStats().undoSteps, stepCount - 1);
+    REQUIRE(journal.undo(world));
+    CHECK(captureVoxels(world) == states[stepCount - 2]);
+}
+
+TEST_CASE(EditJournalKeepsSimulatedVoxels)
+{
+    World world;
+    loadTestWorld(world, 2, loadFlatGround);
+
+    ThreadPool threadPool(2);
+    EditJournal journal;
+    world.setEditJournal(&journal);
+    CellularSimulation simulation;
+
+    // A pit, then sand above it that the simulation drops in
+    const glm::ivec3 pitMin(-3, -6, -3);
+    const glm::ivec3 pitMax(3, -1, 3);
+    world.applyEdit(EditOp::box(pitMin, pitMax, AIR_VOXEL), threadPool);
+    world.applyEdit(EditOp::box(glm::ivec3(-1, 4, -1), glm::ivec3(1, 8, 1), SAND_VOXEL), threadPool);
+    simulation.activateRegion(glm::ivec3(-1, 4, -1), glm::ivec3(1, 8, 1));
+    for (uint32_t tick = 0; tick < 200 && simulation.getStats().activeCells > 0; ++tick)
+    {
+        simulation.tick(world, threadPool);
+    }
+    CHECK_EQ(simulation.getStats().activeCells, 0u);
+
+    const glm::ivec3 regionMin(-8, -8, -8);
+    const glm::ivec3 regionMax(8, 12, 8);
+    const uint32_t sand = countVoxels(world, SAND_VOXEL, regionMin, regionMax);
+    CHECK_EQ(sand, 45u);
+    CHECK_EQ(countVoxels(world, SAND_VOXEL, pitMin, pitMax), sand);
+
+    // Undoing the sand finds it moved and leaves it; undoing the pit refills only its empty part
+    REQUIRE(journal.undo(world));
+    REQUIRE(journal.undo(world));
+    CHECK_EQ(countVoxels(world, SAND_VOXEL, regionMin, regionMax), sand);
+    CHECK_EQ(countVoxels(world, AIR_VOXEL, pitMin, pitMax), 0u);
+    CHECK_EQ(countVoxels(world, STONE_VOXEL, pitMin, pitMax) + sand, 7u * 6u * 7u);
+
+    // Redo digs the stone back out around the sand
+    REQUIRE(journal.redo(world));
+    CHECK_EQ(countVoxels(world, SAND_VOXEL, regionMin, regionMax), sand);
+    CHECK_EQ(countVoxels(world, AIR_VOXEL, pitMin, pitMax) + sand, 7u * 6u * 7u);
+    // The sand's old spot is free again, so placing it is redone in full
+    REQUIRE(journal.redo(world));
+    CHECK_EQ(countVoxels(world, SAND_VOXEL, regionMin, regionMax), 2 * sand);
+}
+
+// One brush stroke of 96 overlapping sphere stamps carved along a wavy path through flat ground,
+// recorded as a single step: what it costs to hold, and to undo and redo it
+BENCHMARK(EditJournalBrushStroke)
+{
+    World world;
+    loadTestWorld(world, 3, loadFlatGround);
+
+    ThreadPool& threadPool = ThreadPool::getInstance();
+    EditJournal journal;
+    world.setEditJournal(&journal);
+    const WorldVoxels before = captureVoxels(world);
+
+    constexpr uint32_t STAMP_COUNT = 96;
+    Timer timer;
+    journal.beginGroup();
+    for (uint32_t i = 0; i < STAMP_COUNT; ++i)
+    {
+        const float x = -72.0f + 1.5f * static_cast<float>(i);
+        const glm::vec3 center(x, -2.0f + 3.0f * std::sin(x * 0.1f), 20.0f * std::sin(x * 0.05f));
+        world.applyEdit(EditOp::sphere(center, 6.0f, AIR_VOXEL), threadPool);
+    }
+    journal.endGroup();
+    timer.stop();
+    const WorldVoxels after = captureVoxels(world);
+
+    const EditJournalStats stats = journal.getStats();
+    CHECK_EQ(stats.undoSteps, 1u);
+    reportMetric("stroke", timer.elapsedTime<std::chrono::microseconds>() * 1e-3, "ms");
+    reportMetric("changed voxels", static_cast<double>(stats.voxelCount), "");
+    reportMetric("journal", static_cast<double>(stats.usedBytes), "bytes");
+    reportMetric("journal per changed voxel", static_cast<double>(stats.usedBytes) / static_cast<double>(stats.voxelCount), "bytes");
+
+    timer.start();
+    REQUIRE(journal.undo(world));
+    timer.stop();
+    reportMetric("undo", timer.elapsedTime<std::chrono::microseconds>() * 1e-3, "ms");
+    CHECK(captureVoxels(world) == before);
+
+    timer.start();
+    REQUIRE(journal.redo(world));
+    timer.stop();
+    reportMetric("redo", timer.elapsedTime<std::chrono::microseconds>() * 1e-3, "ms");
+    CHECK(captureVoxels(world) == after);
+}
@@ -0,0 +1,149 @@
+#pragma once
+
+#include "TestFramework.h"
+#include "ImageWriter.h"
+
+#include "glm/glm.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <iterator>
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+
+// Reads back the PNGs ImageWriter::writePng produces: 8-bit RGBA, stored deflate blocks and no
+// row filters. Anything else, including real compressed PNGs, is rejected.
+inline bool readPng(const std::string& path, uint32_t& width, uint32_t& height, std::vector<uint8_t>& rgba)
+{
+    std::ifstream file(path, std::ios::binary);
+    const std::vector<uint8_t> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    static const uint8_t SIGNATURE[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    if (bytes.size() < 8 || !std::equal(SIGNATURE, SIGNATURE + 8, bytes.begin()))
+    {
+        return false;
+    }
+
+    auto bigEndian = [&bytes](size_t offset)
+    {
+        return static_cast<uint32_t>(bytes[offset]) << 24 | static_cast<uint32_t>(bytes[offset + 1]) << 16 |
+            static_cast<uint32_t>(bytes[offset + 2]) << 8 | bytes[offset + 3];
+    };
+
+    std::vector<uint8_t> zlib;
+    width = 0;
+    height = 0;
+    for (size_t offset = 8; offset + 12 <= bytes.size();)
+    {
+        const uint32_t length = bigEndian(offset);
+        const std::string type(bytes.begin() + offset + 4, bytes.begin() + offset + 8);
+        const size_t data = offset + 8;
+        if (data + length + 4 > bytes.size())
+        {
+            return false;
+        }
+
+        if (type == "IHDR")
+        {
+            width = bigEndian(data);
+            height = bigEndian(data + 4);
+            if (bytes[data + 8] != 8 || bytes[data + 9] != 6 || bytes[data + 12] != 0)
+            {
+                return false;
+            }
+        }
+        else if (type == "IDAT")
+        {
+            zlib.insert(zlib.end(), bytes.begin() + data, bytes.begin() + data + length);
+        }
+        offset = data + length + 4;
+    }
+
+    std::vector<uint8_t> raw;
+    for (size_t offset = 2; offset + 5 <= zlib.size();)
+    {
+        const uint8_t header = zlib[offset];
+        const uint16_t length = static_cast<uint16_t>(zlib[offset + 1] | zlib[offset + 2] << 8);
+        if ((header & 6) != 0 || offset + 5 + length > zlib.size())
+        {
+            return false;
+        }
+        raw.insert(raw.end(), zlib.begin() + offset + 5, zlib.begin() + offset + 5 + length);
+        offset += 5 + length;
+        if (header & 1)
+        {
+            break;
+        }
+    }
+
+    const size_t rowBytes = 1 + static_cast<size_t>(width) * 4;
+    if (width == 0 || raw.size() != rowBytes * height)
+    {
+        return false;
+    }
+
+    rgba.resize(static_cast<size_t>(width) * height * 4);
+    for (uint32_t y = 0; y < height; ++y)
+    {
+        const uint8_t* row = raw.data() + y * rowBytes;
+        if (row[0] != 0)
+        {
+            return false;
+        }
+        std::copy(row + 1, row + rowBytes, rgba.begin() + static_cast<size_t>(y) * width * 4);
+    }
+    return true;
+}
+
+// The 8-bit values writePng stores for an image
+inline std::vector<uint8_t> quantizeImage(const std::vector<glm::vec4>& image)
+{
+    std::vector<uint8_t> rgba(image.size() * 4);
+    for (size_t i = 0; i < rgba.size(); ++i)
+    {
+        rgba[i] = static_cast<uint8_t>(std::clamp(image[i / 4][static_cast<glm::length_t>(i % 4)], 0.0f, 1.0f) * 255.0f + 0.5f);
+    }
+    return rgba;
+}
+
+// Pixels with a channel more than one step apart. Float shading differs in the last bits between
+// compilers and between the scalar and SIMD sphere tests, which moves a channel by one at most.
+inline uint32_t countPixelDifferences(const std::vector<uint8_t>& a, const std::vector<uint8_t>& b)
+{
+    uint32_t differences = 0;
+    for (size_t pixel = 0; pixel + 4 <= std::min(a.size(), b.size()); pixel += 4)
+    {
+        bool different = false;
+        for (size_t channel = pixel; channel < pixel + 4; ++channel)
+        {
+            different = different || std::abs(static_cast<int32_t>(a[channel]) - static_cast<int32_t>(b[channel])) > 1;
+        }
+        differences += different ? 1 : 0;
+    }
+    return differences;
+}
+
+// Compares an image against Tests/data/<name>.png, allowing up to maxDifferentPixels to differ
+// more than countPixelDifferences tolerates. On a mismatch or a missing golden the image is
+// written to the temp directory, to inspect or check in as the new golden.
+inline bool matchesGoldenImage(const std::string& name, uint32_t width, uint32_t height, const std::vector<glm::vec4>& image, uint32_t maxDifferentPixels)
+{
+    uint32_t goldenWidth = 0;
+    uint32_t goldenHeight = 0;
+    std::vector<uint8_t> golden;
+    const bool loaded = readPng(getTestDataPath(name + ".png"), goldenWidth, goldenHeight, golden);
+
+    uint32_t differences = 0;
+    const bool matches = loaded && goldenWidth == width && goldenHeight == height &&
+        (differences = countPixelDifferences(golden, quantizeImage(image))) <= maxDifferentPixels;
+    if (!matches)
+    {
+        const std::string path = makeTempDirectory("GoldenImages/" + name) + "/" + name + ".png";
+        ImageWriter::writePng(path, width, height, &image[0].x);
+        std::cerr << "Golden image " << name << (loaded ? " differs in " + std::to_string(differences) + " pixels" : " is missing") <<
+            ", the rendered image is at " << path << std::endl;
+    }
+    return matches;
+}
@@ -0,0 +1,264 @@
+#include "TestFramework.h"
+
+#include "InstanceTable.h"
+
+#include <cstring>
+#include <map>
+#include <random>
+
+namespace
+{
+    VkAccelerationStructureInstanceKHR makeInstance(uint32_t customIndex)
+    {
+        VkAccelerationStructureInstanceKHR instance{};
+        instance.transform.matrix[0][0] = 1.0f;
+        instance.transform.matrix[1][1] = 1.0f;
+        instance.transform.matrix[2][2] = 1.0f;
+        instance.instanceCustomIndex = customIndex;
+        instance.mask = 0xFF;
+        instance.accelerationStructureReference = 0x1000 + customIndex;
+        return instance;
+    }
+
+    VkTransformMatrixKHR makeTranslation(float x)
+    {
+        VkTransformMatrixKHR transform{};
+        transform.matrix[0][0] = 1.0f;
+        transform.matrix[1][1] = 1.0f;
+        transform.matrix[2][2] = 1.0f;
+        transform.matrix[0][3] = x;
+        return transform;
+    }
+
+    std::vector<InstanceRange> takeRanges(InstanceTable& table, uint32_t mergeGap = 0)
+    {
+        std::vector<InstanceRange> ranges;
+        table.takeDirtyRanges(ranges, mergeGap);
+        return ranges;
+    }
+
+    bool rangesEqual(const std::vector<InstanceRange>& ranges, std::initializer_list<InstanceRange> expected)
+    {
+        return std::equal(ranges.begin(), ranges.end(), expected.begin(), expected.end(), [](const InstanceRange& a, const InstanceRange& b)
+        {
+            return a.first == b.first && a.count == b.count;
+        });
+    }
+}
+
+TEST_CASE(InstanceTableAddRemoveCompact)
+{
+    InstanceTable table;
+    std::vector<InstanceHandle> handles;
+    for (uint32_t i = 0; i < 10; ++i)
+    {
+        handles.push_back(table.add(makeInstance(i), i % 3));
+        CHECK_EQ(table.getSlot(handles.back()), i);
+    }
+    CHECK_EQ(table.getSlotCount(), 10u);
+    CHECK_EQ(table.getLiveCount(), 10u);
+
+    // Removing leaves inactive holes and moves nothing
+    uint64_t layoutVersion = table.getLayoutVersion();
+    for (uint32_t i : { 1u, 4u, 5u, 9u })
+    {
+        CHECK(table.remove(handles[i]));
+    }
+    CHECK(table.getLayoutVersion() != layoutVersion);
+    CHECK_EQ(table.getSlotCount(), 10u);
+    CHECK_EQ(table.getHoleCount(), 4u);
+    CHECK(!table.isLive(4));
+    CHECK_EQ(table.getInstance(4).accelerationStructureReference, 0u);
+    CHECK_EQ(table.getSlot(handles[8]), 8u);
+
+    // The next add takes the latest hole
+    handles[9] = table.add(makeInstance(19), 2);
+    CHECK_EQ(table.getSlot(handles[9]), 9u);
+    CHECK_EQ(table.getHoleCount(), 3u);
+
+    // Compacting pulls the last live instances down into the holes, handles follow them
+    layoutVersion = table.getLayoutVersion();
+    CHECK_EQ(table.compact(), 3u);
+    CHECK(table.getLayoutVersion() != layoutVersion);
+    CHECK_EQ(table.getSlotCount(), 7u);
+    CHECK_EQ(table.getHoleCount(), 0u);
+    for (uint32_t i : { 0u, 2u, 3u, 6u, 7u, 8u, 9u })
+    {
+        const uint32_t slot = table.getSlot(handles[i]);
+        REQUIRE(slot < table.getSlotCount());
+        CHECK(table.isLive(slot));
+        CHECK_EQ(table.getInstance(slot).instanceCustomIndex, i == 9 ? 19u : i);
+        CHECK_EQ(table.getBlas(slot), i == 9 ? 2u : i % 3);
+    }
+    CHECK_EQ(table.getSlot(handles[9]), 1u);
+    CHECK_EQ(table.getSlot(handles[8]), 4u);
+    CHECK_EQ(table.getSlot(handles[7]), 5u);
+    CHECK_EQ(table.getSlot(handles[6]), 6u);
+
+    // Nothing to fill
+    CHECK_EQ(table.compact(), 0u);
+
+    // Only holes at the end
+    CHECK(table.remove(handles[6]));
+    CHECK(table.remove(handles[0]));
+    CHECK(table.remove(handles[9]));
+    CHECK(table.remove(handles[2]));
+    CHECK(table.remove(handles[3]));
+    CHECK(table.remove(handles[8]));
+    CHECK_EQ(table.compact(), 1u);
+    CHECK_EQ(table.getSlotCount(), 1u);
+    CHECK_EQ(table.getSlot(handles[7]), 0u);
+    CHECK(table.remove(handles[7]));
+    CHECK_EQ(table.compact(), 0u);
+    CHECK_EQ(table.getSlotCount(), 0u);
+}
+
+TEST_CASE(InstanceTableRejectsStaleHandles)
+{
+    InstanceTable table;
+    CHECK(!table.contains(InstanceHandle()));
+    CHECK(!table.remove(InstanceHandle()));
+
+    const InstanceHandle first = table.add(makeInstance(1), 0);
+    CHECK(table.remove(first));
+    CHECK(!table.remove(first));
+
+    // The id is reused with a new generation, the old handle doesn't reach the new instance
+    const InstanceHandle second = table.add(makeInstance(2), 0);
+    CHECK_EQ(second.id, first.id);
+    CHECK(!(second == first));
+    CHECK(!table.contains(first));
+    CHECK(!table.setTransform(first, makeTranslation(5.0f)));
+    CHECK(!table.remove(first));
+    CHECK(table.contains(second));
+    CHECK_EQ(table.getInstance(table.getSlot(second)).transform.matrix[0][3], 0.0f);
+
+    // Nor across compaction or clear
+    const InstanceHandle third = table.add(makeInstance(3), 0);
+    CHECK(table.remove(second));
+    table.compact();
+    CHECK(!table.contains(second));
+    CHECK_EQ(table.getSlot(third), 0u);
+
+    table.clear();
+    CHECK(!table.contains(third));
+    const InstanceHandle afterClear[2] = { table.add(makeInstance(4), 0), table.add(makeInstance(5), 0) };
+    CHECK_EQ(afterClear[1].id, third.id);
+    CHECK(!table.contains(third));
+    CHECK(!table.contains(second));
+    CHECK(!table.remove(third));
+    CHECK(table.contains(afterClear[0]) && table.contains(afterClear[1]));
+    CHECK_EQ(table.getLiveCount(), 2u);
+}
+
+TEST_CASE(InstanceTableDirtyRangesMerge)
+{
+    InstanceTable table;
+    std::vector<InstanceHandle> handles;
+    for (uint32_t i = 0; i < 24; ++i)
+    {
+        handles.push_back(table.add(makeInstance(i), 0));
+    }
+    CHECK(rangesEqual(takeRanges(table), { { 0, 24 } }));
+    CHECK(!table.hasDirtySlots());
+    CHECK(takeRanges(table).empty());
+
+    // Repeated and unsorted changes come out once, sorted
+    for (uint32_t slot : { 20u, 3u, 1u, 9u, 2u, 7u, 3u, 20u })
+    {
+        CHECK(table.setTransform(handles[slot], makeTranslation(static_cast<float>(slot))));
+    }
+    CHECK(rangesEqual(takeRanges(table), { { 1, 3 }, { 7, 1 }, { 9, 1 }, { 20, 1 } }));
+
+    // Gaps up to mergeGap are bridged, and the gap slots come along
+    for (uint32_t slot : { 20u, 3u, 1u, 9u, 2u, 7u })
+    {
+        table.setTransform(handles[slot], makeTranslation(1.0f));
+    }
+    CHECK(rangesEqual(takeRanges(table, 1), { { 1, 3 }, { 7, 3 }, { 20, 1 } }));
+    for (uint32_t slot : { 20u, 3u, 1u, 9u, 2u, 7u })
+    {
+        table.setTransform(handles[slot], makeTranslation(2.0f));
+    }
+    CHECK(rangesEqual(takeRanges(table, 3), { { 1, 9 }, { 20, 1 } }));
+    for (uint32_t slot : { 20u, 3u, 1u, 9u, 2u, 7u })
+    {
+        table.setTransform(handles[slot], makeTranslation(3.0f));
+    }
+    CHECK(rangesEqual(takeRanges(table, 10), { { 1, 20 } }));
+
+    // Compaction dirties the filled holes and drops the slots cut off the end
+    table.remove(handles[23]);
+    table.remove(handles[22]);
+    table.remove(handles[4]);
+    table.setTransform(handles[21], makeTranslation(4.0f));
+    table.compact();
+    CHECK(rangesEqual(takeRanges(table), { { 4, 1 } }));
+
+    table.markAllDirty();
+    CHECK(rangesEqual(takeRanges(table, 0), { { 0, table.getSlotCount() } }));
+}
+
+// Random adds, removes, moves and compactions, each followed by an upload of just the dirty
+// ranges into a mirror of the instance buffer. The mirror has to match the table every time.
+TEST_CASE(InstanceTableDirtyRangesKeepMirrorInSync)
+{
+    std::mt19937 random(7);
+    InstanceTable table;
+    std::map<uint32_t, InstanceHandle> live; // Custom index -> handle
+    std::vector<InstanceHandle> removed;
+    std::vector<VkAccelerationStructureInstanceKHR> mirror;
+    uint32_t nextIndex = 0;
+
+    for (uint32_t step = 0; step < 5000; ++step)
+    {
+        const uint32_t operation = random() % 100;
+        if (operation < 40 || live.empty())
+        {
+            live[nextIndex] = table.add(makeInstance(nextIndex), nextIndex % 5);
+            nextIndex++;
+        }
+        else if (operation < 70)
+        {
+            auto it = std::next(live.begin(), random() % live.size());
+            CHECK(table.remove(it->second));
+            removed.push_back(it->second);
+            live.erase(it);
+        }
+        else if (operation < 97)
+        {
+            auto it = std::next(live.begin(), random() % live.size());
+            CHECK(table.setTransform(it->second, makeTranslation(static_cast<float>(step))));
+        }
+        else
+        {
+            table.compact();
+            CHECK_EQ(table.getHoleCount(), 0u);
+        }
+
+        std::vector<InstanceRange> ranges;
+        table.takeDirtyRanges(ranges, random() % 4);
+        mirror.resize(table.getSlotCount());
+        for (const InstanceRange& range : ranges)
+        {
+            REQUIRE(range.first + range.count <= table.getSlotCount());
+            std::memcpy(mirror.data() + range.first, table.getInstances() + range.first, range.count * sizeof(VkAccelerationStructureInstanceKHR));
+        }
+        REQUIRE(std::memcmp(mirror.data(), table.getInstances(), mirror.size() * sizeof(VkAccelerationStructureInstanceKHR)) == 0);
+    }
+
+    CHECK_EQ(table.getLiveCount(), static_cast<uint32_t>(live.size()));
+    for (const auto& [index, handle] : live)
+    {
+        const uint32_t slot = table.getSlot(handle);
+        REQUIRE(slot != InstanceTable::INVALID_SLOT);
+        CHECK_EQ(table.getInstance(slot).instanceCustomIndex, index);
+        CHECK_EQ(table.getBlas(slot), index % 5);
+    }
+    uint32_t staleAccepted = 0;
+    for (const InstanceHandle& handle : removed)
+    {
+        staleAccepted += table.contains(handle) ? 1 : 0;
+    }
+    CHECK_EQ(staleAccepted, 0u);
+}
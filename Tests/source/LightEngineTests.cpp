@@ -0,0 +1,359 @@
+#include "TestFramework.h"
+#include "TestWorld.h"
+
+#include "LightEngine.h"
+#include "TerrainGenerator.h"
+#include "Timer.h"
+
+#include <random>
+
+namespace
+{
+    const glm::ivec3 DIRECTIONS[6] =
+    {
+        { -1, 0, 0 }, { 1, 0, 0 },
+        { 0, -1, 0 }, { 0, 1, 0 },
+        { 0, 0, -1 }, { 0, 0, 1 },
+    };
+
+    // Whole-world flood fill over a dense box around the resident chunks, the same rules as
+    // LightEngine without its batching, colouring, windows or incremental updates
+    class ReferenceLight
+    {
+    public:
+        ReferenceLight(World& world, const LightEngine& engine)
+        {
+            glm::ivec3 minChunk(INT32_MAX);
+            glm::ivec3 maxChunk(INT32_MIN);
+            world.forEachChunk([&](Chunk& chunk)
+            {
+                minChunk = glm::min(minChunk, chunk.position);
+                maxChunk = glm::max(maxChunk, chunk.position);
+            });
+            m_chunkMin = minChunk;
+            m_chunkCount = maxChunk - minChunk + 1;
+            m_origin = minChunk * static_cast<int32_t>(CHUNK_SIZE_X);
+            m_size = m_chunkCount * static_cast<int32_t>(CHUNK_SIZE_X);
+
+            const size_t volume = static_cast<size_t>(m_size.x) * m_size.y * m_size.z;
+            m_voxels.assign(volume, AIR_VOXEL);
+            m_sky.assign(volume, 0);
+            m_block.assign(volume, 0);
+            m_resident.assign(static_cast<size_t>(m_chunkCount.x) * m_chunkCount.y * m_chunkCount.z, false);
+
+            world.forEachChunk([&](Chunk& chunk)
+            {
+                m_resident[chunkIndex(chunk.position)] = true;
+                const glm::ivec3 base = chunk.getWorldOrigin() - m_origin;
+                for (uint32_t z = 0; z < CHUNK_SIZE_Z; ++z)
+                {
+                    for (uint32_t y = 0; y < CHUNK_SIZE_Y; ++y)
+                    {
+                        for (uint32_t x = 0; x < CHUNK_SIZE_X; ++x)
+                        {
+                            m_voxels[index(base + glm::ivec3(x, y, z))] = chunk.get(x, y, z);
+                        }
+                    }
+                }
+            });
+
+            std::vector<glm::ivec3> queue;
+
+            // Full sky straight down from the top of every run of resident chunks
+            for (int32_t z = 0; z < m_size.z; ++z)
+            {
+                for (int32_t x = 0; x < m_size.x; ++x)
+                {
+                    bool open = true;
+                    for (int32_t y = m_size.y - 1; y >= 0; --y)
+                    {
+                        const glm::ivec3 p(x, y, z);
+                        if (!isResident(p))
+                        {
+                            open = true;
+                            continue;
+                        }
+                        open = open && engine.isTransparent(m_voxels[index(p)]);
+                        if (open)
+                        {
+                            m_sky[index(p)] = MAX_LIGHT_LEVEL;
+                            queue.push_back(p);
+                        }
+                    }
+                }
+            }
+            flood(m_sky, queue, true, engine);
+
+            queue.clear();
+            for (int32_t z = 0; z < m_size.z; ++z)
+            {
+                for (int32_t y = 0; y < m_size.y; ++y)
+                {
+                    for (int32_t x = 0; x < m_size.x; ++x)
+                    {
+                        const glm::ivec3 p(x, y, z);
+                        const uint8_t emission = isResident(p) ? engine.getEmission(m_voxels[index(p)]) : 0;
+                        if (emission > 0)
+                        {
+                            m_block[index(p)] = emission;
+                            queue.push_back(p);
+                        }
+                    }
+                }
+            }
+            flood(m_block, queue, false, engine);
+        }
+
+        // Resident voxels whose engine light differs from the reference
+        uint32_t countMismatches(const LightEngine& engine) const
+        {
+            uint32_t mismatches = 0;
+            for (int32_t z = 0; z < m_size.z; ++z)
+            {
+                for (int32_t y = 0; y < m_size.y; ++y)
+                {
+                    for (int32_t x = 0; x < m_size.x; ++x)
+                    {
+                        const glm::ivec3 p(x, y, z);
+                        if (!isResident(p))
+                        {
+                            continue;
+                        }
+                        const bool same = engine.getSkyLight(m_origin + p) == m_sky[index(p)] && engine.getBlockLight(m_origin + p) == m_block[index(p)];
+                        mismatches += same ? 0 : 1;
+                    }
+                }
+            }
+            return mismatches;
+        }
+
+    private:
+        size_t index(const glm::ivec3& p) const
+        {
+            return static_cast<size_t>(p.x) + static_cast<size_t>(m_size.x) * (static_cast<size_t>(p.y) + static_cast<size_t>(m_size.y) * p.z);
+        }
+
+        size_t chunkIndex(const glm::ivec3& chunkCoord) const
+        {
+            const glm::ivec3 c = chunkCoord - m_chunkMin;
+            return static_cast<size_t>(c.x) + static_cast<size_t>(m_chunkCount.x) * (static_cast<size_t>(c.y) + static_cast<size_t>(m_chunkCount.y) * c.z);
+        }
+
+        bool isResident(const glm::ivec3& p) const
+        {
+            if (glm::any(glm::lessThan(p, glm::ivec3(0))) || glm::any(glm::greaterThanEqual(p, m_size)))
+            {
+                return false;
+            }
+            return m_resident[chunkIndex(m_chunkMin + p / static_cast<int32_t>(CHUNK_SIZE_X))];
+        }
+
+        void flood(std::vector<uint8_t>& levels, std::vector<glm::ivec3>& queue, bool sky, const LightEngine& engine) const
+        {
+            for (size_t head = 0; head < queue.size(); ++head)
+            {
+                const glm::ivec3 p = queue[head];
+                const uint8_t level = levels[index(p)];
+                if (level <= 1)
+                {
+                    continue;
+                }
+
+                for (uint32_t d = 0; d < 6; ++d)
+                {
+                    const glm::ivec3 n = p + DIRECTIONS[d];
+                    if (!isResident(n) || !engine.isTransparent(m_voxels[index(n)]))
+                    {
+                        continue;
+                    }
+
+                    const bool skyFall = sky && d == 2 && level == MAX_LIGHT_LEVEL;
+                    const uint8_t newLevel = skyFall ? MAX_LIGHT_LEVEL : static_cast<uint8_t>(level - 1);
+                    if (levels[index(n)] < newLevel)
+                    {
+                        levels[index(n)] = newLevel;
+                        queue.push_back(n);
+                    }
+                }
+            }
+        }
+
+        glm::ivec3 m_chunkMin{ 0 };
+        glm::ivec3 m_chunkCount{ 0 };
+        glm::ivec3 m_origin{ 0 };
+        glm::ivec3 m_size{ 0 };
+        std::vector<VoxelID> m_voxels;
+        std::vector<uint8_t> m_sky;
+        std::vector<uint8_t> m_block;
+        std::vector<bool> m_resident;
+    };
+
+    // First air voxel above the ground at (x, z), searching down from y
+    glm::ivec3 findSurface(const World& world, int32_t x, int32_t z, int32_t y = 60)
+    {
+        while (y > -60 && world.getVoxel(x, y - 1, z) == AIR_VOXEL)
+        {
+            y--;
+        }
+        return glm::ivec3(x, y, z);
+    }
+}
+
+TEST_CASE(LightEngineMatchesReferenceFlood)
+{
+    const TerrainGenerator terrain;
+    World world;
+    loadTestWorld(world, 2, terrain.makeChunkLoader());
+
+    // A cave lit by torches, two of them on the borders to a resident and a non-resident chunk
+    world.applyEdit(EditOp::box(glm::ivec3(0, -50, 0), glm::ivec3(31, -33, 31), AIR_VOXEL));
+    CHECK(world.setVoxel(16, -45, 16, TORCH_VOXEL));
+    CHECK(world.setVoxel(10, -33, 10, TORCH_VOXEL));
+    CHECK(world.setVoxel(0, -40, 20, TORCH_VOXEL));
+
+    ThreadPool threadPool(4);
+    LightEngine engine;
+    engine.init(world);
+    engine.update(threadPool);
+    CHECK_EQ(engine.getUnlitChunkCount(), 0u);
+
+    CHECK_EQ(engine.getBlockLight(glm::ivec3(16, -45, 16)), 14);
+    CHECK_EQ(engine.getBlockLight(glm::ivec3(16, -45, 19)), 11);
+    CHECK_EQ(engine.getSkyLight(findSurface(world, 3, 3)), MAX_LIGHT_LEVEL);
+
+    CHECK_EQ(ReferenceLight(world, engine).countMismatches(engine), 0u);
+
+    // Relighting everything gives the same answer as the batched first pass
+    engine.relightAll(threadPool);
+    CHECK_EQ(ReferenceLight(world, engine).countMismatches(engine), 0u);
+}
+
+TEST_CASE(LightEngineIncrementalEditsMatchReference)
+{
+    const TerrainGenerator terrain;
+    World world;
+    loadTestWorld(world, 2, terrain.makeChunkLoader());
+
+    ThreadPool threadPool(4);
+    LightEngine engine;
+    engine.init(world);
+    engine.update(threadPool);
+
+    std::mt19937 rng(3);
+    std::uniform_int_distribution<int32_t> coord(-50, 50);
+    std::uniform_int_distribution<int32_t> depth(0, 12);
+    std::uniform_int_distribution<int32_t> action(0, 5);
+    std::vector<glm::ivec3> torches;
+
+    for (uint32_t step = 0; step < 300; ++step)
+    {
+        const glm::ivec3 surface = findSurface(world, coord(rng), coord(rng));
+        switch (action(rng))
+        {
+        case 0: // Torch on the ground
+        case 1:
+            if (world.setVoxel(surface.x, surface.y, surface.z, TORCH_VOXEL))
+            {
+                torches.push_back(surface);
+            }
+            break;
+        case 2: // Torch taken away
+            if (!torches.empty())
+            {
+                const glm::ivec3 torch = torches.back();
+                torches.pop_back();
+                world.setVoxel(torch.x, torch.y, torch.z, AIR_VOXEL);
+            }
+            break;
+        case 3: // Shaft dug into the ground, lets the sky in
+            world.applyEdit(EditOp::box(surface - glm::ivec3(1, depth(rng), 1), surface + glm::ivec3(1, 0, 1), AIR_VOXEL), threadPool);
+            break;
+        case 4: // Roof over the surface, shades it
+            world.applyEdit(EditOp::box(surface + glm::ivec3(-3, 4, -3), surface + glm::ivec3(3, 4, 3), STONE_VOXEL), threadPool);
+            break;
+        case 5: // Single block on top of or in place of a torch
+            world.setVoxel(surface.x, surface.y - (step & 1), surface.z, STONE_VOXEL);
+            break;
+        }
+
+        if (step % 100 == 99)
+        {
+            CHECK_EQ(ReferenceLight(world, engine).countMismatches(engine), 0u);
+        }
+    }
+}
+
+BENCHMARK(LightEngineLatencyAndRelight)
+{
+    const TerrainGenerator terrain;
+    World world;
+    loadTestWorld(world, 4, terrain.makeChunkLoader());
+    reportMetric("resident chunks", world.getChunkCount(), "");
+
+    Timer timer;
+    LightEngine engine;
+    {
+        ThreadPool threadPool(3);
+        engine.init(world);
+        engine.update(threadPool);
+    }
+    timer.stop();
+    reportMetric("first light, 4 threads", timer.elapsedTime<std::chrono::microseconds>() * 1e-3, "ms");
+
+    for (uint32_t threads : { 1u, 2u, 4u, 8u })
+    {
+        ThreadPool threadPool(threads - 1); // parallelFor works on the calling thread too
+        timer.start();
+        engine.relightAll(threadPool);
+        timer.stop();
+        reportMetric("relightAll, " + std::to_string(threads) + " threads", timer.elapsedTime<std::chrono::microseconds>() * 1e-3, "ms");
+    }
+
+    // Torches on the ground, placed and taken away one at a time
+    std::mt19937 rng(1);
+    std::uniform_int_distribution<int32_t> coord(-100, 100);
+    std::vector<glm::ivec3> spots(1000);
+    for (glm::ivec3& spot : spots)
+    {
+        spot = findSurface(world, coord(rng), coord(rng));
+    }
+
+    double placeTotal = 0.0;
+    double placeMax = 0.0;
+    double removeTotal = 0.0;
+    double removeMax = 0.0;
+    for (const glm::ivec3& spot : spots)
+    {
+        timer.start();
+        world.setVoxel(spot.x, spot.y, spot.z, TORCH_VOXEL);
+        timer.stop();
+        const double place = static_cast<double>(timer.elapsedTime<std::chrono::microseconds>());
+
+        timer.start();
+        world.setVoxel(spot.x, spot.y, spot.z, AIR_VOXEL);
+        timer.stop();
+        const double remove = static_cast<double>(timer.elapsedTime<std::chrono::microseconds>());
+
+        placeTotal += place;
+        placeMax = std::max(placeMax, place);
+        removeTotal += remove;
+        removeMax = std::max(removeMax, remove);
+    }
+    reportMetric("torch place, mean", placeTotal / spots.size(), "us");
+    reportMetric("torch place, max", placeMax, "us");
+    reportMetric("torch remove, mean", removeTotal / spots.size(), "us");
+    reportMetric("torch remove, max", removeMax, "us");
+
+    // Digging through the ground opens a column to the sky, closing it shades everything again
+    double digTotal = 0.0;
+    for (uint32_t i = 0; i < 200; ++i)
+    {
+        const glm::ivec3& spot = spots[i];
+        timer.start();
+        world.setVoxel(spot.x, spot.y - 1, spot.z, AIR_VOXEL);
+        world.setVoxel(spot.x, spot.y - 1, spot.z, STONE_VOXEL);
+        timer.stop();
+        digTotal += static_cast<double>(timer.elapsedTime<std::chrono::microseconds>());
+    }
+    reportMetric("dig + refill one voxel, mean", digTotal / 200, "us");
+}
@@ -0,0 +1,99 @@
+#include "TestFramework.h"
+
+#include "MaterialRegistry.h"
+
+#include <cstring>
+#include <memory>
+#include <vector>
+
+namespace
+{
+    // A GPU table filled with a marker that no packed material can hold
+    std::vector<GpuMaterial> makeMirror()
+    {
+        return std::vector<GpuMaterial>(MATERIAL_COUNT, { glm::vec4(-1.0f), glm::vec4(-1.0f) });
+    }
+
+    bool isMarker(const GpuMaterial& entry)
+    {
+        return entry.albedo == glm::vec4(-1.0f) && entry.params == glm::vec4(-1.0f);
+    }
+
+    bool sameTables(const std::vector<GpuMaterial>& a, const std::vector<GpuMaterial>& b)
+    {
+        return std::memcmp(a.data(), b.data(), MATERIAL_COUNT * sizeof(GpuMaterial)) == 0;
+    }
+}
+
+TEST_CASE(MaterialRegistrySetBumpsOnlyOnChange)
+{
+    auto registry = std::make_unique<MaterialRegistry>();
+    const uint64_t version = registry->getVersion();
+    CHECK(version != 0);
+
+    // The same values, and values that only become the same once clamped
+    registry->set(STONE_VOXEL, registry->get(STONE_VOXEL));
+    registry->set(TORCH_VOXEL, registry->get(TORCH_VOXEL));
+    Material clamped = registry->get(WATER_VOXEL);
+    registry->set(WATER_VOXEL, { clamped.albedo, clamped.roughness, -2.0f, 0.0f });
+    CHECK_EQ(registry->getVersion(), version);
+
+    clamped.roughness = 7.0f;
+    registry->set(WATER_VOXEL, clamped);
+    CHECK_EQ(registry->getVersion(), version + 1);
+    CHECK_EQ(registry->getRoughness(WATER_VOXEL), 1.0f);
+    registry->set(WATER_VOXEL, clamped);
+    CHECK_EQ(registry->getVersion(), version + 1);
+
+    // Nothing changed since the current version
+    std::vector<GpuMaterial> mirror = makeMirror();
+    CHECK_EQ(registry->writeChanges(registry->getVersion(), mirror.data()), 0u);
+    CHECK(isMarker(mirror[WATER_VOXEL]));
+}
+
+// A mirror following the registry with writeChanges gets exactly the entries that changed after
+// the version it holds, and ends up equal to a full write
+TEST_CASE(MaterialRegistryWritesChangesSinceVersion)
+{
+    auto registry = std::make_unique<MaterialRegistry>();
+    std::vector<GpuMaterial> mirror = makeMirror();
+    registry->writeAll(mirror.data());
+    for (uint32_t id = 0; id < MATERIAL_COUNT; ++id)
+    {
+        const GpuMaterial packed = registry->pack(static_cast<VoxelID>(id));
+        CHECK(std::memcmp(&mirror[id], &packed, sizeof(GpuMaterial)) == 0);
+    }
+    uint64_t mirrorVersion = registry->getVersion();
+
+    // Two batches of changes, one entry changed twice and one set back to its old value
+    const Material oldDirt = registry->get(DIRT_VOXEL);
+    registry->set(DIRT_VOXEL, { glm::vec3(0.1f), 0.5f, 0.0f, 0.0f });
+    registry->set(200, { glm::vec3(0.9f), 0.2f, 1.0f, 2.0f });
+    const uint64_t middle = registry->getVersion();
+    registry->set(200, { glm::vec3(0.8f), 0.2f, 1.0f, 2.0f });
+    registry->set(DIRT_VOXEL, oldDirt);
+    registry->set(255, { glm::vec3(0.3f), 0.4f, 0.5f, 0.6f });
+
+    // Only the entries of the second batch for a mirror that has the first
+    std::vector<GpuMaterial> partial = makeMirror();
+    CHECK_EQ(registry->writeChanges(middle, partial.data()), 3u);
+    uint32_t written = 0;
+    for (uint32_t id = 0; id < MATERIAL_COUNT; ++id)
+    {
+        written += isMarker(partial[id]) ? 0 : 1;
+    }
+    CHECK_EQ(written, 3u);
+    CHECK(!isMarker(partial[DIRT_VOXEL]) && !isMarker(partial[200]) && !isMarker(partial[255]));
+
+    // Everything since the mirror's version, then it matches a fresh full write
+    const std::vector<GpuMaterial> stale = mirror;
+    CHECK_EQ(registry->writeChanges(mirrorVersion, mirror.data()), 3u);
+    mirrorVersion = registry->getVersion();
+    CHECK(std::memcmp(&mirror[DIRT_VOXEL], &stale[DIRT_VOXEL], sizeof(GpuMaterial)) == 0);
+    CHECK(std::memcmp(&mirror[200], &stale[200], sizeof(GpuMaterial)) != 0);
+
+    std::vector<GpuMaterial> fresh = makeMirror();
+    registry->writeAll(fresh.data());
+    CHECK(sameTables(mirror, fresh));
+    CHECK_EQ(registry->writeChanges(mirrorVersion, mirror.data()), 0u);
+}
@@ -0,0 +1,184 @@
+#include "TestFramework.h"
+#include "TestWorld.h"
+
+#include "TerrainGenerator.h"
+#include "Timer.h"
+
+#include <cmath>
+#include <limits>
+#include <random>
+
+namespace
+{
+    // Plain voxel-by-voxel DDA over getVoxel, no empty space skipping
+    RaycastHit referenceRaycast(const World& world, const glm::vec3& origin, const glm::vec3& direction, float maxDistance)
+    {
+        RaycastHit result;
+        constexpr float INF = std::numeric_limits<float>::infinity();
+        const glm::vec3 dir = glm::normalize(direction);
+        const glm::ivec3 step(dir.x >= 0.0f ? 1 : -1, dir.y >= 0.0f ? 1 : -1, dir.z >= 0.0f ? 1 : -1);
+        const glm::vec3 invDir(
+            dir.x != 0.0f ? 1.0f / dir.x : INF,
+            dir.y != 0.0f ? 1.0f / dir.y : INF,
+            dir.z != 0.0f ? 1.0f / dir.z : INF);
+
+        glm::ivec3 voxel(glm::floor(origin));
+        float t = 0.0f;
+        int32_t enteredAxis = -1;
+        while (t <= maxDistance)
+        {
+            const VoxelID id = world.getVoxel(voxel.x, voxel.y, voxel.z);
+            if (id != AIR_VOXEL)
+            {
+                result.hit = true;
+                result.id = id;
+                result.voxel = voxel;
+                result.distance = t;
+                if (enteredAxis >= 0)
+                {
+                    result.normal[enteredAxis] = -step[enteredAxis];
+                }
+                return result;
+            }
+
+            glm::vec3 tExit;
+            for (int32_t axis = 0; axis < 3; ++axis)
+            {
+                const float boundary = static_cast<float>(step[axis] > 0 ? voxel[axis] + 1 : voxel[axis]);
+                tExit[axis] = dir[axis] != 0.0f ? (boundary - origin[axis]) * invDir[axis] : INF;
+            }
+            enteredAxis = tExit.x < tExit.y ? (tExit.x < tExit.z ? 0 : 2) : (tExit.y < tExit.z ? 1 : 2);
+            t = std::max(t, tExit[enteredAxis]);
+            voxel[enteredAxis] += step[enteredAxis];
+        }
+        return result;
+    }
+
+    std::vector<Ray> makeRandomRays(uint32_t count, float maxDistance, uint32_t seed)
+    {
+        std::mt19937 rng(seed);
+        std::uniform_real_distribution<float> position(-40.0f, 40.0f);
+        std::uniform_real_distribution<float> height(-10.0f, 40.0f);
+        std::normal_distribution<float> direction(0.0f, 1.0f);
+
+        std::vector<Ray> rays(count);
+        for (Ray& ray : rays)
+        {
+            ray.origin = glm::vec3(position(rng), height(rng), position(rng));
+            ray.direction = glm::vec3(direction(rng), direction(rng) - 0.5f, direction(rng));
+            ray.maxDistance = maxDistance;
+        }
+        return rays;
+    }
+}
+
+TEST_CASE(WorldRaycastMatchesVoxelDda)
+{
+    const TerrainGenerator terrain;
+    World world;
+    loadTestWorld(world, 3, terrain.makeChunkLoader());
+
+    const std::vector<Ray> rays = makeRandomRays(3000, 90.0f, 99);
+    uint32_t hits = 0;
+    uint32_t mismatches = 0;
+    for (const Ray& ray : rays)
+    {
+        const RaycastHit expected = referenceRaycast(world, ray.origin, ray.direction, ray.maxDistance);
+        const RaycastHit hit = world.raycast(ray.origin, ray.direction, ray.maxDistance);
+
+        hits += expected.hit ? 1 : 0;
+        const bool same = hit.hit == expected.hit && (!hit.hit ||
+            (hit.voxel == expected.voxel && hit.normal == expected.normal && hit.id == expected.id && std::abs(hit.distance - expected.distance) < 1e-3f));
+        mismatches += same ? 0 : 1;
+    }
+    CHECK_EQ(mismatches, 0u);
+    // Both outcomes have to be exercised for the comparison to mean anything
+    CHECK(hits > rays.size() / 4 && hits < rays.size() * 3 / 4);
+}
+
+TEST_CASE(WorldRaycastEdgeCases)
+{
+    World world;
+    loadTestWorld(world, 2, loadFlatGround);
+
+    // Straight down onto the ground from above, entering through the top face
+    RaycastHit hit = world.raycast(glm::vec3(0.5f, 10.5f, 0.5f), glm::vec3(0.0f, -1.0f, 0.0f), 100.0f);
+    CHECK(hit.hit);
+    CHECK(hit.voxel == glm::ivec3(0, -1, 0));
+    CHECK(hit.normal == glm::ivec3(0, 1, 0));
+    CHECK(std::abs(hit.distance - 10.5f) < 1e-4f);
+
+    // Too short to reach it
+    CHECK(!world.raycast(glm::vec3(0.5f, 10.5f, 0.5f), glm::vec3(0.0f, -1.0f, 0.0f), 10.0f).hit);
+
+    // Starting inside a solid voxel hits it at distance 0 without a normal
+    hit = world.raycast(glm::vec3(-3.5f, -5.5f, 7.5f), glm::vec3(1.0f, 0.0f, 0.0f), 10.0f);
+    CHECK(hit.hit && hit.distance == 0.0f && hit.normal == glm::ivec3(0));
+
+    // Zero direction and negative distances never hit
+    CHECK(!world.raycast(glm::vec3(0.5f, 10.5f, 0.5f), glm::vec3(0.0f), 100.0f).hit);
+    CHECK(!world.raycast(glm::vec3(0.5f, 10.5f, 0.5f), glm::vec3(0.0f, -1.0f, 0.0f), -1.0f).hit);
+
+    // Parallel to the ground, crossing chunks and skipping through empty space
+    CHECK(!world.raycast(glm::vec3(-60.5f, 0.5f, 0.5f), glm::vec3(1.0f, 0.0f, 0.0f), 120.0f).hit);
+}
+
+TEST_CASE(WorldRaycastBatchMatchesSingleRays)
+{
+    const TerrainGenerator terrain;
+    World world;
+    loadTestWorld(world, 3, terrain.makeChunkLoader());
+
+    ThreadPool threadPool(4);
+    const std::vector<Ray> rays = makeRandomRays(2000, 80.0f, 5);
+    std::vector<RaycastHit> hits;
+    world.raycastBatch(rays, hits, threadPool);
+    REQUIRE(hits.size() == rays.size());
+
+    uint32_t mismatches = 0;
+    for (size_t i = 0; i < rays.size(); ++i)
+    {
+        const RaycastHit single = world.raycast(rays[i].origin, rays[i].direction, rays[i].maxDistance);
+        mismatches += single.hit == hits[i].hit && single.voxel == hits[i].voxel && single.distance == hits[i].distance ? 0 : 1;
+    }
+    CHECK_EQ(mismatches, 0u);
+}
+
+BENCHMARK(WorldRaycastThroughput)
+{
+    const TerrainGenerator terrain;
+    World world;
+    loadTestWorld(world, 5, terrain.makeChunkLoader());
+
+    const std::vector<Ray> rays = makeRandomRays(1u << 18, 150.0f, 1);
+    std::vector<RaycastHit> hits;
+
+    Timer timer;
+    uint32_t hitCount = 0;
+    for (const Ray& ray : rays)
+    {
+        hitCount += world.raycast(ray.origin, ray.direction, ray.maxDistance).hit ? 1 : 0;
+    }
+    timer.stop();
+    reportMetric("raycast, 1 thread", rays.size() / (timer.elapsedTime<std::chrono::microseconds>() * 1e-6), "rays/s");
+    reportMetric("hit fraction", static_cast<double>(hitCount) / rays.size(), "");
+
+    // The same rays without empty space skipping
+    const uint32_t referenceCount = static_cast<uint32_t>(rays.size() / 8);
+    timer.start();
+    for (uint32_t i = 0; i < referenceCount; ++i)
+    {
+        hitCount += referenceRaycast(world, rays[i].origin, rays[i].direction, rays[i].maxDistance).hit ? 1 : 0;
+    }
+    timer.stop();
+    reportMetric("voxel DDA over getVoxel, 1 thread", referenceCount / (timer.elapsedTime<std::chrono::microseconds>() * 1e-6), "rays/s");
+
+    for (uint32_t threads : { 2u, 4u, 8u })
+    {
+        ThreadPool threadPool(threads - 1); // raycastBatch works on the calling thread too
+        timer.start();
+        world.raycastBatch(rays, hits, threadPool);
+        timer.stop();
+        reportMetric("raycastBatch, " + std::to_string(threads) + " threads", rays.size() / (timer.elapsedTime<std::chrono::microseconds>() * 1e-6), "rays/s");
+    }
+}
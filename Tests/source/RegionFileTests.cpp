@@ -0,0 +1,301 @@
+#include "TestFramework.h"
+
+#include "RegionFile.h"
+#include "ChunkApron.h"
+#include "TerrainGenerator.h"
+#include "Timer.h"
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <algorithm>
+
+namespace
+{
+    std::unique_ptr<Chunk> makeTerrainChunk(const TerrainGenerator& terrain, const glm::ivec3& position)
+    {
+        auto chunk = std::make_unique<Chunk>();
+        chunk->position = position;
+        terrain.generate(*chunk);
+        return chunk;
+    }
+
+    bool sameVoxels(const Chunk& a, const Chunk& b)
+    {
+        return std::memcmp(a.voxels.data(), b.voxels.data(), CHUNK_VOLUME) == 0;
+    }
+
+    // Record header in front of an uncompressed palette payload
+    std::vector<uint8_t> makeUncompressedRecord(const std::vector<uint8_t>& payload)
+    {
+        const uint32_t header[3] = { static_cast<uint32_t>(payload.size()), static_cast<uint32_t>(payload.size()), 0 };
+        std::vector<uint8_t> record(sizeof(header) + payload.size());
+        std::memcpy(record.data(), header, sizeof(header));
+        std::memcpy(record.data() + sizeof(header), payload.data(), payload.size());
+        return record;
+    }
+}
+
+TEST_CASE(ChunkCodecRoundTrips)
+{
+    const TerrainGenerator terrain;
+    std::vector<std::unique_ptr<Chunk>> chunks;
+    chunks.push_back(makeTerrainChunk(terrain, glm::ivec3(0, -1, 0)));
+    chunks.push_back(makeTerrainChunk(terrain, glm::ivec3(3, 0, -2)));
+
+    auto uniform = std::make_unique<Chunk>();
+    uniform->fill(WATER_VOXEL);
+    chunks.push_back(std::move(uniform));
+
+    // Every id in use and no runs, the LZ stage doesn't pay off and is skipped
+    auto noise = std::make_unique<Chunk>();
+    std::mt19937 rng(11);
+    for (VoxelID& voxel : noise->voxels)
+    {
+        voxel = static_cast<VoxelID>(rng());
+    }
+    noise->rebuildDerivedData();
+    chunks.push_back(std::move(noise));
+
+    std::vector<uint8_t> record;
+    for (const auto& chunk : chunks)
+    {
+        ChunkCodec::encode(*chunk, record);
+
+        Chunk decoded;
+        REQUIRE(ChunkCodec::decode(record.data(), record.size(), decoded));
+        CHECK(sameVoxels(*chunk, decoded));
+        CHECK(decoded.occupancy.countSolid() == chunk->occupancy.countSolid());
+    }
+}
+
+TEST_CASE(ChunkCodecCorruptRecordLeavesChunkUntouched)
+{
+    // Uncompressed record with a 3 entry palette at 2 bits per voxel, the very last voxel
+    // pointing at a fourth entry that doesn't exist
+    const uint8_t paletteHeader[] = { 2, STONE_VOXEL, DIRT_VOXEL, GRASS_VOXEL, 2 };
+    std::vector<uint8_t> payload(paletteHeader, paletteHeader + sizeof(paletteHeader));
+    payload.resize(payload.size() + CHUNK_VOLUME * 2 / 8, 0x24);
+    payload.back() = 0xFF;
+
+    std::vector<uint8_t> record = makeUncompressedRecord(payload);
+
+    Chunk chunk;
+    chunk.fill(SAND_VOXEL);
+    const uint64_t version = chunk.version;
+
+    CHECK(!ChunkCodec::decode(record.data(), record.size(), chunk));
+    CHECK(std::all_of(chunk.voxels.begin(), chunk.voxels.end(), [](VoxelID id) { return id == SAND_VOXEL; }));
+    CHECK(chunk.occupancy.countSolid() == CHUNK_VOLUME);
+    CHECK_EQ(chunk.version, version);
+
+    // The same record with the bad index fixed decodes
+    record.back() = 0x24;
+    CHECK(ChunkCodec::decode(record.data(), record.size(), chunk));
+    CHECK_EQ(chunk.get(0, 0, 0), STONE_VOXEL);
+    CHECK_EQ(chunk.get(1, 0, 0), DIRT_VOXEL);
+
+    // A truncated LZ record fails the same way
+    const TerrainGenerator terrain;
+    const auto source = makeTerrainChunk(terrain, glm::ivec3(1, -1, 1));
+    ChunkCodec::encode(*source, record);
+    chunk.fill(SAND_VOXEL);
+    CHECK(!ChunkCodec::decode(record.data(), record.size() / 2, chunk));
+    CHECK(std::all_of(chunk.voxels.begin(), chunk.voxels.end(), [](VoxelID id) { return id == SAND_VOXEL; }));
+}
+
+// Most chunks on disk are all air or all stone, they have to come back like any other load
+TEST_CASE(ChunkCodecUniformRecordIsFresh)
+{
+    Chunk source;
+    source.fill(STONE_VOXEL);
+    std::vector<uint8_t> record;
+    ChunkCodec::encode(source, record);
+
+    // The apron next to it was filled while it wasn't resident
+    auto apron = std::make_unique<ChunkApron>();
+    CHECK(apron->refreshRegion(glm::ivec3(1, 0, 0), nullptr));
+    CHECK_EQ(apron->get(CHUNK_SIZE_X, 3, 3), AIR_VOXEL);
+
+    auto loaded = std::make_unique<Chunk>();
+    loaded->position = glm::ivec3(1, 0, 0);
+    loaded->dirtyBricks = 0;
+    REQUIRE(ChunkCodec::decode(record.data(), record.size(), *loaded));
+    CHECK(loaded->version != 0);
+    CHECK_EQ(loaded->dirtyBricks, ~0ull);
+    CHECK(loaded->occupancy.countSolid() == CHUNK_VOLUME);
+    CHECK(sameVoxels(source, *loaded));
+
+    CHECK(apron->refreshRegion(glm::ivec3(1, 0, 0), loaded.get()));
+    CHECK_EQ(apron->get(CHUNK_SIZE_X, 3, 3), STONE_VOXEL);
+
+    // A uniform payload is the palette and the bit count, nothing may follow
+    const std::vector<uint8_t> uniform = makeUncompressedRecord({ 0, DIRT_VOXEL, 0 });
+    CHECK(ChunkCodec::decode(uniform.data(), uniform.size(), *loaded));
+    CHECK_EQ(loaded->get(5, 5, 5), DIRT_VOXEL);
+    const std::vector<uint8_t> trailing = makeUncompressedRecord({ 0, SAND_VOXEL, 0, 7 });
+    CHECK(!ChunkCodec::decode(trailing.data(), trailing.size(), *loaded));
+    CHECK_EQ(loaded->get(5, 5, 5), DIRT_VOXEL);
+}
+
+TEST_CASE(RegionFileRewritesAndReopens)
+{
+    const std::string directory = makeTempDirectory("RegionFileRewritesAndReopens");
+    const std::string path = directory + "/test.vxr";
+    const TerrainGenerator terrain;
+
+    auto noise = std::make_unique<Chunk>();
+    std::mt19937 rng(5);
+    for (VoxelID& voxel : noise->voxels)
+    {
+        voxel = static_cast<VoxelID>(rng() & 7);
+    }
+
+    auto surface = makeTerrainChunk(terrain, glm::ivec3(0, 0, 0));
+    auto empty = std::make_unique<Chunk>();
+
+    {
+        RegionFile file;
+        file.open(path);
+        file.writeChunk(0, *surface);
+        file.writeChunk(1, *empty);
+        const uint32_t sectors = file.getSectorCount();
+
+        // Grows out of its sectors, then shrinks back into them
+        file.writeChunk(0, *noise);
+        CHECK(file.getSectorCount() > sectors);
+        file.writeChunk(0, *surface);
+
+        file.writeChunk(REGION_CHUNK_COUNT - 1, *noise);
+        CHECK(!file.hasChunk(2));
+    }
+
+    RegionFile file;
+    file.open(path);
+    CHECK(file.hasChunk(0) && file.hasChunk(1) && file.hasChunk(REGION_CHUNK_COUNT - 1));
+
+    Chunk chunk;
+    REQUIRE(file.readChunk(0, chunk));
+    CHECK(sameVoxels(chunk, *surface));
+    REQUIRE(file.readChunk(1, chunk));
+    CHECK(sameVoxels(chunk, *empty));
+    REQUIRE(file.readChunk(REGION_CHUNK_COUNT - 1, chunk));
+    CHECK(sameVoxels(chunk, *noise));
+    CHECK(!file.readChunk(2, chunk));
+}
+
+TEST_CASE(RegionStoreFailedAsyncSaveDoesNotHangFlush)
+{
+    const std::string directory = makeTempDirectory("RegionStoreFailedAsyncSave");
+
+    // Region (0, 0, 0) can't be opened, region (1, 0, 0) is fine
+    {
+        std::ofstream garbage(std::filesystem::path(directory) / "r.0.0.0.vxr", std::ios::binary);
+        garbage << "not a region file";
+    }
+
+    ThreadPool threadPool(2);
+    RegionStore store(directory);
+
+    Chunk broken;
+    broken.position = glm::ivec3(1, 2, 3);
+    broken.fill(STONE_VOXEL);
+
+    Chunk fine;
+    fine.position = glm::ivec3(REGION_SIZE + 1, 2, 3);
+    fine.fill(DIRT_VOXEL);
+    fine.set(4, 5, 6, TORCH_VOXEL);
+
+    store.saveAsync(ChunkSnapshot::create(broken, nullptr), threadPool);
+    store.saveAsync(ChunkSnapshot::create(fine, nullptr), threadPool);
+    store.flush();
+    CHECK_EQ(store.getFailedSaveCount(), 1u);
+
+    // The failed save is gone, so is its pending copy; the good one reached its file
+    Chunk loaded;
+    loaded.position = fine.position;
+    REQUIRE(store.loadChunk(loaded));
+    CHECK(sameVoxels(loaded, fine));
+
+    store.closeAll();
+    CHECK_EQ(store.getFailedSaveCount(), 1u);
+}
+
+BENCHMARK(RegionSaveLoadThroughput)
+{
+    const std::string directory = makeTempDirectory("RegionSaveLoadThroughput");
+    const TerrainGenerator terrain;
+
+    // A 16 x 4 x 16 slab of surface chunks, the interesting ones to compress
+    std::vector<std::unique_ptr<Chunk>> chunks;
+    for (int32_t z = 0; z < 16; ++z)
+    {
+        for (int32_t y = -2; y < 2; ++y)
+        {
+            for (int32_t x = 0; x < 16; ++x)
+            {
+                chunks.push_back(makeTerrainChunk(terrain, glm::ivec3(x, y, z)));
+            }
+        }
+    }
+    const double rawMegabytes = static_cast<double>(chunks.size()) * CHUNK_SIZE_BYTES / (1024.0 * 1024.0);
+
+    std::vector<uint8_t> record;
+    size_t encodedBytes = 0;
+    Timer timer;
+    for (const auto& chunk : chunks)
+    {
+        ChunkCodec::encode(*chunk, record);
+        encodedBytes += record.size();
+    }
+    timer.stop();
+    reportMetric("encode", rawMegabytes / (timer.elapsedTime<std::chrono::microseconds>() * 1e-6), "MB/s");
+    reportMetric("compression ratio", static_cast<double>(chunks.size()) * CHUNK_SIZE_BYTES / encodedBytes, "x");
+
+    {
+        RegionStore store(directory);
+        timer.start();
+        for (const auto& chunk : chunks)
+        {
+            store.saveChunk(*chunk);
+        }
+        store.closeAll();
+        timer.stop();
+        reportMetric("save", chunks.size() / (timer.elapsedTime<std::chrono::microseconds>() * 1e-6), "chunks/s");
+
+        ThreadPool threadPool(4);
+        for (const auto& chunk : chunks)
+        {
+            chunk->set(0, 0, 0, TORCH_VOXEL);
+        }
+        timer.start();
+        for (const auto& chunk : chunks)
+        {
+            store.saveAsync(ChunkSnapshot::create(*chunk, nullptr), threadPool);
+        }
+        store.flush();
+        timer.stop();
+        reportMetric("saveAsync + flush, 4 threads", chunks.size() / (timer.elapsedTime<std::chrono::microseconds>() * 1e-6), "chunks/s");
+    }
+
+    uint64_t diskBytes = 0;
+    for (const auto& entry : std::filesystem::directory_iterator(directory))
+    {
+        diskBytes += entry.file_size();
+    }
+    reportMetric("on disk", static_cast<double>(diskBytes) / (1024.0 * 1024.0), "MB");
+
+    RegionStore store(directory);
+    Chunk loaded;
+    uint32_t mismatches = 0;
+    timer.start();
+    for (const auto& chunk : chunks)
+    {
+        loaded.position = chunk->position;
+        mismatches += store.loadChunk(loaded) && sameVoxels(loaded, *chunk) ? 0 : 1;
+    }
+    timer.stop();
+    reportMetric("load", chunks.size() / (timer.elapsedTime<std::chrono::microseconds>() * 1e-6), "chunks/s");
+    CHECK_EQ(mismatches, 0u);
+}
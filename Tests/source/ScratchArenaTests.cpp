@@ -0,0 +1,114 @@
+#include "TestFramework.h"
+
+#include "ScratchArena.h"
+
+#include <random>
+#include <vector>
+#include <algorithm>
+
+namespace
+{
+    bool batchesEqual(const std::vector<BlasBuildBatch>& batches, std::initializer_list<BlasBuildBatch> expected)
+    {
+        return std::equal(batches.begin(), batches.end(), expected.begin(), expected.end(), [](const BlasBuildBatch& a, const BlasBuildBatch& b)
+        {
+            return a.first == b.first && a.count == b.count && a.scratchSize == b.scratchSize;
+        });
+    }
+}
+
+TEST_CASE(ScratchArenaAllocatesAligned)
+{
+    ScratchArena arena(1000, 128);
+    CHECK_EQ(arena.allocate(1), 0ull);
+    CHECK_EQ(arena.allocate(200), 128ull);
+    CHECK_EQ(arena.getUsed(), 328ull);
+    CHECK_EQ(arena.allocate(616), 384ull);
+    CHECK_EQ(arena.getUsed(), 1000ull);
+
+    // Past the end, or with the aligned offset already past it
+    CHECK_EQ(arena.allocate(1), ScratchArena::NO_SPACE);
+    CHECK_EQ(arena.getUsed(), 1000ull);
+    arena.rewind();
+    CHECK_EQ(arena.allocate(1001), ScratchArena::NO_SPACE);
+    CHECK_EQ(arena.allocate(1000), 0ull);
+
+    arena.reset(10, 0);
+    CHECK_EQ(arena.getAlignment(), 1ull);
+    CHECK_EQ(arena.allocate(3), 0ull);
+    CHECK_EQ(arena.allocate(3), 3ull);
+}
+
+TEST_CASE(ScratchArenaPlansBatches)
+{
+    std::vector<BlasBuildBatch> batches;
+    std::vector<VkDeviceSize> offsets;
+    ScratchArena::planBatches(nullptr, 0, 256, 1024, batches, offsets);
+    CHECK(batches.empty());
+    CHECK(offsets.empty());
+
+    // A batch is split where the next aligned range no longer fits. An oversized build gets a
+    // batch of its own, as does one exactly filling the arena.
+    const VkDeviceSize sizes[] = { 100, 300, 200, 500, 2000, 50, 1024, 10 };
+    ScratchArena::planBatches(sizes, 8, 256, 1024, batches, offsets);
+    CHECK(batchesEqual(batches, { { 0, 3, 968 }, { 3, 1, 500 }, { 4, 1, 2000 }, { 5, 1, 50 }, { 6, 1, 1024 }, { 7, 1, 10 } }));
+    REQUIRE(offsets.size() == 8);
+    CHECK_EQ(offsets[0], 0ull);
+    CHECK_EQ(offsets[1], 256ull);
+    CHECK_EQ(offsets[2], 768ull);
+    for (uint32_t i = 3; i < 8; ++i)
+    {
+        CHECK_EQ(offsets[i], 0ull);
+    }
+
+    // Oversized at the start, the end and back to back, no empty batch left behind
+    const VkDeviceSize oversized[] = { 5000, 10, 20, 5000, 3000 };
+    ScratchArena::planBatches(oversized, 5, 256, 1024, batches, offsets);
+    CHECK(batchesEqual(batches, { { 0, 1, 5000 }, { 1, 2, 276 }, { 3, 1, 5000 }, { 4, 1, 3000 } }));
+
+    // Everything in one batch when it fits
+    const VkDeviceSize small[] = { 1, 1, 1, 1 };
+    ScratchArena::planBatches(small, 4, 1, 1024, batches, offsets);
+    CHECK(batchesEqual(batches, { { 0, 4, 4 } }));
+    CHECK_EQ(offsets[3], 3ull);
+}
+
+// Random build sizes and alignments: batches cover the builds in order, every range is aligned,
+// inside its batch's scratch and disjoint from the others, and only single builds exceed the limit.
+TEST_CASE(ScratchArenaBatchesFitAndDontOverlap)
+{
+    std::mt19937 random(3);
+    std::vector<BlasBuildBatch> batches;
+    std::vector<VkDeviceSize> offsets;
+    for (uint32_t run = 0; run < 500; ++run)
+    {
+        const VkDeviceSize alignment = VkDeviceSize(1) << (random() % 9);
+        const VkDeviceSize maxScratchSize = 256 + random() % 4096;
+        std::vector<VkDeviceSize> sizes(random() % 64);
+        for (VkDeviceSize& size : sizes)
+        {
+            size = 1 + random() % (random() % 8 == 0 ? 8192 : 1024);
+        }
+        ScratchArena::planBatches(sizes.data(), static_cast<uint32_t>(sizes.size()), alignment, maxScratchSize, batches, offsets);
+
+        REQUIRE(offsets.size() == sizes.size());
+        uint32_t next = 0;
+        for (const BlasBuildBatch& batch : batches)
+        {
+            REQUIRE(batch.first == next && batch.count > 0);
+            next += batch.count;
+            REQUIRE(next <= sizes.size());
+            CHECK(batch.scratchSize <= maxScratchSize || (batch.count == 1 && batch.scratchSize == sizes[batch.first]));
+
+            VkDeviceSize end = 0;
+            for (uint32_t i = batch.first; i < batch.first + batch.count; ++i)
+            {
+                CHECK_EQ(offsets[i] % alignment, 0ull);
+                CHECK(offsets[i] >= end);
+                end = offsets[i] + sizes[i];
+            }
+            CHECK_EQ(end, batch.scratchSize);
+        }
+        CHECK_EQ(next, static_cast<uint32_t>(sizes.size()));
+    }
+}
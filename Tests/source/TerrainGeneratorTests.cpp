@@ -0,0 +1,153 @@
+#include "TestFramework.h"
+
+#include "TerrainGenerator.h"
+#include "Timer.h"
+
+#include <cstring>
+#include <memory>
+#include <vector>
+
+namespace
+{
+    // Columns of chunks from y = minY to maxY, x and z in [min, min + size)
+    std::vector<std::unique_ptr<Chunk>> makeChunkColumns(const glm::ivec2& min, int32_t size, int32_t minY, int32_t maxY)
+    {
+        std::vector<std::unique_ptr<Chunk>> chunks;
+        for (int32_t z = min.y; z < min.y + size; ++z)
+        {
+            for (int32_t y = minY; y <= maxY; ++y)
+            {
+                for (int32_t x = min.x; x < min.x + size; ++x)
+                {
+                    chunks.push_back(std::make_unique<Chunk>());
+                    chunks.back()->position = glm::ivec3(x, y, z);
+                }
+            }
+        }
+        return chunks;
+    }
+
+    std::vector<Chunk*> getPointers(const std::vector<std::unique_ptr<Chunk>>& chunks)
+    {
+        std::vector<Chunk*> pointers;
+        for (const auto& chunk : chunks)
+        {
+            pointers.push_back(chunk.get());
+        }
+        return pointers;
+    }
+}
+
+// Chunks come out the same whichever worker generates them and in whatever order
+TEST_CASE(TerrainGeneratorIsDeterministicAcrossThreads)
+{
+    const TerrainGenerator terrain;
+    std::vector<std::unique_ptr<Chunk>> serial = makeChunkColumns(glm::ivec2(-3, 5), 6, -2, 1);
+    std::vector<std::unique_ptr<Chunk>> parallel = makeChunkColumns(glm::ivec2(-3, 5), 6, -2, 1);
+
+    ThreadPool oneThread(1);
+    ThreadPool fourThreads(4);
+    terrain.generateChunks(getPointers(serial), oneThread);
+    terrain.generateChunks(getPointers(parallel), fourThreads);
+
+    uint32_t mismatches = 0;
+    uint32_t solidChunks = 0;
+    for (size_t i = 0; i < serial.size(); ++i)
+    {
+        const bool same = std::memcmp(serial[i]->voxels.data(), parallel[i]->voxels.data(), CHUNK_VOLUME) == 0 &&
+            serial[i]->occupancy.countSolid() == parallel[i]->occupancy.countSolid();
+        mismatches += same ? 0 : 1;
+        solidChunks += serial[i]->occupancy.countSolid() != 0 ? 1 : 0;
+    }
+    CHECK_EQ(mismatches, 0u);
+    CHECK(solidChunks > serial.size() / 4);
+
+    // And the same as generating one at a time on this thread
+    auto chunk = std::make_unique<Chunk>();
+    chunk->position = serial[17]->position;
+    terrain.generate(*chunk);
+    CHECK(std::memcmp(chunk->voxels.data(), serial[17]->voxels.data(), CHUNK_VOLUME) == 0);
+}
+
+// getSurfaceHeight against the topmost solid voxel of every generated column. Without caves the
+// surface voxel is never carved, so the two must agree exactly.
+TEST_CASE(TerrainGeneratorSurfaceHeightMatchesColumns)
+{
+    TerrainConfig config;
+    config.caves = false;
+    const TerrainGenerator terrain(config);
+
+    // Surfaces stay within baseHeight +- heightAmplitude, so chunk y -2..1 holds all of them.
+    // Far from the origin too, where the world coordinates lose float precision first.
+    for (const glm::ivec2& min : { glm::ivec2(-2, -2), glm::ivec2(3000, -4100) })
+    {
+        std::vector<std::unique_ptr<Chunk>> chunks = makeChunkColumns(min, 4, -2, 1);
+        terrain.generateChunks(getPointers(chunks));
+
+        uint32_t mismatches = 0;
+        for (int32_t cz = 0; cz < 4; ++cz)
+        {
+            for (int32_t cx = 0; cx < 4; ++cx)
+            {
+                // The 4 chunks of this column, bottom first
+                const size_t first = (static_cast<size_t>(cz) * 4) * 4 + static_cast<size_t>(cx);
+                for (uint32_t z = 0; z < CHUNK_SIZE_Z; ++z)
+                {
+                    for (uint32_t x = 0; x < CHUNK_SIZE_X; ++x)
+                    {
+                        int32_t top = INT32_MIN;
+                        for (int32_t cy = 3; cy >= 0 && top == INT32_MIN; --cy)
+                        {
+                            const Chunk& chunk = *chunks[first + static_cast<size_t>(cy) * 4];
+                            for (int32_t y = CHUNK_SIZE_Y - 1; y >= 0; --y)
+                            {
+                                const VoxelID id = chunk.get(x, y, z);
+                                if (id != AIR_VOXEL && id != WATER_VOXEL)
+                                {
+                                    top = chunk.getWorldOrigin().y + y;
+                                    break;
+                                }
+                            }
+                        }
+
+                        const glm::ivec3 origin = chunks[first]->getWorldOrigin();
+                        mismatches += terrain.getSurfaceHeight(origin.x + static_cast<int32_t>(x), origin.z + static_cast<int32_t>(z)) == top ? 0 : 1;
+                    }
+                }
+            }
+        }
+        CHECK_EQ(mismatches, 0u);
+    }
+}
+
+// Chunks generated per second over a 16 x 4 x 16 slab around the surface, on one thread and on
+// the shared pool. Streaming wants at least 1000 chunks/s from the pool.
+BENCHMARK(TerrainGeneratorThroughput)
+{
+    const TerrainGenerator terrain;
+    std::vector<std::unique_ptr<Chunk>> chunks = makeChunkColumns(glm::ivec2(0, 0), 16, -2, 1);
+    const std::vector<Chunk*> pointers = getPointers(chunks);
+
+    uint32_t airChunks = 0;
+    {
+        ThreadPool oneThread(1);
+        Timer timer;
+        terrain.generateChunks(pointers, oneThread);
+        timer.stop();
+        reportMetric("1 thread", chunks.size() / (timer.elapsedTime<std::chrono::microseconds>() * 1e-6), "chunks/s");
+    }
+    for (const auto& chunk : chunks)
+    {
+        airChunks += chunk->occupancy.countSolid() == 0 ? 1 : 0;
+    }
+
+    ThreadPool& threadPool = ThreadPool::getInstance();
+    Timer timer;
+    terrain.generateChunks(pointers, threadPool);
+    timer.stop();
+    const double chunksPerSecond = chunks.size() / (timer.elapsedTime<std::chrono::microseconds>() * 1e-6);
+    reportMetric("threads", threadPool.getThreadCount(), "");
+    reportMetric("pool", chunksPerSecond, "chunks/s");
+    reportMetric("chunks", static_cast<double>(chunks.size()), "");
+    reportMetric("all air", airChunks, "");
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <vector>
+#include <sstream>
+
+// Minimal headless test and benchmark registry for the parts of Core that don't need a device.
+// TEST_CASEs run on every invocation, BENCHMARKs only with --bench, see main.cpp.
+
+using TestFunction = void(*)();
+
+struct TestCase
+{
+    const char* name;
+    TestFunction function;
+    bool benchmark;
+};
+
+std::vector<TestCase>& getTestCases();
+
+struct TestRegistrar
+{
+    TestRegistrar(const char* name, TestFunction function, bool benchmark)
+    {
+        getTestCases().push_back({ name, function, benchmark });
+    }
+};
+
+// Thrown by REQUIRE to abandon the rest of a test
+struct TestAbort {};
+
+void reportFailure(const char* file, int line, const std::string& message);
+
+// One line of benchmark output, "name: value unit"
+void reportMetric(const std::string& name, double value, const char* unit);
+
+// Peak resident set of the process in bytes, 0 where the platform doesn't report it
+size_t getPeakResidentBytes();
+
+// Installed physical memory in bytes, 0 where unknown. Large benchmarks skip sizes that wouldn't fit.
+size_t getPhysicalMemoryBytes();
+
+// Path of a checked-in file under Tests/data, see --data
+std::string getTestDataPath(const std::string& fileName);
+
+// Fresh empty directory under the system temp directory, wiped if it already exists
+std::string makeTempDirectory(const std::string& name);
+
+#define TEST_CASE(name) \
+    static void name(); \
+    static TestRegistrar name##Registrar(#name, name, false); \
+    static void name()
+
+#define BENCHMARK(name) \
+    static void name(); \
+    static TestRegistrar name##Registrar(#name, name, true); \
+    static void name()
+
+#define CHECK(condition) \
+    do { \
+        if (!(condition)) { reportFailure(__FILE__, __LINE__, #condition); } \
+    } while (0)
+
+#define CHECK_EQ(a, b) \
+    do { \
+        const auto& lhs_ = (a); \
+        const auto& rhs_ = (b); \
+        if (!(lhs_ == rhs_)) { \
+            std::ostringstream message_; \
+            message_ << #a " == " #b " (" << lhs_ << " vs " << rhs_ << ")"; \
+            reportFailure(__FILE__, __LINE__, message_.str()); \
+        } \
+    } while (0)
+
+#define REQUIRE(condition) \
+    do { \
+        if (!(condition)) { reportFailure(__FILE__, __LINE__, #condition); throw TestAbort{}; } \
+    } while (0)
@@ -0,0 +1,108 @@
+#pragma once
+
+#include "BVH.h"
+
+#include "glm/glm.hpp"
+
+#include <cstdint>
+#include <vector>
+#include <random>
+#include <limits>
+#include <cmath>
+
+// Random spheres in a cube, the same kind of scene the engine builds its sphere BLAS from
+struct SphereScene
+{
+    std::vector<glm::vec4> spheres;         // xyz = center, w = radius
+    std::vector<VkAabbPositionsKHR> aabbs;
+    float extent = 0.0f;                    // The centers lie in [0, extent)^3
+};
+
+// About one sphere per 4^3 cell whatever the count, so rays cross a similar number of them at every scale
+inline SphereScene makeSphereScene(uint32_t count, uint32_t seed)
+{
+    SphereScene scene;
+    scene.extent = 4.0f * std::cbrt(static_cast<float>(count));
+    scene.spheres.resize(count);
+    scene.aabbs.resize(count);
+
+    std::mt19937 random(seed);
+    std::uniform_real_distribution<float> position(0.0f, scene.extent);
+    std::uniform_real_distribution<float> radius(0.25f, 1.5f);
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        const glm::vec4 sphere(position(random), position(random), position(random), radius(random));
+        scene.spheres[i] = sphere;
+        scene.aabbs[i] = { sphere.x - sphere.w, sphere.y - sphere.w, sphere.z - sphere.w, sphere.x + sphere.w, sphere.y + sphere.w, sphere.z + sphere.w };
+    }
+    return scene;
+}
+
+// Nearest intersection in (0, tMax), shortens tMax on a hit
+inline bool intersectSphere(const glm::vec3& origin, const glm::vec3& direction, const glm::vec4& sphere, float& tMax)
+{
+    const glm::vec3 oc = origin - glm::vec3(sphere);
+    const float a = glm::dot(direction, direction);
+    const float b = glm::dot(oc, direction);
+    const float c = glm::dot(oc, oc) - sphere.w * sphere.w;
+    const float discriminant = b * b - a * c;
+    if (discriminant < 0.0f)
+    {
+        return false;
+    }
+
+    const float root = std::sqrt(discriminant);
+    float t = (-b - root) / a;
+    if (t <= 0.0f)
+    {
+        t = (-b + root) / a;
+    }
+    if (t <= 0.0f || t >= tMax)
+    {
+        return false;
+    }
+    tMax = t;
+    return true;
+}
+
+// Ray through pixel (x, y) of a width x height pinhole camera in a corner of the scene looking at its center
+inline void getSceneCameraRay(const SphereScene& scene, uint32_t x, uint32_t y, uint32_t width, uint32_t height, glm::vec3& origin, glm::vec3& direction)
+{
+    origin = glm::vec3(-0.25f, 0.6f, -0.25f) * scene.extent;
+    const glm::vec3 forward = glm::normalize(glm::vec3(0.5f * scene.extent) - origin);
+    const glm::vec3 right = glm::normalize(glm::cross(forward, glm::vec3(0.0f, 1.0f, 0.0f)));
+    const glm::vec3 up = glm::cross(right, forward);
+    const float u = (2.0f * (x + 0.5f) / width - 1.0f) * 0.5f;
+    const float v = (1.0f - 2.0f * (y + 0.5f) / height) * 0.5f;
+    direction = glm::normalize(forward + u * right + v * up);
+}
+
+inline void setPacketRay(BVHRayPacket& packet, uint32_t lane, const glm::vec3& origin, const glm::vec3& direction, float tMax)
+{
+    const glm::vec3 inverse = BVH::safeInverse(direction);
+    packet.originX[lane] = origin.x;
+    packet.originY[lane] = origin.y;
+    packet.originZ[lane] = origin.z;
+    packet.directionX[lane] = direction.x;
+    packet.directionY[lane] = direction.y;
+    packet.directionZ[lane] = direction.z;
+    packet.inverseX[lane] = inverse.x;
+    packet.inverseY[lane] = inverse.y;
+    packet.inverseZ[lane] = inverse.z;
+    packet.tMax[lane] = tMax;
+    packet.primitive[lane] = std::numeric_limits<uint32_t>::max();
+}
+
+// Lane by lane sphere test for packet traversals
+inline void intersectSpherePacket(BVHRayPacket& packet, const SphereScene& scene, uint32_t primitive)
+{
+    for (uint32_t lane = 0; lane < BVHRayPacket::SIZE; ++lane)
+    {
+        const glm::vec3 origin(packet.originX[lane], packet.originY[lane], packet.originZ[lane]);
+        const glm::vec3 direction(packet.directionX[lane], packet.directionY[lane], packet.directionZ[lane]);
+        if (intersectSphere(origin, direction, scene.spheres[primitive], packet.tMax[lane]))
+        {
+            packet.primitive[lane] = primitive;
+        }
+    }
+}
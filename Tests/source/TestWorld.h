@@ -0,0 +1,41 @@
+#pragma once
+
+#include "World.h"
+
+// Makes every chunk within loadRadius chunks of center resident in one go and waits for the loads
+inline void loadTestWorld(World& world, int32_t loadRadius, ChunkLoadFunction loader, const glm::vec3& center = glm::vec3(0.0f))
+{
+    const size_t diameter = static_cast<size_t>(2 * loadRadius + 1);
+
+    ChunkResidencyConfig config;
+    config.loadRadius = loadRadius;
+    config.maxJobsInFlight = static_cast<uint32_t>(diameter * diameter * diameter);
+    config.memoryBudgetBytes = diameter * diameter * diameter * ChunkResidencyManager::getChunkMemorySize();
+    world.init(config, std::move(loader));
+
+    world.update(FirstPersonCamera(center));
+    world.getResidencyManager().flush();
+}
+
+// Solid below y = 0, air above
+inline void loadFlatGround(Chunk& chunk)
+{
+    chunk.fill(chunk.position.y < 0 ? STONE_VOXEL : AIR_VOXEL);
+}
+
+// Voxels holding id in the inclusive box [min, max]
+inline uint32_t countVoxels(const World& world, VoxelID id, const glm::ivec3& min, const glm::ivec3& max)
+{
+    uint32_t count = 0;
+    for (int32_t z = min.z; z <= max.z; ++z)
+    {
+        for (int32_t y = min.y; y <= max.y; ++y)
+        {
+            for (int32_t x = min.x; x <= max.x; ++x)
+            {
+                count += world.getVoxel(x, y, z) == id ? 1 : 0;
+            }
+        }
+    }
+    return count;
+}
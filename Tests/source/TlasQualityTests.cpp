@@ -0,0 +1,179 @@
+#include "TestFramework.h"
+
+#include "TlasQuality.h"
+
+#include <random>
+#include <vector>
+
+namespace
+{
+    // Unit boxes on a grid standing in for the world bounds of the instances in a table
+    struct TestInstances
+    {
+        std::vector<glm::vec3> positions;
+        std::vector<bool> live;
+
+        explicit TestInstances(uint32_t sideCount)
+        {
+            for (uint32_t i = 0; i < sideCount * sideCount * sideCount; ++i)
+            {
+                positions.push_back(glm::vec3(i % sideCount, i / sideCount % sideCount, i / (sideCount * sideCount)) * 4.0f);
+                live.push_back(true);
+            }
+        }
+
+        uint32_t getSlotCount() const { return static_cast<uint32_t>(positions.size()); }
+
+        std::vector<uint32_t> getAllSlots() const
+        {
+            std::vector<uint32_t> slots(getSlotCount());
+            for (uint32_t i = 0; i < slots.size(); ++i)
+            {
+                slots[i] = i;
+            }
+            return slots;
+        }
+
+        InstanceBoundsFunction getBoundsFunction() const
+        {
+            return [this](uint32_t slot, VkAabbPositionsKHR& bounds)
+            {
+                if (!live[slot])
+                {
+                    return false;
+                }
+                const glm::vec3& p = positions[slot];
+                bounds = { p.x, p.y, p.z, p.x + 1.0f, p.y + 1.0f, p.z + 1.0f };
+                return true;
+            };
+        }
+    };
+
+    std::vector<InstanceRange> allDirty(const TestInstances& instances)
+    {
+        return { { 0, instances.getSlotCount() } };
+    }
+}
+
+// Instances wobbling around their places barely change the tree, refits go on forever
+TEST_CASE(TlasQualityJitterKeepsRefitting)
+{
+    TestInstances instances(10);
+    const std::vector<glm::vec3> home = instances.positions;
+    TlasQuality quality;
+    quality.reset(instances.getAllSlots(), instances.getSlotCount(), instances.getBoundsFunction());
+    CHECK_EQ(quality.getCostRatio(), 1.0f);
+
+    std::mt19937 random(3);
+    std::uniform_real_distribution<float> jitter(-0.3f, 0.3f);
+    for (uint32_t frame = 0; frame < 50; ++frame)
+    {
+        for (uint32_t i = 0; i < instances.getSlotCount(); ++i)
+        {
+            instances.positions[i] = home[i] + glm::vec3(jitter(random), jitter(random), jitter(random));
+        }
+        CHECK(quality.decide(true, allDirty(instances), instances.getBoundsFunction()) == TLASBuildDecision::Refit);
+    }
+
+    CHECK_EQ(quality.getRefitsSinceRebuild(), 50u);
+    CHECK_EQ(quality.getQualityRebuildCount(), 0u);
+    CHECK(quality.getCostRatio() > 1.0f && quality.getCostRatio() < quality.getSettings().rebuildCostRatio);
+    CHECK(quality.getLastDecision() == TLASBuildDecision::Refit);
+}
+
+// Instances flying off in all directions stretch the old tree until a rebuild pays off
+TEST_CASE(TlasQualityScatteringRebuilds)
+{
+    TestInstances instances(10);
+    TlasQuality quality;
+    quality.reset(instances.getAllSlots(), instances.getSlotCount(), instances.getBoundsFunction());
+
+    std::mt19937 random(8);
+    std::uniform_real_distribution<float> direction(-1.0f, 1.0f);
+    std::vector<glm::vec3> velocities;
+    for (uint32_t i = 0; i < instances.getSlotCount(); ++i)
+    {
+        velocities.push_back(glm::vec3(direction(random), direction(random), direction(random)) * 0.2f);
+    }
+
+    uint32_t refits = 0;
+    TLASBuildDecision decision = TLASBuildDecision::None;
+    for (uint32_t frame = 0; frame < 100 && decision != TLASBuildDecision::QualityRebuild; ++frame)
+    {
+        for (uint32_t i = 0; i < instances.getSlotCount(); ++i)
+        {
+            instances.positions[i] += velocities[i];
+        }
+        decision = quality.decide(true, allDirty(instances), instances.getBoundsFunction());
+        refits += decision == TLASBuildDecision::Refit ? 1 : 0;
+    }
+
+    REQUIRE(decision == TLASBuildDecision::QualityRebuild);
+    CHECK(refits > 0);
+    CHECK(quality.getCostRatio() > quality.getSettings().rebuildCostRatio);
+    CHECK_EQ(quality.getQualityRebuildCount(), 1u);
+    CHECK_EQ(quality.getRefitsSinceRebuild(), 0u);
+
+    // The rebuilt tree is the new reference
+    quality.reset(instances.getAllSlots(), instances.getSlotCount(), instances.getBoundsFunction());
+    CHECK_EQ(quality.getCostRatio(), 1.0f);
+    CHECK(quality.decide(true, allDirty(instances), instances.getBoundsFunction()) == TLASBuildDecision::Refit);
+}
+
+// Without tracking the same scattering is refitted every frame and no tree is kept
+TEST_CASE(TlasQualityZeroRatioAlwaysRefits)
+{
+    TestInstances instances(10);
+    TlasQuality quality;
+    quality.setSettings({ 0.0f });
+    CHECK(!quality.isTracking());
+    quality.reset(instances.getAllSlots(), instances.getSlotCount(), instances.getBoundsFunction());
+
+    std::mt19937 random(8);
+    std::uniform_real_distribution<float> position(-1000.0f, 1000.0f);
+    for (uint32_t frame = 0; frame < 20; ++frame)
+    {
+        for (glm::vec3& p : instances.positions)
+        {
+            p = glm::vec3(position(random), position(random), position(random));
+        }
+        CHECK(quality.decide(true, allDirty(instances), instances.getBoundsFunction()) == TLASBuildDecision::Refit);
+    }
+    CHECK_EQ(quality.getCostRatio(), 1.0f);
+    CHECK_EQ(quality.getRefitsSinceRebuild(), 20u);
+    CHECK_EQ(quality.getQualityRebuildCount(), 0u);
+}
+
+// A different instance list can't be refitted, whatever the tree looks like
+TEST_CASE(TlasQualityListChangeRebuilds)
+{
+    TestInstances instances(6);
+    for (const float ratio : { 1.3f, 0.0f })
+    {
+        TlasQuality quality;
+        quality.setSettings({ ratio });
+        quality.reset(instances.getAllSlots(), instances.getSlotCount(), instances.getBoundsFunction());
+
+        CHECK(quality.decide(true, {}, instances.getBoundsFunction()) == TLASBuildDecision::Refit);
+        CHECK(quality.decide(true, {}, instances.getBoundsFunction()) == TLASBuildDecision::Refit);
+        CHECK_EQ(quality.getRefitsSinceRebuild(), 2u);
+
+        CHECK(quality.decide(false, {}, instances.getBoundsFunction()) == TLASBuildDecision::Rebuild);
+        CHECK(quality.getLastDecision() == TLASBuildDecision::Rebuild);
+        CHECK_EQ(quality.getRefitsSinceRebuild(), 0u);
+        CHECK_EQ(quality.getQualityRebuildCount(), 0u);
+    }
+
+    // Holes stay out of the tree, and a dirty range over them is harmless
+    TlasQuality quality;
+    instances.live[3] = false;
+    instances.live[10] = false;
+    quality.reset(instances.getAllSlots(), instances.getSlotCount(), instances.getBoundsFunction());
+    instances.positions[3] = glm::vec3(1e6f);
+    CHECK(quality.decide(true, { { 2, 2 } }, instances.getBoundsFunction()) == TLASBuildDecision::Refit);
+    CHECK_EQ(quality.getCostRatio(), 1.0f);
+
+    quality.clear();
+    CHECK(quality.getLastDecision() == TLASBuildDecision::None);
+    CHECK_EQ(quality.getRefitsSinceRebuild(), 0u);
+}
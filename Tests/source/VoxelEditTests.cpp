@@ -0,0 +1,190 @@
+#include "TestFramework.h"
+#include "TestWorld.h"
+
+#include "TerrainGenerator.h"
+#include "Timer.h"
+
+#include <cstring>
+
+namespace
+{
+    // Whether the op writes voxel p, straight from the shape definitions in VoxelEdit.h
+    bool isCovered(const EditOp& op, const glm::ivec3& p)
+    {
+        const glm::vec3 center = glm::vec3(p) + 0.5f;
+        switch (op.shape)
+        {
+        case EditShape::Sphere:
+        {
+            const glm::vec3 offset = center - op.from;
+            return glm::dot(offset, offset) <= op.radius * op.radius;
+        }
+        case EditShape::Box:
+            return glm::all(glm::greaterThanEqual(p, op.min)) && glm::all(glm::lessThanEqual(p, op.max));
+        case EditShape::Line:
+        {
+            const glm::vec3 d = op.to - op.from;
+            const float length2 = glm::dot(d, d);
+            const float t = length2 > 0.0f ? std::clamp(glm::dot(center - op.from, d) / length2, 0.0f, 1.0f) : 0.0f;
+            const glm::vec3 offset = center - (op.from + t * d);
+            return glm::dot(offset, offset) <= op.radius * op.radius;
+        }
+        case EditShape::Paste:
+            break;
+        }
+        return false;
+    }
+
+    // The op one setVoxel at a time, returns the number of voxels that changed
+    uint64_t applyPerVoxel(World& world, const EditOp& op)
+    {
+        uint64_t changed = 0;
+        auto set = [&](const glm::ivec3& p, VoxelID id)
+        {
+            const VoxelID old = world.getVoxel(p.x, p.y, p.z);
+            if (old != id && world.setVoxel(p.x, p.y, p.z, id))
+            {
+                changed++;
+            }
+        };
+
+        if (op.shape == EditShape::Paste)
+        {
+            const VoxelClipboard& clipboard = *op.clipboard;
+            for (int32_t z = 0; z < clipboard.size.z; ++z)
+            {
+                for (int32_t y = 0; y < clipboard.size.y; ++y)
+                {
+                    for (int32_t x = 0; x < clipboard.size.x; ++x)
+                    {
+                        const VoxelID id = clipboard.get(x, y, z);
+                        if (op.pasteAir || id != AIR_VOXEL)
+                        {
+                            set(op.min + glm::ivec3(x, y, z), id);
+                        }
+                    }
+                }
+            }
+            return changed;
+        }
+
+        // Generous bounds, the shape test decides
+        glm::ivec3 min = op.min;
+        glm::ivec3 max = op.max;
+        if (op.shape != EditShape::Box)
+        {
+            const glm::vec3 end = op.shape == EditShape::Line ? op.to : op.from;
+            min = glm::ivec3(glm::floor(glm::min(op.from, end) - op.radius)) - 1;
+            max = glm::ivec3(glm::ceil(glm::max(op.from, end) + op.radius)) + 1;
+        }
+        for (int32_t z = min.z; z <= max.z; ++z)
+        {
+            for (int32_t y = min.y; y <= max.y; ++y)
+            {
+                for (int32_t x = min.x; x <= max.x; ++x)
+                {
+                    if (isCovered(op, glm::ivec3(x, y, z)))
+                    {
+                        set(glm::ivec3(x, y, z), op.id);
+                    }
+                }
+            }
+        }
+        return changed;
+    }
+
+    // Chunks whose voxels or derived data differ between the two worlds
+    uint32_t countChunkMismatches(World& world, const World& reference)
+    {
+        uint32_t mismatches = 0;
+        world.forEachChunk([&](Chunk& chunk)
+        {
+            const Chunk* other = reference.getChunk(chunk.position);
+            const bool same = other != nullptr &&
+                std::memcmp(chunk.voxels.data(), other->voxels.data(), CHUNK_VOLUME) == 0 &&
+                chunk.occupancy.countSolid() == other->occupancy.countSolid() &&
+                std::memcmp(&chunk.mips, &other->mips, sizeof(chunk.mips)) == 0;
+            mismatches += same ? 0 : 1;
+        });
+        return mismatches;
+    }
+}
+
+// Every op, through applyEdit's row spans and writeRow, against the same op voxel by voxel
+TEST_CASE(VoxelEditMatchesPerVoxelReference)
+{
+    const TerrainGenerator terrain;
+    World world;
+    World reference;
+    loadTestWorld(world, 2, terrain.makeChunkLoader());
+    loadTestWorld(reference, 2, terrain.makeChunkLoader());
+    REQUIRE(countChunkMismatches(world, reference) == 0);
+
+    ThreadPool threadPool(2);
+    VoxelClipboard clipboard;
+    world.copyRegion(glm::ivec3(-5, -9, -3), glm::ivec3(6, 3, 4), clipboard);
+
+    const EditOp ops[] =
+    {
+        // Across the chunk corner at the origin, and reaching past the resident chunks
+        EditOp::sphere(glm::vec3(0.3f, -2.2f, 0.4f), 9.7f, AIR_VOXEL),
+        EditOp::sphere(glm::vec3(60.1f, -3.3f, 40.6f), 12.2f, SAND_VOXEL),
+        // A single voxel, and nothing at all
+        EditOp::sphere(glm::vec3(31.5f, 4.5f, 31.5f), 0.4f, TORCH_VOXEL),
+        EditOp::sphere(glm::vec3(31.0f, 4.0f, 31.0f), 0.4f, TORCH_VOXEL),
+        // Partial rows inside a chunk, a row ending on a chunk border, a box over many chunks
+        EditOp::box(glm::ivec3(5, 1, 1), glm::ivec3(20, 1, 1), DIRT_VOXEL),
+        EditOp::box(glm::ivec3(33, 2, 2), glm::ivec3(63, 2, 2), DIRT_VOXEL),
+        EditOp::box(glm::ivec3(-33, -40, -3), glm::ivec3(33, -30, 62), WATER_VOXEL),
+        EditOp::box(glm::ivec3(-100, 0, 0), glm::ivec3(-60, 3, 3), SAND_VOXEL),
+        // Diagonal, axis aligned along rows, and degenerate to a sphere
+        EditOp::line(glm::vec3(-20.2f, 3.1f, -7.7f), glm::vec3(25.9f, -6.3f, 14.2f), 2.6f, GRASS_VOXEL),
+        EditOp::line(glm::vec3(-40.3f, 7.5f, 7.5f), glm::vec3(40.7f, 7.5f, 7.5f), 1.2f, STONE_VOXEL),
+        EditOp::line(glm::vec3(10.2f, 10.7f, -3.1f), glm::vec3(10.2f, 10.7f, -3.1f), 3.3f, DIRT_VOXEL),
+        // The clipboard over chunk borders, without and with its air
+        EditOp::paste(clipboard, glm::ivec3(28, 10, -3)),
+        EditOp::paste(clipboard, glm::ivec3(-40, -5, 30), true),
+    };
+
+    for (const EditOp& op : ops)
+    {
+        const EditResult result = world.applyEdit(op, threadPool);
+        const uint64_t expected = applyPerVoxel(reference, op);
+        CHECK_EQ(result.changedVoxels, expected);
+        CHECK_EQ(countChunkMismatches(world, reference), 0u);
+    }
+}
+
+// Carving a radius 64 sphere out of flat ground, the 750K voxels of it below the surface over 44 chunks
+BENCHMARK(VoxelEditSphereCarve)
+{
+    World world;
+    loadTestWorld(world, 4, loadFlatGround);
+
+    const EditOp carve = EditOp::sphere(glm::vec3(0.5f, -16.0f, 0.5f), 64.0f, AIR_VOXEL);
+    const EditOp refill = EditOp::box(glm::ivec3(-65, -81, -65), glm::ivec3(65, -1, 65), STONE_VOXEL);
+
+    constexpr uint32_t REPEATS = 8;
+    double carveMilliseconds = 0.0;
+    EditResult result;
+    for (uint32_t repeat = 0; repeat < REPEATS; ++repeat)
+    {
+        Timer timer;
+        result = world.applyEdit(carve);
+        timer.stop();
+        carveMilliseconds += timer.elapsedTime<std::chrono::microseconds>() * 1e-3;
+        world.applyEdit(refill);
+    }
+    reportMetric("threads", ThreadPool::getInstance().getThreadCount(), "");
+    reportMetric("changed voxels", static_cast<double>(result.changedVoxels), "");
+    reportMetric("changed chunks", result.chunkCount, "");
+    reportMetric("applyEdit", carveMilliseconds / REPEATS, "ms");
+    reportMetric("applyEdit rate", result.changedVoxels / (carveMilliseconds / REPEATS * 1e3), "Mvoxels/s");
+
+    // The same carve one setVoxel at a time, for comparison
+    Timer timer;
+    const uint64_t changed = applyPerVoxel(world, carve);
+    timer.stop();
+    CHECK_EQ(changed, result.changedVoxels);
+    reportMetric("setVoxel per voxel", timer.elapsedTime<std::chrono::microseconds>() * 1e-3, "ms");
+}
@@ -0,0 +1,162 @@
+#include "TestFramework.h"
+
+#include <iostream>
+#include <cstring>
+#include <filesystem>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+    std::string g_dataDirectory = "data";
+    uint32_t g_failureCount = 0;
+
+    void printUsage()
+    {
+        std::cout << "Usage: Tests [--bench] [--data <directory>] [name filter...]\n"
+                     "  Runs the tests, or only the benchmarks with --bench, whose names contain one of the filters.\n"
+                     "  Benchmarks report their numbers on stdout, run them one at a time for clean peak memory figures.\n";
+    }
+}
+
+std::vector<TestCase>& getTestCases()
+{
+    static std::vector<TestCase> testCases;
+    return testCases;
+}
+
+void reportFailure(const char* file, int line, const std::string& message)
+{
+    g_failureCount++;
+    std::cerr << file << "(" << line << "): check failed: " << message << std::endl;
+}
+
+void reportMetric(const std::string& name, double value, const char* unit)
+{
+    std::cout << "    " << name << ": " << value << " " << unit << std::endl;
+}
+
+size_t getPeakResidentBytes()
+{
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters{};
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+    {
+        return counters.PeakWorkingSetSize;
+    }
+    return 0;
+#else
+    rusage usage{};
+    if (getrusage(RUSAGE_SELF, &usage) == 0)
+    {
+        return static_cast<size_t>(usage.ru_maxrss) * 1024; // KiB on Linux
+    }
+    return 0;
+#endif
+}
+
+size_t getPhysicalMemoryBytes()
+{
+#ifdef _WIN32
+    MEMORYSTATUSEX status{};
+    status.dwLength = sizeof(status);
+    if (GlobalMemoryStatusEx(&status))
+    {
+        return static_cast<size_t>(status.ullTotalPhys);
+    }
+    return 0;
+#else
+    const long pages = sysconf(_SC_PHYS_PAGES);
+    const long pageSize = sysconf(_SC_PAGESIZE);
+    return pages > 0 && pageSize > 0 ? static_cast<size_t>(pages) * static_cast<size_t>(pageSize) : 0;
+#endif
+}
+
+std::string getTestDataPath(const std::string& fileName)
+{
+    return g_dataDirectory + "/" + fileName;
+}
+
+std::string makeTempDirectory(const std::string& name)
+{
+    const std::filesystem::path path = std::filesystem::temp_directory_path() / "VoxelEngineTests" / name;
+    std::filesystem::remove_all(path);
+    std::filesystem::create_directories(path);
+    return path.string();
+}
+
+int main(int argc, char** argv)
+{
+    bool runBenchmarks = false;
+    std::vector<std::string> filters;
+    for (int i = 1; i < argc; ++i)
+    {
+        if (std::strcmp(argv[i], "--bench") == 0)
+        {
+            runBenchmarks = true;
+        }
+        else if (std::strcmp(argv[i], "--data") == 0 && i + 1 < argc)
+        {
+            g_dataDirectory = argv[++i];
+        }
+        else if (std::strcmp(argv[i], "--help") == 0)
+        {
+            printUsage();
+            return 0;
+        }
+        else
+        {
+            filters.push_back(argv[i]);
+        }
+    }
+
+    uint32_t runCount = 0;
+    uint32_t failedCount = 0;
+    for (const TestCase& testCase : getTestCases())
+    {
+        if (testCase.benchmark != runBenchmarks)
+        {
+            continue;
+        }
+
+        bool selected = filters.empty();
+        for (const std::string& filter : filters)
+        {
+            selected = selected || std::strstr(testCase.name, filter.c_str()) != nullptr;
+        }
+        if (!selected)
+        {
+            continue;
+        }
+
+        std::cout << "[ RUN  ] " << testCase.name << std::endl;
+        const uint32_t failuresBefore = g_failureCount;
+        try
+        {
+            testCase.function();
+        }
+        catch (const TestAbort&)
+        {
+        }
+        catch (const std::exception& e)
+        {
+            reportFailure(testCase.name, 0, std::string("unexpected exception: ") + e.what());
+        }
+
+        runCount++;
+        const bool passed = g_failureCount == failuresBefore;
+        failedCount += passed ? 0 : 1;
+        std::cout << (passed ? "[  OK  ] " : "[ FAIL ] ") << testCase.name << std::endl;
+    }
+
+    std::cout << runCount - failedCount << "/" << runCount << (runBenchmarks ? " benchmarks" : " tests") << " passed" << std::endl;
+    return failedCount == 0 ? 0 : 1;
+}